@@ -82,7 +82,22 @@
 #include "program/prog_instruction.h"
 #include <math.h>
 #include "builtin_functions.h"
+#include "ir_serialize.h"
+#include "compiler/blob.h"
+#include "util/debug.h"
 #include "util/hash_table.h"
+#include "util/u_dynarray.h"
+
+/**
+ * The built-in functions serialized by builtin_library_gen.cpp at build
+ * time, as written by _mesa_glsl_serialize_builtin_functions().  The size
+ * is zero when the library could not be generated, in which case every
+ * built-in is built at run time instead.
+ */
+extern "C" const uint32_t _mesa_glsl_builtin_library[];
+extern "C" const uint32_t _mesa_glsl_builtin_library_size;
+
+#define BUILTIN_LIBRARY_VERSION 1
 
 #define M_PIf   ((float) M_PI)
 #define M_PI_2f ((float) M_PI_2)
@@ -819,6 +834,50 @@ shader_atomic_float_minmax(const _mesa_glsl_parse_state *state)
 {
    return state->INTEL_shader_atomic_float_minmax_enable;
 }
+
+/**
+ * Every availability predicate above, so that the serialized built-in
+ * library can refer to them by index.  A signature whose predicate is
+ * missing here makes the library generator fail.
+ */
+static const builtin_available_predicate builtin_predicates[] = {
+   always_available, compatibility_vs_only, derivatives_only, gs_only, v110,
+   v110_derivatives_only, v120, v130, v130_desktop, v460_desktop,
+   v130_derivatives_only, v140_or_es3, v400_derivatives_only,
+   texture_rectangle, texture_external, texture_external_es3,
+   lod_exists_in_stage, v110_lod, texture_buffer, shader_texture_lod,
+   shader_texture_lod_and_rect, shader_bit_encoding, shader_integer_mix,
+   shader_packing_or_es3, shader_packing_or_es3_or_gpu_shader5, gpu_shader4,
+   gpu_shader4_integer, gpu_shader4_array, gpu_shader4_array_integer,
+   gpu_shader4_rect, gpu_shader4_rect_integer, gpu_shader4_tbo,
+   gpu_shader4_tbo_integer, gpu_shader4_derivs_only,
+   gpu_shader4_integer_derivs_only, gpu_shader4_array_derivs_only,
+   gpu_shader4_array_integer_derivs_only, v130_or_gpu_shader4,
+   v130_or_gpu_shader4_and_tex_shadow_lod, gpu_shader5, gpu_shader5_es,
+   gpu_shader5_or_OES_texture_cube_map_array, es31_not_gs5,
+   gpu_shader5_or_es31, shader_packing_or_es31_or_gpu_shader5,
+   gpu_shader5_or_es31_or_integer_functions, fs_interpolate_at,
+   texture_array_lod, texture_array, texture_array_derivs_only,
+   texture_multisample, texture_multisample_array, texture_samples_identical,
+   texture_samples_identical_array, derivatives_texture_cube_map_array,
+   texture_cube_map_array, v130_or_gpu_shader4_and_tex_cube_map_array,
+   texture_query_levels, texture_query_lod, texture_gather_cube_map_array,
+   texture_texture4, texture_gather_or_es31, texture_gather_only_or_es31,
+   derivatives, derivative_control, tex1d_lod, tex3d, derivatives_tex3d,
+   tex3d_lod, shader_atomic_counters, shader_atomic_counter_ops,
+   shader_atomic_counter_ops_or_v460_desktop, shader_ballot,
+   supports_arb_fragment_shader_interlock,
+   supports_nv_fragment_shader_interlock, shader_clock, shader_clock_int64,
+   shader_storage_buffer_object, shader_trinary_minmax,
+   shader_image_load_store, shader_image_load_store_ext, shader_image_atomic,
+   shader_image_atomic_exchange_float, shader_image_atomic_add_float,
+   shader_image_size, shader_samples, gs_streams, fp64, int64, int64_fp64,
+   compute_shader, compute_shader_supported, buffer_atomics_supported,
+   barrier_supported, vote, vote_or_v460_desktop, integer_functions_supported,
+   NV_shader_atomic_float_supported, shader_atomic_float_add,
+   shader_atomic_float_exchange, INTEL_shader_atomic_float_minmax_supported,
+   shader_atomic_float_minmax,
+};
 /** @} */
 
 /******************************************************************************/
@@ -837,11 +896,19 @@ public:
    builtin_builder();
    ~builtin_builder();
 
-   void initialize();
+   void initialize(bool use_library = true);
    void release();
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
 
+   /**
+    * Look up a built-in function by name, deserializing it from the
+    * library the first time it is asked for.
+    */
+   ir_function *get_function(const char *name);
+
+   bool serialize(struct blob *blob);
+
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
@@ -854,10 +921,33 @@ public:
 private:
    void *mem_ctx;
 
+   /**
+    * Offset of each function in _mesa_glsl_builtin_library, by name.  NULL
+    * when the functions were built by create_builtins() instead.
+    */
+   struct hash_table *library;
+
+   /** Every function added by add_function(), in order */
+   struct util_dynarray functions;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
 
+   /**
+    * Functions being deserialized, innermost first.  They are only added
+    * to the symbol table once complete, but their bodies may call them.
+    */
+   struct loading_function {
+      ir_function *f;
+      loading_function *next;
+   } *loading;
+
+   bool load_library();
+   ir_function *load_function(const char *name, uint32_t offset);
+   static ir_function_signature *resolve_callee(void *data, const char *name,
+                                                unsigned index);
+
    /**
     * IR builder helpers:
     *
@@ -1215,6 +1305,9 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   library = NULL;
+   loading = NULL;
+   util_dynarray_init(&functions, NULL);
 }
 
 builtin_builder::~builtin_builder()
@@ -1235,7 +1328,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1247,8 +1340,31 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL || library == NULL)
+      return f;
+
+   hash_entry *entry = _mesa_hash_table_search(library, name);
+   if (entry == NULL)
+      return NULL;
+
+   f = load_function((const char *) entry->key, (uintptr_t) entry->data);
+   if (f == NULL) {
+      /* Don't retry, and don't let a later lookup find half of it. */
+      fprintf(stderr, "glsl: corrupt built-in function library entry "
+              "for %s\n", name);
+      assert(!"corrupt built-in function library");
+      _mesa_hash_table_remove(library, entry);
+   }
+
+   return f;
+}
+
 void
-builtin_builder::initialize()
+builtin_builder::initialize(bool use_library)
 {
    /* If already initialized, don't do it again. */
    if (mem_ctx != NULL)
@@ -1256,6 +1372,13 @@ builtin_builder::initialize()
 
    mem_ctx = ralloc_context(NULL);
    create_shader();
+
+   if (use_library &&
+       !env_var_as_boolean("MESA_GLSL_BUILTIN_LIBRARY_DISABLE", false) &&
+       load_library())
+      return;
+
+   util_dynarray_init(&functions, mem_ctx);
    create_intrinsics();
    create_builtins();
 }
@@ -1265,6 +1388,8 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   library = NULL;
+   util_dynarray_init(&functions, NULL);
 
    ralloc_free(shader);
    shader = NULL;
@@ -1283,6 +1408,188 @@ builtin_builder::create_shader()
 
 /** @} */
 
+/**
+ * Serialized built-in library:
+ *
+ * The library starts with a header
+ *
+ *    BUILTIN_LIBRARY_VERSION, number of predicates, number of functions,
+ *    and for each function its name and the offset of its record
+ *
+ * followed by one record per function
+ *
+ *    number of signatures,
+ *    for each signature the index of its predicate and its prototype,
+ *    for each signature its body
+ *
+ * so that a function is only deserialized when a shader first uses it.
+ *  @{
+ */
+bool
+builtin_builder::serialize(struct blob *blob)
+{
+   const unsigned num_functions =
+      util_dynarray_num_elements(&functions, ir_function *);
+   intptr_t *offsets = ralloc_array(mem_ctx, intptr_t, num_functions);
+   unsigned count = 0;
+
+   /* Skip the functions hidden by a later one of the same name. */
+   util_dynarray_foreach(&functions, ir_function *, f) {
+      if (shader->symbols->get_function((*f)->name) == *f)
+         count++;
+   }
+
+   blob_write_uint32(blob, BUILTIN_LIBRARY_VERSION);
+   blob_write_uint32(blob, ARRAY_SIZE(builtin_predicates));
+   blob_write_uint32(blob, count);
+   for (unsigned i = 0; i < num_functions; i++) {
+      ir_function *f = *util_dynarray_element(&functions, ir_function *, i);
+      if (shader->symbols->get_function(f->name) != f)
+         continue;
+
+      blob_write_string(blob, f->name);
+      offsets[i] = blob_reserve_uint32(blob);
+   }
+
+   for (unsigned i = 0; i < num_functions; i++) {
+      ir_function *f = *util_dynarray_element(&functions, ir_function *, i);
+      if (shader->symbols->get_function(f->name) != f)
+         continue;
+
+      const intptr_t start = blob_reserve_uint32(blob);
+      blob_overwrite_uint32(blob, offsets[i], start);
+      blob_overwrite_uint32(blob, start, f->signatures.length());
+
+      foreach_in_list(ir_function_signature, sig, &f->signatures) {
+         unsigned p = 0;
+         while (p < ARRAY_SIZE(builtin_predicates) &&
+                builtin_predicates[p] != sig->get_builtin_avail())
+            p++;
+
+         if (p == ARRAY_SIZE(builtin_predicates)) {
+            fprintf(stderr, "%s: availability predicate missing from "
+                    "builtin_predicates[]\n", f->name);
+            return false;
+         }
+
+         blob_write_uint32(blob, p);
+         ir_serialize_prototype(blob, sig);
+      }
+
+      foreach_in_list(ir_function_signature, sig, &f->signatures)
+         ir_serialize_body(blob, sig);
+   }
+
+   return !blob->out_of_memory;
+}
+
+bool
+builtin_builder::load_library()
+{
+   struct blob_reader blob;
+
+   if (_mesa_glsl_builtin_library_size == 0)
+      return false;
+
+   blob_reader_init(&blob, _mesa_glsl_builtin_library,
+                    _mesa_glsl_builtin_library_size);
+   if (blob_read_uint32(&blob) != BUILTIN_LIBRARY_VERSION ||
+       blob_read_uint32(&blob) != ARRAY_SIZE(builtin_predicates))
+      return false;
+
+   const unsigned num_functions = blob_read_uint32(&blob);
+
+   library = _mesa_hash_table_create(mem_ctx, _mesa_key_hash_string,
+                                     _mesa_key_string_equal);
+   for (unsigned i = 0; i < num_functions; i++) {
+      const char *name = blob_read_string(&blob);
+      const uint32_t offset = blob_read_uint32(&blob);
+      if (blob.overrun) {
+         library = NULL;
+         return false;
+      }
+
+      _mesa_hash_table_insert(library, name, (void *) (uintptr_t) offset);
+   }
+
+   return true;
+}
+
+ir_function *
+builtin_builder::load_function(const char *name, uint32_t offset)
+{
+   struct blob_reader blob;
+
+   blob_reader_init(&blob, _mesa_glsl_builtin_library,
+                    _mesa_glsl_builtin_library_size);
+   blob_skip_bytes(&blob, offset);
+
+   ir_function *f = new(mem_ctx) ir_function(name);
+   const unsigned num_signatures = blob_read_uint32(&blob);
+
+   for (unsigned i = 0; i < num_signatures; i++) {
+      const unsigned p = blob_read_uint32(&blob);
+      if (p >= ARRAY_SIZE(builtin_predicates))
+         return NULL;
+
+      ir_function_signature *sig =
+         ir_deserialize_prototype(mem_ctx, &blob, builtin_predicates[p]);
+      if (sig == NULL)
+         return NULL;
+
+      f->add_signature(sig);
+   }
+
+   /* The bodies may call any signature of this function, see
+    * resolve_callee().
+    */
+   loading_function entry = { f, loading };
+   loading = &entry;
+
+   bool ok = true;
+   foreach_in_list(ir_function_signature, sig, &f->signatures) {
+      if (!ir_deserialize_body(mem_ctx, &blob, sig, resolve_callee, this)) {
+         ok = false;
+         break;
+      }
+   }
+
+   loading = entry.next;
+   if (!ok)
+      return NULL;
+
+   shader->symbols->add_function(f);
+   return f;
+}
+
+ir_function_signature *
+builtin_builder::resolve_callee(void *data, const char *name, unsigned index)
+{
+   builtin_builder *builder = (builtin_builder *) data;
+   ir_function *f = NULL;
+
+   for (loading_function *l = builder->loading; l != NULL; l = l->next) {
+      if (strcmp(l->f->name, name) == 0) {
+         f = l->f;
+         break;
+      }
+   }
+
+   if (f == NULL)
+      f = builder->get_function(name);
+   if (f == NULL)
+      return NULL;
+
+   foreach_in_list(ir_function_signature, sig, &f->signatures) {
+      if (index-- == 0)
+         return sig;
+   }
+
+   return NULL;
+}
+
+/** @} */
+
 /**
  * Create ir_function and ir_function_signature objects for each
  * intrinsic.
@@ -4281,6 +4588,7 @@ builtin_builder::add_function(const char *name, ...)
    va_end(ap);
 
    shader->symbols->add_function(f);
+   util_dynarray_append(&functions, ir_function *, f);
 }
 
 void
@@ -7316,7 +7624,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -7330,10 +7638,28 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
-gl_shader *
-_mesa_glsl_get_builtin_function_shader()
+ir_function *
+_mesa_glsl_get_builtin_function(const char *name)
 {
-   return builtins.shader;
+   ir_function *f;
+   mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   mtx_unlock(&builtins_lock);
+
+   return f;
+}
+
+bool
+_mesa_glsl_serialize_builtin_functions(struct blob *blob)
+{
+   builtin_builder builder;
+   bool ok;
+
+   builder.initialize(false);
+   ok = builder.serialize(blob);
+   builder.release();
+
+   return ok;
 }
 
 
@@ -24,7 +24,7 @@
 #ifndef BULITIN_FUNCTIONS_H
 #define BULITIN_FUNCTIONS_H
 
-struct gl_shader;
+struct blob;
 
 extern void
 _mesa_glsl_initialize_builtin_functions();
@@ -37,8 +37,11 @@ extern bool
 _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state,
                                 const char *name);
 
-extern gl_shader *
-_mesa_glsl_get_builtin_function_shader(void);
+extern ir_function *
+_mesa_glsl_get_builtin_function(const char *name);
+
+extern bool
+_mesa_glsl_serialize_builtin_functions(struct blob *blob);
 
 extern ir_function_signature *
 _mesa_get_main_function_signature(glsl_symbol_table *symbols);
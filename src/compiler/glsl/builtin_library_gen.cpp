@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file builtin_library_gen.cpp
+ *
+ * Builds every GLSL built-in function and writes them, serialized, as a C
+ * source file defining _mesa_glsl_builtin_library.  The compiler then only
+ * deserializes the functions a shader actually uses instead of building the
+ * whole set the first time a shader calls a built-in.
+ *
+ * Usage: glsl_builtin_gen output.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler/blob.h"
+#include "compiler/glsl_types.h"
+#include "glsl_symbol_table.h"
+#include "ir.h"
+#include "builtin_functions.h"
+
+static bool
+write_library(FILE *fp, const struct blob *blob)
+{
+   const size_t num_words = DIV_ROUND_UP(blob->size, sizeof(uint32_t));
+
+   fprintf(fp,
+           "/* Generated by glsl_builtin_gen from builtin_functions.cpp. */\n"
+           "\n"
+           "#include <stdint.h>\n"
+           "\n"
+           "const uint32_t _mesa_glsl_builtin_library_size = %zu;\n"
+           "\n"
+           "const uint32_t _mesa_glsl_builtin_library[] = {\n",
+           blob->size);
+
+   for (size_t i = 0; i < num_words; i++) {
+      uint32_t word = 0;
+
+      memcpy(&word, blob->data + i * sizeof(uint32_t),
+             MIN2(sizeof(uint32_t), blob->size - i * sizeof(uint32_t)));
+      fprintf(fp, "%s0x%08x,%s", i % 6 == 0 ? "   " : " ", word,
+              i % 6 == 5 || i == num_words - 1 ? "\n" : "");
+   }
+
+   fprintf(fp, "};\n");
+
+   return !ferror(fp);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct blob blob;
+   bool ok;
+
+   if (argc != 2) {
+      fprintf(stderr, "usage: %s output.c\n", argv[0]);
+      return 1;
+   }
+
+   glsl_type_singleton_init_or_ref();
+
+   /* Keep the names of temporaries so that they show up in IR dumps when
+    * the compiler is asked for them; it drops them otherwise.
+    */
+   ir_variable::temporaries_allocate_names = true;
+
+   blob_init(&blob);
+   ok = _mesa_glsl_serialize_builtin_functions(&blob);
+
+   if (ok) {
+      FILE *fp = fopen(argv[1], "w");
+
+      ok = fp != NULL && write_library(fp, &blob);
+      if (fp != NULL && fclose(fp) != 0)
+         ok = false;
+      if (!ok) {
+         fprintf(stderr, "%s: cannot write %s\n", argv[0], argv[1]);
+         remove(argv[1]);
+      }
+   }
+
+   blob_finish(&blob);
+   glsl_type_singleton_decref();
+
+   return ok ? 0 : 1;
+}
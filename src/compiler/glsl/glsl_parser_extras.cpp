@@ -2034,10 +2034,9 @@ do_late_parsing_checks(struct _mesa_glsl_parse_state *state)
 static void
 opt_shader_and_create_symbol_table(struct gl_context *ctx,
                                    struct glsl_symbol_table *source_symbols,
-                                   struct gl_shader *shader)
+                                   struct gl_shader *shader, exec_list *ir)
 {
-   assert(shader->CompileStatus != COMPILE_FAILURE &&
-          !shader->ir->is_empty());
+   assert(shader->CompileStatus != COMPILE_FAILURE && !ir->is_empty());
 
    struct gl_shader_compiler_options *options =
       &ctx->Const.ShaderCompilerOptions[shader->Stage];
@@ -2047,16 +2046,16 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
     */
    if (ctx->Const.GLSLOptimizeConservatively) {
       /* Run it just once. */
-      do_common_optimization(shader->ir, false, false, options,
+      do_common_optimization(ir, false, false, options,
                              ctx->Const.NativeIntegers);
    } else {
       /* Repeat it until it stops making changes. */
-      while (do_common_optimization(shader->ir, false, false, options,
+      while (do_common_optimization(ir, false, false, options,
                                     ctx->Const.NativeIntegers))
          ;
    }
 
-   validate_ir_tree(shader->ir);
+   validate_ir_tree(ir);
 
    enum ir_variable_mode other;
    switch (shader->Stage) {
@@ -2074,12 +2073,12 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
       break;
    }
 
-   optimize_dead_builtin_variables(shader->ir, other);
+   optimize_dead_builtin_variables(ir, other);
 
-   validate_ir_tree(shader->ir);
+   validate_ir_tree(ir);
 
    /* Retain any live IR, but trash the rest. */
-   reparent_ir(shader->ir, shader->ir);
+   clone_ir_list(shader->ir, shader->ir, ir);
 
    /* Destroy the symbol table.  Create a new symbol table that contains only
     * the variables and functions that still exist in the IR.  The symbol
@@ -2129,8 +2128,15 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
          return;
    }
 
+   /* The parse state, the AST and the IR are all carved out of an arena.
+    * The live IR is copied out of it once the shader is optimized, and the
+    * rest goes away with the arena, without visiting every node.
+    */
+   void *arena = ralloc_arena_context(NULL);
+   exec_list *ir = new(arena) exec_list;
+
    struct _mesa_glsl_parse_state *state =
-      new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
+      new(arena) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
 
    if (ctx->Const.GenerateTemporaryNames)
       (void) p_atomic_cmpxchg(&ir_variable::temporaries_allocate_names,
@@ -2156,14 +2162,14 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    ralloc_free(shader->ir);
    shader->ir = new(shader) exec_list;
    if (!state->error && !state->translation_unit.is_empty())
-      _mesa_ast_to_hir(shader->ir, state);
+      _mesa_ast_to_hir(ir, state);
 
    if (!state->error) {
-      validate_ir_tree(shader->ir);
+      validate_ir_tree(ir);
 
       /* Print out the unoptimized IR. */
       if (dump_hir) {
-         _mesa_print_ir(stdout, shader->ir, state);
+         _mesa_print_ir(stdout, ir, state);
       }
    }
 
@@ -2179,10 +2185,10 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    shader->Version = state->language_version;
    shader->IsES = state->es_shader;
 
-   if (!state->error && !shader->ir->is_empty()) {
+   if (!state->error && !ir->is_empty()) {
       assign_subroutine_indexes(state);
-      lower_subroutine(shader->ir, state);
-      opt_shader_and_create_symbol_table(ctx, state->symbols, shader);
+      lower_subroutine(ir, state);
+      opt_shader_and_create_symbol_table(ctx, state->symbols, shader, ir);
    }
 
    if (!force_recompile) {
@@ -2191,7 +2197,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    }
 
    delete state->symbols;
-   ralloc_free(state);
+   ralloc_free(arena);
 
    if (ctx->Cache && shader->CompileStatus == COMPILE_SUCCESS) {
       char sha1_buf[41];
@@ -1255,6 +1255,12 @@ public:
    /** Whether or not a built-in is available for this shader. */
    bool is_builtin_available(const _mesa_glsl_parse_state *state) const;
 
+   /** The availability predicate of a built-in, NULL otherwise. */
+   builtin_available_predicate get_builtin_avail() const
+   {
+      return builtin_avail;
+   }
+
    /** Body of instructions in the function. */
    struct exec_list body;
 
@@ -0,0 +1,686 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file ir_serialize.cpp
+ *
+ * Every node is written as its ir_node_type followed by its fields, and
+ * every field is a uint32_t unless it is a string, a type or constant data.
+ * A missing rvalue is written as ir_type_unset.
+ *
+ * Variables are numbered in the order they are first seen, starting with
+ * the parameters.  The first reference to a variable, usually its
+ * declaration, is followed by its definition; later references only carry
+ * the number.
+ */
+
+#include "ir_serialize.h"
+#include "compiler/blob.h"
+#include "compiler/glsl_types.h"
+#include "util/hash_table.h"
+#include "util/u_dynarray.h"
+
+namespace {
+
+enum {
+   VAR_HAS_DATA = (1 << 0),
+   VAR_HAS_CONSTANT_VALUE = (1 << 1),
+   VAR_HAS_CONSTANT_INITIALIZER = (1 << 2),
+};
+
+class ir_serializer {
+public:
+   ir_serializer(struct blob *blob)
+      : blob(blob), num_variables(0)
+   {
+      mem_ctx = ralloc_context(NULL);
+      variables = _mesa_pointer_hash_table_create(mem_ctx);
+   }
+
+   ~ir_serializer()
+   {
+      ralloc_free(mem_ctx);
+   }
+
+   void add_variable(const ir_variable *var);
+   void write_variable(const ir_variable *var);
+   void write_constant(const ir_constant *c);
+   void write_rvalue(const ir_rvalue *ir);
+   void write_instruction(const ir_instruction *ir);
+   void write_list(const exec_list *list);
+
+private:
+   struct blob *blob;
+   void *mem_ctx;
+
+   /** Maps each ir_variable seen so far to its number */
+   struct hash_table *variables;
+   unsigned num_variables;
+};
+
+class ir_deserializer {
+public:
+   ir_deserializer(void *mem_ctx, struct blob_reader *blob)
+      : mem_ctx(mem_ctx), blob(blob), resolve(NULL), resolve_data(NULL),
+        failed(false)
+   {
+      util_dynarray_init(&variables, NULL);
+   }
+
+   ~ir_deserializer()
+   {
+      util_dynarray_fini(&variables);
+   }
+
+   ir_variable *read_variable();
+   ir_constant *read_constant();
+   ir_rvalue *read_rvalue();
+   ir_instruction *read_instruction();
+   bool read_list(exec_list *list);
+
+   bool ok() const
+   {
+      return !failed && !blob->overrun;
+   }
+
+   void *mem_ctx;
+   struct blob_reader *blob;
+
+   ir_serialize_resolve_callee resolve;
+   void *resolve_data;
+
+   /** The ir_variable of each number, in order */
+   struct util_dynarray variables;
+
+private:
+   ir_instruction *read_node(unsigned type);
+
+   /** Set when a node could not be read */
+   bool failed;
+};
+
+} /* anonymous namespace */
+
+static unsigned
+constant_component_size(const glsl_type *type)
+{
+   if (type->base_type == GLSL_TYPE_BOOL)
+      return sizeof(bool);
+   if (glsl_base_type_is_64bit(type->base_type) ||
+       type->is_sampler() || type->is_image())
+      return sizeof(uint64_t);
+   return sizeof(uint32_t);
+}
+
+void
+ir_serializer::add_variable(const ir_variable *var)
+{
+   _mesa_hash_table_insert(variables, var,
+                           (void *) (uintptr_t) num_variables++);
+}
+
+void
+ir_serializer::write_variable(const ir_variable *var)
+{
+   hash_entry *entry = _mesa_hash_table_search(variables, var);
+   if (entry) {
+      blob_write_uint32(blob, (uintptr_t) entry->data);
+      return;
+   }
+
+   blob_write_uint32(blob, num_variables);
+   add_variable(var);
+
+   /* Most variables keep the state the constructor gave them, so only
+    * write the data block of those that differ.
+    */
+   ir_variable *fresh =
+      new(mem_ctx) ir_variable(var->type, var->name,
+                               (ir_variable_mode) var->data.mode);
+   const bool has_data = memcmp(&fresh->data, &var->data, sizeof(var->data));
+
+   assert(var->get_interface_type() == NULL);
+   assert(var->get_num_state_slots() == 0);
+
+   blob_write_string(blob, var->name);
+   encode_type_to_blob(blob, var->type);
+   blob_write_uint32(blob, var->data.mode);
+   blob_write_uint32(blob,
+                     (has_data ? VAR_HAS_DATA : 0) |
+                     (var->constant_value ? VAR_HAS_CONSTANT_VALUE : 0) |
+                     (var->constant_initializer ?
+                      VAR_HAS_CONSTANT_INITIALIZER : 0));
+   if (has_data)
+      blob_write_bytes(blob, &var->data, sizeof(var->data));
+   if (var->constant_value)
+      write_constant(var->constant_value);
+   if (var->constant_initializer)
+      write_constant(var->constant_initializer);
+}
+
+void
+ir_serializer::write_constant(const ir_constant *c)
+{
+   encode_type_to_blob(blob, c->type);
+
+   if (c->type->is_array() || c->type->is_struct()) {
+      for (unsigned i = 0; i < c->type->length; i++)
+         write_constant(c->const_elements[i]);
+   } else {
+      blob_write_bytes(blob, &c->value,
+                       c->type->components() *
+                       constant_component_size(c->type));
+   }
+}
+
+void
+ir_serializer::write_rvalue(const ir_rvalue *ir)
+{
+   if (ir == NULL)
+      blob_write_uint32(blob, ir_type_unset);
+   else
+      write_instruction(ir);
+}
+
+void
+ir_serializer::write_list(const exec_list *list)
+{
+   blob_write_uint32(blob, list->length());
+   foreach_in_list(const ir_instruction, ir, list)
+      write_instruction(ir);
+}
+
+void
+ir_serializer::write_instruction(const ir_instruction *ir)
+{
+   blob_write_uint32(blob, ir->ir_type);
+
+   switch (ir->ir_type) {
+   case ir_type_dereference_array: {
+      const ir_dereference_array *deref = (const ir_dereference_array *) ir;
+      write_rvalue(deref->array);
+      write_rvalue(deref->array_index);
+      break;
+   }
+   case ir_type_dereference_record: {
+      const ir_dereference_record *deref = (const ir_dereference_record *) ir;
+      blob_write_uint32(blob, deref->field_idx);
+      write_rvalue(deref->record);
+      break;
+   }
+   case ir_type_dereference_variable:
+      write_variable(((const ir_dereference_variable *) ir)->var);
+      break;
+   case ir_type_constant:
+      write_constant((const ir_constant *) ir);
+      break;
+   case ir_type_expression: {
+      const ir_expression *expr = (const ir_expression *) ir;
+      blob_write_uint32(blob, expr->operation);
+      encode_type_to_blob(blob, expr->type);
+      blob_write_uint32(blob, expr->num_operands);
+      for (unsigned i = 0; i < expr->num_operands; i++)
+         write_rvalue(expr->operands[i]);
+      break;
+   }
+   case ir_type_swizzle: {
+      const ir_swizzle *swiz = (const ir_swizzle *) ir;
+      blob_write_uint32(blob, swiz->mask.x | swiz->mask.y << 2 |
+                              swiz->mask.z << 4 | swiz->mask.w << 6 |
+                              swiz->mask.num_components << 8);
+      write_rvalue(swiz->val);
+      break;
+   }
+   case ir_type_texture: {
+      const ir_texture *tex = (const ir_texture *) ir;
+      blob_write_uint32(blob, tex->op);
+      encode_type_to_blob(blob, tex->type);
+      write_rvalue(tex->sampler);
+      write_rvalue(tex->coordinate);
+      write_rvalue(tex->projector);
+      write_rvalue(tex->shadow_comparator);
+      write_rvalue(tex->offset);
+      switch (tex->op) {
+      case ir_tex:
+      case ir_lod:
+      case ir_query_levels:
+      case ir_texture_samples:
+      case ir_samples_identical:
+         break;
+      case ir_txb:
+         write_rvalue(tex->lod_info.bias);
+         break;
+      case ir_txl:
+      case ir_txf:
+      case ir_txs:
+         write_rvalue(tex->lod_info.lod);
+         break;
+      case ir_txf_ms:
+         write_rvalue(tex->lod_info.sample_index);
+         break;
+      case ir_txd:
+         write_rvalue(tex->lod_info.grad.dPdx);
+         write_rvalue(tex->lod_info.grad.dPdy);
+         break;
+      case ir_tg4:
+         write_rvalue(tex->lod_info.component);
+         break;
+      }
+      break;
+   }
+   case ir_type_variable:
+      write_variable((const ir_variable *) ir);
+      break;
+   case ir_type_assignment: {
+      const ir_assignment *assign = (const ir_assignment *) ir;
+      blob_write_uint32(blob, assign->write_mask);
+      write_rvalue(assign->lhs);
+      write_rvalue(assign->rhs);
+      write_rvalue(assign->condition);
+      break;
+   }
+   case ir_type_call: {
+      const ir_call *call = (const ir_call *) ir;
+      const ir_function *f = call->callee->function();
+      unsigned index = 0;
+
+      assert(call->sub_var == NULL);
+      foreach_in_list(const ir_function_signature, sig, &f->signatures) {
+         if (sig == call->callee)
+            break;
+         index++;
+      }
+
+      blob_write_string(blob, f->name);
+      blob_write_uint32(blob, index);
+      write_rvalue(call->return_deref);
+      write_list(&call->actual_parameters);
+      break;
+   }
+   case ir_type_if: {
+      const ir_if *iif = (const ir_if *) ir;
+      write_rvalue(iif->condition);
+      write_list(&iif->then_instructions);
+      write_list(&iif->else_instructions);
+      break;
+   }
+   case ir_type_loop:
+      write_list(&((const ir_loop *) ir)->body_instructions);
+      break;
+   case ir_type_loop_jump:
+      blob_write_uint32(blob, ((const ir_loop_jump *) ir)->mode);
+      break;
+   case ir_type_return:
+      write_rvalue(((const ir_return *) ir)->value);
+      break;
+   case ir_type_discard:
+      write_rvalue(((const ir_discard *) ir)->condition);
+      break;
+   case ir_type_emit_vertex:
+      write_rvalue(((const ir_emit_vertex *) ir)->stream);
+      break;
+   case ir_type_end_primitive:
+      write_rvalue(((const ir_end_primitive *) ir)->stream);
+      break;
+   case ir_type_barrier:
+      break;
+   case ir_type_function:
+   case ir_type_function_signature:
+   case ir_type_max:
+      unreachable("cannot serialize this node inside a function body");
+   }
+}
+
+ir_variable *
+ir_deserializer::read_variable()
+{
+   const unsigned n = util_dynarray_num_elements(&variables, ir_variable *);
+   const unsigned id = blob_read_uint32(blob);
+
+   if (id < n)
+      return *util_dynarray_element(&variables, ir_variable *, id);
+   if (id != n || blob->overrun)
+      return NULL;
+
+   const char *name = blob_read_string(blob);
+   const glsl_type *type = decode_type_from_blob(blob);
+   const unsigned mode = blob_read_uint32(blob);
+   const unsigned flags = blob_read_uint32(blob);
+
+   if (blob->overrun || mode >= ir_var_mode_count)
+      return NULL;
+
+   ir_variable *var =
+      new(mem_ctx) ir_variable(type, name, (ir_variable_mode) mode);
+   util_dynarray_append(&variables, ir_variable *, var);
+
+   if (flags & VAR_HAS_DATA)
+      blob_copy_bytes(blob, &var->data, sizeof(var->data));
+   if (flags & VAR_HAS_CONSTANT_VALUE)
+      var->constant_value = read_constant();
+   if (flags & VAR_HAS_CONSTANT_INITIALIZER)
+      var->constant_initializer = read_constant();
+
+   return var;
+}
+
+ir_constant *
+ir_deserializer::read_constant()
+{
+   const glsl_type *type = decode_type_from_blob(blob);
+   if (type == NULL || blob->overrun)
+      return NULL;
+
+   if (type->is_array() || type->is_struct()) {
+      ir_constant *c = ir_constant::zero(mem_ctx, type);
+      for (unsigned i = 0; i < type->length; i++) {
+         c->const_elements[i] = read_constant();
+         if (c->const_elements[i] == NULL)
+            return NULL;
+      }
+      return c;
+   }
+
+   ir_constant_data data;
+   memset(&data, 0, sizeof(data));
+   blob_copy_bytes(blob, &data,
+                   type->components() * constant_component_size(type));
+   return new(mem_ctx) ir_constant(type, &data);
+}
+
+ir_rvalue *
+ir_deserializer::read_rvalue()
+{
+   ir_instruction *ir = read_instruction();
+   if (ir != NULL && ir->as_rvalue() == NULL)
+      failed = true;
+   return ir ? ir->as_rvalue() : NULL;
+}
+
+bool
+ir_deserializer::read_list(exec_list *list)
+{
+   const unsigned count = blob_read_uint32(blob);
+
+   for (unsigned i = 0; i < count; i++) {
+      ir_instruction *ir = read_instruction();
+      if (ir == NULL)
+         return false;
+      list->push_tail(ir);
+   }
+
+   return ok();
+}
+
+ir_instruction *
+ir_deserializer::read_instruction()
+{
+   const unsigned type = blob_read_uint32(blob);
+   if (blob->overrun || type == ir_type_unset)
+      return NULL;
+
+   ir_instruction *ir = read_node(type);
+   if (ir == NULL)
+      failed = true;
+   return ir;
+}
+
+/* Every node checks that its mandatory children could be read and returns
+ * NULL otherwise.
+ */
+ir_instruction *
+ir_deserializer::read_node(unsigned type)
+{
+   switch (type) {
+   case ir_type_dereference_array: {
+      ir_rvalue *array = read_rvalue();
+      ir_rvalue *index = read_rvalue();
+      if (array == NULL || index == NULL)
+         return NULL;
+      return new(mem_ctx) ir_dereference_array(array, index);
+   }
+   case ir_type_dereference_record: {
+      const unsigned field = blob_read_uint32(blob);
+      ir_rvalue *record = read_rvalue();
+      if (record == NULL ||
+          !(record->type->is_struct() || record->type->is_interface()) ||
+          field >= record->type->length)
+         return NULL;
+      return new(mem_ctx) ir_dereference_record(record,
+         record->type->fields.structure[field].name);
+   }
+   case ir_type_dereference_variable: {
+      ir_variable *var = read_variable();
+      if (var == NULL)
+         return NULL;
+      return new(mem_ctx) ir_dereference_variable(var);
+   }
+   case ir_type_constant:
+      return read_constant();
+   case ir_type_expression: {
+      const unsigned op = blob_read_uint32(blob);
+      const glsl_type *type = decode_type_from_blob(blob);
+      const unsigned num_operands = blob_read_uint32(blob);
+      ir_rvalue *operands[4] = { NULL, NULL, NULL, NULL };
+
+      if (op > ir_last_opcode || type == NULL ||
+          num_operands > ARRAY_SIZE(operands))
+         return NULL;
+      for (unsigned i = 0; i < num_operands; i++) {
+         operands[i] = read_rvalue();
+         if (operands[i] == NULL)
+            return NULL;
+      }
+      return new(mem_ctx) ir_expression(op, type, operands[0], operands[1],
+                                        operands[2], operands[3]);
+   }
+   case ir_type_swizzle: {
+      const unsigned mask = blob_read_uint32(blob);
+      ir_rvalue *val = read_rvalue();
+      if (val == NULL)
+         return NULL;
+      return new(mem_ctx) ir_swizzle(val, mask & 3, (mask >> 2) & 3,
+                                     (mask >> 4) & 3, (mask >> 6) & 3,
+                                     (mask >> 8) & 7);
+   }
+   case ir_type_texture: {
+      const unsigned op = blob_read_uint32(blob);
+      if (op > ir_samples_identical)
+         return NULL;
+
+      ir_texture *tex = new(mem_ctx) ir_texture((ir_texture_opcode) op);
+      tex->type = decode_type_from_blob(blob);
+      ir_rvalue *sampler = read_rvalue();
+      tex->sampler = sampler ? sampler->as_dereference() : NULL;
+      tex->coordinate = read_rvalue();
+      tex->projector = read_rvalue();
+      tex->shadow_comparator = read_rvalue();
+      tex->offset = read_rvalue();
+      if (tex->type == NULL || tex->sampler == NULL)
+         return NULL;
+
+      switch (tex->op) {
+      case ir_tex:
+      case ir_lod:
+      case ir_query_levels:
+      case ir_texture_samples:
+      case ir_samples_identical:
+         break;
+      case ir_txb:
+         tex->lod_info.bias = read_rvalue();
+         break;
+      case ir_txl:
+      case ir_txf:
+      case ir_txs:
+         tex->lod_info.lod = read_rvalue();
+         break;
+      case ir_txf_ms:
+         tex->lod_info.sample_index = read_rvalue();
+         break;
+      case ir_txd:
+         tex->lod_info.grad.dPdx = read_rvalue();
+         tex->lod_info.grad.dPdy = read_rvalue();
+         break;
+      case ir_tg4:
+         tex->lod_info.component = read_rvalue();
+         break;
+      }
+      return tex;
+   }
+   case ir_type_variable:
+      return read_variable();
+   case ir_type_assignment: {
+      const unsigned write_mask = blob_read_uint32(blob);
+      ir_rvalue *lhs = read_rvalue();
+      ir_rvalue *rhs = read_rvalue();
+      ir_rvalue *condition = read_rvalue();
+      if (lhs == NULL || lhs->as_dereference() == NULL || rhs == NULL)
+         return NULL;
+      return new(mem_ctx) ir_assignment(lhs->as_dereference(), rhs,
+                                        condition, write_mask);
+   }
+   case ir_type_call: {
+      const char *name = blob_read_string(blob);
+      const unsigned index = blob_read_uint32(blob);
+      if (blob->overrun || resolve == NULL)
+         return NULL;
+
+      ir_function_signature *callee = resolve(resolve_data, name, index);
+      ir_rvalue *ret = read_rvalue();
+      exec_list parameters;
+      if (callee == NULL || !read_list(&parameters))
+         return NULL;
+      if (ret != NULL && ret->as_dereference_variable() == NULL)
+         return NULL;
+      return new(mem_ctx) ir_call(callee,
+                                  ret ? ret->as_dereference_variable() : NULL,
+                                  &parameters);
+   }
+   case ir_type_if: {
+      ir_rvalue *condition = read_rvalue();
+      if (condition == NULL)
+         return NULL;
+      ir_if *iif = new(mem_ctx) ir_if(condition);
+      if (!read_list(&iif->then_instructions) ||
+          !read_list(&iif->else_instructions))
+         return NULL;
+      return iif;
+   }
+   case ir_type_loop: {
+      ir_loop *loop = new(mem_ctx) ir_loop();
+      if (!read_list(&loop->body_instructions))
+         return NULL;
+      return loop;
+   }
+   case ir_type_loop_jump: {
+      const unsigned mode = blob_read_uint32(blob);
+      if (mode > ir_loop_jump::jump_continue)
+         return NULL;
+      return new(mem_ctx) ir_loop_jump((ir_loop_jump::jump_mode) mode);
+   }
+   case ir_type_return:
+      return new(mem_ctx) ir_return(read_rvalue());
+   case ir_type_discard:
+      return new(mem_ctx) ir_discard(read_rvalue());
+   case ir_type_emit_vertex: {
+      ir_rvalue *stream = read_rvalue();
+      return stream ? new(mem_ctx) ir_emit_vertex(stream) : NULL;
+   }
+   case ir_type_end_primitive: {
+      ir_rvalue *stream = read_rvalue();
+      return stream ? new(mem_ctx) ir_end_primitive(stream) : NULL;
+   }
+   case ir_type_barrier:
+      return new(mem_ctx) ir_barrier();
+   default:
+      return NULL;
+   }
+}
+
+void
+ir_serialize_prototype(struct blob *blob, const ir_function_signature *sig)
+{
+   ir_serializer s(blob);
+
+   encode_type_to_blob(blob, sig->return_type);
+   blob_write_uint32(blob, sig->is_defined);
+   blob_write_uint32(blob, sig->intrinsic_id);
+   blob_write_uint32(blob, sig->parameters.length());
+   foreach_in_list(const ir_variable, param, &sig->parameters)
+      s.write_variable(param);
+}
+
+void
+ir_serialize_body(struct blob *blob, const ir_function_signature *sig)
+{
+   ir_serializer s(blob);
+
+   /* The prototype holds the definitions of the parameters. */
+   foreach_in_list(const ir_variable, param, &sig->parameters)
+      s.add_variable(param);
+
+   s.write_list(&sig->body);
+}
+
+ir_function_signature *
+ir_deserialize_prototype(void *mem_ctx, struct blob_reader *blob,
+                         builtin_available_predicate avail)
+{
+   ir_deserializer d(mem_ctx, blob);
+
+   const glsl_type *return_type = decode_type_from_blob(blob);
+   const unsigned is_defined = blob_read_uint32(blob);
+   const unsigned intrinsic_id = blob_read_uint32(blob);
+   const unsigned num_params = blob_read_uint32(blob);
+   if (blob->overrun || return_type == NULL)
+      return NULL;
+
+   ir_function_signature *sig =
+      new(mem_ctx) ir_function_signature(return_type, avail);
+   sig->is_defined = is_defined;
+   sig->intrinsic_id = (ir_intrinsic_id) intrinsic_id;
+
+   for (unsigned i = 0; i < num_params; i++) {
+      ir_variable *param = d.read_variable();
+      if (param == NULL)
+         return NULL;
+      sig->parameters.push_tail(param);
+   }
+
+   return d.ok() ? sig : NULL;
+}
+
+bool
+ir_deserialize_body(void *mem_ctx, struct blob_reader *blob,
+                    ir_function_signature *sig,
+                    ir_serialize_resolve_callee resolve, void *data)
+{
+   ir_deserializer d(mem_ctx, blob);
+
+   d.resolve = resolve;
+   d.resolve_data = data;
+   foreach_in_list(ir_variable, param, &sig->parameters)
+      util_dynarray_append(&d.variables, ir_variable *, param);
+
+   return d.read_list(&sig->body) && d.ok();
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef IR_SERIALIZE_H
+#define IR_SERIALIZE_H
+
+#include "ir.h"
+
+struct blob;
+struct blob_reader;
+
+/**
+ * \file ir_serialize.h
+ *
+ * Binary serialization of function signatures in GLSL IR.
+ *
+ * A signature is written in two parts: its prototype (return type and
+ * parameters) and its body.  Keeping them apart lets a reader create every
+ * prototype of a function before reading any body, so bodies may call any
+ * signature of the function being read.
+ *
+ * Calls are recorded as the name of the callee's function and the index of
+ * the callee among that function's signatures; the reader resolves them
+ * through a callback.  The availability predicate of built-in signatures is
+ * not serialized since it is a function pointer; the caller provides it.
+ *
+ * The encoding is only meant to be read back by the same build of Mesa.
+ */
+
+typedef ir_function_signature *
+(*ir_serialize_resolve_callee)(void *data, const char *function_name,
+                               unsigned signature_index);
+
+void
+ir_serialize_prototype(struct blob *blob, const ir_function_signature *sig);
+
+void
+ir_serialize_body(struct blob *blob, const ir_function_signature *sig);
+
+ir_function_signature *
+ir_deserialize_prototype(void *mem_ctx, struct blob_reader *blob,
+                         builtin_available_predicate avail);
+
+bool
+ir_deserialize_body(void *mem_ctx, struct blob_reader *blob,
+                    ir_function_signature *sig,
+                    ir_serialize_resolve_callee resolve, void *data);
+
+#endif /* IR_SERIALIZE_H */
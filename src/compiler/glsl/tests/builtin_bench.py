@@ -0,0 +1,115 @@
+# encoding=utf-8
+# Copyright © 2019 FMSoft Technologies
+
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+
+"""Compares the start-up cost of the GLSL built-in functions when they are
+loaded from the library serialized at build time and when they are all built
+at run time (MESA_GLSL_BUILTIN_LIBRARY_DISABLE=1).
+
+Each shader is compiled --runs times by the standalone compiler in each mode;
+the median wall time and the median peak RSS are printed, and the compiler
+output of both modes must match.
+
+Usage: builtin_bench.py --glsl-compiler path/to/glsl_compiler shader...
+"""
+
+from __future__ import print_function
+import argparse
+import os
+import subprocess
+import time
+
+
+def arg_parser():
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        '--glsl-compiler',
+        required=True,
+        help='Path to the standalone glsl compiler')
+    parser.add_argument(
+        '--version',
+        default='150',
+        help='GLSL version passed to the compiler')
+    parser.add_argument(
+        '--runs',
+        type=int,
+        default=20,
+        help='Number of compilations of each shader in each mode')
+    parser.add_argument(
+        'shaders',
+        nargs='+',
+        help='Shaders to compile')
+    return parser.parse_args()
+
+
+def run(args, shader, disable):
+    env = dict(os.environ)
+    env['MESA_GLSL_BUILTIN_LIBRARY_DISABLE'] = '1' if disable else '0'
+
+    start = time.time()
+    proc = subprocess.Popen(
+        [args.glsl_compiler, '--just-log', '--version', args.version, shader],
+        stdout=subprocess.PIPE, env=env)
+    output = proc.stdout.read()
+    proc.stdout.close()
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = time.time() - start
+
+    # ru_maxrss is in kilobytes on Linux
+    return output, status, elapsed * 1000.0, usage.ru_maxrss
+
+
+def median(values):
+    values = sorted(values)
+    return values[len(values) // 2]
+
+
+def main():
+    args = arg_parser()
+    failed = False
+
+    print('{:<40} {:>12} {:>12} {:>12} {:>12}'.format(
+        'shader', 'library ms', 'built ms', 'library KB', 'built KB'))
+
+    for shader in args.shaders:
+        results = {}
+        for disable in (False, True):
+            times = []
+            rss = []
+            for _ in range(max(args.runs, 1)):
+                output, status, ms, kb = run(args, shader, disable)
+                times.append(ms)
+                rss.append(kb)
+            results[disable] = (output, status, median(times), median(rss))
+
+        print('{:<40} {:>12.2f} {:>12.2f} {:>12} {:>12}'.format(
+            os.path.basename(shader), results[False][2], results[True][2],
+            results[False][3], results[True][3]))
+
+        if results[False][:2] != results[True][:2]:
+            print('  compiler output differs between the two modes')
+            failed = True
+
+    exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
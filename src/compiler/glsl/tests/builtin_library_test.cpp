@@ -0,0 +1,257 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file builtin_library_test.cpp
+ *
+ * Checks that every built-in function loaded lazily from the library
+ * serialized at build time has the same IR as when it is built at run time.
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "compiler/blob.h"
+#include "compiler/glsl_types.h"
+#include "ir.h"
+#include "ir_hierarchical_visitor.h"
+#include "builtin_functions.h"
+
+extern "C" const uint32_t _mesa_glsl_builtin_library[];
+extern "C" const uint32_t _mesa_glsl_builtin_library_size;
+
+namespace {
+
+/**
+ * Prints what the IR printer leaves out: the variable qualifiers it doesn't
+ * show and which signature each call resolves to.
+ */
+class extra_printer : public ir_hierarchical_visitor {
+public:
+   extra_printer(FILE *f) : f(f)
+   {
+   }
+
+   void print(const ir_variable *var)
+   {
+      fprintf(f, "[%s mode=%u precision=%u read_only=%u invariant=%u "
+              "how_declared=%u]\n", var->name ? var->name : "",
+              var->data.mode, var->data.precision, var->data.read_only,
+              var->data.invariant, var->data.how_declared);
+   }
+
+   virtual ir_visitor_status visit(ir_variable *var)
+   {
+      print(var);
+      return visit_continue;
+   }
+
+   virtual ir_visitor_status visit_enter(ir_call *call)
+   {
+      unsigned index = 0;
+
+      foreach_in_list(ir_function_signature, sig,
+                      &call->callee->function()->signatures) {
+         if (sig == call->callee)
+            break;
+         index++;
+      }
+      fprintf(f, "[call %s #%u]\n", call->callee_name(), index);
+      return visit_continue;
+   }
+
+private:
+   FILE *f;
+};
+
+/** Checks that every call targets the registered built-in of its name. */
+class callee_checker : public ir_hierarchical_visitor {
+public:
+   virtual ir_visitor_status visit_enter(ir_call *call)
+   {
+      EXPECT_EQ(_mesa_glsl_get_builtin_function(call->callee_name()),
+                call->callee->function()) << call->callee_name();
+      return visit_continue;
+   }
+};
+
+/**
+ * The IR printer numbers clashing variable names with counters shared by
+ * every printout, so renumber them from zero.
+ */
+std::string
+renumber(const std::string &s)
+{
+   std::vector<std::string> ids;
+   std::string out;
+   size_t pos = 0;
+
+   for (;;) {
+      size_t at = s.find('@', pos);
+      if (at == std::string::npos)
+         break;
+
+      size_t end = at + 1;
+      while (end < s.size() && s[end] >= '0' && s[end] <= '9')
+         end++;
+
+      out.append(s, pos, at + 1 - pos);
+      if (end > at + 1) {
+         const std::string id = s.substr(at + 1, end - at - 1);
+         unsigned n = 0;
+         while (n < ids.size() && ids[n] != id)
+            n++;
+         if (n == ids.size())
+            ids.push_back(id);
+         out += std::to_string(n);
+      }
+      pos = end;
+   }
+   out.append(s, pos, std::string::npos);
+
+   return out;
+}
+
+std::string
+print_function(ir_function *f)
+{
+   FILE *file = tmpfile();
+   std::string s;
+   char buf[4096];
+   size_t n;
+
+   if (file == NULL)
+      return s;
+
+   foreach_in_list(ir_function_signature, sig, &f->signatures) {
+      extra_printer extra(file);
+
+      fprintf(file, "avail=%p intrinsic=%u defined=%u\n",
+              (void *) sig->get_builtin_avail(), sig->intrinsic_id,
+              sig->is_defined);
+      sig->fprint(file);
+      foreach_in_list(ir_variable, param, &sig->parameters)
+         extra.print(param);
+      extra.run(&sig->body);
+   }
+
+   rewind(file);
+   while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+      s.append(buf, n);
+   fclose(file);
+
+   return renumber(s);
+}
+
+/** The names of the functions in the library, read from its index. */
+std::vector<std::string>
+library_function_names()
+{
+   std::vector<std::string> names;
+   struct blob_reader blob;
+
+   blob_reader_init(&blob, _mesa_glsl_builtin_library,
+                    _mesa_glsl_builtin_library_size);
+   blob_read_uint32(&blob); /* version */
+   blob_read_uint32(&blob); /* number of predicates */
+
+   const unsigned num_functions = blob_read_uint32(&blob);
+   for (unsigned i = 0; i < num_functions && !blob.overrun; i++) {
+      names.push_back(blob_read_string(&blob));
+      blob_read_uint32(&blob); /* offset */
+   }
+
+   return names;
+}
+
+class builtin_library : public ::testing::Test {
+public:
+   virtual void SetUp()
+   {
+      glsl_type_singleton_init_or_ref();
+      _mesa_glsl_release_builtin_functions();
+   }
+
+   virtual void TearDown()
+   {
+      unsetenv("MESA_GLSL_BUILTIN_LIBRARY_DISABLE");
+      _mesa_glsl_release_builtin_functions();
+      glsl_type_singleton_decref();
+   }
+};
+
+} /* anonymous namespace */
+
+TEST_F(builtin_library, loaded_ir_matches_built_ir)
+{
+   /* Cross builds can't run the generator and embed an empty library. */
+   if (_mesa_glsl_builtin_library_size == 0)
+      return;
+
+   const std::vector<std::string> names = library_function_names();
+   std::vector<std::string> built;
+
+   ASSERT_FALSE(names.empty());
+
+   setenv("MESA_GLSL_BUILTIN_LIBRARY_DISABLE", "true", 1);
+   _mesa_glsl_initialize_builtin_functions();
+   for (unsigned i = 0; i < names.size(); i++) {
+      ir_function *f = _mesa_glsl_get_builtin_function(names[i].c_str());
+      ASSERT_NE((void *) NULL, f) << names[i];
+      built.push_back(print_function(f));
+   }
+   _mesa_glsl_release_builtin_functions();
+
+   unsetenv("MESA_GLSL_BUILTIN_LIBRARY_DISABLE");
+   _mesa_glsl_initialize_builtin_functions();
+   for (unsigned i = 0; i < names.size(); i++) {
+      ir_function *f = _mesa_glsl_get_builtin_function(names[i].c_str());
+      ASSERT_NE((void *) NULL, f) << names[i];
+      EXPECT_EQ(built[i], print_function(f)) << names[i];
+   }
+}
+
+TEST_F(builtin_library, calls_resolve_to_registered_functions)
+{
+   if (_mesa_glsl_builtin_library_size == 0)
+      return;
+
+   const std::vector<std::string> names = library_function_names();
+
+   _mesa_glsl_initialize_builtin_functions();
+
+   /* Loading a function loads the functions its bodies call; each call
+    * must end up pointing at the one function registered under that name.
+    */
+   for (unsigned i = 0; i < names.size(); i++) {
+      ir_function *f = _mesa_glsl_get_builtin_function(names[i].c_str());
+      ASSERT_NE((void *) NULL, f) << names[i];
+
+      foreach_in_list(ir_function_signature, sig, &f->signatures) {
+         callee_checker checker;
+         checker.run(&sig->body);
+      }
+   }
+}
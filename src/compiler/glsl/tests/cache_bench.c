@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Compares the two layouts of the disk cache: a file per entry, the
+ * current default, and the single file store.  For each one it times the
+ * puts, then the lookups of every entry twice, with the page cache cold, as
+ * after a reboot, then warm, as when a program is started again.
+ *
+ * Usage: cache_bench [number of entries] [entry size in bytes]
+ */
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/disk_cache.h"
+#include "util/os_time.h"
+
+#define CACHE_BENCH_TMP "./cache-bench-tmp"
+
+static uint64_t disk_usage;
+
+static int
+remove_entry(const char *path, const struct stat *sb, int typeflag,
+             struct FTW *ftwbuf)
+{
+   return remove(path);
+}
+
+/* Drop the cache files from the page cache, as after a reboot. */
+static int
+drop_entry(const char *path, const struct stat *sb, int typeflag,
+           struct FTW *ftwbuf)
+{
+   int fd;
+
+   if (typeflag != FTW_F)
+      return 0;
+
+   disk_usage += (uint64_t)sb->st_blocks * 512;
+
+   fd = open(path, O_RDONLY);
+   if (fd != -1) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+   }
+
+   return 0;
+}
+
+/* Something looking like a serialized shader: compressible, but not
+ * trivially so.
+ */
+static void
+fill_entry(uint8_t *data, size_t size, unsigned seed)
+{
+   for (size_t i = 0; i < size; i++)
+      data[i] = "vec4 mul add mov tex "[(i * 7 + seed + i / 64) % 21] ^
+                ((i % 97 == 0) ? seed : 0);
+}
+
+/* The cache queue has a single thread, which writes the entries in the
+ * order they were put: once the last one can be found, all of them are
+ * written.
+ */
+static void
+wait_until_written(struct disk_cache *cache, const cache_key key)
+{
+   const struct timespec req = { 0, 1000000 };
+   size_t size;
+   void *data;
+
+   while (!(data = disk_cache_get(cache, key, &size)))
+      nanosleep(&req, NULL);
+   free(data);
+}
+
+static double
+lookup_all(struct disk_cache *cache, cache_key *keys, unsigned num_entries)
+{
+   int64_t start = os_time_get_nano();
+   unsigned misses = 0;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      size_t size;
+      void *data = disk_cache_get(cache, keys[i], &size);
+
+      if (!data)
+         misses++;
+      free(data);
+   }
+
+   if (misses)
+      fprintf(stderr, "  %u misses\n", misses);
+
+   return (os_time_get_nano() - start) / 1e6;
+}
+
+static void
+bench_layout(const char *name, bool single_file, cache_key *keys,
+             unsigned num_entries, size_t entry_size)
+{
+   struct disk_cache *cache;
+   uint8_t *data;
+   double put_ms, cold_ms, warm_ms;
+   int64_t start;
+
+   nftw(CACHE_BENCH_TMP, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+   mkdir(CACHE_BENCH_TMP, 0755);
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_BENCH_TMP, 1);
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", single_file ? "true" : "false", 1);
+
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   if (!cache) {
+      fprintf(stderr, "failed to create the cache\n");
+      exit(1);
+   }
+
+   data = malloc(entry_size);
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++) {
+      fill_entry(data, entry_size, i);
+      disk_cache_compute_key(cache, data, entry_size, keys[i]);
+      disk_cache_put(cache, keys[i], data, entry_size, NULL);
+   }
+   wait_until_written(cache, keys[num_entries - 1]);
+   put_ms = (os_time_get_nano() - start) / 1e6;
+
+   free(data);
+   disk_cache_destroy(cache);
+
+   disk_usage = 0;
+   nftw(CACHE_BENCH_TMP, drop_entry, 64, FTW_PHYS);
+
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   cold_ms = lookup_all(cache, keys, num_entries);
+   warm_ms = lookup_all(cache, keys, num_entries);
+   disk_cache_destroy(cache);
+
+   printf("%-26s %10.2f %10.2f %10.2f %10.2f\n", name, put_ms, cold_ms,
+          warm_ms, disk_usage / (1024.0 * 1024.0));
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_entries = argc > 1 ? atoi(argv[1]) : 4096;
+   size_t entry_size = argc > 2 ? atoi(argv[2]) : 16 * 1024;
+   cache_key *keys;
+
+   keys = malloc(num_entries * sizeof(cache_key));
+   if (!keys)
+      return 1;
+
+   printf("%u entries of %zu bytes\n\n", num_entries, entry_size);
+   printf("%-26s %10s %10s %10s %10s\n", "layout", "put ms", "cold ms",
+          "warm ms", "disk MB");
+
+   bench_layout("file per entry (current)", false, keys, num_entries,
+                entry_size);
+   bench_layout("single file store", true, keys, num_entries, entry_size);
+
+   nftw(CACHE_BENCH_TMP, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+   free(keys);
+
+   return 0;
+}
@@ -35,6 +35,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "util/macros.h"
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
 
@@ -493,6 +494,130 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+static void
+fill_random(uint8_t *data, size_t size)
+{
+   for (size_t i = 0; i < size; i++)
+      data[i] = rand();
+}
+
+static void
+test_single_file(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   uint8_t keys[4][20];
+   uint8_t *data;
+   char *result;
+   size_t size;
+   struct stat sb;
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   wait_until_file_written(cache, blob_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "single file disk_cache_get (pointer)");
+   expect_equal(size, sizeof(blob), "single file disk_cache_get (size)");
+   free(result);
+
+   expect_true(stat(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME
+                    "/pack", &sb) == 0, "single file store created");
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(!does_cache_contain(cache, blob_key),
+               "single file disk_cache_remove");
+
+   /* Fill the cache with incompressible items, which take 900K together,
+    * use the first one, and check that the one used the least recently is
+    * evicted when a fourth one is added.
+    */
+   data = malloc(300 * 1024);
+   for (unsigned i = 0; i < 4; i++) {
+      fill_random(data, 300 * 1024);
+      disk_cache_compute_key(cache, data, 300 * 1024, keys[i]);
+
+      if (i == 3)
+         expect_true(does_cache_contain(cache, keys[0]),
+                     "single file get before eviction");
+
+      disk_cache_put(cache, keys[i], data, 300 * 1024, NULL);
+      wait_until_file_written(cache, keys[i]);
+   }
+   free(data);
+
+   expect_true(does_cache_contain(cache, keys[3]),
+               "single file eviction last item");
+   expect_true(does_cache_contain(cache, keys[0]),
+               "single file eviction keeps recently used item");
+   expect_true(!does_cache_contain(cache, keys[1]),
+               "single file eviction of least recently used item");
+
+   /* The entries outlive the cache object. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   expect_true(does_cache_contain(cache, keys[3]),
+               "single file entry after reopening");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+}
+
+static void
+test_put_burst(bool single_file)
+{
+   struct disk_cache *cache;
+   const size_t sizes[] = { 16, 4 * 1024, 100 * 1024 };
+   uint8_t keys[200][20];
+   uint8_t *data;
+   char *result;
+   size_t size;
+   bool all_found = true;
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", single_file ? "true" : "false", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1G", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   /* More puts than a batch holds, of sizes getting different codecs. */
+   data = malloc(100 * 1024);
+   for (unsigned i = 0; i < ARRAY_SIZE(keys); i++) {
+      size = sizes[i % ARRAY_SIZE(sizes)];
+      memset(data, i, size);
+      data[0] = i % 3;
+      disk_cache_compute_key(cache, data, size, keys[i]);
+      keys[i][19] = i;
+      disk_cache_put(cache, keys[i], data, size, NULL);
+   }
+
+   disk_cache_wait_for_idle(cache);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(keys); i++) {
+      size_t expected = sizes[i % ARRAY_SIZE(sizes)];
+
+      result = disk_cache_get(cache, keys[i], &size);
+      if (!result || size != expected ||
+          (uint8_t) result[expected - 1] != (uint8_t) i)
+         all_found = false;
+      free(result);
+   }
+   free(data);
+
+   expect_true(all_found, single_file ?
+               "single file disk_cache_get after disk_cache_wait_for_idle" :
+               "disk_cache_get after disk_cache_wait_for_idle");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -507,6 +632,12 @@ main(void)
 
    test_put_key_and_get_key();
 
+   test_single_file();
+
+   test_put_burst(false);
+
+   test_put_burst(true);
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
@@ -1764,9 +1764,13 @@ dri2_set_damage_region(_EGLDriver *drv, _EGLDisplay *disp, _EGLSurface *surf,
    struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
    __DRIdrawable *drawable = dri2_dpy->vtbl->get_dri_drawable(surf);
 
-   if (!dri2_dpy->buffer_damage || !dri2_dpy->buffer_damage->set_damage_region)
+   if (dri2_dpy->vtbl->set_damage_region &&
+       !dri2_dpy->vtbl->set_damage_region(drv, disp, surf, rects, n_rects))
       return EGL_FALSE;
 
+   if (!dri2_dpy->buffer_damage || !dri2_dpy->buffer_damage->set_damage_region)
+      return dri2_dpy->vtbl->set_damage_region != NULL;
+
    dri2_dpy->buffer_damage->set_damage_region(drawable, n_rects, rects);
    return EGL_TRUE;
 }
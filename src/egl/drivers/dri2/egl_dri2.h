@@ -126,6 +126,13 @@ struct dri2_egl_display_vtbl {
                                      _EGLSurface *surf, EGLint numRects,
                                      const EGLint *rects);
 
+   /* Used in EGL_KHR_partial_update when the platform presents the damage
+    * region itself, may be NULL.
+    */
+   EGLBoolean (*set_damage_region)(_EGLDriver *drv, _EGLDisplay *disp,
+                                   _EGLSurface *surf,
+                                   const EGLint *rects, EGLint n_rects);
+
    EGLBoolean (*post_sub_buffer)(_EGLDriver *drv, _EGLDisplay *disp,
                                  _EGLSurface *surf,
                                  EGLint x, EGLint y,
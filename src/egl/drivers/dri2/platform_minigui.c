@@ -27,6 +27,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -40,6 +41,7 @@
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/shm.h>
 
 #define _DEBUG
 #include <minigui/common.h>
@@ -123,6 +125,9 @@
 #define MG_DRM_CAPABILITY_NAME      0x01
 #define MG_DRM_CAPABILITY_PRIME     0x02
 
+/* more damage rectangles than this are merged into their bounding box */
+#define MG_MAX_DAMAGE_RECTS         16
+
 struct dri2_egl_drv_display
 {
    struct dri2_egl_display base;
@@ -166,6 +171,39 @@ struct dri2_egl_drv_surface
       bool              locked;
       int               age;
    } color_buffers[4], *back, *current;
+
+   /* for swrast with shared memory images: memdcs wrapping the images of
+    * the driver, which thus renders straight into MiniGUI surfaces; each
+    * holds its own mapping of the segment, so that the segment lives as
+    * long as the memdc even if the driver frees the image */
+   struct {
+      HDC               memdc;
+      int               shmid;
+      char             *shmaddr;
+      int               stride;
+      int               height;
+   } shm_images[2], *shm_front;
+   bool        use_shm;
+
+   /* damage of the frame being presented, in window coordinates; the
+    * whole surface if has_damage is false */
+   bool        has_damage;
+   RECT        damage_rcs[MG_MAX_DAMAGE_RECTS];
+   int         n_damage_rcs;
+
+   /* region set by eglSetDamageRegionKHR for the frame being rendered */
+   bool        has_partial;
+   RECT        partial_rcs[MG_MAX_DAMAGE_RECTS];
+   int         n_partial_rcs;
+
+   /* for swrast: the driver keeps rendering into the same image, which
+    * thus holds the previous frame once one has been presented */
+   int         swrast_age;
+
+   /* bytes copied by the loader to present the frames */
+   uint64_t    frame_bytes_copied;
+   uint64_t    total_bytes_copied;
+   unsigned    frame_count;
 };
 
 /*
@@ -482,6 +520,7 @@ swrast_update_buffers(struct dri2_egl_drv_surface *dri2_drv_surf)
       dri2_drv_surf->base.base.Width  = RECTW(rc_win);
       dri2_drv_surf->base.base.Height = RECTH(rc_win);
       dri2_drv_surf->current = NULL;
+      dri2_drv_surf->swrast_age = 0;
    }
 
    /* find back buffer */
@@ -556,15 +595,101 @@ dri2_minigui_swrast_get_backbuffer_data(struct dri2_egl_drv_surface *dri2_drv_su
    return dri2_drv_surf->back->data;
 }
 
+/**
+ * Convert EGL rectangles, whose origin is the bottom-left corner of the
+ * surface, to window rectangles clipped to the surface.  Too many
+ * rectangles are merged into their bounding box.
+ *
+ * Returns the number of rectangles stored in rcs.
+ */
+static int
+dri2_minigui_rects_from_egl(struct dri2_egl_drv_surface *dri2_drv_surf,
+                            const EGLint *rects, EGLint n_rects, RECT *rcs)
+{
+   int height = dri2_drv_surf->base.base.Height;
+   RECT rc_surf, rc;
+   int n = 0;
+
+   SetRect(&rc_surf, 0, 0, dri2_drv_surf->base.base.Width, height);
+
+   for (int i = 0; i < n_rects; i++) {
+      const EGLint *rect = &rects[i * 4];
+
+      SetRect(&rc, rect[0], height - rect[1] - rect[3],
+               rect[0] + rect[2], height - rect[1]);
+      if (!IntersectRect(&rc, &rc, &rc_surf))
+         continue;
+
+      if (n_rects > MG_MAX_DAMAGE_RECTS && n > 0)
+         GetBoundRect(&rcs[0], &rcs[0], &rc);
+      else
+         rcs[n++] = rc;
+   }
+
+   return n;
+}
+
+/**
+ * Get the rectangles to update for an image put at (x, y, w, h): the
+ * damaged ones if the destination already holds the previous frame, the
+ * whole image else.
+ *
+ * Returns the number of rectangles stored in rcs.
+ */
+static int
+dri2_minigui_swrast_get_update_rects(struct dri2_egl_drv_surface *dri2_drv_surf,
+                                     bool has_previous,
+                                     int x, int y, int w, int h, RECT *rcs)
+{
+   RECT rc_put;
+   int n = 0;
+
+   if (w <= 0 || h <= 0)
+      return 0;
+
+   SetRect(&rc_put, x, y, x + w, y + h);
+   if (!has_previous || !dri2_drv_surf->has_damage) {
+      rcs[0] = rc_put;
+      return 1;
+   }
+
+   for (int i = 0; i < dri2_drv_surf->n_damage_rcs; i++) {
+      if (IntersectRect(&rcs[n], &dri2_drv_surf->damage_rcs[i], &rc_put))
+         n++;
+   }
+
+   return n;
+}
+
+/**
+ * Blit the rectangles of a memdc to the window.
+ */
 static void
-dri2_minigui_swrast_commit_backbuffer(struct dri2_egl_drv_surface *dri2_drv_surf)
+dri2_minigui_blit_rects(struct dri2_egl_drv_surface *dri2_drv_surf,
+                               HDC memdc, const RECT *rcs, int n_rcs)
+{
+   SelectClipRect(dri2_drv_surf->private_cdc, NULL);
+
+   /* note that BitBlt takes an empty rectangle for the whole surface */
+   for (int i = 0; i < n_rcs; i++) {
+      BitBlt(memdc, rcs[i].left, rcs[i].top, RECTW(rcs[i]), RECTH(rcs[i]),
+               dri2_drv_surf->private_cdc, rcs[i].left, rcs[i].top, 0);
+      dri2_drv_surf->frame_bytes_copied += (uint64_t)RECTH(rcs[i]) *
+         dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
+                                                   RECTW(rcs[i]), NULL);
+   }
+}
+
+static void
+dri2_minigui_swrast_commit_backbuffer(struct dri2_egl_drv_surface *dri2_drv_surf,
+                                 const RECT *rcs, int n_rcs)
 {
    dri2_drv_surf->current = dri2_drv_surf->back;
    dri2_drv_surf->back = NULL;
 
-   SelectClipRect(dri2_drv_surf->private_cdc, NULL);
-   BitBlt(dri2_drv_surf->current->memdc, 0, 0, 0, 0,
-            dri2_drv_surf->private_cdc, 0, 0, 0);
+   /* only the updated region changed on screen */
+   dri2_minigui_blit_rects(dri2_drv_surf,
+                                  dri2_drv_surf->current->memdc, rcs, n_rcs);
 
    dri2_minigui_release_buffer(dri2_drv_surf, dri2_drv_surf->current->memdc);
 }
@@ -576,16 +701,51 @@ dri2_minigui_swrast_get_drawable_info(__DRIdrawable * draw,
 {
    struct dri2_egl_drv_surface *dri2_drv_surf = loaderPrivate;
 
-   (void) swrast_update_buffers(dri2_drv_surf);
+   if (dri2_drv_surf->use_shm) {
+      /* the driver renders into its own images, no buffers needed here */
+      RECT rc_win;
+
+      GetClientRect(dri2_drv_surf->win, &rc_win);
+      if (dri2_drv_surf->base.base.Width != RECTW(rc_win) ||
+          dri2_drv_surf->base.base.Height != RECTH(rc_win)) {
+         /* the driver reallocates its images */
+         dri2_drv_surf->base.base.Width  = RECTW(rc_win);
+         dri2_drv_surf->base.base.Height = RECTH(rc_win);
+         dri2_drv_surf->swrast_age = 0;
+      }
+   }
+   else {
+      (void) swrast_update_buffers(dri2_drv_surf);
+   }
+
    *x = 0;
    *y = 0;
    *w = dri2_drv_surf->base.base.Width;
    *h = dri2_drv_surf->base.base.Height;
 }
 
+/**
+ * Release the memdc wrapping a shared memory image, then the mapping of the
+ * segment it wraps.
+ */
 static void
-dri2_minigui_swrast_get_image(__DRIdrawable * read,
-                         int x, int y, int w, int h,
+dri2_minigui_swrast_release_shm_image(struct dri2_egl_drv_surface *dri2_drv_surf,
+                                      int i)
+{
+   if (dri2_drv_surf->shm_front == &dri2_drv_surf->shm_images[i])
+      dri2_drv_surf->shm_front = NULL;
+
+   if (dri2_drv_surf->shm_images[i].memdc) {
+      dri2_minigui_destroy_memdc(dri2_drv_surf->shm_images[i].memdc);
+      shmdt(dri2_drv_surf->shm_images[i].shmaddr);
+      dri2_drv_surf->shm_images[i].memdc = NULL;
+      dri2_drv_surf->shm_images[i].shmaddr = NULL;
+   }
+}
+
+static void
+dri2_minigui_swrast_get_image2(__DRIdrawable * read,
+                         int x, int y, int w, int h, int stride,
                          char *data, void *loaderPrivate)
 {
    struct dri2_egl_drv_surface *dri2_drv_surf = loaderPrivate;
@@ -596,16 +756,25 @@ dri2_minigui_swrast_get_image(__DRIdrawable * read,
             x, NULL);
    int src_stride = dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
             dri2_surf->base.Width, NULL);
-   int dst_stride = copy_width;
+   int dst_stride = stride ? stride : copy_width;
    char *src, *dst;
 
-   src = dri2_minigui_swrast_get_frontbuffer_data(dri2_drv_surf);
+   if (dri2_drv_surf->use_shm && dri2_drv_surf->shm_front) {
+      src = dri2_drv_surf->shm_front->shmaddr;
+      src_stride = dri2_drv_surf->shm_front->stride;
+      if (h > dri2_drv_surf->shm_front->height - y)
+         h = dri2_drv_surf->shm_front->height - y;
+   }
+   else {
+      src = dri2_minigui_swrast_get_frontbuffer_data(dri2_drv_surf);
+   }
+
    if (!src) {
-      memset(data, 0, copy_width * h);
+      for (; h > 0; h--, data += dst_stride)
+         memset(data, 0, copy_width);
       return;
    }
 
-   assert(data != src);
    assert(copy_width <= src_stride);
 
    src += x_offset;
@@ -617,8 +786,85 @@ dri2_minigui_swrast_get_image(__DRIdrawable * read,
    if (h > dri2_surf->base.Height-y)
       h = dri2_surf->base.Height-y;
 
+   /* data may be the front image itself, when the driver reads it back
+    * into the same segment: the rows then only move toward its start,
+    * since dst_stride is at most src_stride */
+   assert(data <= src || data >= src + h * src_stride);
+
    for (; h>0; h--) {
-      memcpy(dst, src, copy_width);
+      memmove(dst, src, copy_width);
+      src += src_stride;
+      dst += dst_stride;
+      dri2_drv_surf->frame_bytes_copied += copy_width;
+   }
+}
+
+static void
+dri2_minigui_swrast_get_image(__DRIdrawable * read,
+                         int x, int y, int w, int h,
+                         char *data, void *loaderPrivate)
+{
+   dri2_minigui_swrast_get_image2(read, x, y, w, h, 0, data, loaderPrivate);
+}
+
+static void
+dri2_minigui_swrast_get_image_shm(__DRIdrawable * read,
+                             int x, int y, int w, int h,
+                             int shmid, void *loaderPrivate)
+{
+   struct dri2_egl_drv_surface *dri2_drv_surf = loaderPrivate;
+   int stride = dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
+            w, NULL);
+   char *shmaddr = NULL;
+   bool attached = false;
+   int i;
+
+   /* the rows are 32-bit aligned and start at the beginning of the segment,
+    * like XShmGetImage() lays them out */
+   stride = (stride + 3) & ~3;
+
+   /* even when the segment is the image presented last, which already
+    * holds the frame, the caller expects the rows at the stride above: they
+    * are then moved in place */
+   for (i = 0; i < ARRAY_SIZE(dri2_drv_surf->shm_images); i++) {
+      if (dri2_drv_surf->shm_images[i].memdc &&
+          dri2_drv_surf->shm_images[i].shmid == shmid) {
+         shmaddr = dri2_drv_surf->shm_images[i].shmaddr;
+         break;
+      }
+   }
+
+   if (!shmaddr) {
+      shmaddr = shmat(shmid, NULL, 0);
+      if (shmaddr == (char *)-1) {
+         _eglLog(_EGL_WARNING, "failed to attach shm image %d\n", shmid);
+         return;
+      }
+      attached = true;
+   }
+
+   dri2_minigui_swrast_get_image2(read, x, y, w, h, stride, shmaddr,
+                                  loaderPrivate);
+
+   if (attached)
+      shmdt(shmaddr);
+}
+
+/**
+ * Copy h rows of w bytes between two buffers.
+ */
+static void
+dri2_minigui_swrast_copy_rows(struct dri2_egl_drv_surface *dri2_drv_surf,
+                              char *dst, int dst_stride,
+                              const char *src, int src_stride, int w, int h)
+{
+   if (w <= 0 || h <= 0)
+      return;
+
+   dri2_drv_surf->frame_bytes_copied += (uint64_t)w * h;
+
+   for (; h > 0; h--) {
+      memcpy(dst, src, w);
       src += src_stride;
       dst += dst_stride;
    }
@@ -630,45 +876,191 @@ dri2_minigui_swrast_put_image2(__DRIdrawable * draw, int op,
                          char *data, void *loaderPrivate)
 {
    struct dri2_egl_drv_surface *dri2_drv_surf = loaderPrivate;
-   int copy_width = dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
-            w, NULL);
+   int cpp = dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
+            1, NULL);
    int dst_stride = dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
             dri2_drv_surf->base.base.Width, NULL);
-   int x_offset = dri2_minigui_swrast_get_stride_for_format(dri2_drv_surf->mg_format,
-            x, NULL);
-   char *src, *dst;
+   int width = dri2_drv_surf->base.base.Width;
+   int height = dri2_drv_surf->base.base.Height;
+   RECT rcs[MG_MAX_DAMAGE_RECTS];
+   int n_rcs;
+   char *dst, *front;
 
-   assert(copy_width <= stride);
+   assert(w * cpp <= stride);
+
+   if (dri2_drv_surf->use_shm) {
+      /* the driver could not get a shared memory image this time */
+      dri2_drv_surf->use_shm = false;
+      for (int i = 0; i < ARRAY_SIZE(dri2_drv_surf->shm_images); i++)
+         dri2_minigui_swrast_release_shm_image(dri2_drv_surf, i);
+   }
 
    (void) swrast_update_buffers(dri2_drv_surf);
    dst = dri2_minigui_swrast_get_backbuffer_data(dri2_drv_surf);
 
-   /* partial copy, copy old content */
-   if (copy_width < dst_stride) {
-      dri2_minigui_swrast_get_image(draw, 0, 0,
-                               dri2_drv_surf->base.base.Width,
-                               dri2_drv_surf->base.base.Height,
-                               dst, loaderPrivate);
+   /* drivers expect we do these checks (and some rely on it) */
+   if (w > width - x)
+      w = width - x;
+   if (h > height - y)
+      h = height - y;
+
+   /* only the damage has to be updated in a buffer holding the previous
+    * frame */
+   front = dri2_minigui_swrast_get_frontbuffer_data(dri2_drv_surf);
+   n_rcs = dri2_minigui_swrast_get_update_rects(dri2_drv_surf, front == dst,
+                                                x, y, w, h, rcs);
+
+   /* partial update into another buffer than the front one: bring over the
+    * old content around the updated region only */
+   if (front && front != dst && w > 0 && h > 0 &&
+       (w < width || h < height)) {
+      dri2_minigui_swrast_copy_rows(dri2_drv_surf, dst, dst_stride,
+                                    front, dst_stride, dst_stride, y);
+      dri2_minigui_swrast_copy_rows(dri2_drv_surf,
+                                    dst + (y + h) * dst_stride, dst_stride,
+                                    front + (y + h) * dst_stride, dst_stride,
+                                    dst_stride, height - y - h);
+      dri2_minigui_swrast_copy_rows(dri2_drv_surf,
+                                    dst + y * dst_stride, dst_stride,
+                                    front + y * dst_stride, dst_stride,
+                                    x * cpp, h);
+      dri2_minigui_swrast_copy_rows(dri2_drv_surf,
+                                    dst + y * dst_stride + (x + w) * cpp,
+                                    dst_stride,
+                                    front + y * dst_stride + (x + w) * cpp,
+                                    dst_stride, (width - x - w) * cpp, h);
+   }
+
+   for (int i = 0; i < n_rcs; i++) {
+      dri2_minigui_swrast_copy_rows(dri2_drv_surf,
+            dst + rcs[i].top * dst_stride + rcs[i].left * cpp, dst_stride,
+            data + (rcs[i].top - y) * stride + (rcs[i].left - x) * cpp, stride,
+            RECTW(rcs[i]) * cpp, RECTH(rcs[i]));
+   }
+
+   dri2_minigui_swrast_commit_backbuffer(dri2_drv_surf, rcs, n_rcs);
+}
+
+/**
+ * Find or create the memdc wrapping a shared memory image of the driver.
+ *
+ * The memdc wraps a mapping of the segment of its own rather than the one
+ * of the driver, which goes away with the image; the segment is only freed
+ * once both are detached, so a segment id cannot be reused while a memdc
+ * refers to it.
+ */
+static HDC
+dri2_minigui_swrast_get_shm_memdc(struct dri2_egl_drv_surface *dri2_drv_surf,
+                                  int shmid, int stride, int height)
+{
+   int visual_idx = dri2_minigui_visual_idx_from_fourcc(dri2_drv_surf->mg_format);
+   int bpp = dri2_mg_visuals[visual_idx].bpp;
+   char *shmaddr;
+   int i;
+
+   for (i = 0; i < ARRAY_SIZE(dri2_drv_surf->shm_images); i++) {
+      if (dri2_drv_surf->shm_images[i].memdc &&
+          dri2_drv_surf->shm_images[i].shmid == shmid &&
+          dri2_drv_surf->shm_images[i].stride == stride &&
+          dri2_drv_surf->shm_images[i].height >= height)
+         break;
    }
 
-   dst += x_offset;
-   dst += y * dst_stride;
+   if (i == ARRAY_SIZE(dri2_drv_surf->shm_images)) {
+      /* replace the slot not holding the front image */
+      i = 0;
+      if (dri2_drv_surf->shm_front == &dri2_drv_surf->shm_images[0])
+         i = 1;
+
+      dri2_minigui_swrast_release_shm_image(dri2_drv_surf, i);
+
+      shmaddr = shmat(shmid, NULL, 0);
+      if (shmaddr == (char *)-1)
+         return HDC_INVALID;
+
+      dri2_drv_surf->shm_images[i].memdc = CreateMemDCEx(stride / (bpp / 8),
+            height, bpp, MEMDC_FLAG_SWSURFACE,
+            dri2_mg_visuals[visual_idx].rgba_masks[0],
+            dri2_mg_visuals[visual_idx].rgba_masks[1],
+            dri2_mg_visuals[visual_idx].rgba_masks[2],
+            dri2_mg_visuals[visual_idx].rgba_masks[3],
+            shmaddr, stride);
+      if (dri2_drv_surf->shm_images[i].memdc == HDC_INVALID) {
+         dri2_drv_surf->shm_images[i].memdc = NULL;
+         shmdt(shmaddr);
+         return HDC_INVALID;
+      }
 
-   src = data;
+      dri2_drv_surf->shm_images[i].shmid = shmid;
+      dri2_drv_surf->shm_images[i].shmaddr = shmaddr;
+      dri2_drv_surf->shm_images[i].stride = stride;
+      dri2_drv_surf->shm_images[i].height = height;
 
-   /* drivers expect we do these checks (and some rely on it) */
-   if (copy_width > dst_stride-x_offset)
-      copy_width = dst_stride-x_offset;
-   if (h > dri2_drv_surf->base.base.Height-y)
-      h = dri2_drv_surf->base.base.Height-y;
+      _eglLog(_EGL_DEBUG, "a memdc created for shm image: shmid(%d), "
+               "stride(%d), height(%d)\n", shmid, stride, height);
+   }
 
-   for (; h>0; h--) {
-      memcpy(dst, src, copy_width);
-      src += stride;
-      dst += dst_stride;
+   dri2_drv_surf->shm_front = &dri2_drv_surf->shm_images[i];
+   return dri2_drv_surf->shm_images[i].memdc;
+}
+
+static void
+dri2_minigui_swrast_put_image_shm2(__DRIdrawable * draw, int op,
+                              int x, int y, int w, int h, int stride,
+                              int shmid, char *shmaddr, unsigned offset,
+                              void *loaderPrivate)
+{
+   struct dri2_egl_drv_surface *dri2_drv_surf = loaderPrivate;
+   RECT rcs[MG_MAX_DAMAGE_RECTS];
+   int n_rcs;
+   HDC memdc;
+
+   /* offset only moves to the first row, src and dst positions match */
+   assert(offset == (unsigned)y * stride);
+
+   if (!dri2_drv_surf->use_shm) {
+      /* the buffers of the copying path are not used anymore */
+      dri2_minigui_release_buffers(dri2_drv_surf);
+      dri2_drv_surf->back = NULL;
+      dri2_drv_surf->current = NULL;
+      dri2_drv_surf->use_shm = true;
+   }
+
+   memdc = dri2_minigui_swrast_get_shm_memdc(dri2_drv_surf, shmid,
+                                             stride, y + h);
+   if (memdc == HDC_INVALID) {
+      _eglLog(_EGL_WARNING, "failed to create memdc for shm image %d\n", shmid);
+      dri2_drv_surf->shm_front = NULL;
+      dri2_drv_surf->use_shm = false;
+      dri2_minigui_swrast_put_image2(draw, op, x, y, w, h, stride,
+                                     shmaddr + offset +
+                                     dri2_minigui_swrast_get_stride_for_format(
+                                          dri2_drv_surf->mg_format, x, NULL),
+                                     loaderPrivate);
+      return;
    }
 
-   dri2_minigui_swrast_commit_backbuffer(dri2_drv_surf);
+   if (w > dri2_drv_surf->base.base.Width - x)
+      w = dri2_drv_surf->base.base.Width - x;
+   if (h > dri2_drv_surf->base.base.Height - y)
+      h = dri2_drv_surf->base.base.Height - y;
+
+   /* the image of the driver always holds the whole frame */
+   n_rcs = dri2_minigui_swrast_get_update_rects(dri2_drv_surf, true,
+                                                x, y, w, h, rcs);
+   dri2_minigui_blit_rects(dri2_drv_surf, memdc, rcs, n_rcs);
+}
+
+static void
+dri2_minigui_swrast_put_image_shm(__DRIdrawable * draw, int op,
+                             int x, int y, int w, int h, int stride,
+                             int shmid, char *shmaddr, unsigned offset,
+                             void *loaderPrivate)
+{
+   /* the original version has the x offset folded into offset */
+   offset -= offset % stride;
+   dri2_minigui_swrast_put_image_shm2(draw, op, x, y, w, h, stride,
+                                      shmid, shmaddr, offset, loaderPrivate);
 }
 
 static void
@@ -967,6 +1359,16 @@ dri2_minigui_destroy_surface(_EGLDriver *drv, _EGLDisplay *disp, _EGLSurface *su
                 dri2_drv_surf->color_buffers[i].data_size);
    }
 
+   for (int i = 0; i < ARRAY_SIZE(dri2_drv_surf->shm_images); i++)
+      dri2_minigui_swrast_release_shm_image(dri2_drv_surf, i);
+
+   if (dri2_drv_surf->frame_count) {
+      _eglLog(_EGL_DEBUG, "%u frames presented, %" PRIu64 " bytes copied "
+               "(%" PRIu64 " per frame)\n", dri2_drv_surf->frame_count,
+               dri2_drv_surf->total_bytes_copied,
+               dri2_drv_surf->total_bytes_copied / dri2_drv_surf->frame_count);
+   }
+
    if (dri2_dpy->dri2)
       dri2_egl_surface_free_local_buffers(dri2_surf);
 
@@ -1541,22 +1943,49 @@ create_minigui_buffer(struct dri2_egl_drv_display *dri2_drv_dpy,
    return ret;
 }
 
-static EGLBoolean
-clip_minigui_buffer(struct dri2_egl_drv_surface *dri2_drv_surf,
-            const EGLint *rects, EGLint n_rects)
+/**
+ * Set the damage of the frame to present: the given rectangles, else the
+ * region set by eglSetDamageRegionKHR.  A presented buffer of age 0 may
+ * hold anything outside of the damage, so it is presented whole.
+ */
+static void
+dri2_minigui_set_frame_damage(struct dri2_egl_drv_surface *dri2_drv_surf,
+                              int age, const EGLint *rects, EGLint n_rects)
 {
-   assert(n_rects > 0);
+   dri2_drv_surf->has_damage = false;
 
-   SelectClipRect(dri2_drv_surf->private_cdc, NULL);
+   if (age > 0 && n_rects > 0) {
+      dri2_drv_surf->n_damage_rcs =
+         dri2_minigui_rects_from_egl(dri2_drv_surf, rects, n_rects,
+                                     dri2_drv_surf->damage_rcs);
+      dri2_drv_surf->has_damage = true;
+   }
+   else if (age > 0 && dri2_drv_surf->has_partial) {
+      memcpy(dri2_drv_surf->damage_rcs, dri2_drv_surf->partial_rcs,
+             sizeof(dri2_drv_surf->damage_rcs));
+      dri2_drv_surf->n_damage_rcs = dri2_drv_surf->n_partial_rcs;
+      dri2_drv_surf->has_damage = true;
+   }
 
-   for (int i = 0; i < n_rects; i++) {
-      const int *rect = &rects[i * 4];
-      RECT clip_rc = {rect[0], dri2_drv_surf->base.base.Height - rect[1] - rect[3]};
-      clip_rc.right = clip_rc.left + rect[2];
-      clip_rc.bottom = clip_rc.top + rect[3];
+   dri2_drv_surf->has_partial = false;
+}
 
-      IncludeClipRect(dri2_drv_surf->private_cdc, &clip_rc);
-   }
+/**
+ * Called via eglSetDamageRegionKHR(), drv->API.SetDamageRegion().
+ */
+static EGLBoolean
+dri2_minigui_set_damage_region(_EGLDriver *drv, _EGLDisplay *disp,
+                               _EGLSurface *surf,
+                               const EGLint *rects, EGLint n_rects)
+{
+   struct dri2_egl_drv_surface *dri2_drv_surf =
+        (struct dri2_egl_drv_surface *)dri2_egl_surface(surf);
+
+   /* no rectangles means the whole surface */
+   dri2_drv_surf->has_partial = n_rects > 0;
+   dri2_drv_surf->n_partial_rcs =
+      dri2_minigui_rects_from_egl(dri2_drv_surf, rects, n_rects,
+                                  dri2_drv_surf->partial_rcs);
 
    return EGL_TRUE;
 }
@@ -1577,16 +2006,20 @@ dri2_minigui_swap_buffers_with_damage(_EGLDriver *drv,
    struct dri2_egl_surface *dri2_surf = dri2_egl_surface(surf);
    struct dri2_egl_drv_surface *dri2_drv_surf =
         (struct dri2_egl_drv_surface *)dri2_surf;
-
-   for (int i = 0; i < ARRAY_SIZE(dri2_drv_surf->color_buffers); i++)
-      if (dri2_drv_surf->color_buffers[i].age > 0)
-         dri2_drv_surf->color_buffers[i].age++;
+   RECT rc_surf;
 
    /* Make sure we have a back buffer in case we're swapping without ever
     * rendering. */
    if (update_buffers_if_needed(dri2_drv_surf) < 0)
       return _eglError(EGL_BAD_ALLOC, "dri2_swap_buffers");
 
+   dri2_minigui_set_frame_damage(dri2_drv_surf, dri2_drv_surf->back->age,
+                                 rects, n_rects);
+
+   for (int i = 0; i < ARRAY_SIZE(dri2_drv_surf->color_buffers); i++)
+      if (dri2_drv_surf->color_buffers[i].age > 0)
+         dri2_drv_surf->color_buffers[i].age++;
+
    dri2_drv_surf->back->age = 1;
    dri2_drv_surf->current = dri2_drv_surf->back;
    dri2_drv_surf->back = NULL;
@@ -1605,10 +2038,6 @@ dri2_minigui_swap_buffers_with_damage(_EGLDriver *drv,
       dri2_drv_surf->current->release = false;
    }
 
-   if (n_rects > 0 && rects) {
-      clip_minigui_buffer(dri2_drv_surf, rects, n_rects);
-   }
-
 #if 0 // VW
    if (dri2_dpy->is_different_gpu) {
       _EGLContext *ctx = _eglGetCurrentContext();
@@ -1627,8 +2056,19 @@ dri2_minigui_swap_buffers_with_damage(_EGLDriver *drv,
    if (dri2_dpy->flush)
       dri2_dpy->flush->invalidate(dri2_surf->dri_drawable);
 
-   BitBlt(dri2_drv_surf->current->memdc, 0, 0, 0, 0,
-            dri2_drv_surf->private_cdc, 0, 0, 0);
+   /* only the damage changed on screen */
+   if (dri2_drv_surf->has_damage) {
+      dri2_minigui_blit_rects(dri2_drv_surf, dri2_drv_surf->current->memdc,
+                              dri2_drv_surf->damage_rcs,
+                              dri2_drv_surf->n_damage_rcs);
+   }
+   else {
+      SetRect(&rc_surf, 0, 0, dri2_drv_surf->base.base.Width,
+               dri2_drv_surf->base.base.Height);
+      dri2_minigui_blit_rects(dri2_drv_surf, dri2_drv_surf->current->memdc,
+                              &rc_surf, 1);
+   }
+   dri2_drv_surf->has_damage = false;
 
    dri2_minigui_release_buffer(dri2_drv_surf, dri2_drv_surf->current->memdc);
 
@@ -1641,23 +2081,84 @@ dri2_minigui_swap_buffers(_EGLDriver *drv, _EGLDisplay *disp, _EGLSurface *surf)
    return dri2_minigui_swap_buffers_with_damage(drv, disp, surf, NULL, 0);
 }
 
+static EGLint
+dri2_minigui_query_buffer_age(_EGLDriver *drv,
+                              _EGLDisplay *disp, _EGLSurface *surf)
+{
+   struct dri2_egl_drv_surface *dri2_drv_surf =
+        (struct dri2_egl_drv_surface *)dri2_egl_surface(surf);
+
+   if (!dri2_drv_surf->win)
+      return 0;
+
+   if (update_buffers_if_needed(dri2_drv_surf) < 0) {
+      _eglError(EGL_BAD_ALLOC, "dri2_query_buffer_age");
+      return -1;
+   }
+
+   return dri2_drv_surf->back->age;
+}
+
 static EGLBoolean
-dri2_minigui_swrast_swap_buffers(_EGLDriver *drv, _EGLDisplay *disp,
-        _EGLSurface *surf)
+dri2_minigui_swrast_swap_buffers_with_damage(_EGLDriver *drv,
+                                        _EGLDisplay *disp,
+                                        _EGLSurface *surf,
+                                        const EGLint *rects,
+                                        EGLint n_rects)
 {
    struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
    struct dri2_egl_surface *dri2_surf = dri2_egl_surface(surf);
+   struct dri2_egl_drv_surface *dri2_drv_surf =
+        (struct dri2_egl_drv_surface *)dri2_surf;
+
+   /* the driver puts the whole image, the loader presents the damage */
+   dri2_minigui_set_frame_damage(dri2_drv_surf, dri2_drv_surf->swrast_age,
+                                 rects, n_rects);
+   dri2_drv_surf->frame_bytes_copied = 0;
 
    dri2_dpy->core->swapBuffers(dri2_surf->dri_drawable);
 
-#if 0
-   if (dri2_drv_surf->win)
-      return dri2_minigui_swap_buffers_with_damage(drv, disp, surf, NULL, 0);
-#endif
+   dri2_drv_surf->has_damage = false;
+   dri2_drv_surf->swrast_age = 1;
+
+   /* report the presentation cost, EGL_LOG_LEVEL=debug to see it */
+   dri2_drv_surf->total_bytes_copied += dri2_drv_surf->frame_bytes_copied;
+   dri2_drv_surf->frame_count++;
+   _eglLog(_EGL_DEBUG, "frame %u: %" PRIu64 " bytes copied%s\n",
+            dri2_drv_surf->frame_count, dri2_drv_surf->frame_bytes_copied,
+            dri2_drv_surf->use_shm ? " (shm)" : "");
 
    return EGL_TRUE;
 }
 
+static EGLBoolean
+dri2_minigui_swrast_swap_buffers(_EGLDriver *drv, _EGLDisplay *disp,
+        _EGLSurface *surf)
+{
+   return dri2_minigui_swrast_swap_buffers_with_damage(drv, disp, surf,
+                                                       NULL, 0);
+}
+
+static EGLint
+dri2_minigui_swrast_query_buffer_age(_EGLDriver *drv,
+                                     _EGLDisplay *disp, _EGLSurface *surf)
+{
+   struct dri2_egl_drv_surface *dri2_drv_surf =
+        (struct dri2_egl_drv_surface *)dri2_egl_surface(surf);
+   RECT rc_win;
+
+   if (!dri2_drv_surf->win)
+      return 0;
+
+   /* the driver reallocates its images on the next frame */
+   GetClientRect(dri2_drv_surf->win, &rc_win);
+   if (dri2_drv_surf->base.base.Width != RECTW(rc_win) ||
+       dri2_drv_surf->base.base.Height != RECTH(rc_win))
+      return 0;
+
+   return dri2_drv_surf->swrast_age;
+}
+
 static _EGLImage *
 dri2_create_image_khr_pixmap(_EGLDisplay *disp, _EGLContext *ctx,
               EGLClientBuffer buffer, const EGLint *attr_list)
@@ -1726,11 +2227,12 @@ static const struct dri2_egl_display_vtbl dri2_minigui_swrast_display_vtbl = {
    .destroy_surface = dri2_minigui_destroy_surface,
    .create_image = dri2_create_image_khr,
    .swap_buffers = dri2_minigui_swrast_swap_buffers,
-   .swap_buffers_with_damage = dri2_fallback_swap_buffers_with_damage,
+   .swap_buffers_with_damage = dri2_minigui_swrast_swap_buffers_with_damage,
    .swap_buffers_region = dri2_fallback_swap_buffers_region,
+   .set_damage_region = dri2_minigui_set_damage_region,
    .post_sub_buffer = dri2_fallback_post_sub_buffer,
    .copy_buffers = dri2_fallback_copy_buffers,
-   .query_buffer_age = dri2_fallback_query_buffer_age,
+   .query_buffer_age = dri2_minigui_swrast_query_buffer_age,
    .create_wayland_buffer_from_image = dri2_fallback_create_wayland_buffer_from_image,
    .get_sync_values = dri2_fallback_get_sync_values,
    .get_dri_drawable = dri2_surface_get_dri_drawable,
@@ -1746,21 +2248,26 @@ static const struct dri2_egl_display_vtbl dri2_minigui_drm_display_vtbl = {
    .swap_buffers = dri2_minigui_swap_buffers,
    .swap_buffers_with_damage = dri2_minigui_swap_buffers_with_damage,
    .swap_buffers_region = dri2_fallback_swap_buffers_region,
+   .set_damage_region = dri2_minigui_set_damage_region,
    .post_sub_buffer = dri2_fallback_post_sub_buffer,
    .copy_buffers = dri2_fallback_copy_buffers,
-   .query_buffer_age = dri2_fallback_query_buffer_age,
+   .query_buffer_age = dri2_minigui_query_buffer_age,
    .create_wayland_buffer_from_image = dri2_fallback_create_wayland_buffer_from_image,
    .get_sync_values = dri2_fallback_get_sync_values,
    .get_dri_drawable = dri2_surface_get_dri_drawable,
 };
 
 static const __DRIswrastLoaderExtension swrast_loader_extension = {
-   .base = { __DRI_SWRAST_LOADER, 2 },
+   .base = { __DRI_SWRAST_LOADER, 5 },
 
    .getDrawableInfo = dri2_minigui_swrast_get_drawable_info,
    .putImage        = dri2_minigui_swrast_put_image,
    .getImage        = dri2_minigui_swrast_get_image,
    .putImage2       = dri2_minigui_swrast_put_image2,
+   .getImage2       = dri2_minigui_swrast_get_image2,
+   .putImageShm     = dri2_minigui_swrast_put_image_shm,
+   .getImageShm     = dri2_minigui_swrast_get_image_shm,
+   .putImageShm2    = dri2_minigui_swrast_put_image_shm2,
 };
 
 static const __DRIextension *swrast_loader_extensions[] = {
@@ -1833,6 +2340,10 @@ dri2_initialize_minigui_swrast(_EGLDriver *drv, _EGLDisplay *disp)
          goto cleanup;
    }
 
+   disp->Extensions.EXT_buffer_age = EGL_TRUE;
+   disp->Extensions.EXT_swap_buffers_with_damage = EGL_TRUE;
+   disp->Extensions.KHR_partial_update = EGL_TRUE;
+
    /* Fill vtbl last to prevent accidentally calling virtual function during
     * initialization.
     */
@@ -2055,6 +2566,7 @@ dri2_initialize_minigui_dri2(_EGLDriver *drv, _EGLDisplay *disp)
 
    disp->Extensions.EXT_buffer_age = EGL_TRUE;
    disp->Extensions.EXT_swap_buffers_with_damage = EGL_TRUE;
+   disp->Extensions.KHR_partial_update = EGL_TRUE;
 
    /* Fill vtbl last to prevent accidentally calling virtual function during
     * initialization.
@@ -30,8 +30,11 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
 
 #include "tgsi/tgsi_parse.h"
+#include "nir/nir_to_tgsi_info.h"
 
 #include "draw_fs.h"
 #include "draw_private.h"
@@ -47,7 +50,16 @@ draw_create_fragment_shader(struct draw_context *draw,
    dfs = CALLOC_STRUCT(draw_fragment_shader);
    if (dfs) {
       dfs->base = *shader;
-      tgsi_scan_shader(shader->tokens, &dfs->info);
+      if (shader->type == PIPE_SHADER_IR_NIR) {
+         struct pipe_screen *screen = draw->pipe->screen;
+
+         nir_tgsi_scan_shader(shader->ir.nir,
+                              screen->get_param(screen,
+                                                PIPE_CAP_TGSI_TEXCOORD),
+                              &dfs->info);
+      } else {
+         tgsi_scan_shader(shader->tokens, &dfs->info);
+      }
    }
 
    return dfs;
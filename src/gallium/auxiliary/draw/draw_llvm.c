@@ -53,6 +53,9 @@
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
 
+#include "tgsi/tgsi_parse.h"
+
+#include "util/mesa-sha1.h"
 #include "util/u_math.h"
 #include "util/u_pointer.h"
 #include "util/u_string.h"
@@ -555,6 +558,36 @@ draw_llvm_destroy(struct draw_llvm *llvm)
 }
 
 
+/**
+ * Look a variant up in the machine code cache of the driver, if any.
+ * \return whether the compiled variant should be inserted into the cache
+ */
+static bool
+draw_llvm_find_cached_variant(struct draw_llvm *llvm,
+                              const struct tgsi_token *tokens,
+                              const void *key, unsigned key_size,
+                              unsigned num_vertex_attribs,
+                              struct lp_cached_code *cached,
+                              unsigned char ir_sha1_cache_key[20])
+{
+   struct mesa_sha1 ctx;
+
+   if (!llvm->draw->disk_cache_find_shader)
+      return false;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, key, key_size);
+   _mesa_sha1_update(&ctx, &num_vertex_attribs, sizeof(num_vertex_attribs));
+   _mesa_sha1_update(&ctx, tokens,
+                     tgsi_num_tokens(tokens) * sizeof(struct tgsi_token));
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+
+   llvm->draw->disk_cache_find_shader(llvm->draw->disk_cache_cookie,
+                                      cached, ir_sha1_cache_key);
+   return !cached->data_size;
+}
+
+
 /**
  * Create LLVM-generated code for a vertex shader.
  */
@@ -568,6 +601,9 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
       llvm_vertex_shader(llvm->draw->vs.vertex_shader);
    LLVMTypeRef vertex_header;
    char module_name[64];
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching;
 
    variant = MALLOC(sizeof *variant +
                     shader->variant_key_size -
@@ -581,7 +617,15 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    snprintf(module_name, sizeof(module_name), "draw_llvm_vs_variant%u",
             variant->shader->variants_cached);
 
-   variant->gallivm = gallivm_create(module_name, llvm->context);
+   needs_caching =
+      draw_llvm_find_cached_variant(llvm, shader->base.state.tokens,
+                                    key, shader->variant_key_size, num_inputs,
+                                    &cached, ir_sha1_cache_key);
+
+   /* Without a disk cache there's no use for a copy of the machine code. */
+   variant->gallivm = gallivm_create(module_name, llvm->context,
+                                     llvm->draw->disk_cache_find_shader ?
+                                     &cached : NULL);
 
    create_jit_types(variant);
 
@@ -603,7 +647,11 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    variant->jit_func = (draw_jit_vert_func)
          gallivm_jit_function(variant->gallivm, variant->function);
 
+   if (needs_caching && cached.data_size)
+      llvm->draw->disk_cache_insert_shader(llvm->draw->disk_cache_cookie,
+                                           &cached, ir_sha1_cache_key);
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -1600,8 +1648,10 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
 
    memset(&system_values, 0, sizeof(system_values));
 
-   snprintf(func_name, sizeof(func_name), "draw_llvm_vs_variant%u",
-            variant->shader->variants_cached);
+   /* The name must not depend on the order the variants are created in,
+    * for the machine code cache.
+    */
+   snprintf(func_name, sizeof(func_name), "draw_llvm_vs_variant");
 
    i = 0;
    arg_types[i++] = get_context_ptr_type(variant);       /* context */
@@ -2287,8 +2337,7 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
 
    memset(&system_values, 0, sizeof(system_values));
 
-   snprintf(func_name, sizeof(func_name), "draw_llvm_gs_variant%u",
-            variant->shader->variants_cached);
+   snprintf(func_name, sizeof(func_name), "draw_llvm_gs_variant");
 
    assert(variant->vertex_header_ptr_type);
 
@@ -2420,6 +2469,9 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
       llvm_geometry_shader(llvm->draw->gs.geometry_shader);
    LLVMTypeRef vertex_header;
    char module_name[64];
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching;
 
    variant = MALLOC(sizeof *variant +
                     shader->variant_key_size -
@@ -2433,7 +2485,14 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
    snprintf(module_name, sizeof(module_name), "draw_llvm_gs_variant%u",
             variant->shader->variants_cached);
 
-   variant->gallivm = gallivm_create(module_name, llvm->context);
+   needs_caching =
+      draw_llvm_find_cached_variant(llvm, shader->base.state.tokens,
+                                    key, shader->variant_key_size, num_outputs,
+                                    &cached, ir_sha1_cache_key);
+
+   variant->gallivm = gallivm_create(module_name, llvm->context,
+                                     llvm->draw->disk_cache_find_shader ?
+                                     &cached : NULL);
 
    create_gs_jit_types(variant);
 
@@ -2450,7 +2509,11 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
    variant->jit_func = (draw_gs_jit_func)
          gallivm_jit_function(variant->gallivm, variant->function);
 
+   if (needs_caching && cached.data_size)
+      llvm->draw->disk_cache_insert_shader(llvm->draw->disk_cache_cookie,
+                                           &cached, ir_sha1_cache_key);
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
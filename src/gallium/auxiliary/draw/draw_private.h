@@ -45,6 +45,8 @@
 #include "pipe/p_defines.h"
 
 #include "tgsi/tgsi_scan.h"
+#include "util/u_queue.h"
+#include "util/os_time.h"
 
 #ifdef HAVE_LLVM
 struct gallivm_state;
@@ -68,6 +70,7 @@ struct tgsi_exec_machine;
 struct tgsi_sampler;
 struct tgsi_image;
 struct tgsi_buffer;
+struct lp_cached_code;
 struct draw_pt_front_end;
 struct draw_assembler;
 struct draw_llvm;
@@ -105,6 +108,31 @@ struct vertex_header {
 /* maximum number of shader variants we can cache */
 #define DRAW_MAX_SHADER_VARIANTS 512
 
+/* maximum number of threads helping to shade the vertices of a segment */
+#define DRAW_MAX_VS_THREADS 15
+
+
+/**
+ * Time spent in each stage of the middle end, in nanoseconds, collected
+ * when DRAW_TIMINGS is set and printed when the context is destroyed.
+ */
+struct draw_timings
+{
+   uint64_t fetch_shade;
+   uint64_t gs;         /**< geometry shader or primitive assembler */
+   uint64_t so;         /**< stream output */
+   uint64_t post_vs;    /**< cliptest after the geometry shader */
+   uint64_t pipeline;
+   uint64_t emit;
+   unsigned segments;
+   unsigned parallel_segments;  /**< segments shaded by several threads */
+
+   /* indexed segments going through the vsplit vertex cache */
+   uint64_t cache_fetches;  /**< vertices shaded */
+   uint64_t cache_elts;     /**< indices looked up */
+   uint64_t cache_prims;    /**< primitives decomposed from the indices */
+};
+
 /**
  * Private context for the drawing module.
  */
@@ -218,6 +246,12 @@ struct draw_context
 
       boolean test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       boolean no_fse;           /* disable FSE even when it is correct */
+
+      /** Threads shading parts of large segments along with the calling
+       * thread, created on first use.  See DRAW_THREADS.
+       */
+      struct util_queue vs_queue;
+      unsigned num_vs_threads;
    } pt;
 
    struct {
@@ -332,6 +366,15 @@ struct draw_context
 
    struct draw_llvm *llvm;
 
+   /** Machine code cache of the driver for the LLVM shader variants */
+   void *disk_cache_cookie;
+   void (*disk_cache_find_shader)(void *cookie,
+                                  struct lp_cached_code *cache,
+                                  unsigned char ir_sha1_cache_key[20]);
+   void (*disk_cache_insert_shader)(void *cookie,
+                                    struct lp_cached_code *cache,
+                                    unsigned char ir_sha1_cache_key[20]);
+
    /** Texture sampler and sampler view state.
     * Note that we have arrays indexed by shader type.  At this time
     * we only handle vertex and geometry shaders in the draw module, but
@@ -345,6 +388,9 @@ struct draw_context
    struct pipe_query_data_pipeline_statistics statistics;
    boolean collect_statistics;
 
+   struct draw_timings timings;
+   boolean collect_timings;
+
    struct draw_assembler *ia;
 
    void *driver_private;
@@ -429,6 +475,23 @@ boolean draw_pt_init( struct draw_context *draw );
 void draw_pt_destroy( struct draw_context *draw );
 void draw_pt_reset_vertex_ids( struct draw_context *draw );
 void draw_pt_flush( struct draw_context *draw, unsigned flags );
+boolean draw_pt_init_vs_queue( struct draw_context *draw );
+
+
+/**
+ * Add the time since *start to a stage of draw_context::timings, and
+ * start timing the next stage.
+ */
+static inline void
+draw_timings_end_stage(struct draw_context *draw, uint64_t *stage,
+                       int64_t *start)
+{
+   if (draw->collect_timings) {
+      int64_t now = os_time_get_nano();
+      *stage += now - *start;
+      *start = now;
+   }
+}
 
 
 /*******************************************************************************
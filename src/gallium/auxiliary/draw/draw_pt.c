@@ -37,6 +37,7 @@
 #include "draw/draw_vbuf.h"
 #include "draw/draw_vs.h"
 #include "tgsi/tgsi_dump.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 #include "util/u_prim.h"
 #include "util/u_format.h"
@@ -45,6 +46,7 @@
 
 DEBUG_GET_ONCE_BOOL_OPTION(draw_fse, "DRAW_FSE", FALSE)
 DEBUG_GET_ONCE_BOOL_OPTION(draw_no_fse, "DRAW_NO_FSE", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(draw_timings, "DRAW_TIMINGS", FALSE)
 
 /* Overall we split things into:
  *     - frontend -- prepare fetch_elts, draw_elts - eg vsplit
@@ -174,6 +176,14 @@ boolean draw_pt_init( struct draw_context *draw )
 {
    draw->pt.test_fse = debug_get_option_draw_fse();
    draw->pt.no_fse = debug_get_option_draw_no_fse();
+   draw->collect_timings = debug_get_option_draw_timings();
+
+   draw->pt.num_vs_threads =
+      debug_get_num_option("DRAW_THREADS",
+                           MIN2(util_cpu_caps.nr_cpus - 1,
+                                DRAW_MAX_VS_THREADS));
+   draw->pt.num_vs_threads = MIN2(draw->pt.num_vs_threads,
+                                  DRAW_MAX_VS_THREADS);
 
    draw->pt.front.vsplit = draw_pt_vsplit(draw);
    if (!draw->pt.front.vsplit)
@@ -200,8 +210,59 @@ boolean draw_pt_init( struct draw_context *draw )
 }
 
 
+/**
+ * Start the threads of draw_context::pt.vs_queue, if not done yet.
+ * Returns FALSE if there are none to help shading.
+ */
+boolean draw_pt_init_vs_queue( struct draw_context *draw )
+{
+   if (!draw->pt.num_vs_threads)
+      return FALSE;
+
+   if (!util_queue_is_initialized(&draw->pt.vs_queue) &&
+       !util_queue_init(&draw->pt.vs_queue, "draw_vs", 32,
+                        draw->pt.num_vs_threads,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+      draw->pt.num_vs_threads = 0;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static void
+draw_pt_print_timings( const struct draw_context *draw )
+{
+   const struct draw_timings *t = &draw->timings;
+
+   debug_printf("draw: segments:          %9u (%u shaded in parallel)\n",
+                t->segments, t->parallel_segments);
+   debug_printf("draw: fetch and shade:   %9.3f ms\n", t->fetch_shade / 1e6);
+   debug_printf("draw: gs or assembly:    %9.3f ms\n", t->gs / 1e6);
+   debug_printf("draw: stream output:     %9.3f ms\n", t->so / 1e6);
+   debug_printf("draw: post gs cliptest:  %9.3f ms\n", t->post_vs / 1e6);
+   debug_printf("draw: pipeline:          %9.3f ms\n", t->pipeline / 1e6);
+   debug_printf("draw: emit:              %9.3f ms\n", t->emit / 1e6);
+
+   /* average cache miss ratio, vertices shaded per primitive */
+   if (t->cache_prims) {
+      debug_printf("draw: vertex cache:      %9.3f acmr, %.1f%% hits\n",
+                   (double) t->cache_fetches / t->cache_prims,
+                   100.0 * (t->cache_elts - t->cache_fetches) /
+                   t->cache_elts);
+   }
+}
+
+
 void draw_pt_destroy( struct draw_context *draw )
 {
+   if (util_queue_is_initialized(&draw->pt.vs_queue))
+      util_queue_destroy(&draw->pt.vs_queue);
+
+   if (draw->collect_timings)
+      draw_pt_print_timings(draw);
+
    if (draw->pt.middle.llvm) {
       draw->pt.middle.llvm->destroy( draw->pt.middle.llvm );
       draw->pt.middle.llvm = NULL;
@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
@@ -40,6 +41,34 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/* Segments are shaded by several threads in parts of at least this many
+ * vertices, aligned so that the vectors written by the shader of one part
+ * never overlap the next part.
+ *
+ * Handing a part to another thread costs about 3us, and a simple vertex
+ * shader about 3ns per vertex, so smaller parts are faster shaded by the
+ * calling thread.  This leaves the indexed segments of vsplit, of at most
+ * 1024 vertices, to the calling thread, and splits the larger linear ones.
+ */
+#define LLVM_VS_JOB_MIN_VERTICES 1024
+#define LLVM_VS_JOB_ALIGN 64
+
+
+/**
+ * Fetch and shade a part of a segment, see llvm_middle_end_shade().
+ */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned vid_base;
+   const unsigned *elts;
+   boolean clipped;
+   struct util_queue_fence fence;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -57,6 +86,8 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   struct llvm_vs_job vs_jobs[DRAW_MAX_VS_THREADS + 1];
 };
 
 
@@ -364,6 +395,113 @@ emit(struct pt_emit *emit,
 }
 
 
+static void
+llvm_vs_job_run(struct llvm_vs_job *job)
+{
+   struct llvm_middle_end *fpme = job->fpme;
+   struct draw_context *draw = fpme->draw;
+
+   job->clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                                  job->verts,
+                                                  draw->pt.user.vbuffer,
+                                                  job->count,
+                                                  job->start_or_maxelt,
+                                                  fpme->vertex_size,
+                                                  draw->pt.vertex_buffer,
+                                                  draw->instance_id,
+                                                  job->vid_base,
+                                                  draw->start_instance,
+                                                  job->elts);
+}
+
+
+static void
+llvm_vs_job_execute(void *data, int thread_index)
+{
+   /* Same floating point environment as the thread running draw_vbo() */
+   unsigned fpstate = util_fpstate_get();
+   util_fpstate_set_denorms_to_zero(fpstate);
+
+   llvm_vs_job_run((struct llvm_vs_job *)data);
+
+   util_fpstate_set(fpstate);
+}
+
+
+/**
+ * Run the fetch and vertex shader code on the vertices of a segment.
+ * Large segments are split in parts shaded concurrently by the threads of
+ * draw_context::pt.vs_queue and this thread, so the vertices are still
+ * output in order for the later stages.
+ * Returns whether any vertex needs clipping.
+ */
+static boolean
+llvm_middle_end_shade(struct llvm_middle_end *fpme,
+                      struct vertex_header *verts,
+                      unsigned count,
+                      unsigned start_or_maxelt,
+                      unsigned vid_base,
+                      const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+   unsigned num_jobs, per_job, first, i;
+   boolean clipped;
+
+   num_jobs = MIN2(draw->pt.num_vs_threads + 1,
+                   count / LLVM_VS_JOB_MIN_VERTICES);
+
+   if (num_jobs < 2 || !draw_pt_init_vs_queue(draw)) {
+      struct llvm_vs_job *job = &fpme->vs_jobs[0];
+
+      job->verts = verts;
+      job->count = count;
+      job->start_or_maxelt = start_or_maxelt;
+      job->vid_base = vid_base;
+      job->elts = elts;
+      llvm_vs_job_run(job);
+      return job->clipped;
+   }
+
+   per_job = align(DIV_ROUND_UP(count, num_jobs), LLVM_VS_JOB_ALIGN);
+
+   for (i = 0, first = 0; first < count; i++, first += per_job) {
+      struct llvm_vs_job *job = &fpme->vs_jobs[i];
+
+      job->verts = (struct vertex_header *)
+         ((char *)verts + first * fpme->vertex_size);
+      job->count = MIN2(per_job, count - first);
+      job->vid_base = vid_base;
+      if (elts) {
+         job->start_or_maxelt = start_or_maxelt;
+         job->elts = elts + first;
+      }
+      else {
+         job->start_or_maxelt = start_or_maxelt + first;
+         job->elts = NULL;
+      }
+
+      if (i > 0) {
+         util_queue_add_job(&draw->pt.vs_queue, job, &job->fence,
+                            llvm_vs_job_execute, NULL);
+      }
+   }
+   num_jobs = i;
+
+   llvm_vs_job_run(&fpme->vs_jobs[0]);
+   clipped = fpme->vs_jobs[0].clipped;
+
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&fpme->vs_jobs[i].fence);
+      clipped |= fpme->vs_jobs[i].clipped;
+   }
+
+   if (draw->collect_timings)
+      draw->timings.parallel_segments++;
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -384,6 +522,12 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    boolean clipped = 0;
    unsigned start_or_maxelt, vid_base;
    const unsigned *elts;
+   int64_t time = 0;
+
+   if (draw->collect_timings) {
+      time = os_time_get_nano();
+      draw->timings.segments++;
+   }
 
    assert(fetch_info->count > 0);
    llvm_vert_info.count = fetch_info->count;
@@ -414,22 +558,15 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts);
+   clipped = llvm_middle_end_shade(fpme, llvm_vert_info.verts,
+                                   fetch_info->count, start_or_maxelt,
+                                   vid_base, elts);
 
    /* Finished with fetch and vs:
     */
    fetch_info = NULL;
    vert_info = &llvm_vert_info;
+   draw_timings_end_stage(draw, &draw->timings.fetch_shade, &time);
 
    if ((opt & PT_SHADE) && gshader) {
       struct draw_vertex_shader *vshader = draw->vs.vertex_shader;
@@ -467,6 +604,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
          }
       }
    }
+   draw_timings_end_stage(draw, &draw->timings.gs, &time);
+
    if (prim_info->count == 0) {
       debug_printf("GS/IA didn't emit any vertices!\n");
 
@@ -479,6 +618,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 
    /* stream output needs to be done before clipping */
    draw_pt_so_emit( fpme->so_emit, 1, vert_info, prim_info );
+   draw_timings_end_stage(draw, &draw->timings.so, &time);
 
    draw_stats_clipper_primitives(draw, prim_info);
 
@@ -490,6 +630,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       if ((opt & PT_SHADE) && (gshader ||
                                draw->vs.vertex_shader->info.writes_viewport_index)) {
          clipped = draw_pt_post_vs_run( fpme->post_vs, vert_info, prim_info );
+         draw_timings_end_stage(draw, &draw->timings.post_vs, &time);
       }
       /* "clipped" also includes non-one edgeflag */
       if (clipped) {
@@ -500,9 +641,11 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
        */
       if (opt & PT_PIPELINE) {
          pipeline( fpme, vert_info, prim_info );
+         draw_timings_end_stage(draw, &draw->timings.pipeline, &time);
       }
       else {
          emit( fpme->emit, vert_info, prim_info );
+         draw_timings_end_stage(draw, &draw->timings.emit, &time);
       }
    }
    FREE(vert_info->verts);
@@ -623,6 +766,10 @@ static void
 llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(fpme->vs_jobs); i++)
+      util_queue_fence_destroy(&fpme->vs_jobs[i].fence);
 
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
@@ -644,6 +791,7 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   unsigned i;
 
    if (!draw->llvm)
       return NULL;
@@ -652,6 +800,11 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    if (!fpme)
       goto fail;
 
+   for (i = 0; i < ARRAY_SIZE(fpme->vs_jobs); i++) {
+      fpme->vs_jobs[i].fpme = fpme;
+      util_queue_fence_init(&fpme->vs_jobs[i].fence);
+   }
+
    fpme->base.prepare         = llvm_middle_end_prepare;
    fpme->base.bind_parameters = llvm_middle_end_bind_parameters;
    fpme->base.run             = llvm_middle_end_run;
@@ -25,13 +25,21 @@
 
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_prim.h"
 
 #include "draw/draw_context.h"
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
 #define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+
+/*
+ * The cache is an open-addressed hash table holding every fetch element of
+ * the current segment.  It is kept at most half full so that probe
+ * sequences stay short.
+ */
+#define CACHE_ORDER  11
+#define CACHE_SIZE   (1 << CACHE_ORDER)
 
 /* The largest possible index within an index buffer */
 #define MAX_ELT_IDX 0xffffffff
@@ -54,9 +62,11 @@ struct vsplit_frontend {
 
    struct {
       /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      unsigned fetches[CACHE_SIZE];
+      ushort draws[CACHE_SIZE];
+      /* an entry is valid only when its stamp matches the segment's */
+      unsigned stamps[CACHE_SIZE];
+      unsigned stamp;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
@@ -67,8 +77,11 @@ struct vsplit_frontend {
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   /* invalidate all entries at once, unless the stamp wraps around */
+   if (++vsplit->cache.stamp == 0) {
+      memset(vsplit->cache.stamps, 0, sizeof(vsplit->cache.stamps));
+      vsplit->cache.stamp = 1;
+   }
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -76,25 +89,41 @@ vsplit_clear_cache(struct vsplit_frontend *vsplit)
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   struct draw_context *draw = vsplit->draw;
+
+   if (draw->collect_timings) {
+      draw->timings.cache_fetches += vsplit->cache.num_fetch_elts;
+      draw->timings.cache_elts += vsplit->cache.num_draw_elts;
+      draw->timings.cache_prims +=
+         u_decomposed_prims_for_vertices(vsplit->prim,
+                                         vsplit->cache.num_draw_elts);
+   }
+
    vsplit->middle->run(vsplit->middle,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
 }
 
 /**
- * Add a fetch element and add it to the draw elements.
+ * Add a fetch element and add it to the draw elements.  A fetch element is
+ * only shaded once per segment, however far apart its uses are.
  */
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch)
 {
+   const unsigned stamp = vsplit->cache.stamp;
    unsigned hash;
 
-   hash = fetch % MAP_SIZE;
+   /* Fibonacci hashing spreads both sequential and strided indices */
+   hash = (fetch * 2654435761u) >> (32 - CACHE_ORDER);
+
+   while (vsplit->cache.stamps[hash] == stamp &&
+          vsplit->cache.fetches[hash] != fetch)
+      hash = (hash + 1) & (CACHE_SIZE - 1);
 
-   /* If the value isn't in the cache or it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch) {
+   if (vsplit->cache.stamps[hash] != stamp) {
       /* update cache */
+      vsplit->cache.stamps[hash] = stamp;
       vsplit->cache.fetches[hash] = fetch;
       vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
 
@@ -125,12 +154,6 @@ vsplit_add_cache_ubyte(struct vsplit_frontend *vsplit, const ubyte *elts,
    unsigned elt_idx;
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* unlike the uint case this can only happen with elt_bias */
-   if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = TRUE;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -142,12 +165,6 @@ vsplit_add_cache_ushort(struct vsplit_frontend *vsplit, const ushort *elts,
    unsigned elt_idx;
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* unlike the uint case this can only happen with elt_bias */
-   if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = TRUE;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -164,16 +181,11 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
    unsigned elt_idx;
    /*
     * The final element index is just element index plus element bias.
+    * Entries are tagged by stamp, so DRAW_MAX_FETCH_IDX needs no special
+    * care.
     */
    elt_idx = vsplit_get_base_idx(start, fetch);
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
-   /* Take care for DRAW_MAX_FETCH_IDX (since cache is initialized to -1). */
-   if (elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
-      /* force update - any value will do except DRAW_MAX_FETCH_IDX */
-      vsplit->cache.fetches[hash] = 0;
-      vsplit->cache.has_max_fetch = TRUE;
-   }
    vsplit_add_cache(vsplit, elt_idx);
 }
 
@@ -254,6 +266,9 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    struct vsplit_frontend *vsplit = CALLOC_STRUCT(vsplit_frontend);
    ushort i;
 
+   /* keep the cache at most half full */
+   STATIC_ASSERT(SEGMENT_SIZE * 2 <= CACHE_SIZE);
+
    if (!vsplit)
       return NULL;
 
@@ -456,7 +456,7 @@ int lp_build_conv_auto(struct gallivm_state *gallivm,
        src_type.sign == dst_type->sign)
       return num_dsts;
 
-   /* Special case 4x4x32 -> 1x16x8 or 2x8x32 -> 1x16x8
+   /* Special case 4x4x32 -> 1x16x8, 2x8x32 -> 1x16x8 or 1x16x32 -> 1x16x8
     */
    if (src_type.norm     == 0 &&
        src_type.width    == 32 &&
@@ -491,6 +491,25 @@ int lp_build_conv_auto(struct gallivm_state *gallivm,
          lp_build_conv(gallivm, src_type, *dst_type, src, num_srcs, dst, num_dsts);
          return num_dsts;
       }
+
+      /* Special case 1x16x32 --> 1x16x8, as 2x8x32 --> 1x16x8 per vector */
+      if (src_type.length == 16 &&
+          util_cpu_caps.has_avx)
+      {
+         struct lp_type half_type = src_type;
+
+         half_type.length = 8;
+         dst_type->length = 16;
+
+         for (i = 0; i < num_srcs; i++) {
+            LLVMValueRef halves[2];
+
+            halves[0] = lp_build_extract_range(gallivm, src[i], 0, 8);
+            halves[1] = lp_build_extract_range(gallivm, src[i], 8, 8);
+            lp_build_conv(gallivm, half_type, *dst_type, halves, 2, &dst[i], 1);
+         }
+         return num_dsts;
+      }
    }
 
    /* lp_build_resize does not support M:N */
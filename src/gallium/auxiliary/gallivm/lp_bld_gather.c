@@ -343,11 +343,30 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
 
       assert(src_width == 32 || src_width == 64);
       if (src_width == 32) {
-         assert(length == 4 || length == 8);
+         assert(length == 4 || length == 8 || length == 16);
       } else {
          assert(length == 2 || length == 4);
       }
 
+      if (length == 16) {
+         /* AVX-512 takes the mask in a k register, and a 32 bit scale. */
+         LLVMTypeRef i16_type = LLVMIntTypeInContext(gallivm->context, 16);
+         LLVMTypeRef i32_type = LLVMIntTypeInContext(gallivm->context, 32);
+         LLVMValueRef args[5];
+
+         intrinsic = dst_type.floating ? "llvm.x86.avx512.gather.dps.512" :
+                                         "llvm.x86.avx512.gather.dpi.512";
+         args[0] = LLVMGetUndef(src_vec_type);
+         args[1] = base_ptr;
+         args[2] = offsets;
+         args[3] = LLVMConstAllOnes(i16_type);
+         args[4] = LLVMConstInt(i32_type, 1, 0);
+
+         res = lp_build_intrinsic(builder, intrinsic, src_vec_type, args, 5, 0);
+         return LLVMBuildBitCast(builder, res,
+                                 lp_build_vec_type(gallivm, res_type), "");
+      }
+
       static const char *intrinsics[2][2][2] = {
 
          {{"llvm.x86.avx2.gather.d.d",
@@ -492,6 +511,10 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+   } else if (util_cpu_caps.has_avx512f && !need_expansion &&
+              src_width == 32 && length == 16) {
+      return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
+                                  base_ptr, offsets);
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
@@ -37,6 +37,7 @@
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
+#include "lp_bld_type.h"
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
@@ -82,6 +83,7 @@ static const struct debug_named_value lp_bld_debug_flags[] = {
    { "perf",   GALLIVM_DEBUG_PERF, NULL },
    { "gc",     GALLIVM_DEBUG_GC, NULL },
    { "dumpbc", GALLIVM_DEBUG_DUMP_BC, NULL },
+   { "stats",  GALLIVM_DEBUG_STATS, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -144,7 +146,18 @@ create_pass_manager(struct gallivm_state *gallivm)
       free(td_str);
    }
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   return TRUE;
+}
+
+
+/**
+ * Install the optimization passes in the pass manager, according to the
+ * optimization wanted for the module.
+ */
+static void
+add_optimization_passes(struct gallivm_state *gallivm)
+{
+   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0 && !gallivm->fast_compile) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -177,8 +190,6 @@ create_pass_manager(struct gallivm_state *gallivm)
        */
       LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
    }
-
-   return TRUE;
 }
 
 
@@ -189,6 +200,19 @@ create_pass_manager(struct gallivm_state *gallivm)
 void
 gallivm_free_ir(struct gallivm_state *gallivm)
 {
+   if ((gallivm_debug & GALLIVM_DEBUG_STATS) &&
+       gallivm->compiled && gallivm->module) {
+      assert(gallivm->module_name);
+      debug_printf("gallivm: %s: %s, %u instrs, opt %u usec, "
+                   "codegen %u usec, %u bytes\n",
+                   gallivm->module_name,
+                   gallivm->cache && gallivm->cache->data_size ? "cached" :
+                   gallivm->fast_compile ||
+                   (gallivm_perf & GALLIVM_PERF_NO_OPT) ? "fast" : "optimized",
+                   gallivm->stats.nr_instrs, gallivm->stats.opt_usecs,
+                   gallivm->stats.codegen_usecs, gallivm->stats.code_size);
+   }
+
    if (gallivm->passmgr) {
       LLVMDisposePassManager(gallivm->passmgr);
    }
@@ -200,6 +224,15 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposeModule(gallivm->module);
    }
 
+   /* The object cache is used by the engine, and the cache description
+    * usually lives on the stack of the caller.
+    */
+   if (gallivm->cache) {
+      lp_free_objcache(gallivm->cache->jit_obj_cache);
+      gallivm->cache->jit_obj_cache = NULL;
+      gallivm->cache = NULL;
+   }
+
    FREE(gallivm->module_name);
 
    if (!use_mcjit) {
@@ -248,7 +281,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if ((gallivm_perf & GALLIVM_PERF_NO_OPT) || gallivm->fast_compile) {
          optlevel = None;
       }
       else {
@@ -259,6 +292,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     &gallivm->code,
                                                     gallivm->module,
                                                     gallivm->memorymgr,
+                                                    gallivm->cache,
                                                     (unsigned) optlevel,
                                                     use_mcjit,
                                                     &error);
@@ -309,7 +343,7 @@ fail:
  */
 static boolean
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   LLVMContextRef context)
+                   LLVMContextRef context, struct lp_cached_code *cache)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -318,6 +352,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
       return FALSE;
 
    gallivm->context = context;
+   gallivm->cache = cache;
 
    if (!gallivm->context)
       goto fail;
@@ -404,6 +439,8 @@ fail:
 boolean
 lp_build_init(void)
 {
+   unsigned default_vector_width;
+
    if (gallivm_initialized)
       return TRUE;
 
@@ -446,6 +483,7 @@ lp_build_init(void)
       util_cpu_caps.has_avx2 = 0;
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_fma = 0;
+      util_cpu_caps.has_avx512f = 0;
    }
 #endif
 
@@ -458,17 +496,46 @@ lp_build_init(void)
     */
    if (util_cpu_caps.has_avx &&
        util_cpu_caps.has_intel) {
-      lp_native_vector_width = 256;
+      default_vector_width = 256;
    } else {
       /* Leave it at 128, even when no SIMD extensions are available.
        * Really needs to be a multiple of 128 so can fit 4 floats.
        */
-      lp_native_vector_width = 128;
+      default_vector_width = 128;
    }
  
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
-                                                 lp_native_vector_width);
+                                                 default_vector_width);
+
+   if (lp_native_vector_width > 256 &&
+       !(util_cpu_caps.has_avx512f &&
+         util_cpu_caps.has_avx512bw &&
+         util_cpu_caps.has_avx512dq &&
+         util_cpu_caps.has_avx512vl &&
+         HAVE_LLVM >= 0x0600 && use_mcjit)) {
+      /* 512 bit vectors (16 pixels of a 4x4 stamp per vector, with the masks
+       * in k registers) need AVX-512F/BW/DQ/VL, and LLVM versions older than
+       * 6.0 generate poor AVX-512 code.  They are only used when asked for
+       * with LP_NATIVE_VECTOR_WIDTH=512, as they aren't measurably faster
+       * than 256 bit vectors yet.
+       */
+      lp_native_vector_width = default_vector_width;
+   }
 
+   if (lp_native_vector_width <= 256) {
+      /* Hide AVX-512 unless 512 bit vectors are used, for the same reasons
+       * as AVX below.
+       */
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512dq = 0;
+      util_cpu_caps.has_avx512ifma = 0;
+      util_cpu_caps.has_avx512pf = 0;
+      util_cpu_caps.has_avx512er = 0;
+      util_cpu_caps.has_avx512cd = 0;
+      util_cpu_caps.has_avx512bw = 0;
+      util_cpu_caps.has_avx512vl = 0;
+      util_cpu_caps.has_avx512vbmi = 0;
+   }
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -519,15 +586,18 @@ lp_build_init(void)
 
 /**
  * Create a new gallivm_state object.
+ * \param cache  optional machine code cache for the module, which must stay
+ *               valid until gallivm_free_ir() is called
  */
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context)
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache)
 {
    struct gallivm_state *gallivm;
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context)) {
+      if (!init_gallivm_state(gallivm, name, context, cache)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -582,7 +652,7 @@ void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
    LLVMValueRef func;
-   int64_t time_begin = 0;
+   int64_t time_begin, time_end;
 
    assert(!gallivm->compiled);
 
@@ -607,10 +677,11 @@ gallivm_compile_module(struct gallivm_state *gallivm)
                    "[-mattr=<-mattr option(s)>]");
    }
 
-   if (gallivm_debug & GALLIVM_DEBUG_PERF)
-      time_begin = os_time_get();
+   gallivm->stats.nr_instrs = lp_build_count_ir_module(gallivm->module);
+   time_begin = os_time_get();
 
-   /* Run optimization passes */
+   /* Run optimization passes, unless the machine code comes from the cache */
+   add_optimization_passes(gallivm);
    LLVMInitializeFunctionPassManager(gallivm->passmgr);
    func = LLVMGetFirstFunction(gallivm->module);
    while (func) {
@@ -627,13 +698,16 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim-non-leaf", "true");
 #endif
 
-      LLVMRunFunctionPassManager(gallivm->passmgr, func);
+      if (!gallivm->cache || !gallivm->cache->data_size)
+         LLVMRunFunctionPassManager(gallivm->passmgr, func);
       func = LLVMGetNextFunction(func);
    }
    LLVMFinalizeFunctionPassManager(gallivm->passmgr);
 
+   time_end = os_time_get();
+   gallivm->stats.opt_usecs = (unsigned)(time_end - time_begin);
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-      int64_t time_end = os_time_get();
       int time_msec = (int)((time_end - time_begin) / 1000);
       assert(gallivm->module_name);
       debug_printf("optimizing module %s took %d msec\n",
@@ -660,9 +734,11 @@ gallivm_compile_module(struct gallivm_state *gallivm)
        */
       LLVMSetDataLayout(gallivm->module, "");
       assert(!gallivm->engine);
+      time_begin = os_time_get();
       if (!init_gallivm_engine(gallivm)) {
          assert(0);
       }
+      gallivm->stats.codegen_usecs += (unsigned)(os_time_get() - time_begin);
    }
    assert(gallivm->engine);
 
@@ -708,20 +784,23 @@ gallivm_jit_function(struct gallivm_state *gallivm,
 {
    void *code;
    func_pointer jit_func;
-   int64_t time_begin = 0;
+   int64_t time_begin, time_end;
 
    assert(gallivm->compiled);
    assert(gallivm->engine);
 
-   if (gallivm_debug & GALLIVM_DEBUG_PERF)
-      time_begin = os_time_get();
+   time_begin = os_time_get();
 
+   /* MCJIT generates the code of the whole module here, the first time. */
    code = LLVMGetPointerToGlobal(gallivm->engine, func);
    assert(code);
    jit_func = pointer_to_func(code);
 
+   time_end = os_time_get();
+   gallivm->stats.codegen_usecs += (unsigned)(time_end - time_begin);
+   gallivm->stats.code_size = lp_generated_code_size(gallivm->code);
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-      int64_t time_end = os_time_get();
       int time_msec = (int)(time_end - time_begin) / 1000;
       debug_printf("   jitting func %s took %d msec\n",
                    LLVMGetValueName(func), time_msec);
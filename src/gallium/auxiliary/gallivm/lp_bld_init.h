@@ -39,6 +39,33 @@
 extern "C" {
 #endif
 
+/**
+ * Machine code of a module, as stored in and loaded from a shader cache.
+ *
+ * If data is set before the module is compiled, it is loaded instead of
+ * running the optimization passes and the code generator.  Otherwise the
+ * compiled code is returned in data, which the caller must free, unless
+ * the module can't be cached because it embeds process specific pointers.
+ */
+struct lp_cached_code {
+   void *data;
+   size_t data_size;
+   bool dont_cache;
+   void *jit_obj_cache;
+};
+
+/**
+ * What compiling a module cost, for GALLIVM_DEBUG=stats and the drivers'
+ * own statistics.  Filled by gallivm_compile_module() and
+ * gallivm_jit_function().
+ */
+struct gallivm_compile_stats {
+   unsigned nr_instrs;        /**< IR instructions, before optimization */
+   unsigned opt_usecs;        /**< time spent in the optimization passes */
+   unsigned codegen_usecs;    /**< time spent in the code generator */
+   unsigned code_size;        /**< bytes of machine code generated */
+};
+
 struct gallivm_state
 {
    char *module_name;
@@ -50,7 +77,14 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_cached_code *cache;
+   /** Generate code as fast as possible rather than fast code, with no
+    * optimization pass and the instruction selection of -O0 (FastISel).
+    * To be set before gallivm_compile_module().
+    */
+   boolean fast_compile;
    unsigned compiled;
+   struct gallivm_compile_stats stats;
 };
 
 
@@ -59,7 +93,8 @@ lp_build_init(void);
 
 
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context);
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache);
 
 void
 gallivm_destroy(struct gallivm_state *gallivm);
@@ -347,6 +347,16 @@ lp_build_select(struct lp_build_context *bld,
 
       res = LLVMBuildSelect(builder, mask, a, b, "");
    }
+   else if (util_cpu_caps.has_avx512f &&
+            type.width * type.length == 512 && type.width >= 32) {
+      /* There are no blendv intrinsics in AVX-512, blends take a k register
+       * instead, which a comparison of the mask against zero becomes.
+       */
+      LLVMValueRef zero = LLVMConstNull(bld->int_vec_type);
+      mask = LLVMBuildBitCast(builder, mask, bld->int_vec_type, "");
+      mask = LLVMBuildICmp(builder, LLVMIntNE, mask, zero, "");
+      res = LLVMBuildSelect(builder, mask, a, b, "");
+   }
    else if (((util_cpu_caps.has_sse4_1 &&
               type.width * type.length == 128) ||
              (util_cpu_caps.has_avx &&
@@ -65,6 +65,8 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -95,6 +97,7 @@
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 
+#include "lp_bld_init.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
 
@@ -407,9 +410,11 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
       typedef std::vector<void *> Vec;
       Vec FunctionBody, ExceptionTable;
       BaseMemoryManager *TheMM;
+      size_t CodeSize;
 
       GeneratedCode(BaseMemoryManager *MM) {
          TheMM = MM;
+         CodeSize = 0;
       }
 
       ~GeneratedCode() {
@@ -459,6 +464,29 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          delete (GeneratedCode *) code;
       }
 
+      static size_t getGeneratedCodeSize(const struct lp_generated_code *code) {
+         return ((const GeneratedCode *) code)->CodeSize;
+      }
+
+      /* Only to account for the size of the code. */
+#if HAVE_LLVM >= 0x0304
+      virtual uint8_t *allocateCodeSection(uintptr_t Size,
+                                           unsigned Alignment,
+                                           unsigned SectionID,
+                                           llvm::StringRef SectionName) {
+         code->CodeSize += Size;
+         return mgr()->allocateCodeSection(Size, Alignment, SectionID,
+                                           SectionName);
+      }
+#else
+      virtual uint8_t *allocateCodeSection(uintptr_t Size,
+                                           unsigned Alignment,
+                                           unsigned SectionID) {
+         code->CodeSize += Size;
+         return mgr()->allocateCodeSection(Size, Alignment, SectionID);
+      }
+#endif
+
 #if HAVE_LLVM < 0x0304
       virtual void deallocateExceptionTable(void *ET) {
          // remember for later deallocation
@@ -473,6 +501,55 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+#if HAVE_LLVM >= 0x0306
+/**
+ * Object cache of a single module, backed by a lp_cached_code.
+ *
+ * MCJIT asks for the object before running the code generator, and only
+ * compiles the module if there isn't any.  RuntimeDyld then relocates the
+ * object into the memory manager as usual.
+ */
+class LPObjectCache : public llvm::ObjectCache {
+private:
+   struct lp_cached_code *cache_out;
+
+public:
+   LPObjectCache(struct lp_cached_code *cache) : cache_out(cache)
+   {
+   }
+
+   ~LPObjectCache()
+   {
+   }
+
+   void notifyObjectCompiled(const llvm::Module *M,
+                             llvm::MemoryBufferRef Obj)
+   {
+      if (cache_out->dont_cache)
+         return;
+
+      assert(!cache_out->data);
+      cache_out->data = malloc(Obj.getBufferSize());
+      if (!cache_out->data)
+         return;
+
+      cache_out->data_size = Obj.getBufferSize();
+      memcpy(cache_out->data, Obj.getBufferStart(), cache_out->data_size);
+   }
+
+   std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M)
+   {
+      if (!cache_out->data_size)
+         return NULL;
+
+      return llvm::MemoryBuffer::getMemBuffer(
+         llvm::StringRef((const char *)cache_out->data, cache_out->data_size),
+         "", false);
+   }
+};
+#endif
+
+
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
@@ -489,6 +566,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         lp_generated_code **OutCode,
                                         LLVMModuleRef M,
                                         LLVMMCJITMemoryManagerRef CMM,
+                                        lp_cached_code *cache,
                                         unsigned OptLevel,
                                         int useMCJIT,
                                         char **OutError)
@@ -529,6 +607,9 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 #endif
 #endif
 
+   /* The unoptimized tier is all about compiling fast. */
+   options.EnableFastISel = OptLevel == 0;
+
    builder.setEngineKind(EngineKind::JIT)
           .setErrorStr(&Error)
           .setTargetOptions(options)
@@ -570,6 +651,22 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
         ++f) {
       MAttrs.push_back(((*f).second ? "+" : "-") + (*f).first().str());
    }
+#if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
+   /*
+    * lp_build_init() hides AVX-512 when the native vector width is smaller
+    * than 512 bits, for instance to compare with AVX2, and the later
+    * attributes override the host ones.
+    */
+   if (!util_cpu_caps.has_avx512f) {
+      MAttrs.push_back("-avx512f");
+      MAttrs.push_back("-avx512cd");
+      MAttrs.push_back("-avx512er");
+      MAttrs.push_back("-avx512pf");
+      MAttrs.push_back("-avx512bw");
+      MAttrs.push_back("-avx512dq");
+      MAttrs.push_back("-avx512vl");
+   }
+#endif
 #elif defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
    /*
     * We need to unset attributes because sometimes LLVM mistakenly assumes
@@ -612,17 +709,20 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MAttrs.push_back("-fma");
    }
    MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
-   /* disable avx512 and all subvariants */
+   /*
+    * avx512 and all subvariants, which lp_build_init() only leaves enabled
+    * for the 512 bit native vector width.
+    */
 #if HAVE_LLVM >= 0x0304
-   MAttrs.push_back("-avx512cd");
-   MAttrs.push_back("-avx512er");
-   MAttrs.push_back("-avx512f");
-   MAttrs.push_back("-avx512pf");
+   MAttrs.push_back(util_cpu_caps.has_avx512cd ? "+avx512cd" : "-avx512cd");
+   MAttrs.push_back(util_cpu_caps.has_avx512er ? "+avx512er" : "-avx512er");
+   MAttrs.push_back(util_cpu_caps.has_avx512f  ? "+avx512f"  : "-avx512f");
+   MAttrs.push_back(util_cpu_caps.has_avx512pf ? "+avx512pf" : "-avx512pf");
 #endif
 #if HAVE_LLVM >= 0x0305
-   MAttrs.push_back("-avx512bw");
-   MAttrs.push_back("-avx512dq");
-   MAttrs.push_back("-avx512vl");
+   MAttrs.push_back(util_cpu_caps.has_avx512bw ? "+avx512bw" : "-avx512bw");
+   MAttrs.push_back(util_cpu_caps.has_avx512dq ? "+avx512dq" : "-avx512dq");
+   MAttrs.push_back(util_cpu_caps.has_avx512vl ? "+avx512vl" : "-avx512vl");
 #endif
 #endif
 #if defined(PIPE_ARCH_ARM)
@@ -745,6 +845,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT->RegisterJITEventListener(JEL);
 #endif
    if (JIT) {
+#if HAVE_LLVM >= 0x0306
+      if (useMCJIT && cache) {
+         LPObjectCache *objcache = new LPObjectCache(cache);
+         cache->jit_obj_cache = objcache;
+         JIT->setObjectCache(objcache);
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -763,6 +870,22 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+extern "C"
+unsigned
+lp_generated_code_size(const struct lp_generated_code *code)
+{
+   return code ? ShaderMemoryManager::getGeneratedCodeSize(code) : 0;
+}
+
+extern "C"
+void
+lp_free_objcache(void *objcache)
+{
+#if HAVE_LLVM >= 0x0306
+   delete reinterpret_cast<LPObjectCache *>(objcache);
+#endif
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
@@ -41,6 +41,7 @@ extern "C" {
 
 
 struct lp_generated_code;
+struct lp_cached_code;
 
 extern LLVMTargetLibraryInfoRef
 gallivm_create_target_library_info(const char *triple);
@@ -57,6 +58,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         struct lp_generated_code **OutCode,
                                         LLVMModuleRef M,
                                         LLVMMCJITMemoryManagerRef MM,
+                                        struct lp_cached_code *cache,
                                         unsigned OptLevel,
                                         int useMCJIT,
                                         char **OutError);
@@ -64,6 +66,12 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
+extern unsigned
+lp_generated_code_size(const struct lp_generated_code *code);
+
+extern void
+lp_free_objcache(void *objcache);
+
 extern LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager();
 
@@ -0,0 +1,1760 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * NIR to LLVM IR translation, in SoA layout.
+ *
+ * All values are kept as integer vectors of their bit size, and cast to
+ * the type an instruction operates on when used.  1-bit booleans are kept
+ * as 32-bit masks, like the TGSI translator does, and 16-bit floats as the
+ * i16 vectors the rest of gallivm uses for halfs.
+ *
+ * The shader is first lowered by lp_build_nir_prepasses(): phis are
+ * replaced by registers, which are written under the execution mask, so
+ * that values merged at the end of conditionals and loops are right for
+ * each lane.  The loop exit values are made explicit with LCSSA first, so
+ * that their copies happen where the lanes leave the loop.
+ */
+
+#include "pipe/p_shader_tokens.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "compiler/nir/nir.h"
+#include "lp_bld_nir.h"
+#include "lp_bld_ir_common.h"
+#include "lp_bld_type.h"
+#include "lp_bld_const.h"
+#include "lp_bld_arit.h"
+#include "lp_bld_bitarit.h"
+#include "lp_bld_logic.h"
+#include "lp_bld_conv.h"
+#include "lp_bld_flow.h"
+#include "lp_bld_intr.h"
+#include "lp_bld_quad.h"
+#include "lp_bld_sample.h"
+#include "lp_bld_struct.h"
+#include "lp_bld_swizzle.h"
+#include "lp_bld_debug.h"
+#include "lp_bld_limits.h"
+
+
+const struct nir_shader_compiler_options gallivm_nir_options = {
+   .lower_scmp = true,
+   .lower_sub = true,
+   .lower_fmod = true,
+   .lower_fdph = true,
+   .lower_ldexp = true,
+   .lower_bitfield_extract_to_shifts = true,
+   .lower_bitfield_insert_to_shifts = true,
+   .lower_pack_half_2x16 = true,
+   .lower_pack_unorm_2x16 = true,
+   .lower_pack_snorm_2x16 = true,
+   .lower_pack_unorm_4x8 = true,
+   .lower_pack_snorm_4x8 = true,
+   .lower_unpack_half_2x16 = true,
+   .lower_unpack_unorm_2x16 = true,
+   .lower_unpack_snorm_2x16 = true,
+   .lower_unpack_unorm_4x8 = true,
+   .lower_unpack_snorm_4x8 = true,
+   .lower_extract_byte = true,
+   .lower_extract_word = true,
+   .lower_uadd_carry = true,
+   .lower_usub_borrow = true,
+   .lower_hadd = true,
+   .lower_add_sat = true,
+   .lower_mul_2x32_64 = true,
+   .lower_rotate = true,
+   .max_unroll_iterations = 32,
+};
+
+
+struct lp_build_nir_soa_context
+{
+   struct lp_build_context base;     /**< float32 */
+   struct lp_build_context dbl_bld;
+   struct lp_build_context uint_bld;
+   struct lp_build_context int_bld;
+   struct lp_build_context uint64_bld;
+   struct lp_build_context int64_bld;
+   struct lp_build_context uint16_bld;
+   struct lp_build_context int16_bld;
+   struct lp_build_context uint8_bld;
+   struct lp_build_context int8_bld;
+
+   struct lp_exec_mask exec_mask;
+
+   const struct lp_build_tgsi_params *params;
+   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS];
+
+   nir_shader *shader;
+
+   /** The value of each component of each SSA definition */
+   LLVMValueRef (*ssa_defs)[NIR_MAX_VEC_COMPONENTS];
+
+   /** An array alloca for each register */
+   LLVMValueRef *regs;
+
+   LLVMValueRef consts[LP_MAX_TGSI_CONST_BUFFERS];
+   LLVMValueRef consts_sizes[LP_MAX_TGSI_CONST_BUFFERS];
+};
+
+
+static void
+visit_cf_list(struct lp_build_nir_soa_context *bld,
+              struct exec_list *list);
+
+
+static void
+init_bld(struct gallivm_state *gallivm, struct lp_build_context *bld,
+         struct lp_type type, boolean floating, boolean sign,
+         unsigned width)
+{
+   type.floating = floating;
+   type.sign = sign;
+   type.width = width;
+   lp_build_context_init(bld, gallivm, type);
+}
+
+
+static struct lp_build_context *
+get_flt_bld(struct lp_build_nir_soa_context *bld, unsigned bit_size)
+{
+   /* 16-bit floats are computed in 32 bits. */
+   return bit_size == 64 ? &bld->dbl_bld : &bld->base;
+}
+
+
+static struct lp_build_context *
+get_int_bld(struct lp_build_nir_soa_context *bld, boolean is_unsigned,
+            unsigned bit_size)
+{
+   switch (bit_size) {
+   case 8:
+      return is_unsigned ? &bld->uint8_bld : &bld->int8_bld;
+   case 16:
+      return is_unsigned ? &bld->uint16_bld : &bld->int16_bld;
+   case 64:
+      return is_unsigned ? &bld->uint64_bld : &bld->int64_bld;
+   default:
+      /* Booleans are 32-bit masks. */
+      return is_unsigned ? &bld->uint_bld : &bld->int_bld;
+   }
+}
+
+
+/**
+ * Make a 32-bit mask of a comparison result of the given bit size.
+ */
+static LLVMValueRef
+mask_to_i32(struct lp_build_nir_soa_context *bld, LLVMValueRef mask,
+            unsigned bit_size)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+
+   if (bit_size > 32)
+      return LLVMBuildTrunc(builder, mask, bld->int_bld.vec_type, "");
+   if (bit_size < 32)
+      return LLVMBuildSExt(builder, mask, bld->int_bld.vec_type, "");
+   return mask;
+}
+
+
+/**
+ * Make a mask of the given bit size from a 32-bit mask, to select between
+ * values of that size.
+ */
+static LLVMValueRef
+mask_from_i32(struct lp_build_nir_soa_context *bld, LLVMValueRef mask,
+              unsigned bit_size)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+   LLVMTypeRef vec_type = get_int_bld(bld, FALSE, bit_size)->vec_type;
+
+   if (bit_size > 32)
+      return LLVMBuildSExt(builder, mask, vec_type, "");
+   if (bit_size < 32 && bit_size != 1)
+      return LLVMBuildTrunc(builder, mask, vec_type, "");
+   return mask;
+}
+
+
+/**
+ * Make a 64-bit value of two 32-bit halves.
+ */
+static LLVMValueRef
+pack_64(struct lp_build_nir_soa_context *bld, LLVMValueRef lo,
+        LLVMValueRef hi)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+
+   lo = LLVMBuildZExt(builder, lo, bld->uint64_bld.vec_type, "");
+   hi = LLVMBuildZExt(builder, hi, bld->uint64_bld.vec_type, "");
+   hi = lp_build_shl_imm(&bld->uint64_bld, hi, 32);
+   return LLVMBuildOr(builder, lo, hi, "");
+}
+
+
+/**
+ * Take the low (hi == FALSE) or high 32-bit half of a 64-bit value.
+ */
+static LLVMValueRef
+unpack_64(struct lp_build_nir_soa_context *bld, LLVMValueRef val,
+          boolean hi)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+
+   if (hi)
+      val = lp_build_shr_imm(&bld->uint64_bld, val, 32);
+   return LLVMBuildTrunc(builder, val, bld->uint_bld.vec_type, "");
+}
+
+
+/**
+ * Cast a stored value to the type it is used as.
+ */
+static LLVMValueRef
+cast_type(struct lp_build_nir_soa_context *bld, LLVMValueRef val,
+          nir_alu_type type, unsigned bit_size)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+
+   switch (nir_alu_type_get_base_type(type)) {
+   case nir_type_float:
+      if (bit_size == 16)
+         return lp_build_half_to_float(gallivm, val);
+      return LLVMBuildBitCast(builder, val,
+                              get_flt_bld(bld, bit_size)->vec_type, "");
+   case nir_type_int:
+      return LLVMBuildBitCast(builder, val,
+                              get_int_bld(bld, FALSE, bit_size)->vec_type, "");
+   default:
+      return LLVMBuildBitCast(builder, val,
+                              get_int_bld(bld, TRUE, bit_size)->vec_type, "");
+   }
+}
+
+
+/**
+ * Cast a result to the integer vector it is stored as.
+ */
+static LLVMValueRef
+cast_result(struct lp_build_nir_soa_context *bld, LLVMValueRef val,
+            nir_alu_type type, unsigned bit_size)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+
+   if (nir_alu_type_get_base_type(type) == nir_type_float && bit_size == 16)
+      return lp_build_float_to_half(gallivm, val);
+
+   return LLVMBuildBitCast(gallivm->builder, val,
+                           get_int_bld(bld, TRUE, bit_size)->vec_type, "");
+}
+
+
+static LLVMValueRef
+reg_chan_ptr(struct lp_build_nir_soa_context *bld,
+             const nir_register *reg, unsigned base_offset, unsigned chan)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMValueRef indices[2];
+
+   indices[0] = lp_build_const_int32(gallivm, 0);
+   indices[1] = lp_build_const_int32(gallivm,
+                                     base_offset * reg->num_components + chan);
+
+   return LLVMBuildGEP(gallivm->builder, bld->regs[reg->index],
+                       indices, 2, "");
+}
+
+
+/**
+ * Fetch a component of a source, as stored.
+ */
+static LLVMValueRef
+get_src(struct lp_build_nir_soa_context *bld, nir_src src, unsigned chan)
+{
+   if (src.is_ssa)
+      return bld->ssa_defs[src.ssa->index][chan];
+
+   /* The prepasses don't leave indirect register accesses. */
+   assert(!src.reg.indirect);
+
+   return LLVMBuildLoad(bld->base.gallivm->builder,
+                        reg_chan_ptr(bld, src.reg.reg,
+                                     src.reg.base_offset, chan), "");
+}
+
+
+static void
+assign_dest(struct lp_build_nir_soa_context *bld, const nir_dest *dest,
+            unsigned chan, LLVMValueRef val)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+   LLVMValueRef ptr;
+
+   if (dest->is_ssa) {
+      bld->ssa_defs[dest->ssa.index][chan] = val;
+      return;
+   }
+
+   assert(!dest->reg.indirect);
+   ptr = reg_chan_ptr(bld, dest->reg.reg, dest->reg.base_offset, chan);
+
+   /*
+    * Registers merge the values of the different paths through the
+    * control flow, so lanes which don't take this one keep their value.
+    */
+   if (bld->exec_mask.has_mask) {
+      unsigned bit_size = dest->reg.reg->bit_size;
+      LLVMValueRef mask = mask_from_i32(bld, bld->exec_mask.exec_mask,
+                                        bit_size);
+      val = lp_build_select(get_int_bld(bld, TRUE, bit_size), mask, val,
+                            LLVMBuildLoad(builder, ptr, ""));
+   }
+
+   LLVMBuildStore(builder, val, ptr);
+}
+
+
+static LLVMValueRef
+emit_intrinsic_unary(struct lp_build_context *bld, const char *name,
+                     LLVMValueRef a)
+{
+   char intrinsic[64];
+
+   lp_format_intrinsic(intrinsic, sizeof intrinsic, name, bld->vec_type);
+   return lp_build_intrinsic_unary(bld->gallivm->builder, intrinsic,
+                                   bld->vec_type, a);
+}
+
+
+/**
+ * Emit cttz or ctlz, which are defined for zero.
+ */
+static LLVMValueRef
+emit_count_zeros(struct lp_build_context *bld, const char *name,
+                 LLVMValueRef a)
+{
+   LLVMContextRef context = bld->gallivm->context;
+   char intrinsic[64];
+
+   lp_format_intrinsic(intrinsic, sizeof intrinsic, name, bld->vec_type);
+   return lp_build_intrinsic_binary(bld->gallivm->builder, intrinsic,
+                                    bld->vec_type, a,
+                                    LLVMConstInt(LLVMInt1TypeInContext(context),
+                                                 0, 0));
+}
+
+
+/**
+ * Round a float value, with the LLVM intrinsics for doubles, since the
+ * gallivm rounding helpers only know about 32-bit floats.
+ */
+static LLVMValueRef
+emit_round(struct lp_build_context *flt_bld, nir_op op, LLVMValueRef a)
+{
+   if (flt_bld->type.width == 64) {
+      switch (op) {
+      case nir_op_ffloor:
+         return emit_intrinsic_unary(flt_bld, "llvm.floor", a);
+      case nir_op_fceil:
+         return emit_intrinsic_unary(flt_bld, "llvm.ceil", a);
+      case nir_op_ftrunc:
+         return emit_intrinsic_unary(flt_bld, "llvm.trunc", a);
+      case nir_op_fround_even:
+         return emit_intrinsic_unary(flt_bld, "llvm.rint", a);
+      case nir_op_ffract:
+         return lp_build_sub(flt_bld, a,
+                             emit_intrinsic_unary(flt_bld, "llvm.floor", a));
+      default:
+         unreachable("not a rounding op");
+      }
+   }
+
+   switch (op) {
+   case nir_op_ffloor:
+      return lp_build_floor(flt_bld, a);
+   case nir_op_fceil:
+      return lp_build_ceil(flt_bld, a);
+   case nir_op_ftrunc:
+      return lp_build_trunc(flt_bld, a);
+   case nir_op_fround_even:
+      return lp_build_round(flt_bld, a);
+   case nir_op_ffract:
+      return lp_build_fract_safe(flt_bld, a);
+   default:
+      unreachable("not a rounding op");
+   }
+}
+
+
+/**
+ * Integer division and modulo, which must not trap on a zero divisor.
+ * Like the TGSI ops, a division by zero returns 0 for signed and ~0 for
+ * unsigned values.
+ */
+static LLVMValueRef
+emit_div_mod(struct lp_build_nir_soa_context *bld, nir_op op,
+             unsigned bit_size, LLVMValueRef a, LLVMValueRef b)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+   boolean is_unsigned = op == nir_op_udiv || op == nir_op_umod;
+   struct lp_build_context *int_bld = get_int_bld(bld, is_unsigned, bit_size);
+   LLVMValueRef zero_mask, divisor, res;
+
+   zero_mask = lp_build_cmp(int_bld, PIPE_FUNC_EQUAL, b, int_bld->zero);
+   divisor = LLVMBuildOr(builder, b, zero_mask, "");
+
+   switch (op) {
+   case nir_op_udiv:
+      res = LLVMBuildUDiv(builder, a, divisor, "");
+      return LLVMBuildOr(builder, res, zero_mask, "");
+   case nir_op_umod:
+      res = LLVMBuildURem(builder, a, divisor, "");
+      return LLVMBuildOr(builder, res, zero_mask, "");
+   case nir_op_idiv:
+      res = LLVMBuildSDiv(builder, a, divisor, "");
+      break;
+   case nir_op_irem:
+      res = LLVMBuildSRem(builder, a, divisor, "");
+      break;
+   case nir_op_imod: {
+      /* The result has the sign of the divisor. */
+      LLVMValueRef nonzero, sign_differs, fixup;
+
+      res = LLVMBuildSRem(builder, a, divisor, "");
+      nonzero = lp_build_cmp(int_bld, PIPE_FUNC_NOTEQUAL, res, int_bld->zero);
+      sign_differs = lp_build_cmp(int_bld, PIPE_FUNC_LESS,
+                                  LLVMBuildXor(builder, res, b, ""),
+                                  int_bld->zero);
+      fixup = LLVMBuildAnd(builder, nonzero, sign_differs, "");
+      res = LLVMBuildAdd(builder, res,
+                         LLVMBuildAnd(builder, b, fixup, ""), "");
+      break;
+   }
+   default:
+      unreachable("not a division op");
+   }
+
+   return LLVMBuildAnd(builder, res, LLVMBuildNot(builder, zero_mask, ""), "");
+}
+
+
+static LLVMValueRef
+emit_shift(struct lp_build_nir_soa_context *bld, nir_op op,
+           unsigned bit_size, unsigned count_bit_size,
+           LLVMValueRef a, LLVMValueRef count)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+   struct lp_build_context *uint_bld = get_int_bld(bld, TRUE, bit_size);
+
+   /* The shift count is 32-bit for all sizes of shifted values. */
+   if (count_bit_size < bit_size)
+      count = LLVMBuildZExt(builder, count, uint_bld->vec_type, "");
+   else if (count_bit_size > bit_size)
+      count = LLVMBuildTrunc(builder, count, uint_bld->vec_type, "");
+
+   /* Only the low bits of the count are used, as in D3D and SPIR-V. */
+   count = lp_build_and(uint_bld, count,
+                        lp_build_const_int_vec(bld->base.gallivm,
+                                               uint_bld->type, bit_size - 1));
+
+   switch (op) {
+   case nir_op_ishl:
+      return LLVMBuildShl(builder, a, count, "");
+   case nir_op_ishr:
+      return LLVMBuildAShr(builder, a, count, "");
+   case nir_op_ushr:
+      return LLVMBuildLShr(builder, a, count, "");
+   default:
+      unreachable("not a shift op");
+   }
+}
+
+
+/**
+ * Conversions between types and sizes.
+ */
+static LLVMValueRef
+emit_conversion(struct lp_build_nir_soa_context *bld, nir_op op,
+                unsigned src_bit_size, unsigned dst_bit_size,
+                LLVMValueRef src)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+   const nir_op_info *info = &nir_op_infos[op];
+   nir_alu_type src_type = nir_alu_type_get_base_type(info->input_types[0]);
+   nir_alu_type dst_type = nir_alu_type_get_base_type(info->output_type);
+   struct lp_build_context *src_flt_bld = get_flt_bld(bld, src_bit_size);
+   struct lp_build_context *dst_flt_bld = get_flt_bld(bld, dst_bit_size);
+   struct lp_build_context *dst_int_bld =
+      get_int_bld(bld, dst_type == nir_type_uint, dst_bit_size);
+
+   if (dst_type == nir_type_bool) {
+      /* f2b, i2b */
+      struct lp_build_context *src_bld = src_type == nir_type_float ?
+         src_flt_bld : get_int_bld(bld, TRUE, src_bit_size);
+
+      return mask_to_i32(bld, lp_build_cmp(src_bld, PIPE_FUNC_NOTEQUAL,
+                                           src, src_bld->zero),
+                         src_bld->type.width);
+   }
+
+   if (src_type == nir_type_bool) {
+      /* b2f, b2i */
+      if (dst_type == nir_type_float) {
+         return lp_build_select(dst_flt_bld,
+                                mask_from_i32(bld, src, dst_flt_bld->type.width),
+                                dst_flt_bld->one, dst_flt_bld->zero);
+      }
+      src = LLVMBuildAnd(builder, src, bld->int_bld.one, "");
+      src_bit_size = 32;
+      src_type = nir_type_uint;
+   }
+
+   if (src_type == nir_type_float) {
+      if (dst_type == nir_type_float) {
+         if (src_flt_bld->type.width > dst_flt_bld->type.width)
+            return LLVMBuildFPTrunc(builder, src, dst_flt_bld->vec_type, "");
+         if (src_flt_bld->type.width < dst_flt_bld->type.width)
+            return LLVMBuildFPExt(builder, src, dst_flt_bld->vec_type, "");
+         return src;
+      }
+      if (dst_type == nir_type_int)
+         return LLVMBuildFPToSI(builder, src, dst_int_bld->vec_type, "");
+      return LLVMBuildFPToUI(builder, src, dst_int_bld->vec_type, "");
+   }
+
+   if (dst_type == nir_type_float) {
+      if (src_type == nir_type_int)
+         return LLVMBuildSIToFP(builder, src, dst_flt_bld->vec_type, "");
+      return LLVMBuildUIToFP(builder, src, dst_flt_bld->vec_type, "");
+   }
+
+   if (src_bit_size > dst_bit_size)
+      return LLVMBuildTrunc(builder, src, dst_int_bld->vec_type, "");
+   if (src_bit_size < dst_bit_size) {
+      if (src_type == nir_type_int)
+         return LLVMBuildSExt(builder, src, dst_int_bld->vec_type, "");
+      return LLVMBuildZExt(builder, src, dst_int_bld->vec_type, "");
+   }
+   return src;
+}
+
+
+/**
+ * Emit one component of an ALU instruction, from its sources cast to the
+ * types of the instruction.  Comparisons return 32-bit masks.
+ */
+static LLVMValueRef
+do_alu_action(struct lp_build_nir_soa_context *bld, nir_op op,
+              const unsigned *src_bit_size, unsigned dst_bit_size,
+              LLVMValueRef *src)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *flt_bld = get_flt_bld(bld, src_bit_size[0]);
+   struct lp_build_context *int_bld = get_int_bld(bld, FALSE, src_bit_size[0]);
+   struct lp_build_context *uint_bld = get_int_bld(bld, TRUE, src_bit_size[0]);
+   LLVMValueRef result = NULL;
+
+   if (nir_op_infos[op].is_conversion)
+      return emit_conversion(bld, op, src_bit_size[0], dst_bit_size, src[0]);
+
+   switch (op) {
+   case nir_op_b2f16:
+   case nir_op_b2f32:
+   case nir_op_b2f64:
+   case nir_op_b2i8:
+   case nir_op_b2i16:
+   case nir_op_b2i32:
+   case nir_op_b2i64:
+   case nir_op_f2b1:
+   case nir_op_f2b32:
+   case nir_op_i2b1:
+   case nir_op_i2b32:
+      return emit_conversion(bld, op, src_bit_size[0], dst_bit_size, src[0]);
+
+   /* float */
+   case nir_op_fabs:
+      return lp_build_abs(flt_bld, src[0]);
+   case nir_op_fneg:
+      return lp_build_negate(flt_bld, src[0]);
+   case nir_op_fsat:
+      return lp_build_clamp_zero_one_nanzero(flt_bld, src[0]);
+   case nir_op_fsign:
+      return lp_build_sgn(flt_bld, src[0]);
+   case nir_op_fadd:
+      return lp_build_add(flt_bld, src[0], src[1]);
+   case nir_op_fsub:
+      return lp_build_sub(flt_bld, src[0], src[1]);
+   case nir_op_fmul:
+      return lp_build_mul(flt_bld, src[0], src[1]);
+   case nir_op_fdiv:
+      return lp_build_div(flt_bld, src[0], src[1]);
+   case nir_op_ffma:
+      return lp_build_fmuladd(builder, src[0], src[1], src[2]);
+   case nir_op_flrp:
+      return lp_build_lerp(flt_bld, src[2], src[0], src[1], 0);
+   case nir_op_fmin:
+      return lp_build_min_ext(flt_bld, src[0], src[1],
+                              GALLIVM_NAN_RETURN_OTHER);
+   case nir_op_fmax:
+      return lp_build_max_ext(flt_bld, src[0], src[1],
+                              GALLIVM_NAN_RETURN_OTHER);
+   case nir_op_frcp:
+      return lp_build_rcp(flt_bld, src[0]);
+   case nir_op_frsq:
+      return lp_build_rsqrt(flt_bld, src[0]);
+   case nir_op_fsqrt:
+      return lp_build_sqrt(flt_bld, src[0]);
+   case nir_op_fexp2:
+      return lp_build_exp2(flt_bld, src[0]);
+   case nir_op_flog2:
+      return lp_build_log2_safe(flt_bld, src[0]);
+   case nir_op_fpow:
+      return lp_build_pow(flt_bld, src[0], src[1]);
+   case nir_op_fsin:
+      return lp_build_sin(flt_bld, src[0]);
+   case nir_op_fcos:
+      return lp_build_cos(flt_bld, src[0]);
+   case nir_op_ffloor:
+   case nir_op_fceil:
+   case nir_op_ftrunc:
+   case nir_op_fround_even:
+   case nir_op_ffract:
+      return emit_round(flt_bld, op, src[0]);
+   case nir_op_fddx:
+   case nir_op_fddx_coarse:
+   case nir_op_fddx_fine:
+      return lp_build_ddx(flt_bld, src[0]);
+   case nir_op_fddy:
+   case nir_op_fddy_coarse:
+   case nir_op_fddy_fine:
+      return lp_build_ddy(flt_bld, src[0]);
+
+   case nir_op_flt:
+   case nir_op_flt32:
+      result = lp_build_cmp(flt_bld, PIPE_FUNC_LESS, src[0], src[1]);
+      return mask_to_i32(bld, result, flt_bld->type.width);
+   case nir_op_fge:
+   case nir_op_fge32:
+      result = lp_build_cmp(flt_bld, PIPE_FUNC_GEQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, flt_bld->type.width);
+   case nir_op_feq:
+   case nir_op_feq32:
+      result = lp_build_cmp(flt_bld, PIPE_FUNC_EQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, flt_bld->type.width);
+   case nir_op_fne:
+   case nir_op_fne32:
+      result = lp_build_cmp(flt_bld, PIPE_FUNC_NOTEQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, flt_bld->type.width);
+
+   /* integer */
+   case nir_op_iabs:
+      return lp_build_abs(int_bld, src[0]);
+   case nir_op_ineg:
+      return lp_build_negate(int_bld, src[0]);
+   case nir_op_isign:
+      return lp_build_sgn(int_bld, src[0]);
+   case nir_op_iadd:
+      return LLVMBuildAdd(builder, src[0], src[1], "");
+   case nir_op_isub:
+      return LLVMBuildSub(builder, src[0], src[1], "");
+   case nir_op_imul:
+      return LLVMBuildMul(builder, src[0], src[1], "");
+   case nir_op_imul_high:
+   case nir_op_umul_high:
+      if (src_bit_size[0] == 32) {
+         LLVMValueRef hi;
+
+         lp_build_mul_32_lohi_cpu(op == nir_op_imul_high ? int_bld : uint_bld,
+                                  src[0], src[1], &hi);
+         return hi;
+      }
+      break;
+   case nir_op_idiv:
+   case nir_op_udiv:
+   case nir_op_umod:
+   case nir_op_irem:
+   case nir_op_imod:
+      return emit_div_mod(bld, op, src_bit_size[0], src[0], src[1]);
+   case nir_op_imin:
+      return lp_build_min(int_bld, src[0], src[1]);
+   case nir_op_imax:
+      return lp_build_max(int_bld, src[0], src[1]);
+   case nir_op_umin:
+      return lp_build_min(uint_bld, src[0], src[1]);
+   case nir_op_umax:
+      return lp_build_max(uint_bld, src[0], src[1]);
+   case nir_op_iand:
+      return LLVMBuildAnd(builder, src[0], src[1], "");
+   case nir_op_ior:
+      return LLVMBuildOr(builder, src[0], src[1], "");
+   case nir_op_ixor:
+      return LLVMBuildXor(builder, src[0], src[1], "");
+   case nir_op_inot:
+      return LLVMBuildNot(builder, src[0], "");
+   case nir_op_ishl:
+   case nir_op_ishr:
+   case nir_op_ushr:
+      return emit_shift(bld, op, src_bit_size[0], src_bit_size[1],
+                        src[0], src[1]);
+   case nir_op_bit_count:
+      result = emit_intrinsic_unary(uint_bld, "llvm.ctpop", src[0]);
+      break;
+   case nir_op_bitfield_reverse:
+      return emit_intrinsic_unary(uint_bld, "llvm.bitreverse", src[0]);
+   case nir_op_find_lsb:
+      /* -1 for zero */
+      result = emit_count_zeros(uint_bld, "llvm.cttz", src[0]);
+      result = LLVMBuildOr(builder, result,
+                           lp_build_cmp(uint_bld, PIPE_FUNC_EQUAL, src[0],
+                                        uint_bld->zero), "");
+      break;
+   case nir_op_ufind_msb:
+   case nir_op_ifind_msb: {
+      LLVMValueRef val = src[0];
+
+      /* Look for the first bit different from the sign bit. */
+      if (op == nir_op_ifind_msb) {
+         val = lp_build_select(int_bld,
+                               lp_build_cmp(int_bld, PIPE_FUNC_LESS, val,
+                                            int_bld->zero),
+                               LLVMBuildNot(builder, val, ""), val);
+      }
+
+      /* bit_size - 1 - clz, which is -1 for zero */
+      result = emit_count_zeros(uint_bld, "llvm.ctlz", val);
+      result = LLVMBuildSub(builder,
+                            lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                   src_bit_size[0] - 1),
+                            result, "");
+      break;
+   }
+
+   case nir_op_ilt:
+   case nir_op_ilt32:
+      result = lp_build_cmp(int_bld, PIPE_FUNC_LESS, src[0], src[1]);
+      return mask_to_i32(bld, result, src_bit_size[0]);
+   case nir_op_ige:
+   case nir_op_ige32:
+      result = lp_build_cmp(int_bld, PIPE_FUNC_GEQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, src_bit_size[0]);
+   case nir_op_ult:
+   case nir_op_ult32:
+      result = lp_build_cmp(uint_bld, PIPE_FUNC_LESS, src[0], src[1]);
+      return mask_to_i32(bld, result, src_bit_size[0]);
+   case nir_op_uge:
+   case nir_op_uge32:
+      result = lp_build_cmp(uint_bld, PIPE_FUNC_GEQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, src_bit_size[0]);
+   case nir_op_ieq:
+   case nir_op_ieq32:
+      result = lp_build_cmp(uint_bld, PIPE_FUNC_EQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, src_bit_size[0]);
+   case nir_op_ine:
+   case nir_op_ine32:
+      result = lp_build_cmp(uint_bld, PIPE_FUNC_NOTEQUAL, src[0], src[1]);
+      return mask_to_i32(bld, result, src_bit_size[0]);
+
+   /* selects */
+   case nir_op_bcsel:
+   case nir_op_b32csel: {
+      struct lp_build_context *sel_bld = get_int_bld(bld, TRUE,
+                                                     src_bit_size[1]);
+      return lp_build_select(sel_bld,
+                             mask_from_i32(bld, src[0], src_bit_size[1]),
+                             src[1], src[2]);
+   }
+   case nir_op_fcsel: {
+      LLVMValueRef cond = lp_build_cmp(flt_bld, PIPE_FUNC_NOTEQUAL,
+                                       src[0], flt_bld->zero);
+      return lp_build_select(flt_bld, cond, src[1], src[2]);
+   }
+
+   /* packing */
+   case nir_op_pack_64_2x32_split:
+      return pack_64(bld, src[0], src[1]);
+   case nir_op_unpack_64_2x32_split_x:
+      return unpack_64(bld, src[0], FALSE);
+   case nir_op_unpack_64_2x32_split_y:
+      return unpack_64(bld, src[0], TRUE);
+   case nir_op_pack_half_2x16_split: {
+      LLVMValueRef lo = lp_build_float_to_half(gallivm, src[0]);
+      LLVMValueRef hi = lp_build_float_to_half(gallivm, src[1]);
+      lo = LLVMBuildZExt(builder, lo, bld->uint_bld.vec_type, "");
+      hi = LLVMBuildZExt(builder, hi, bld->uint_bld.vec_type, "");
+      hi = lp_build_shl_imm(&bld->uint_bld, hi, 16);
+      return LLVMBuildOr(builder, lo, hi, "");
+   }
+   case nir_op_unpack_half_2x16_split_x:
+   case nir_op_unpack_half_2x16_split_y:
+      result = src[0];
+      if (op == nir_op_unpack_half_2x16_split_y)
+         result = lp_build_shr_imm(&bld->uint_bld, result, 16);
+      result = LLVMBuildTrunc(builder, result, bld->uint16_bld.vec_type, "");
+      return lp_build_half_to_float(gallivm, result);
+
+   default:
+      break;
+   }
+
+   if (result == NULL) {
+      debug_printf("gallivm: unsupported NIR ALU op %s\n",
+                   nir_op_infos[op].name);
+      return LLVMGetUndef(get_int_bld(bld, TRUE, dst_bit_size)->vec_type);
+   }
+
+   /* bit counts and indices are 32-bit for all sizes */
+   if (src_bit_size[0] > 32)
+      result = LLVMBuildTrunc(builder, result, bld->uint_bld.vec_type, "");
+   else if (src_bit_size[0] < 32)
+      result = LLVMBuildZExt(builder, result, bld->uint_bld.vec_type, "");
+   return result;
+}
+
+
+static LLVMValueRef
+get_alu_src(struct lp_build_nir_soa_context *bld, const nir_alu_instr *instr,
+            unsigned i, unsigned chan)
+{
+   const nir_alu_src *alu_src = &instr->src[i];
+   nir_alu_type type = nir_op_infos[instr->op].input_types[i];
+   unsigned bit_size = nir_src_bit_size(alu_src->src);
+   LLVMValueRef val;
+
+   val = get_src(bld, alu_src->src, alu_src->swizzle[chan]);
+   val = cast_type(bld, val, type, bit_size);
+
+   if (alu_src->abs || alu_src->negate) {
+      struct lp_build_context *mod_bld =
+         nir_alu_type_get_base_type(type) == nir_type_float ?
+         get_flt_bld(bld, bit_size) : get_int_bld(bld, FALSE, bit_size);
+
+      if (alu_src->abs)
+         val = lp_build_abs(mod_bld, val);
+      if (alu_src->negate)
+         val = lp_build_negate(mod_bld, val);
+   }
+
+   return val;
+}
+
+
+static void
+visit_alu(struct lp_build_nir_soa_context *bld, const nir_alu_instr *instr)
+{
+   const nir_op_info *info = &nir_op_infos[instr->op];
+   unsigned dst_bit_size = nir_dest_bit_size(instr->dest.dest);
+   unsigned num_components = nir_dest_num_components(instr->dest.dest);
+   unsigned src_bit_size[NIR_MAX_VEC_COMPONENTS];
+   LLVMValueRef result[NIR_MAX_VEC_COMPONENTS] = { NULL };
+   unsigned i, c;
+
+   for (i = 0; i < info->num_inputs; i++)
+      src_bit_size[i] = nir_src_bit_size(instr->src[i].src);
+
+   switch (instr->op) {
+   case nir_op_mov:
+   case nir_op_vec2:
+   case nir_op_vec3:
+   case nir_op_vec4:
+      /* Plain copies of the stored values. */
+      for (c = 0; c < num_components; c++) {
+         if (instr->op == nir_op_mov)
+            result[c] = get_src(bld, instr->src[0].src,
+                                instr->src[0].swizzle[c]);
+         else
+            result[c] = get_src(bld, instr->src[c].src,
+                                instr->src[c].swizzle[0]);
+      }
+      break;
+
+   case nir_op_fdot2:
+   case nir_op_fdot3:
+   case nir_op_fdot4: {
+      struct lp_build_context *flt_bld = get_flt_bld(bld, src_bit_size[0]);
+      LLVMValueRef sum = NULL;
+
+      for (c = 0; c < info->input_sizes[0]; c++) {
+         LLVMValueRef prod = lp_build_mul(flt_bld,
+                                          get_alu_src(bld, instr, 0, c),
+                                          get_alu_src(bld, instr, 1, c));
+         sum = sum ? lp_build_add(flt_bld, sum, prod) : prod;
+      }
+      for (c = 0; c < num_components; c++)
+         result[c] = sum;
+      break;
+   }
+
+   default:
+      for (c = 0; c < num_components; c++) {
+         LLVMValueRef src[NIR_MAX_VEC_COMPONENTS];
+
+         if (!instr->dest.dest.is_ssa && !(instr->dest.write_mask & (1 << c)))
+            continue;
+
+         for (i = 0; i < info->num_inputs; i++) {
+            /* Vector sources of per-component ops are replicated. */
+            assert(info->input_sizes[i] <= 1);
+            src[i] = get_alu_src(bld, instr, i, c);
+         }
+
+         result[c] = do_alu_action(bld, instr->op, src_bit_size,
+                                   dst_bit_size, src);
+      }
+      break;
+   }
+
+   for (c = 0; c < num_components; c++) {
+      LLVMValueRef val = result[c];
+
+      if (!val)
+         continue;
+
+      if (instr->op != nir_op_mov && info->output_type != nir_type_invalid &&
+          nir_alu_type_get_base_type(info->output_type) != nir_type_bool) {
+         if (instr->dest.saturate &&
+             nir_alu_type_get_base_type(info->output_type) == nir_type_float) {
+            val = lp_build_clamp_zero_one_nanzero(get_flt_bld(bld, dst_bit_size),
+                                                  val);
+         }
+         if (instr->op != nir_op_vec2 && instr->op != nir_op_vec3 &&
+             instr->op != nir_op_vec4)
+            val = cast_result(bld, val, info->output_type, dst_bit_size);
+      }
+
+      assign_dest(bld, &instr->dest.dest, c, val);
+   }
+}
+
+
+static void
+visit_load_const(struct lp_build_nir_soa_context *bld,
+                 const nir_load_const_instr *instr)
+{
+   unsigned bit_size = instr->def.bit_size;
+   struct lp_build_context *uint_bld = get_int_bld(bld, TRUE, bit_size);
+   unsigned c;
+
+   for (c = 0; c < instr->def.num_components; c++) {
+      long long val = nir_const_value_as_uint(instr->value[c], bit_size);
+
+      /* true is all ones */
+      if (bit_size == 1)
+         val = val ? -1 : 0;
+
+      bld->ssa_defs[instr->def.index][c] =
+         lp_build_const_int_vec(bld->base.gallivm, uint_bld->type, val);
+   }
+}
+
+
+static void
+visit_ssa_undef(struct lp_build_nir_soa_context *bld,
+                const nir_ssa_undef_instr *instr)
+{
+   struct lp_build_context *uint_bld =
+      get_int_bld(bld, TRUE, instr->def.bit_size);
+   unsigned c;
+
+   for (c = 0; c < instr->def.num_components; c++)
+      bld->ssa_defs[instr->def.index][c] = uint_bld->undef;
+}
+
+
+/**
+ * The slot of a variable dereference, which only has constant array
+ * indices after the prepasses.
+ */
+static unsigned
+get_deref_location(const nir_deref_instr *deref)
+{
+   unsigned offset = 0;
+
+   while (deref->deref_type == nir_deref_type_array) {
+      const nir_deref_instr *parent = nir_deref_instr_parent(deref);
+
+      assert(nir_src_is_const(deref->arr.index));
+      offset += nir_src_as_uint(deref->arr.index) *
+                glsl_count_attribute_slots(deref->type, false);
+      deref = parent;
+   }
+
+   assert(deref->deref_type == nir_deref_type_var);
+   return deref->var->data.driver_location + offset;
+}
+
+
+/**
+ * The base type of an input or output variable, for the 16-bit values
+ * which are converted to and from the 32 bits of the interface.
+ */
+static enum glsl_base_type
+get_io_base_type(const nir_variable *var)
+{
+   return glsl_get_base_type(glsl_without_array(var->type));
+}
+
+
+static void
+visit_load_input(struct lp_build_nir_soa_context *bld,
+                 const nir_intrinsic_instr *instr)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const nir_deref_instr *deref = nir_src_as_deref(instr->src[0]);
+   const nir_variable *var = nir_deref_instr_get_variable(deref);
+   unsigned location = get_deref_location(deref);
+   unsigned bit_size = instr->dest.ssa.bit_size;
+   unsigned c;
+
+   for (c = 0; c < instr->num_components; c++) {
+      LLVMValueRef val;
+
+      if (bit_size == 64) {
+         /* As with TGSI, each 64-bit component takes two channels. */
+         unsigned chan = 2 * c;
+         LLVMValueRef *slot = bld->params->inputs[location + chan / 4];
+
+         val = pack_64(bld,
+                       LLVMBuildBitCast(builder, slot[chan % 4],
+                                        bld->uint_bld.vec_type, ""),
+                       LLVMBuildBitCast(builder, slot[chan % 4 + 1],
+                                        bld->uint_bld.vec_type, ""));
+         assign_dest(bld, &instr->dest, c, val);
+         continue;
+      }
+
+      val = bld->params->inputs[location][c];
+
+      if (bit_size == 1) {
+         /* The front face, which the interpolation gives as +1 or -1. */
+         assert(glsl_type_is_boolean(var->type));
+         val = lp_build_cmp(&bld->base, PIPE_FUNC_GREATER, val,
+                            bld->base.zero);
+      } else if (bit_size == 16 &&
+                 get_io_base_type(var) == GLSL_TYPE_FLOAT16) {
+         val = lp_build_float_to_half(gallivm, val);
+      } else {
+         val = LLVMBuildBitCast(builder, val, bld->uint_bld.vec_type, "");
+         if (bit_size < 32)
+            val = LLVMBuildTrunc(builder, val,
+                                 get_int_bld(bld, TRUE, bit_size)->vec_type,
+                                 "");
+      }
+
+      assign_dest(bld, &instr->dest, c, val);
+   }
+}
+
+
+static void
+visit_store_output(struct lp_build_nir_soa_context *bld,
+                   const nir_intrinsic_instr *instr)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const nir_deref_instr *deref = nir_src_as_deref(instr->src[0]);
+   const nir_variable *var = nir_deref_instr_get_variable(deref);
+   unsigned location = get_deref_location(deref);
+   unsigned write_mask = nir_intrinsic_write_mask(instr);
+   unsigned bit_size = nir_src_bit_size(instr->src[1]);
+   unsigned first_chan = 0;
+   unsigned c;
+
+   /* TGSI semantics: depth is in .z, stencil in .y */
+   if (bld->shader->info.stage == MESA_SHADER_FRAGMENT) {
+      if (var->data.location == FRAG_RESULT_DEPTH)
+         first_chan = 2;
+      else if (var->data.location == FRAG_RESULT_STENCIL)
+         first_chan = 1;
+   }
+
+   for (c = 0; c < instr->num_components; c++) {
+      LLVMValueRef val;
+
+      if (!(write_mask & (1 << c)))
+         continue;
+
+      val = get_src(bld, instr->src[1], c);
+
+      if (bit_size == 64) {
+         /* As with TGSI, each 64-bit component takes two channels. */
+         unsigned chan = 2 * c;
+         LLVMValueRef *slot = bld->outputs[location + chan / 4];
+         unsigned i;
+
+         for (i = 0; i < 2; i++) {
+            LLVMValueRef half = unpack_64(bld, val, i);
+
+            lp_exec_mask_store(&bld->exec_mask, &bld->base,
+                               LLVMBuildBitCast(builder, half,
+                                                bld->base.vec_type, ""),
+                               slot[chan % 4 + i]);
+         }
+         continue;
+      }
+
+      if (bit_size == 16) {
+         switch (get_io_base_type(var)) {
+         case GLSL_TYPE_FLOAT16:
+            val = lp_build_half_to_float(gallivm, val);
+            break;
+         case GLSL_TYPE_INT16:
+            val = LLVMBuildSExt(builder, val, bld->int_bld.vec_type, "");
+            break;
+         default:
+            val = LLVMBuildZExt(builder, val, bld->uint_bld.vec_type, "");
+            break;
+         }
+      }
+
+      val = LLVMBuildBitCast(builder, val, bld->base.vec_type, "");
+      lp_exec_mask_store(&bld->exec_mask, &bld->base, val,
+                         bld->outputs[location][first_chan + c]);
+   }
+}
+
+
+/**
+ * Load from a constant buffer: element is the index of the 32-bit value,
+ * and num_consts the size of the buffer in vec4s.
+ */
+static LLVMValueRef
+emit_load_const_buffer(struct lp_build_nir_soa_context *bld,
+                       unsigned buffer, LLVMValueRef element)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld->uint_bld;
+   LLVMValueRef consts_ptr = bld->consts[buffer];
+   LLVMValueRef res;
+
+   if (LLVMIsConstant(element)) {
+      LLVMValueRef index = LLVMBuildExtractElement(builder, element,
+                                                   lp_build_const_int32(gallivm, 0),
+                                                   "");
+      LLVMValueRef scalar = LLVMBuildLoad(builder,
+                                          LLVMBuildGEP(builder, consts_ptr,
+                                                       &index, 1, ""), "");
+      res = lp_build_broadcast_scalar(&bld->base, scalar);
+   } else {
+      /*
+       * As with TGSI, out of bounds fetches return 0, and fetch from index 0
+       * rather than going through per lane control flow.
+       */
+      LLVMValueRef num_consts = lp_build_broadcast_scalar(uint_bld,
+                                                          bld->consts_sizes[buffer]);
+      LLVMValueRef overflow_mask;
+      unsigned i;
+
+      num_consts = lp_build_shl_imm(uint_bld, num_consts, 2);
+      overflow_mask = lp_build_compare(gallivm, uint_bld->type,
+                                       PIPE_FUNC_GEQUAL, element, num_consts);
+      element = lp_build_select(uint_bld, overflow_mask, uint_bld->zero,
+                                element);
+
+      res = bld->base.undef;
+      for (i = 0; i < bld->base.type.length; i++) {
+         LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+         LLVMValueRef index = LLVMBuildExtractElement(builder, element, ii, "");
+         LLVMValueRef scalar =
+            LLVMBuildLoad(builder,
+                          LLVMBuildGEP(builder, consts_ptr, &index, 1, ""), "");
+         res = LLVMBuildInsertElement(builder, res, scalar, ii, "");
+      }
+
+      res = lp_build_select(&bld->base, overflow_mask, bld->base.zero, res);
+   }
+
+   return LLVMBuildBitCast(builder, res, uint_bld->vec_type, "");
+}
+
+
+static void
+visit_load_const_buffer(struct lp_build_nir_soa_context *bld,
+                        const nir_intrinsic_instr *instr)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld->uint_bld;
+   unsigned bit_size = instr->dest.ssa.bit_size;
+   unsigned buffer;
+   LLVMValueRef offset;
+   unsigned c;
+
+   if (instr->intrinsic == nir_intrinsic_load_uniform) {
+      /* base and offset are in vec4s */
+      buffer = 0;
+      offset = lp_build_add(uint_bld, get_src(bld, instr->src[0], 0),
+                            lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                   nir_intrinsic_base(instr)));
+      offset = lp_build_shl_imm(uint_bld, offset, 4);
+   } else {
+      /* The UBOs follow the default constant buffer; offset is in bytes. */
+      assert(nir_src_is_const(instr->src[0]));
+      buffer = nir_src_as_uint(instr->src[0]) + 1;
+      offset = get_src(bld, instr->src[1], 0);
+   }
+   assert(buffer <= bld->shader->info.num_ubos);
+
+   for (c = 0; c < instr->num_components; c++) {
+      LLVMValueRef byte =
+         lp_build_add(uint_bld, offset,
+                      lp_build_const_int_vec(gallivm, uint_bld->type,
+                                             c * bit_size / 8));
+      LLVMValueRef element = lp_build_shr_imm(uint_bld, byte, 2);
+      LLVMValueRef val = emit_load_const_buffer(bld, buffer, element);
+
+      if (bit_size == 64) {
+         element = lp_build_add(uint_bld, element, uint_bld->one);
+         val = pack_64(bld, val,
+                       emit_load_const_buffer(bld, buffer, element));
+      } else if (bit_size < 32) {
+         /* Take the bytes at the offset from the 32-bit value. */
+         LLVMValueRef shift =
+            lp_build_and(uint_bld, byte,
+                         lp_build_const_int_vec(gallivm, uint_bld->type, 3));
+         shift = lp_build_shl_imm(uint_bld, shift, 3);
+         val = lp_build_shr(uint_bld, val, shift);
+         val = LLVMBuildTrunc(builder, val,
+                              get_int_bld(bld, TRUE, bit_size)->vec_type, "");
+      }
+
+      assign_dest(bld, &instr->dest, c, val);
+   }
+}
+
+
+static void
+visit_discard(struct lp_build_nir_soa_context *bld,
+              const nir_intrinsic_instr *instr)
+{
+   LLVMBuilderRef builder = bld->base.gallivm->builder;
+   LLVMValueRef mask;
+
+   /* The lanes to keep */
+   if (instr->intrinsic == nir_intrinsic_discard_if)
+      mask = LLVMBuildNot(builder, get_src(bld, instr->src[0], 0), "");
+   else
+      mask = LLVMConstNull(bld->base.int_vec_type);
+
+   if (bld->exec_mask.has_mask) {
+      LLVMValueRef invmask = LLVMBuildNot(builder, bld->exec_mask.exec_mask,
+                                          "kilp");
+      mask = LLVMBuildOr(builder, mask, invmask, "");
+   }
+
+   lp_build_mask_update(bld->params->mask, mask);
+}
+
+
+static void
+visit_intrinsic(struct lp_build_nir_soa_context *bld,
+                const nir_intrinsic_instr *instr)
+{
+   nir_variable_mode mode;
+   unsigned c;
+
+   switch (instr->intrinsic) {
+   case nir_intrinsic_load_deref:
+      mode = nir_src_as_deref(instr->src[0])->mode;
+      if (mode == nir_var_shader_in) {
+         visit_load_input(bld, instr);
+         return;
+      }
+      break;
+   case nir_intrinsic_store_deref:
+      mode = nir_src_as_deref(instr->src[0])->mode;
+      if (mode == nir_var_shader_out) {
+         visit_store_output(bld, instr);
+         return;
+      }
+      break;
+   case nir_intrinsic_load_uniform:
+   case nir_intrinsic_load_ubo:
+      visit_load_const_buffer(bld, instr);
+      return;
+   case nir_intrinsic_discard:
+   case nir_intrinsic_discard_if:
+      if (bld->params->mask) {
+         visit_discard(bld, instr);
+         return;
+      }
+      break;
+   default:
+      break;
+   }
+
+   debug_printf("gallivm: unsupported NIR intrinsic %s\n",
+                nir_intrinsic_infos[instr->intrinsic].name);
+
+   if (nir_intrinsic_infos[instr->intrinsic].has_dest) {
+      for (c = 0; c < nir_dest_num_components(instr->dest); c++)
+         assign_dest(bld, &instr->dest, c,
+                     get_int_bld(bld, TRUE,
+                                 nir_dest_bit_size(instr->dest))->undef);
+   }
+}
+
+
+static unsigned
+get_pipe_texture_target(const nir_tex_instr *instr)
+{
+   switch (instr->sampler_dim) {
+   case GLSL_SAMPLER_DIM_1D:
+      return instr->is_array ? PIPE_TEXTURE_1D_ARRAY : PIPE_TEXTURE_1D;
+   case GLSL_SAMPLER_DIM_2D:
+   case GLSL_SAMPLER_DIM_EXTERNAL:
+      return instr->is_array ? PIPE_TEXTURE_2D_ARRAY : PIPE_TEXTURE_2D;
+   case GLSL_SAMPLER_DIM_3D:
+      return PIPE_TEXTURE_3D;
+   case GLSL_SAMPLER_DIM_CUBE:
+      return instr->is_array ? PIPE_TEXTURE_CUBE_ARRAY : PIPE_TEXTURE_CUBE;
+   case GLSL_SAMPLER_DIM_RECT:
+      return PIPE_TEXTURE_RECT;
+   case GLSL_SAMPLER_DIM_BUF:
+      return PIPE_BUFFER;
+   default:
+      unreachable("unsupported sampler dim");
+   }
+}
+
+
+static enum lp_sampler_lod_property
+get_lod_property(struct lp_build_nir_soa_context *bld, nir_src src)
+{
+   if (src.is_ssa && src.ssa->parent_instr->type == nir_instr_type_load_const)
+      return LP_SAMPLER_LOD_SCALAR;
+
+   if (bld->shader->info.stage == MESA_SHADER_FRAGMENT &&
+       !(gallivm_perf & GALLIVM_PERF_NO_QUAD_LOD))
+      return LP_SAMPLER_LOD_PER_QUAD;
+
+   return LP_SAMPLER_LOD_PER_ELEMENT;
+}
+
+
+static void
+visit_txs(struct lp_build_nir_soa_context *bld, const nir_tex_instr *instr)
+{
+   struct lp_sampler_size_query_params params;
+   LLVMValueRef sizes_out[4];
+   int lod_src = nir_tex_instr_src_index(instr, nir_tex_src_lod);
+   unsigned c;
+
+   memset(&params, 0, sizeof(params));
+   params.int_type = bld->int_bld.type;
+   params.texture_unit = instr->texture_index;
+   params.target = get_pipe_texture_target(instr);
+   params.context_ptr = bld->params->context_ptr;
+   params.is_sviewinfo = TRUE;
+   params.lod_property = LP_SAMPLER_LOD_SCALAR;
+   params.sizes_out = sizes_out;
+
+   /* Rectangles and buffers have no levels. */
+   if (lod_src >= 0 &&
+       params.target != PIPE_TEXTURE_RECT && params.target != PIPE_BUFFER) {
+      params.explicit_lod = get_src(bld, instr->src[lod_src].src, 0);
+      params.lod_property = get_lod_property(bld, instr->src[lod_src].src);
+   }
+
+   bld->params->sampler->emit_size_query(bld->params->sampler,
+                                         bld->base.gallivm, &params);
+
+   /* The number of levels is in .w */
+   if (instr->op == nir_texop_query_levels) {
+      assign_dest(bld, &instr->dest, 0, sizes_out[3]);
+      return;
+   }
+
+   for (c = 0; c < nir_dest_num_components(instr->dest); c++)
+      assign_dest(bld, &instr->dest, c, sizes_out[c]);
+}
+
+
+static void
+visit_tex(struct lp_build_nir_soa_context *bld, const nir_tex_instr *instr)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_sampler_params params;
+   struct lp_derivatives derivs;
+   LLVMValueRef coords[5];
+   LLVMValueRef offsets[3] = { NULL };
+   LLVMValueRef texel[4];
+   LLVMValueRef lod = NULL;
+   LLVMValueRef proj = NULL;
+   enum lp_sampler_lod_property lod_property = LP_SAMPLER_LOD_SCALAR;
+   unsigned sample_key;
+   unsigned num_coords = instr->coord_components - instr->is_array;
+   boolean is_fetch = instr->op == nir_texop_txf;
+   boolean is_cube_array = instr->sampler_dim == GLSL_SAMPLER_DIM_CUBE &&
+                           instr->is_array;
+   unsigned i, c;
+
+   if (!bld->params->sampler) {
+      debug_printf("gallivm: texture instruction without a sampler generator\n");
+      for (c = 0; c < nir_dest_num_components(instr->dest); c++)
+         assign_dest(bld, &instr->dest, c, bld->uint_bld.undef);
+      return;
+   }
+
+   if (instr->op == nir_texop_txs || instr->op == nir_texop_query_levels) {
+      visit_txs(bld, instr);
+      return;
+   }
+
+   switch (instr->op) {
+   case nir_texop_tex:
+   case nir_texop_txb:
+   case nir_texop_txl:
+   case nir_texop_txd:
+      sample_key = LP_SAMPLER_OP_TEXTURE << LP_SAMPLER_OP_TYPE_SHIFT;
+      break;
+   case nir_texop_txf:
+      sample_key = LP_SAMPLER_OP_FETCH << LP_SAMPLER_OP_TYPE_SHIFT;
+      break;
+   default:
+      debug_printf("gallivm: unsupported NIR texture op %u\n", instr->op);
+      for (c = 0; c < nir_dest_num_components(instr->dest); c++)
+         assign_dest(bld, &instr->dest, c, bld->uint_bld.undef);
+      return;
+   }
+
+   memset(&params, 0, sizeof(params));
+
+   for (i = 0; i < 5; i++)
+      coords[i] = is_fetch ? bld->int_bld.undef : bld->base.undef;
+
+   for (i = 0; i < instr->num_srcs; i++) {
+      nir_src src = instr->src[i].src;
+
+      switch (instr->src[i].src_type) {
+      case nir_tex_src_coord:
+         for (c = 0; c < instr->coord_components; c++) {
+            LLVMValueRef val = get_src(bld, src, c);
+            unsigned dst = c;
+
+            val = LLVMBuildBitCast(builder, val, is_fetch ?
+                                   bld->int_bld.vec_type : bld->base.vec_type,
+                                   "");
+
+            /* The layer is in the 3rd slot, except for cube arrays. */
+            if (instr->is_array && c == num_coords)
+               dst = is_cube_array ? 3 : 2;
+            coords[dst] = val;
+         }
+         break;
+      case nir_tex_src_projector:
+         proj = lp_build_rcp(&bld->base,
+                             LLVMBuildBitCast(builder, get_src(bld, src, 0),
+                                              bld->base.vec_type, ""));
+         break;
+      case nir_tex_src_comparator:
+         sample_key |= LP_SAMPLER_SHADOW;
+         coords[4] = LLVMBuildBitCast(builder, get_src(bld, src, 0),
+                                      bld->base.vec_type, "");
+         break;
+      case nir_tex_src_offset:
+         sample_key |= LP_SAMPLER_OFFSETS;
+         for (c = 0; c < nir_src_num_components(src); c++)
+            offsets[c] = get_src(bld, src, c);
+         break;
+      case nir_tex_src_bias:
+         sample_key |= LP_SAMPLER_LOD_BIAS << LP_SAMPLER_LOD_CONTROL_SHIFT;
+         lod = LLVMBuildBitCast(builder, get_src(bld, src, 0),
+                                bld->base.vec_type, "");
+         lod_property = get_lod_property(bld, src);
+         break;
+      case nir_tex_src_lod:
+         /* Buffers have no levels. */
+         if (is_fetch && instr->sampler_dim == GLSL_SAMPLER_DIM_BUF)
+            break;
+         sample_key |= LP_SAMPLER_LOD_EXPLICIT << LP_SAMPLER_LOD_CONTROL_SHIFT;
+         lod = get_src(bld, src, 0);
+         if (!is_fetch)
+            lod = LLVMBuildBitCast(builder, lod, bld->base.vec_type, "");
+         lod_property = get_lod_property(bld, src);
+         break;
+      case nir_tex_src_ddx:
+      case nir_tex_src_ddy:
+         for (c = 0; c < nir_src_num_components(src); c++) {
+            LLVMValueRef val = LLVMBuildBitCast(builder, get_src(bld, src, c),
+                                                bld->base.vec_type, "");
+            if (instr->src[i].src_type == nir_tex_src_ddx)
+               derivs.ddx[c] = val;
+            else
+               derivs.ddy[c] = val;
+         }
+         break;
+      default:
+         break;
+      }
+   }
+
+   if (instr->op == nir_texop_txd) {
+      sample_key |= LP_SAMPLER_LOD_DERIVATIVES << LP_SAMPLER_LOD_CONTROL_SHIFT;
+      params.derivs = &derivs;
+      if (bld->shader->info.stage == MESA_SHADER_FRAGMENT &&
+          !(gallivm_perf & GALLIVM_PERF_NO_QUAD_LOD))
+         lod_property = LP_SAMPLER_LOD_PER_QUAD;
+      else
+         lod_property = LP_SAMPLER_LOD_PER_ELEMENT;
+   }
+   sample_key |= lod_property << LP_SAMPLER_LOD_PROPERTY_SHIFT;
+
+   if (proj) {
+      for (c = 0; c < num_coords; c++)
+         coords[c] = lp_build_mul(&bld->base, coords[c], proj);
+      if (instr->is_array && !is_cube_array)
+         coords[2] = lp_build_mul(&bld->base, coords[2], proj);
+      if (sample_key & LP_SAMPLER_SHADOW)
+         coords[4] = lp_build_mul(&bld->base, coords[4], proj);
+   }
+
+   params.type = bld->base.type;
+   params.sample_key = sample_key;
+   params.texture_index = instr->texture_index;
+   /* The sampler isn't used by fetches, see the TGSI translator. */
+   params.sampler_index = is_fetch ? 0 : instr->sampler_index;
+   params.context_ptr = bld->params->context_ptr;
+   params.thread_data_ptr = bld->params->thread_data_ptr;
+   params.coords = coords;
+   params.offsets = offsets;
+   params.lod = lod;
+   params.texel = texel;
+
+   bld->params->sampler->emit_tex_sample(bld->params->sampler, gallivm,
+                                         &params);
+
+   for (c = 0; c < nir_dest_num_components(instr->dest); c++)
+      assign_dest(bld, &instr->dest, c,
+                  LLVMBuildBitCast(builder, texel[c],
+                                   bld->uint_bld.vec_type, ""));
+}
+
+
+static void
+visit_jump(struct lp_build_nir_soa_context *bld, const nir_jump_instr *instr)
+{
+   switch (instr->type) {
+   case nir_jump_break:
+      lp_exec_break(&bld->exec_mask, NULL, FALSE);
+      break;
+   case nir_jump_continue:
+      lp_exec_continue(&bld->exec_mask);
+      break;
+   default:
+      /* Returns are lowered by the prepasses. */
+      unreachable("unsupported jump");
+   }
+}
+
+
+static void
+visit_block(struct lp_build_nir_soa_context *bld, nir_block *block)
+{
+   nir_foreach_instr(instr, block) {
+      switch (instr->type) {
+      case nir_instr_type_alu:
+         visit_alu(bld, nir_instr_as_alu(instr));
+         break;
+      case nir_instr_type_load_const:
+         visit_load_const(bld, nir_instr_as_load_const(instr));
+         break;
+      case nir_instr_type_ssa_undef:
+         visit_ssa_undef(bld, nir_instr_as_ssa_undef(instr));
+         break;
+      case nir_instr_type_intrinsic:
+         visit_intrinsic(bld, nir_instr_as_intrinsic(instr));
+         break;
+      case nir_instr_type_tex:
+         visit_tex(bld, nir_instr_as_tex(instr));
+         break;
+      case nir_instr_type_jump:
+         visit_jump(bld, nir_instr_as_jump(instr));
+         break;
+      case nir_instr_type_deref:
+         /* Resolved by the instructions using them. */
+         break;
+      default:
+         unreachable("unsupported NIR instruction");
+      }
+   }
+}
+
+
+static void
+visit_if(struct lp_build_nir_soa_context *bld, nir_if *if_stmt)
+{
+   lp_exec_mask_cond_push(&bld->exec_mask,
+                          get_src(bld, if_stmt->condition, 0));
+   visit_cf_list(bld, &if_stmt->then_list);
+
+   if (!nir_cf_list_is_empty_block(&if_stmt->else_list)) {
+      lp_exec_mask_cond_invert(&bld->exec_mask);
+      visit_cf_list(bld, &if_stmt->else_list);
+   }
+
+   lp_exec_mask_cond_pop(&bld->exec_mask);
+}
+
+
+static void
+visit_loop(struct lp_build_nir_soa_context *bld, nir_loop *loop)
+{
+   lp_exec_bgnloop(&bld->exec_mask);
+   visit_cf_list(bld, &loop->body);
+   lp_exec_endloop(bld->base.gallivm, &bld->exec_mask);
+}
+
+
+static void
+visit_cf_list(struct lp_build_nir_soa_context *bld, struct exec_list *list)
+{
+   foreach_list_typed(nir_cf_node, node, node, list) {
+      switch (node->type) {
+      case nir_cf_node_block:
+         visit_block(bld, nir_cf_node_as_block(node));
+         break;
+      case nir_cf_node_if:
+         visit_if(bld, nir_cf_node_as_if(node));
+         break;
+      case nir_cf_node_loop:
+         visit_loop(bld, nir_cf_node_as_loop(node));
+         break;
+      default:
+         unreachable("unsupported CF node");
+      }
+   }
+}
+
+
+/**
+ * Create the allocas and load the pointers used by the whole shader, in
+ * the entry block.
+ */
+static void
+emit_prologue(struct lp_build_nir_soa_context *bld, nir_function_impl *impl)
+{
+   struct gallivm_state *gallivm = bld->base.gallivm;
+   const struct lp_build_tgsi_params *params = bld->params;
+   unsigned i, c;
+
+   bld->regs = CALLOC(MAX2(impl->reg_alloc, 1), sizeof(*bld->regs));
+   nir_foreach_register(reg, &impl->registers) {
+      LLVMTypeRef vec_type = get_int_bld(bld, TRUE, reg->bit_size)->vec_type;
+      unsigned size = reg->num_components * MAX2(reg->num_array_elems, 1);
+
+      bld->regs[reg->index] = lp_build_alloca(gallivm,
+                                              LLVMArrayType(vec_type, size),
+                                              "reg");
+   }
+
+   /* The caller reads all the channels of all the outputs. */
+   for (i = 0; i < params->info->num_outputs; i++) {
+      for (c = 0; c < TGSI_NUM_CHANNELS; c++)
+         bld->outputs[i][c] = lp_build_alloca(gallivm, bld->base.vec_type,
+                                              "output");
+   }
+
+   for (i = 0; i <= bld->shader->info.num_ubos; i++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, i);
+
+      assert(i < LP_MAX_TGSI_CONST_BUFFERS);
+      bld->consts[i] = lp_build_array_get(gallivm, params->consts_ptr, index);
+      bld->consts_sizes[i] = lp_build_array_get(gallivm,
+                                                params->const_sizes_ptr,
+                                                index);
+   }
+}
+
+
+void
+lp_build_nir_prepasses(struct nir_shader *nir)
+{
+   nir_function_impl *impl = nir_shader_get_entrypoint(nir);
+
+   NIR_PASS_V(nir, nir_lower_returns);
+
+   /* Make the values leaving loops go through phis, so that they are
+    * copied to registers before the lanes break out.
+    */
+   NIR_PASS_V(nir, nir_convert_to_lcssa, true, true);
+   NIR_PASS_V(nir, nir_convert_from_ssa, true);
+   NIR_PASS_V(nir, nir_lower_locals_to_regs);
+   NIR_PASS_V(nir, nir_remove_dead_derefs);
+   NIR_PASS_V(nir, nir_remove_dead_variables, nir_var_function_temp);
+
+   nir_index_ssa_defs(impl);
+   nir_index_local_regs(impl);
+}
+
+
+void
+lp_build_nir_soa(struct gallivm_state *gallivm,
+                 struct nir_shader *shader,
+                 const struct lp_build_tgsi_params *params,
+                 LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS])
+{
+   struct lp_build_nir_soa_context bld;
+   nir_function_impl *impl = nir_shader_get_entrypoint(shader);
+   struct lp_type type = params->type;
+
+   memset(&bld, 0, sizeof bld);
+
+   lp_build_context_init(&bld.base, gallivm, type);
+   init_bld(gallivm, &bld.dbl_bld, type, TRUE, TRUE, 64);
+   init_bld(gallivm, &bld.uint_bld, type, FALSE, FALSE, 32);
+   init_bld(gallivm, &bld.int_bld, type, FALSE, TRUE, 32);
+   init_bld(gallivm, &bld.uint64_bld, type, FALSE, FALSE, 64);
+   init_bld(gallivm, &bld.int64_bld, type, FALSE, TRUE, 64);
+   init_bld(gallivm, &bld.uint16_bld, type, FALSE, FALSE, 16);
+   init_bld(gallivm, &bld.int16_bld, type, FALSE, TRUE, 16);
+   init_bld(gallivm, &bld.uint8_bld, type, FALSE, FALSE, 8);
+   init_bld(gallivm, &bld.int8_bld, type, FALSE, TRUE, 8);
+
+   bld.params = params;
+   bld.outputs = outputs;
+   bld.shader = shader;
+   bld.ssa_defs = CALLOC(MAX2(impl->ssa_alloc, 1), sizeof(*bld.ssa_defs));
+
+   lp_exec_mask_init(&bld.exec_mask, &bld.int_bld);
+
+   emit_prologue(&bld, impl);
+   visit_cf_list(&bld, &impl->body);
+
+   lp_exec_mask_fini(&bld.exec_mask);
+
+   FREE(bld.regs);
+   FREE(bld.ssa_defs);
+}
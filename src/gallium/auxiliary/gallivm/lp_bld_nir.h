@@ -0,0 +1,69 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * NIR to LLVM IR translation, in SoA layout.
+ *
+ * Each component of a NIR value is an LLVM vector with one element per
+ * fragment (or vertex) processed at once.  SSA values map directly to LLVM
+ * values, so unlike with TGSI nothing goes through memory but the NIR
+ * registers left by the out-of-SSA pass, which are written under the
+ * execution mask of the structured control flow.
+ */
+
+#ifndef LP_BLD_NIR_H
+#define LP_BLD_NIR_H
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_tgsi.h"
+
+struct nir_shader;
+struct nir_shader_compiler_options;
+
+/** The NIR options of the shaders given to lp_build_nir_soa() */
+extern const struct nir_shader_compiler_options gallivm_nir_options;
+
+/**
+ * Lower the shader to the form lp_build_nir_soa() translates.  This must be
+ * called once, before any translation, which then only reads the shader.
+ */
+void
+lp_build_nir_prepasses(struct nir_shader *nir);
+
+/**
+ * Translate the shader, reading the inputs and the resources described in
+ * params, and storing the outputs in allocas created in outputs, indexed by
+ * the driver_location of the output variables.
+ */
+void
+lp_build_nir_soa(struct gallivm_state *gallivm,
+                 struct nir_shader *shader,
+                 const struct lp_build_tgsi_params *params,
+                 LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS]);
+
+#endif /* LP_BLD_NIR_H */
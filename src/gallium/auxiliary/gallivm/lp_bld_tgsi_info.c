@@ -307,7 +307,8 @@ analyse_instruction(struct analysis_context *ctx,
          max_regs = ARRAY_SIZE(info->output);
       } else if (dst->File == TGSI_FILE_ADDRESS) {
          continue;
-      } else if (dst->File == TGSI_FILE_BUFFER) {
+      } else if (dst->File == TGSI_FILE_BUFFER ||
+                 dst->File == TGSI_FILE_MEMORY) {
          continue;
       } else {
          assert(0);
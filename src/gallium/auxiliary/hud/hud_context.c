@@ -1270,6 +1270,24 @@ hud_parse_env_var(struct hud_context *hud, struct pipe_screen *screen,
       else if (strcmp(name, "API-thread-num-syncs") == 0) {
          hud_thread_counter_install(pane, name, HUD_COUNTER_SYNCS);
       }
+      else if (strcmp(name, "API-thread-syncs-per-frame") == 0) {
+         hud_thread_counter_install(pane, name, HUD_COUNTER_SYNCS_PER_FRAME);
+      }
+      else if (strcmp(name, "driver-thread-syncs-transfer") == 0) {
+         hud_tc_syncs_install(pane, name, TC_SYNC_TRANSFER);
+      }
+      else if (strcmp(name, "driver-thread-syncs-subdata") == 0) {
+         hud_tc_syncs_install(pane, name, TC_SYNC_SUBDATA);
+      }
+      else if (strcmp(name, "driver-thread-syncs-query") == 0) {
+         hud_tc_syncs_install(pane, name, TC_SYNC_QUERY);
+      }
+      else if (strcmp(name, "driver-thread-syncs-flush") == 0) {
+         hud_tc_syncs_install(pane, name, TC_SYNC_FLUSH);
+      }
+      else if (strcmp(name, "driver-thread-syncs-other") == 0) {
+         hud_tc_syncs_install(pane, name, TC_SYNC_OTHER);
+      }
       else if (strcmp(name, "main-thread-busy") == 0) {
          hud_thread_busy_install(pane, name, true);
       }
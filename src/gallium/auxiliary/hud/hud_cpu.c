@@ -358,12 +358,25 @@ struct counter_info {
    enum hud_counter counter;
    unsigned last_value;
    int64_t last_time;
+   unsigned frames;
+   enum tc_sync_reason reason;
 };
 
 static unsigned get_counter(struct hud_graph *gr, enum hud_counter counter)
 {
    struct util_queue_monitoring *mon = gr->pane->hud->monitored_queue;
 
+   if (counter == HUD_COUNTER_TC_SYNCS) {
+      struct threaded_context *tc =
+         threaded_context_get(gr->pane->hud->record_pipe);
+      struct counter_info *info = gr->query_data;
+
+      if (!tc)
+         return 0;
+
+      return p_atomic_read(&tc->num_syncs_by_reason[info->reason]);
+   }
+
    if (!mon || !mon->queue)
       return 0;
 
@@ -373,6 +386,7 @@ static unsigned get_counter(struct hud_graph *gr, enum hud_counter counter)
    case HUD_COUNTER_DIRECT:
       return mon->num_direct_items;
    case HUD_COUNTER_SYNCS:
+   case HUD_COUNTER_SYNCS_PER_FRAME:
       return mon->num_syncs;
    default:
       assert(0);
@@ -387,12 +401,20 @@ query_thread_counter(struct hud_graph *gr, struct pipe_context *pipe)
    int64_t now = os_time_get_nano();
 
    if (info->last_time) {
+      /* This is called once per frame. */
+      info->frames++;
+
       if (info->last_time + gr->pane->period*1000 <= now) {
          unsigned current_value = get_counter(gr, info->counter);
+         unsigned value = current_value - info->last_value;
 
-         hud_graph_add_value(gr, current_value - info->last_value);
+         if (info->counter == HUD_COUNTER_SYNCS_PER_FRAME)
+            hud_graph_add_value(gr, (double)value / info->frames);
+         else
+            hud_graph_add_value(gr, value);
          info->last_value = current_value;
          info->last_time = now;
+         info->frames = 0;
       }
    } else {
       /* initialize */
@@ -401,19 +423,20 @@ query_thread_counter(struct hud_graph *gr, struct pipe_context *pipe)
    }
 }
 
-void hud_thread_counter_install(struct hud_pane *pane, const char *name,
-                                enum hud_counter counter)
+static struct hud_graph *
+thread_counter_create(struct hud_pane *pane, const char *name,
+                      enum hud_counter counter)
 {
    struct hud_graph *gr = CALLOC_STRUCT(hud_graph);
    if (!gr)
-      return;
+      return NULL;
 
    strcpy(gr->name, name);
 
    gr->query_data = CALLOC_STRUCT(counter_info);
    if (!gr->query_data) {
       FREE(gr);
-      return;
+      return NULL;
    }
 
    ((struct counter_info*)gr->query_data)->counter = counter;
@@ -423,6 +446,29 @@ void hud_thread_counter_install(struct hud_pane *pane, const char *name,
     * memory debugger.  Use simple free_query_data() wrapper.
     */
    gr->free_query_data = free_query_data;
+   return gr;
+}
+
+void hud_thread_counter_install(struct hud_pane *pane, const char *name,
+                                enum hud_counter counter)
+{
+   struct hud_graph *gr = thread_counter_create(pane, name, counter);
+   if (!gr)
+      return;
+
+   hud_pane_add_graph(pane, gr);
+   hud_pane_set_max_value(pane, 100);
+}
+
+void hud_tc_syncs_install(struct hud_pane *pane, const char *name,
+                          enum tc_sync_reason reason)
+{
+   struct hud_graph *gr = thread_counter_create(pane, name,
+                                                HUD_COUNTER_TC_SYNCS);
+   if (!gr)
+      return;
+
+   ((struct counter_info*)gr->query_data)->reason = reason;
 
    hud_pane_add_graph(pane, gr);
    hud_pane_set_max_value(pane, 100);
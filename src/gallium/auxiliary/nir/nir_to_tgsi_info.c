@@ -0,0 +1,333 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "compiler/nir/nir.h"
+#include "tgsi/tgsi_from_mesa.h"
+#include "tgsi/tgsi_scan.h"
+#include "util/u_math.h"
+#include "nir_to_tgsi_info.h"
+
+
+/**
+ * The interpolation of a fragment shader input, defaulting as
+ * glsl_to_tgsi does for the inputs without a qualifier.
+ */
+static unsigned
+get_interpolate(const nir_variable *var, unsigned semantic_name)
+{
+   switch (var->data.interpolation) {
+   case INTERP_MODE_SMOOTH:
+      return TGSI_INTERPOLATE_PERSPECTIVE;
+   case INTERP_MODE_NOPERSPECTIVE:
+      return TGSI_INTERPOLATE_LINEAR;
+   case INTERP_MODE_FLAT:
+      return TGSI_INTERPOLATE_CONSTANT;
+   default:
+      break;
+   }
+
+   switch (semantic_name) {
+   case TGSI_SEMANTIC_POSITION:
+      return TGSI_INTERPOLATE_LINEAR;
+   case TGSI_SEMANTIC_COLOR:
+   case TGSI_SEMANTIC_BCOLOR:
+      return TGSI_INTERPOLATE_COLOR;
+   case TGSI_SEMANTIC_FACE:
+   case TGSI_SEMANTIC_PRIMID:
+   case TGSI_SEMANTIC_LAYER:
+   case TGSI_SEMANTIC_VIEWPORT_INDEX:
+      return TGSI_INTERPOLATE_CONSTANT;
+   default:
+      return TGSI_INTERPOLATE_PERSPECTIVE;
+   }
+}
+
+
+/**
+ * The channels of each slot of a variable, all of them for the types which
+ * don't map to one vector per slot.
+ */
+static unsigned
+get_usage_mask(const nir_variable *var)
+{
+   const struct glsl_type *type = glsl_without_array(var->type);
+
+   if (!glsl_type_is_vector_or_scalar(type) || glsl_type_is_64bit(type))
+      return TGSI_WRITEMASK_XYZW;
+
+   return ((1 << glsl_get_vector_elements(type)) - 1) <<
+          var->data.location_frac;
+}
+
+
+static void
+scan_input(const nir_shader *nir, const nir_variable *var,
+           bool needs_texcoord_semantic, struct tgsi_shader_info *info)
+{
+   gl_shader_stage stage = nir->info.stage;
+   unsigned num_slots = glsl_count_attribute_slots(var->type,
+                                                   stage == MESA_SHADER_VERTEX);
+   unsigned i;
+
+   for (i = 0; i < num_slots; i++) {
+      unsigned index = var->data.driver_location + i;
+      unsigned semantic_name, semantic_index;
+
+      if (index >= PIPE_MAX_SHADER_INPUTS)
+         break;
+
+      if (stage == MESA_SHADER_VERTEX) {
+         semantic_name = TGSI_SEMANTIC_GENERIC;
+         semantic_index = index;
+      } else {
+         tgsi_get_gl_varying_semantic(var->data.location + i,
+                                      needs_texcoord_semantic,
+                                      &semantic_name, &semantic_index);
+      }
+
+      info->input_semantic_name[index] = semantic_name;
+      info->input_semantic_index[index] = semantic_index;
+      info->input_usage_mask[index] |= get_usage_mask(var);
+      info->num_inputs = MAX2(info->num_inputs, index + 1);
+
+      if (stage != MESA_SHADER_FRAGMENT)
+         continue;
+
+      info->input_interpolate[index] = get_interpolate(var, semantic_name);
+      if (var->data.sample)
+         info->input_interpolate_loc[index] = TGSI_INTERPOLATE_LOC_SAMPLE;
+      else if (var->data.centroid)
+         info->input_interpolate_loc[index] = TGSI_INTERPOLATE_LOC_CENTROID;
+      else
+         info->input_interpolate_loc[index] = TGSI_INTERPOLATE_LOC_CENTER;
+
+      switch (semantic_name) {
+      case TGSI_SEMANTIC_POSITION:
+         info->reads_position = TRUE;
+         break;
+      case TGSI_SEMANTIC_FACE:
+         info->uses_frontface = TRUE;
+         break;
+      case TGSI_SEMANTIC_PRIMID:
+         info->uses_primid = TRUE;
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+
+static void
+scan_output(const nir_shader *nir, const nir_variable *var,
+            bool needs_texcoord_semantic, struct tgsi_shader_info *info)
+{
+   unsigned num_slots = glsl_count_attribute_slots(var->type, false);
+   unsigned i;
+
+   for (i = 0; i < num_slots; i++) {
+      unsigned index = var->data.driver_location + i;
+      unsigned semantic_name, semantic_index;
+      unsigned usage_mask = get_usage_mask(var);
+
+      if (index >= PIPE_MAX_SHADER_OUTPUTS)
+         break;
+
+      if (nir->info.stage == MESA_SHADER_FRAGMENT) {
+         tgsi_get_gl_frag_result_semantic(var->data.location + i,
+                                          &semantic_name, &semantic_index);
+
+         /* TGSI semantics: depth is in .z, stencil in .y */
+         switch (var->data.location) {
+         case FRAG_RESULT_COLOR:
+            info->properties[TGSI_PROPERTY_FS_COLOR0_WRITES_ALL_CBUFS] = 1;
+            break;
+         case FRAG_RESULT_DEPTH:
+            info->writes_z = TRUE;
+            usage_mask = TGSI_WRITEMASK_Z;
+            break;
+         case FRAG_RESULT_STENCIL:
+            info->writes_stencil = TRUE;
+            usage_mask = TGSI_WRITEMASK_Y;
+            break;
+         case FRAG_RESULT_SAMPLE_MASK:
+            info->writes_samplemask = TRUE;
+            break;
+         default:
+            break;
+         }
+      } else {
+         tgsi_get_gl_varying_semantic(var->data.location + i,
+                                      needs_texcoord_semantic,
+                                      &semantic_name, &semantic_index);
+      }
+
+      info->output_semantic_name[index] = semantic_name;
+      info->output_semantic_index[index] = semantic_index;
+      info->output_usagemask[index] |= usage_mask;
+      info->num_outputs = MAX2(info->num_outputs, index + 1);
+   }
+}
+
+
+/**
+ * Whether an intrinsic may write to memory other than the outputs and the
+ * function temporaries.  This is conservative, as it is only used to keep
+ * the shaders with side effects from being skipped or reordered.
+ */
+static bool
+writes_memory(const nir_intrinsic_instr *instr)
+{
+   const nir_intrinsic_info *intr_info = &nir_intrinsic_infos[instr->intrinsic];
+
+   switch (instr->intrinsic) {
+   case nir_intrinsic_discard:
+   case nir_intrinsic_discard_if:
+      return false;
+   case nir_intrinsic_store_deref:
+      return !(nir_src_as_deref(instr->src[0])->mode &
+               (nir_var_shader_out | nir_var_function_temp |
+                nir_var_shader_temp));
+   default:
+      return !(intr_info->flags & NIR_INTRINSIC_CAN_ELIMINATE);
+   }
+}
+
+
+static void
+scan_instr(const nir_instr *instr, struct tgsi_shader_info *info)
+{
+   info->num_instructions++;
+
+   switch (instr->type) {
+   case nir_instr_type_intrinsic: {
+      const nir_intrinsic_instr *intr = nir_instr_as_intrinsic(instr);
+
+      switch (intr->intrinsic) {
+      case nir_intrinsic_discard:
+      case nir_intrinsic_discard_if:
+         info->uses_kill = TRUE;
+         break;
+      case nir_intrinsic_load_front_face:
+         info->uses_frontface = TRUE;
+         break;
+      case nir_intrinsic_load_primitive_id:
+         info->uses_primid = TRUE;
+         break;
+      case nir_intrinsic_load_sample_mask_in:
+         info->reads_samplemask = TRUE;
+         break;
+      default:
+         break;
+      }
+
+      if (writes_memory(intr))
+         info->writes_memory = TRUE;
+      break;
+   }
+   case nir_instr_type_tex: {
+      const nir_tex_instr *tex = nir_instr_as_tex(instr);
+
+      info->file_mask[TGSI_FILE_SAMPLER_VIEW] |= 1u << tex->texture_index;
+
+      /* The fetches and queries don't use a sampler state. */
+      switch (tex->op) {
+      case nir_texop_txf:
+      case nir_texop_txf_ms:
+      case nir_texop_txs:
+      case nir_texop_query_levels:
+      case nir_texop_texture_samples:
+      case nir_texop_samples_identical:
+         break;
+      default:
+         info->file_mask[TGSI_FILE_SAMPLER] |= 1u << tex->sampler_index;
+         break;
+      }
+      break;
+   }
+   default:
+      break;
+   }
+}
+
+
+void
+nir_tgsi_scan_shader(const struct nir_shader *nir,
+                     bool needs_texcoord_semantic,
+                     struct tgsi_shader_info *info)
+{
+   unsigned i;
+
+   memset(info, 0, sizeof *info);
+   for (i = 0; i < TGSI_FILE_COUNT; i++)
+      info->file_max[i] = -1;
+
+   info->processor = pipe_shader_type_from_mesa(nir->info.stage);
+
+   nir_foreach_variable(var, &nir->inputs)
+      scan_input(nir, var, needs_texcoord_semantic, info);
+   nir_foreach_variable(var, &nir->outputs)
+      scan_output(nir, var, needs_texcoord_semantic, info);
+
+   nir_foreach_function(func, nir) {
+      if (!func->impl)
+         continue;
+
+      nir_foreach_block(block, func->impl) {
+         nir_foreach_instr(instr, block)
+            scan_instr(instr, info);
+      }
+   }
+
+   info->file_count[TGSI_FILE_INPUT] = info->num_inputs;
+   info->file_max[TGSI_FILE_INPUT] = (int)info->num_inputs - 1;
+   info->file_count[TGSI_FILE_OUTPUT] = info->num_outputs;
+   info->file_max[TGSI_FILE_OUTPUT] = (int)info->num_outputs - 1;
+
+   info->file_count[TGSI_FILE_SAMPLER] =
+      util_bitcount(info->file_mask[TGSI_FILE_SAMPLER]);
+   info->file_max[TGSI_FILE_SAMPLER] =
+      (int)util_last_bit(info->file_mask[TGSI_FILE_SAMPLER]) - 1;
+   info->file_count[TGSI_FILE_SAMPLER_VIEW] =
+      util_bitcount(info->file_mask[TGSI_FILE_SAMPLER_VIEW]);
+   info->file_max[TGSI_FILE_SAMPLER_VIEW] =
+      (int)util_last_bit(info->file_mask[TGSI_FILE_SAMPLER_VIEW]) - 1;
+
+   if (nir->info.stage == MESA_SHADER_FRAGMENT) {
+      if (nir->info.fs.uses_discard)
+         info->uses_kill = TRUE;
+      info->properties[TGSI_PROPERTY_FS_COORD_ORIGIN] =
+         nir->info.fs.origin_upper_left ? TGSI_FS_COORD_ORIGIN_UPPER_LEFT :
+                                          TGSI_FS_COORD_ORIGIN_LOWER_LEFT;
+      info->properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER] =
+         nir->info.fs.pixel_center_integer ?
+         TGSI_FS_COORD_PIXEL_CENTER_INTEGER :
+         TGSI_FS_COORD_PIXEL_CENTER_HALF_INTEGER;
+      info->properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL] =
+         nir->info.fs.early_fragment_tests;
+   }
+}
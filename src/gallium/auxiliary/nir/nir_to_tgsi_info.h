@@ -0,0 +1,56 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Describe a NIR shader with the TGSI shader info, for the drivers and
+ * modules which take NIR shaders but were written around tgsi_scan_shader().
+ */
+
+#ifndef NIR_TO_TGSI_INFO_H
+#define NIR_TO_TGSI_INFO_H
+
+#include <stdbool.h>
+
+struct nir_shader;
+struct tgsi_shader_info;
+
+/**
+ * Fill info from the variables and the instructions of nir.  The TGSI
+ * input and output indices are the driver_location of the variables, and
+ * the semantics are those the state tracker gives with the
+ * PIPE_CAP_TGSI_TEXCOORD of the screen, needs_texcoord_semantic.
+ *
+ * Only the I/O, resource and fragment fields are set; the TGSI register
+ * and opcode counts other than num_instructions are left at zero.
+ */
+void
+nir_tgsi_scan_shader(const struct nir_shader *nir,
+                     bool needs_texcoord_semantic,
+                     struct tgsi_shader_info *info);
+
+#endif /* NIR_TO_TGSI_INFO_H */
@@ -32,8 +32,16 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_state.h"
+#include "util/u_debug.h"
 #include "translate.h"
 
+#if defined(PIPE_ARCH_AARCH64)
+/* The NEON backend hasn't been run on AArch64 hardware yet, so it is only
+ * used on request until it has been checked against translate_generic.
+ */
+DEBUG_GET_ONCE_BOOL_OPTION(translate_neon, "TRANSLATE_NEON", FALSE)
+#endif
+
 struct translate *translate_create( const struct translate_key *key )
 {
    struct translate *translate = NULL;
@@ -42,6 +50,12 @@ struct translate *translate_create( const struct translate_key *key )
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
+#elif defined(PIPE_ARCH_AARCH64)
+   if (debug_get_option_translate_neon()) {
+      translate = translate_neon_create( key );
+      if (translate)
+         return translate;
+   }
 #else
    (void)translate;
 #endif
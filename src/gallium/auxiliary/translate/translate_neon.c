@@ -0,0 +1,723 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Vertex translation with NEON intrinsics for AArch64.
+ *
+ * Instead of calling a fetch and an emit function for every attribute of
+ * every vertex like translate_generic.c, the vertices are processed in
+ * batches: the source pointers of a batch are gathered once per buffer, and
+ * then each element converts the whole batch with a loop specialized for its
+ * input channel type, keeping each attribute in a single NEON register.
+ *
+ * Only the format pairs common in vertex fetch and emit are handled; keys
+ * with any other element return NULL so that the generic path is used.
+ */
+
+#include "pipe/p_config.h"
+#include "pipe/p_compiler.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_format.h"
+
+#include "translate.h"
+
+
+#if defined(PIPE_ARCH_AARCH64) && !defined(EMBEDDED_DEVICE)
+
+#include <arm_neon.h>
+
+
+/* number of vertices whose source pointers are gathered at once */
+#define NEON_BATCH 32
+
+
+enum neon_output {
+   NEON_OUTPUT_FLOAT1,
+   NEON_OUTPUT_FLOAT2,
+   NEON_OUTPUT_FLOAT3,
+   NEON_OUTPUT_FLOAT4,
+   NEON_OUTPUT_R8G8B8A8_UNORM,
+   NEON_OUTPUT_B8G8R8A8_UNORM,
+};
+
+enum neon_input {
+   NEON_INPUT_UNORM8,
+   NEON_INPUT_SNORM8,
+   NEON_INPUT_USCALED8,
+   NEON_INPUT_SSCALED8,
+   NEON_INPUT_UNORM16,
+   NEON_INPUT_SNORM16,
+   NEON_INPUT_USCALED16,
+   NEON_INPUT_SSCALED16,
+   NEON_INPUT_FLOAT16,
+   NEON_INPUT_FLOAT32,
+   NEON_INPUT_COUNT
+};
+
+
+struct neon_element;
+
+typedef void (*neon_convert_func)(const struct neon_element *elem,
+                                  uint8_t *dst, unsigned dst_stride,
+                                  const uint8_t * const *src,
+                                  unsigned count);
+
+struct neon_buffer
+{
+   const uint8_t *base_ptr;
+   unsigned stride;
+   unsigned max_index;
+};
+
+/**
+ * A buffer fetched with a given instance divisor, as in translate_sse.c.
+ * Each variant gets its own array of source pointers.
+ */
+struct neon_buffer_variant
+{
+   unsigned buffer_index;
+   unsigned instance_divisor;
+};
+
+struct neon_element
+{
+   enum translate_element_type type;
+   neon_convert_func convert;
+   unsigned variant;
+   unsigned input_offset;
+   unsigned output_offset;
+   enum neon_output output;
+
+   /* normalization of integer inputs */
+   float scale;
+
+   /* instance ids are stored as integers rather than converted */
+   boolean instance_id_integer;
+};
+
+struct translate_neon
+{
+   struct translate translate;
+
+   struct neon_buffer buffer[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_buffers;
+
+   struct neon_buffer_variant buffer_variant[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_buffer_variants;
+
+   struct neon_element element[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_elements;
+
+   /* source pointers of the current batch, per buffer variant */
+   const uint8_t *src[TRANSLATE_MAX_ATTRIBS][NEON_BATCH];
+};
+
+
+static inline struct translate_neon *
+translate_neon(struct translate *translate)
+{
+   return (struct translate_neon *)translate;
+}
+
+
+/*
+ * Loads of exactly nr channels, without reading past the attribute.  The
+ * missing channels are zero.
+ */
+
+static ALWAYS_INLINE float32x4_t
+neon_load_8(const uint8_t *src, unsigned nr, boolean is_signed)
+{
+   uint32_t bits = 0;
+   uint8x8_t v;
+
+   memcpy(&bits, src, nr);
+   v = vreinterpret_u8_u32(vdup_n_u32(bits));
+
+   if (is_signed)
+      return vcvtq_f32_s32(vmovl_s16(vget_low_s16(
+                vmovl_s8(vreinterpret_s8_u8(v)))));
+   else
+      return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(v))));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_16(const uint8_t *src, unsigned nr, boolean is_signed)
+{
+   uint64_t bits = 0;
+
+   memcpy(&bits, src, nr * 2);
+
+   if (is_signed)
+      return vcvtq_f32_s32(vmovl_s16(vcreate_s16(bits)));
+   else
+      return vcvtq_f32_u32(vmovl_u16(vcreate_u16(bits)));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_half(const uint8_t *src, unsigned nr)
+{
+   uint64_t bits = 0;
+
+   memcpy(&bits, src, nr * 2);
+
+   return vcvt_f32_f16(vreinterpret_f16_u16(vcreate_u16(bits)));
+}
+
+static ALWAYS_INLINE float32x4_t
+neon_load_float(const uint8_t *src, unsigned nr)
+{
+   float data[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+   memcpy(data, src, nr * 4);
+
+   return vld1q_f32(data);
+}
+
+
+static ALWAYS_INLINE void
+neon_store(enum neon_output output, float32x4_t v, uint8_t *dst)
+{
+   float *fdst = (float *)dst;
+
+   switch (output) {
+   case NEON_OUTPUT_FLOAT4:
+      vst1q_f32(fdst, v);
+      break;
+   case NEON_OUTPUT_FLOAT3:
+      vst1_f32(fdst, vget_low_f32(v));
+      vst1q_lane_f32(fdst + 2, v, 2);
+      break;
+   case NEON_OUTPUT_FLOAT2:
+      vst1_f32(fdst, vget_low_f32(v));
+      break;
+   case NEON_OUTPUT_FLOAT1:
+      vst1q_lane_f32(fdst, v, 0);
+      break;
+   case NEON_OUTPUT_R8G8B8A8_UNORM:
+   case NEON_OUTPUT_B8G8R8A8_UNORM: {
+      uint32x4_t u;
+      uint8x8_t b;
+
+      /* truncate like translate_generic.c, but clamp first as narrowing
+       * only keeps the low bits */
+      v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+      u = vcvtq_u32_f32(vmulq_n_f32(v, 255.0f));
+      b = vmovn_u16(vcombine_u16(vmovn_u32(u), vdup_n_u16(0)));
+
+      if (output == NEON_OUTPUT_B8G8R8A8_UNORM)
+         b = vtbl1_u8(b, vcreate_u8(0x0706050403000102ULL));
+
+      vst1_lane_u32((uint32_t *)dst, vreinterpret_u32_u8(b), 0);
+      break;
+   }
+   }
+}
+
+
+/**
+ * Convert one element of a batch of vertices.  The input channel type and
+ * count are constant so that the load is inlined; the output is chosen with
+ * a switch that is well predicted within the loop.
+ */
+#define NEON_CONVERT(NAME, NR, LOAD, NORMALIZED)                        \
+static void                                                             \
+neon_convert_##NAME##_##NR(const struct neon_element *elem,            \
+                           uint8_t *dst, unsigned dst_stride,           \
+                           const uint8_t * const *src,                  \
+                           unsigned count)                              \
+{                                                                       \
+   const enum neon_output output = elem->output;                        \
+   const unsigned offset = elem->input_offset;                          \
+   const float scale = elem->scale;                                     \
+   unsigned i;                                                          \
+                                                                        \
+   for (i = 0; i < count; i++) {                                        \
+      float32x4_t v = LOAD(src[i] + offset, NR);                        \
+                                                                        \
+      if (NORMALIZED)                                                   \
+         v = vmulq_n_f32(v, scale);                                     \
+      if (NR < 4)                                                       \
+         v = vsetq_lane_f32(1.0f, v, 3);                                \
+                                                                        \
+      neon_store(output, v, dst);                                       \
+      dst += dst_stride;                                                \
+   }                                                                    \
+}
+
+#define NEON_LOAD_U8(src, nr)  neon_load_8(src, nr, FALSE)
+#define NEON_LOAD_S8(src, nr)  neon_load_8(src, nr, TRUE)
+#define NEON_LOAD_U16(src, nr) neon_load_16(src, nr, FALSE)
+#define NEON_LOAD_S16(src, nr) neon_load_16(src, nr, TRUE)
+
+#define NEON_CONVERT_ALL(NAME, LOAD, NORMALIZED) \
+   NEON_CONVERT(NAME, 1, LOAD, NORMALIZED)       \
+   NEON_CONVERT(NAME, 2, LOAD, NORMALIZED)       \
+   NEON_CONVERT(NAME, 3, LOAD, NORMALIZED)       \
+   NEON_CONVERT(NAME, 4, LOAD, NORMALIZED)
+
+NEON_CONVERT_ALL(unorm8, NEON_LOAD_U8, TRUE)
+NEON_CONVERT_ALL(snorm8, NEON_LOAD_S8, TRUE)
+NEON_CONVERT_ALL(uscaled8, NEON_LOAD_U8, FALSE)
+NEON_CONVERT_ALL(sscaled8, NEON_LOAD_S8, FALSE)
+NEON_CONVERT_ALL(unorm16, NEON_LOAD_U16, TRUE)
+NEON_CONVERT_ALL(snorm16, NEON_LOAD_S16, TRUE)
+NEON_CONVERT_ALL(uscaled16, NEON_LOAD_U16, FALSE)
+NEON_CONVERT_ALL(sscaled16, NEON_LOAD_S16, FALSE)
+NEON_CONVERT_ALL(float16, neon_load_half, FALSE)
+NEON_CONVERT_ALL(float32, neon_load_float, FALSE)
+
+#define NEON_CONVERT_ENTRY(NAME) \
+   { neon_convert_##NAME##_1, neon_convert_##NAME##_2, \
+     neon_convert_##NAME##_3, neon_convert_##NAME##_4 }
+
+static const neon_convert_func neon_convert_funcs[NEON_INPUT_COUNT][4] = {
+   NEON_CONVERT_ENTRY(unorm8),
+   NEON_CONVERT_ENTRY(snorm8),
+   NEON_CONVERT_ENTRY(uscaled8),
+   NEON_CONVERT_ENTRY(sscaled8),
+   NEON_CONVERT_ENTRY(unorm16),
+   NEON_CONVERT_ENTRY(snorm16),
+   NEON_CONVERT_ENTRY(uscaled16),
+   NEON_CONVERT_ENTRY(sscaled16),
+   NEON_CONVERT_ENTRY(float16),
+   NEON_CONVERT_ENTRY(float32),
+};
+
+
+/**
+ * Copy elements whose input and output formats are the same.
+ */
+#define NEON_COPY(SIZE)                                                 \
+static void                                                             \
+neon_copy_##SIZE(const struct neon_element *elem,                      \
+                 uint8_t *dst, unsigned dst_stride,                     \
+                 const uint8_t * const *src,                            \
+                 unsigned count)                                        \
+{                                                                       \
+   const unsigned offset = elem->input_offset;                          \
+   unsigned i;                                                          \
+                                                                        \
+   for (i = 0; i < count; i++) {                                        \
+      memcpy(dst, src[i] + offset, SIZE);                               \
+      dst += dst_stride;                                                \
+   }                                                                    \
+}
+
+NEON_COPY(4)
+NEON_COPY(8)
+NEON_COPY(12)
+NEON_COPY(16)
+
+
+static void
+neon_emit_instance_id(const struct neon_element *elem,
+                      uint8_t *dst, unsigned dst_stride,
+                      unsigned instance_id, unsigned count)
+{
+   uint32_t value;
+   unsigned i;
+
+   if (elem->instance_id_integer) {
+      value = instance_id;
+   }
+   else {
+      float f = (float)instance_id;
+      memcpy(&value, &f, 4);
+   }
+
+   for (i = 0; i < count; i++) {
+      memcpy(dst, &value, 4);
+      dst += dst_stride;
+   }
+}
+
+
+/**
+ * Run the elements on count vertices, whose indices are read from elts with
+ * elt_size bytes each, or are consecutive from start when elt_size is 0.
+ */
+static ALWAYS_INLINE void
+neon_run_common(struct translate_neon *p,
+                const void *elts, unsigned elt_size,
+                unsigned start, unsigned count,
+                unsigned start_instance, unsigned instance_id,
+                uint8_t *vert)
+{
+   const unsigned output_stride = p->translate.key.output_stride;
+   unsigned first;
+
+   for (first = 0; first < count; first += NEON_BATCH) {
+      const unsigned n = MIN2(count - first, NEON_BATCH);
+      unsigned i, j;
+
+      for (i = 0; i < p->nr_buffer_variants; i++) {
+         const struct neon_buffer_variant *variant = &p->buffer_variant[i];
+         const struct neon_buffer *buffer =
+            &p->buffer[variant->buffer_index];
+         const uint8_t **src = p->src[i];
+
+         if (variant->instance_divisor) {
+            /* Like translate_generic.c, this index is not clamped. */
+            const unsigned index =
+               start_instance + instance_id / variant->instance_divisor;
+            const uint8_t *ptr =
+               buffer->base_ptr + (ptrdiff_t)buffer->stride * index;
+
+            for (j = 0; j < n; j++)
+               src[j] = ptr;
+         }
+         else {
+            for (j = 0; j < n; j++) {
+               unsigned index;
+
+               switch (elt_size) {
+               case 1:
+                  index = ((const uint8_t *)elts)[first + j];
+                  break;
+               case 2:
+                  index = ((const uint16_t *)elts)[first + j];
+                  break;
+               case 4:
+                  index = ((const uint32_t *)elts)[first + j];
+                  break;
+               default:
+                  index = start + first + j;
+                  break;
+               }
+
+               /* clamp to avoid going out of bounds */
+               index = MIN2(index, buffer->max_index);
+
+               src[j] = buffer->base_ptr + (ptrdiff_t)buffer->stride * index;
+            }
+         }
+      }
+
+      for (i = 0; i < p->nr_elements; i++) {
+         const struct neon_element *elem = &p->element[i];
+         uint8_t *dst = vert + elem->output_offset;
+
+         if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID)
+            neon_emit_instance_id(elem, dst, output_stride, instance_id, n);
+         else
+            elem->convert(elem, dst, output_stride,
+                          p->src[elem->variant], n);
+      }
+
+      vert += n * output_stride;
+   }
+}
+
+
+static void PIPE_CDECL
+neon_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned start_instance,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   neon_run_common(translate_neon(translate), elts, 4, 0, count,
+                   start_instance, instance_id, output_buffer);
+}
+
+static void PIPE_CDECL
+neon_run_elts16(struct translate *translate,
+                const uint16_t *elts,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   neon_run_common(translate_neon(translate), elts, 2, 0, count,
+                   start_instance, instance_id, output_buffer);
+}
+
+static void PIPE_CDECL
+neon_run_elts8(struct translate *translate,
+               const uint8_t *elts,
+               unsigned count,
+               unsigned start_instance,
+               unsigned instance_id,
+               void *output_buffer)
+{
+   neon_run_common(translate_neon(translate), elts, 1, 0, count,
+                   start_instance, instance_id, output_buffer);
+}
+
+static void PIPE_CDECL
+neon_run(struct translate *translate,
+         unsigned start,
+         unsigned count,
+         unsigned start_instance,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   neon_run_common(translate_neon(translate), NULL, 0, start, count,
+                   start_instance, instance_id, output_buffer);
+}
+
+
+static void
+neon_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_neon *p = translate_neon(translate);
+
+   if (buf < p->nr_buffers) {
+      p->buffer[buf].base_ptr = (const uint8_t *)ptr;
+      p->buffer[buf].stride = stride;
+      p->buffer[buf].max_index = max_index;
+   }
+}
+
+
+static void
+neon_release(struct translate *translate)
+{
+   FREE(translate);
+}
+
+
+static boolean
+neon_get_output(enum pipe_format format, enum neon_output *output)
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+      *output = NEON_OUTPUT_FLOAT1;
+      return TRUE;
+   case PIPE_FORMAT_R32G32_FLOAT:
+      *output = NEON_OUTPUT_FLOAT2;
+      return TRUE;
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+      *output = NEON_OUTPUT_FLOAT3;
+      return TRUE;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      *output = NEON_OUTPUT_FLOAT4;
+      return TRUE;
+   case PIPE_FORMAT_R8G8B8A8_UNORM:
+      *output = NEON_OUTPUT_R8G8B8A8_UNORM;
+      return TRUE;
+   case PIPE_FORMAT_B8G8R8A8_UNORM:
+      *output = NEON_OUTPUT_B8G8R8A8_UNORM;
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+/**
+ * Pick the conversion of a plain RGBA format whose channels all have the
+ * same type, in order, with the default 0/0/0/1 for the missing ones.
+ */
+static boolean
+neon_get_input(const struct util_format_description *desc,
+               struct neon_element *elem)
+{
+   const struct util_format_channel_description *channel = &desc->channel[0];
+   const unsigned nr = desc->nr_channels;
+   enum neon_input input;
+   unsigned i;
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       nr < 1 || nr > 4 ||
+       channel->pure_integer ||
+       desc->block.bits != nr * channel->size)
+      return FALSE;
+
+   for (i = 0; i < 4; i++) {
+      const unsigned expected = i < nr ? i :
+                                i == 3 ? PIPE_SWIZZLE_1 : PIPE_SWIZZLE_0;
+
+      if (desc->swizzle[i] != expected)
+         return FALSE;
+
+      if (i < nr &&
+          (desc->channel[i].type != channel->type ||
+           desc->channel[i].size != channel->size ||
+           desc->channel[i].normalized != channel->normalized))
+         return FALSE;
+   }
+
+   elem->scale = 1.0f;
+
+   switch (channel->type) {
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      if (channel->size == 8) {
+         input = channel->normalized ? NEON_INPUT_UNORM8 : NEON_INPUT_USCALED8;
+         elem->scale = 1.0f / 255.0f;
+      }
+      else if (channel->size == 16) {
+         input = channel->normalized ? NEON_INPUT_UNORM16 : NEON_INPUT_USCALED16;
+         elem->scale = 1.0f / 65535.0f;
+      }
+      else
+         return FALSE;
+      break;
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (channel->size == 8) {
+         input = channel->normalized ? NEON_INPUT_SNORM8 : NEON_INPUT_SSCALED8;
+         elem->scale = 1.0f / 127.0f;
+      }
+      else if (channel->size == 16) {
+         input = channel->normalized ? NEON_INPUT_SNORM16 : NEON_INPUT_SSCALED16;
+         elem->scale = 1.0f / 32767.0f;
+      }
+      else
+         return FALSE;
+      break;
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (channel->size == 16)
+         input = NEON_INPUT_FLOAT16;
+      else if (channel->size == 32)
+         input = NEON_INPUT_FLOAT32;
+      else
+         return FALSE;
+      break;
+   default:
+      return FALSE;
+   }
+
+   elem->convert = neon_convert_funcs[input][nr - 1];
+   return TRUE;
+}
+
+
+static neon_convert_func
+neon_get_copy(const struct util_format_description *desc)
+{
+   if (desc->block.width != 1 || desc->block.height != 1)
+      return NULL;
+
+   switch (desc->block.bits) {
+   case 32:
+      return neon_copy_4;
+   case 64:
+      return neon_copy_8;
+   case 96:
+      return neon_copy_12;
+   case 128:
+      return neon_copy_16;
+   default:
+      return NULL;
+   }
+}
+
+
+struct translate *
+translate_neon_create(const struct translate_key *key)
+{
+   struct translate_neon *p = CALLOC_STRUCT(translate_neon);
+   unsigned i, j;
+
+   if (!p)
+      return NULL;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   p->translate.key = *key;
+   p->translate.release = neon_release;
+   p->translate.set_buffer = neon_set_buffer;
+   p->translate.run_elts = neon_run_elts;
+   p->translate.run_elts16 = neon_run_elts16;
+   p->translate.run_elts8 = neon_run_elts8;
+   p->translate.run = neon_run;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *element = &key->element[i];
+      struct neon_element *elem = &p->element[i];
+
+      elem->type = element->type;
+      elem->output_offset = element->output_offset;
+
+      if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         if (element->output_format == PIPE_FORMAT_R32_USCALED ||
+             element->output_format == PIPE_FORMAT_R32_SSCALED)
+            elem->instance_id_integer = TRUE;
+         else if (element->output_format != PIPE_FORMAT_R32_FLOAT)
+            goto fail;
+         continue;
+      }
+
+      if (element->input_buffer >= TRANSLATE_MAX_ATTRIBS)
+         goto fail;
+
+      elem->input_offset = element->input_offset;
+
+      if (element->input_format == element->output_format) {
+         elem->convert =
+            neon_get_copy(util_format_description(element->input_format));
+         if (!elem->convert)
+            goto fail;
+      }
+      else {
+         if (!neon_get_output(element->output_format, &elem->output) ||
+             !neon_get_input(util_format_description(element->input_format),
+                             elem))
+            goto fail;
+      }
+
+      p->nr_buffers = MAX2(p->nr_buffers, element->input_buffer + 1);
+
+      /* share the source pointers of elements from the same buffer */
+      for (j = 0; j < p->nr_buffer_variants; j++) {
+         if (p->buffer_variant[j].buffer_index == element->input_buffer &&
+             p->buffer_variant[j].instance_divisor ==
+                element->instance_divisor)
+            break;
+      }
+      if (j == p->nr_buffer_variants) {
+         p->buffer_variant[j].buffer_index = element->input_buffer;
+         p->buffer_variant[j].instance_divisor = element->instance_divisor;
+         p->nr_buffer_variants++;
+      }
+      elem->variant = j;
+   }
+
+   p->nr_elements = key->nr_elements;
+
+   return &p->translate;
+
+ fail:
+   neon_release(&p->translate);
+   return NULL;
+}
+
+
+#else
+
+struct translate *
+translate_neon_create(const struct translate_key *key)
+{
+   return NULL;
+}
+
+#endif
@@ -621,6 +621,86 @@ def generate_pack_kernel(format, src_channel, src_native_type):
         print_channels(format, pack_into_union)
 
 
+def unorm8_array_size(format):
+    '''Return the number of channels, padding included, of formats whose
+    pixels are arrays of linear 8-bit unorm channels on both endiannesses,
+    and 0 for the other formats.'''
+
+    if format.layout != PLAIN or format.colorspace != RGB:
+        return 0
+    if format.block_width != 1 or format.block_height != 1:
+        return 0
+    if format.le_swizzles != format.be_swizzles or format.le_channels != format.be_channels:
+        return 0
+
+    channels = [channel for channel in format.le_channels if channel.size]
+    for channel in channels:
+        if channel.size != 8:
+            return 0
+        if channel.type != VOID and (channel.type != UNSIGNED or not channel.norm):
+            return 0
+    return len(channels)
+
+
+def is_half_rgba(format):
+    '''Whether the pixels are arrays of 4 half floats in RGBA order.'''
+
+    return format.layout == PLAIN and format.colorspace == RGB and \
+           format.block_width == 1 and format.block_height == 1 and \
+           format.le_swizzles == format.be_swizzles and \
+           format.le_swizzles == [SWIZZLE_X, SWIZZLE_Y, SWIZZLE_Z, SWIZZLE_W] and \
+           all(channel.type == FLOAT and channel.size == 16 for channel in format.le_channels)
+
+
+def simd_unpack_expr(format, dst_channel):
+    '''Return the swizzle and the call to util/format_simd.h that unpack the
+    leading pixels of a row, or None if there is none.'''
+
+    size = unorm8_array_size(format)
+    if size:
+        swizzle = []
+        for s in format.le_swizzles:
+            if s < 4:
+                swizzle.append(s)
+            elif s == SWIZZLE_1:
+                swizzle.append(5)
+            else:
+                swizzle.append(4)
+
+        if dst_channel == Channel(FLOAT, False, False, 32):
+            return swizzle, 'util_format_simd_unorm8_to_float(dst, 4, src, %u, swizzle, width)' % size
+        if dst_channel == Channel(UNSIGNED, True, False, 8):
+            return swizzle, 'util_format_simd_swizzle_ubyte(dst, 4, src, %u, swizzle, 0xff, width)' % size
+
+    if is_half_rgba(format) and dst_channel == Channel(FLOAT, False, False, 32):
+        return None, 'util_format_simd_half_to_float(dst, (const uint16_t *)src, width * 4) / 4'
+
+    return None
+
+
+def simd_pack_expr(format, src_channel):
+    '''Return the swizzle and the call to util/format_simd.h that pack the
+    leading pixels of a row, or None if there is none.'''
+
+    size = unorm8_array_size(format)
+    if not size:
+        return None
+
+    # Padding channels are only zeroed when packing into a bitmask.
+    if not format.is_bitmask() and any(channel.type == VOID and channel.size for channel in format.le_channels):
+        return None
+
+    swizzle = [4 if s is None else s for s in inv_swizzles(format.le_swizzles)[:size]]
+    swizzle += [4] * (4 - size)
+
+    if src_channel == Channel(FLOAT, False, False, 32):
+        return swizzle, 'util_format_simd_float_to_unorm8(dst, %u, src, 4, swizzle, width)' % size
+    if src_channel == Channel(UNSIGNED, True, False, 8):
+        return swizzle, 'util_format_simd_swizzle_ubyte(dst, %u, src, 4, swizzle, 0xff, width)' % size
+
+    return None
+
+
 def generate_format_unpack(format, dst_channel, dst_native_type, dst_suffix):
     '''Generate the function to unpack pixels from a particular format'''
 
@@ -631,11 +711,21 @@ def generate_format_unpack(format, dst_channel, dst_native_type, dst_suffix):
     print('{')
 
     if is_format_supported(format):
+        simd = simd_unpack_expr(format, dst_channel)
+        if simd and simd[0]:
+            print('   static const uint8_t swizzle[4] = { %s };' % ', '.join(map(str, simd[0])))
         print('   unsigned x, y;')
         print('   for(y = 0; y < height; y += %u) {' % (format.block_height,))
         print('      %s *dst = dst_row;' % (dst_native_type))
         print('      const uint8_t *src = src_row;')
-        print('      for(x = 0; x < width; x += %u) {' % (format.block_width,))
+        if simd:
+            # The SIMD path converts the leading pixels of the row
+            print('      x = %s;' % simd[1])
+            print('      src += x * %u;' % (format.block_size() / 8,))
+            print('      dst += x * 4;')
+            print('      for(; x < width; x += %u) {' % (format.block_width,))
+        else:
+            print('      for(x = 0; x < width; x += %u) {' % (format.block_width,))
         
         generate_unpack_kernel(format, dst_channel, dst_native_type)
     
@@ -660,11 +750,21 @@ def generate_format_pack(format, src_channel, src_native_type, src_suffix):
     print('{')
     
     if is_format_supported(format):
+        simd = simd_pack_expr(format, src_channel)
+        if simd:
+            print('   static const uint8_t swizzle[4] = { %s };' % ', '.join(map(str, simd[0])))
         print('   unsigned x, y;')
         print('   for(y = 0; y < height; y += %u) {' % (format.block_height,))
         print('      const %s *src = src_row;' % (src_native_type))
         print('      uint8_t *dst = dst_row;')
-        print('      for(x = 0; x < width; x += %u) {' % (format.block_width,))
+        if simd:
+            # The SIMD path converts the leading pixels of the row
+            print('      x = %s;' % simd[1])
+            print('      src += x * 4;')
+            print('      dst += x * %u;' % (format.block_size() / 8,))
+            print('      for(; x < width; x += %u) {' % (format.block_width,))
+        else:
+            print('      for(x = 0; x < width; x += %u) {' % (format.block_width,))
     
         generate_pack_kernel(format, src_channel, src_native_type)
             
@@ -706,6 +806,7 @@ def generate(formats):
     print('#include "u_half.h"')
     print('#include "u_format.h"')
     print('#include "u_format_other.h"')
+    print('#include "util/format_simd.h"')
     print('#include "util/format_srgb.h"')
     print('#include "u_format_yuv.h"')
     print('#include "u_format_zs.h"')
@@ -180,7 +180,8 @@ tc_is_sync(struct threaded_context *tc)
 }
 
 static void
-_tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char *func)
+_tc_sync(struct threaded_context *tc, enum tc_sync_reason reason,
+         UNUSED const char *info, UNUSED const char *func)
 {
    struct tc_batch *last = &tc->batch_slots[tc->last];
    struct tc_batch *next = &tc->batch_slots[tc->next];
@@ -210,6 +211,7 @@ _tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char
 
    if (synced) {
       p_atomic_inc(&tc->num_syncs);
+      p_atomic_inc(&tc->num_syncs_by_reason[reason]);
 
       if (tc_strcmp(func, "tc_destroy") != 0) {
          tc_printf("sync %s %s\n", func, info);
@@ -219,8 +221,9 @@ _tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char
    tc_debug_check(tc);
 }
 
-#define tc_sync(tc) _tc_sync(tc, "", __func__)
-#define tc_sync_msg(tc, info) _tc_sync(tc, info, __func__)
+#define tc_sync(tc) _tc_sync(tc, TC_SYNC_OTHER, "", __func__)
+#define tc_sync_reason(tc, reason) _tc_sync(tc, reason, "", __func__)
+#define tc_sync_msg(tc, reason, info) _tc_sync(tc, reason, info, __func__)
 
 /**
  * Call this from fence_finish for same-context fence waits of deferred fences
@@ -246,7 +249,7 @@ threaded_context_flush(struct pipe_context *_pipe,
       if (prefer_async || !util_queue_fence_is_signalled(&last->fence))
          tc_batch_flush(tc);
       else
-         tc_sync(token->tc);
+         tc_sync_reason(token->tc, TC_SYNC_FLUSH);
    }
 }
 
@@ -285,7 +288,7 @@ threaded_context_unwrap_sync(struct pipe_context *pipe)
    if (!pipe || !pipe->priv)
       return pipe;
 
-   tc_sync(threaded_context(pipe));
+   tc_sync_reason(threaded_context(pipe), TC_SYNC_FLUSH);
    return (struct pipe_context*)pipe->priv;
 }
 
@@ -424,7 +427,7 @@ tc_get_query_result(struct pipe_context *_pipe,
    struct pipe_context *pipe = tc->pipe;
 
    if (!tq->flushed)
-      tc_sync_msg(tc, wait ? "wait" : "nowait");
+      tc_sync_msg(tc, TC_SYNC_QUERY, wait ? "wait" : "nowait");
 
    bool success = pipe->get_query_result(pipe, query, wait, result);
 
@@ -1421,6 +1424,13 @@ tc_improve_map_buffer_flags(struct threaded_context *tc,
    /* TODO: We might not need TC_TRANSFER_MAP_NO_INVALIDATE with this. */
    usage &= ~PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE;
 
+   /* Only the flushed ranges of write-only mappings with explicit flushes
+    * are written, so they don't need the current contents of the buffer and
+    * can use a staging upload instead of waiting for it to be idle.
+    */
+   if (usage & PIPE_TRANSFER_FLUSH_EXPLICIT)
+      usage |= PIPE_TRANSFER_DISCARD_RANGE;
+
    /* GL_AMD_pinned_memory and persistent mappings can't use staging
     * buffers. */
    if (usage & (PIPE_TRANSFER_UNSYNCHRONIZED |
@@ -1437,6 +1447,85 @@ tc_improve_map_buffer_flags(struct threaded_context *tc,
    return usage;
 }
 
+static bool
+tc_can_stage_texture_map(struct threaded_context *tc, unsigned usage)
+{
+   /* Only write-only mappings of discarded contents can be staged, and
+    * only the whole box is uploaded.
+    */
+   return tc->pipe->texture_subdata &&
+          (usage & (PIPE_TRANSFER_READ | PIPE_TRANSFER_WRITE)) ==
+          PIPE_TRANSFER_WRITE &&
+          usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                   PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE) &&
+          !(usage & (PIPE_TRANSFER_UNSYNCHRONIZED |
+                     PIPE_TRANSFER_PERSISTENT |
+                     PIPE_TRANSFER_COHERENT |
+                     PIPE_TRANSFER_FLUSH_EXPLICIT |
+                     PIPE_TRANSFER_MAP_DIRECTLY));
+}
+
+static void *
+tc_alloc_cpu_staging(struct threaded_context *tc, unsigned size)
+{
+   void *data;
+
+   if (!size || size > TC_MAX_CPU_STAGING_BYTES ||
+       p_atomic_read(&tc->cpu_staging_size) + size > TC_MAX_CPU_STAGING_BYTES)
+      return NULL;
+
+   data = MALLOC(size);
+   if (data)
+      p_atomic_add(&tc->cpu_staging_size, size);
+   return data;
+}
+
+struct tc_cpu_staging_upload {
+   struct threaded_context *tc;
+   struct pipe_resource *resource;
+   unsigned level, usage, stride, layer_stride, size;
+   struct pipe_box box;
+   void *data;
+};
+
+static void
+tc_call_cpu_staging_upload(struct pipe_context *pipe,
+                           union tc_payload *payload)
+{
+   struct tc_cpu_staging_upload *p = (struct tc_cpu_staging_upload *)payload;
+
+   pipe->texture_subdata(pipe, p->resource, p->level, p->usage, &p->box,
+                         p->data, p->stride, p->layer_stride);
+   pipe_resource_reference(&p->resource, NULL);
+   FREE(p->data);
+   p_atomic_add(&p->tc->cpu_staging_size, -(int)p->size);
+}
+
+/* Upload CPU staging memory allocated by tc_alloc_cpu_staging and free it
+ * in the driver thread.
+ */
+static void
+tc_add_cpu_staging_upload(struct threaded_context *tc,
+                          struct pipe_resource *resource, unsigned level,
+                          unsigned usage, const struct pipe_box *box,
+                          void *data, unsigned stride, unsigned layer_stride,
+                          unsigned size)
+{
+   struct tc_cpu_staging_upload *p =
+      tc_add_struct_typed_call(tc, TC_CALL_cpu_staging_upload,
+                               tc_cpu_staging_upload);
+
+   p->tc = tc;
+   tc_set_resource_reference(&p->resource, resource);
+   p->level = level;
+   p->usage = usage;
+   p->box = *box;
+   p->data = data;
+   p->stride = stride;
+   p->layer_stride = layer_stride;
+   p->size = size;
+}
+
 static void *
 tc_transfer_map(struct pipe_context *_pipe,
                 struct pipe_resource *resource, unsigned level,
@@ -1458,6 +1547,7 @@ tc_transfer_map(struct pipe_context *_pipe,
          uint8_t *map;
 
          ttrans->staging = NULL;
+         ttrans->cpu_staging = NULL;
 
          u_upload_alloc(tc->base.stream_uploader, 0,
                         box->width + (box->x % tc->map_buffer_alignment),
@@ -1476,13 +1566,37 @@ tc_transfer_map(struct pipe_context *_pipe,
          *transfer = &ttrans->b;
          return map + (box->x % tc->map_buffer_alignment);
       }
+   } else if (tc_can_stage_texture_map(tc, usage)) {
+      /* Do a staging transfer in CPU memory, uploaded with texture_subdata
+       * in the driver thread on unmap.
+       */
+      unsigned stride = util_format_get_stride(resource->format, box->width);
+      unsigned layer_stride = util_format_get_2d_size(resource->format, stride,
+                                                      box->height);
+      void *map = tc_alloc_cpu_staging(tc, layer_stride * box->depth);
+
+      if (map) {
+         struct threaded_transfer *ttrans = slab_alloc(&tc->pool_transfers);
+
+         ttrans->staging = NULL;
+         ttrans->cpu_staging = map;
+         tc_set_resource_reference(&ttrans->b.resource, resource);
+         ttrans->b.level = level;
+         ttrans->b.usage = usage;
+         ttrans->b.box = *box;
+         ttrans->b.stride = stride;
+         ttrans->b.layer_stride = layer_stride;
+         *transfer = &ttrans->b;
+         return map;
+      }
    }
 
    /* Unsychronized buffer mappings don't have to synchronize the thread. */
    if (!(usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
-      tc_sync_msg(tc, resource->target != PIPE_BUFFER ? "  texture" :
-                      usage & PIPE_TRANSFER_DISCARD_RANGE ? "  discard_range" :
-                      usage & PIPE_TRANSFER_READ ? "  read" : "  ??");
+      tc_sync_msg(tc, TC_SYNC_TRANSFER,
+                  resource->target != PIPE_BUFFER ? "  texture" :
+                  usage & PIPE_TRANSFER_DISCARD_RANGE ? "  discard_range" :
+                  usage & PIPE_TRANSFER_READ ? "  read" : "  ??");
 
    return pipe->transfer_map(pipe, tres->latest ? tres->latest : resource,
                              level, usage, box, transfer);
@@ -1563,6 +1677,9 @@ tc_transfer_flush_region(struct pipe_context *_pipe,
       /* Staging transfers don't send the call to the driver. */
       if (ttrans->staging)
          return;
+   } else if (ttrans->cpu_staging) {
+      /* The whole box is uploaded on unmap. */
+      return;
    }
 
    struct tc_transfer_flush_region *p =
@@ -1585,6 +1702,19 @@ tc_transfer_unmap(struct pipe_context *_pipe, struct pipe_transfer *transfer)
    struct threaded_transfer *ttrans = threaded_transfer(transfer);
    struct threaded_resource *tres = threaded_resource(transfer->resource);
 
+   if (tres->b.target != PIPE_BUFFER && ttrans->cpu_staging) {
+      tc_add_cpu_staging_upload(tc, transfer->resource, transfer->level,
+                                PIPE_TRANSFER_WRITE |
+                                (transfer->usage &
+                                 PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE),
+                                &transfer->box, ttrans->cpu_staging,
+                                transfer->stride, transfer->layer_stride,
+                                transfer->layer_stride * transfer->box.depth);
+      pipe_resource_reference(&ttrans->b.resource, NULL);
+      slab_free(&tc->pool_transfers, ttrans);
+      return;
+   }
+
    if (tres->b.target == PIPE_BUFFER) {
       if (transfer->usage & PIPE_TRANSFER_WRITE &&
           !(transfer->usage & PIPE_TRANSFER_FLUSH_EXPLICIT))
@@ -1722,8 +1852,17 @@ tc_texture_subdata(struct pipe_context *_pipe,
       memcpy(p->slot, data, size);
    } else {
       struct pipe_context *pipe = tc->pipe;
+      void *copy = tc_alloc_cpu_staging(tc, size);
 
-      tc_sync(tc);
+      /* Big uploads are copied and enqueued too, up to a limit. */
+      if (copy) {
+         memcpy(copy, data, size);
+         tc_add_cpu_staging_upload(tc, resource, level, usage, box, copy,
+                                   stride, layer_stride, size);
+         return;
+      }
+
+      tc_sync_reason(tc, TC_SYNC_SUBDATA);
       pipe->texture_subdata(pipe, resource, level, usage, box, data,
                             stride, layer_stride);
    }
@@ -1850,7 +1989,7 @@ tc_create_fence_fd(struct pipe_context *_pipe,
    struct threaded_context *tc = threaded_context(_pipe);
    struct pipe_context *pipe = tc->pipe;
 
-   tc_sync(tc);
+   tc_sync_reason(tc, TC_SYNC_FLUSH);
    pipe->create_fence_fd(pipe, fence, fd, type);
 }
 
@@ -2036,8 +2175,9 @@ tc_flush(struct pipe_context *_pipe, struct pipe_fence_handle **fence,
    }
 
 out_of_memory:
-   tc_sync_msg(tc, flags & PIPE_FLUSH_END_OF_FRAME ? "end of frame" :
-                   flags & PIPE_FLUSH_DEFERRED ? "deferred fence" : "normal");
+   tc_sync_msg(tc, TC_SYNC_FLUSH,
+               flags & PIPE_FLUSH_END_OF_FRAME ? "end of frame" :
+               flags & PIPE_FLUSH_DEFERRED ? "deferred fence" : "normal");
 
    if (!(flags & PIPE_FLUSH_DEFERRED))
       tc_flush_queries(tc);
@@ -2536,6 +2676,20 @@ tc_destroy(struct pipe_context *_pipe)
    os_free_aligned(tc);
 }
 
+/**
+ * Return the threaded context \p pipe is, or NULL if it is another kind of
+ * context.  Contexts wrapping a threaded context (ddebug, rbug, trace)
+ * copy its "priv", so that can't be used to tell them apart.
+ */
+struct threaded_context *
+threaded_context_get(struct pipe_context *pipe)
+{
+   if (!pipe || pipe->destroy != tc_destroy)
+      return NULL;
+
+   return threaded_context(pipe);
+}
+
 static const tc_execute execute_func[TC_NUM_CALLS] = {
 #define CALL(name) tc_call_##name,
 #include "u_threaded_context_calls.h"
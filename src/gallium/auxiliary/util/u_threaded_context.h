@@ -107,6 +107,13 @@
  *    indicate this. Ignoring the flag will lead to failures.
  *    The threaded context uses its own buffer invalidation mechanism.
  *
+ * 4) Write-only mappings that don't need to wait for the GPU go through
+ *    staging memory in the threaded context, and the driver only receives
+ *    the upload in the driver thread: resource_copy_region for buffers,
+ *    texture_subdata for textures. This is done for DISCARD_RANGE and
+ *    FLUSH_EXPLICIT buffer mappings and for DISCARD_RANGE and DISCARD_WHOLE_-
+ *    RESOURCE texture mappings.
+ *
  *
  * Rules for fences
  * ----------------
@@ -232,6 +239,22 @@ struct tc_unflushed_batch_token;
  */
 #define TC_MAX_SUBDATA_BYTES        320
 
+/* The maximum amount of CPU memory used for texture uploads that haven't
+ * been executed by the driver thread yet. Mappings and uploads sync beyond
+ * that.
+ */
+#define TC_MAX_CPU_STAGING_BYTES    (64 * 1024 * 1024)
+
+/* Why the application thread had to wait for the driver thread. */
+enum tc_sync_reason {
+   TC_SYNC_TRANSFER,  /* transfer_map */
+   TC_SYNC_SUBDATA,   /* texture_subdata */
+   TC_SYNC_QUERY,     /* get_query_result */
+   TC_SYNC_FLUSH,     /* flush, fences and unwrapping the context */
+   TC_SYNC_OTHER,
+   TC_NUM_SYNC_REASONS
+};
+
 typedef void (*tc_replace_buffer_storage_func)(struct pipe_context *ctx,
                                                struct pipe_resource *dst,
                                                struct pipe_resource *src);
@@ -291,6 +314,13 @@ struct threaded_transfer {
    /* Offset into the staging buffer, because the backing buffer is
     * sub-allocated. */
    unsigned offset;
+
+   /* Staging memory for texture transfers, uploaded on unmap.  It is only
+    * set by the threaded context, which tests it to tell its own texture
+    * transfers from those of the driver: drivers must zero-initialize the
+    * texture transfers they create (e.g. with CALLOC_STRUCT).
+    */
+   void *cpu_staging;
 };
 
 struct threaded_query {
@@ -360,6 +390,10 @@ struct threaded_context {
    unsigned num_offloaded_slots;
    unsigned num_direct_slots;
    unsigned num_syncs;
+   unsigned num_syncs_by_reason[TC_NUM_SYNC_REASONS];
+
+   /* Size of the texture uploads in flight, see TC_MAX_CPU_STAGING_BYTES. */
+   unsigned cpu_staging_size;
 
    struct util_queue queue;
    struct util_queue_fence *fence;
@@ -384,6 +418,9 @@ threaded_context_flush(struct pipe_context *_pipe,
                        struct tc_unflushed_batch_token *token,
                        bool prefer_async);
 
+struct threaded_context *
+threaded_context_get(struct pipe_context *pipe);
+
 static inline struct threaded_context *
 threaded_context(struct pipe_context *pipe)
 {
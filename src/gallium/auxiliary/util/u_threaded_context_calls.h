@@ -24,6 +24,7 @@ CALL(transfer_flush_region)
 CALL(transfer_unmap)
 CALL(buffer_subdata)
 CALL(texture_subdata)
+CALL(cpu_staging_upload)
 CALL(emit_string_marker)
 CALL(draw_vbo)
 CALL(launch_grid)
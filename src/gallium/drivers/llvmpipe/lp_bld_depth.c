@@ -457,6 +457,20 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                                        LLVMInt32TypeInContext(context), bits);
       count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
    }
+   else if(util_cpu_caps.has_avx512f && type.length == 16) {
+      /* The comparison becomes a k register, which is moved to a GPR. */
+      const char *popcntintr = "llvm.ctpop.i32";
+      LLVMTypeRef int_vec_type = lp_build_int_vec_type(gallivm, type);
+      LLVMValueRef bits = LLVMBuildBitCast(builder, maskvalue, int_vec_type, "");
+      bits = LLVMBuildICmp(builder, LLVMIntNE, bits,
+                           LLVMConstNull(int_vec_type), "");
+      bits = LLVMBuildBitCast(builder, bits,
+                              LLVMInt16TypeInContext(context), "");
+      bits = LLVMBuildZExt(builder, bits, LLVMInt32TypeInContext(context), "");
+      count = lp_build_intrinsic_unary(builder, popcntintr,
+                                       LLVMInt32TypeInContext(context), bits);
+      count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
+   }
    else {
       unsigned i;
       LLVMValueRef countv = LLVMBuildAnd(builder, maskvalue, countmask, "countv");
@@ -545,6 +559,40 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
    struct lp_type zs_type = lp_depth_type(format_desc, z_src_type.length);
    struct lp_type zs_load_type = zs_type;
 
+   if (z_src_type.length == 16) {
+      /*
+       * The 4x4 block is the 2x4 values of the first and last two rows,
+       * each swizzled as for 8 wide vectors.  1d resources are never
+       * shaded 16 wide.
+       */
+      struct lp_type half_type = z_src_type;
+      LLVMValueRef z_half[2], s_half[2];
+      LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
+                                         lp_build_const_int32(gallivm, 1), "");
+      unsigned i;
+
+      assert(!is_1d);
+      half_type.length = 8;
+      for (i = 0; i < 2; i++) {
+         LLVMValueRef half_counter =
+            LLVMBuildAdd(builder, loopx2, lp_build_const_int32(gallivm, i), "");
+         lp_build_depth_stencil_load_swizzled(gallivm, half_type, format_desc,
+                                              is_1d, depth_ptr, depth_stride,
+                                              &z_half[i], &s_half[i],
+                                              half_counter);
+      }
+      for (i = 0; i < 16; i++) {
+         shuffles[i] = lp_build_const_int32(gallivm, i);
+      }
+      *z_fb = LLVMBuildShuffleVector(builder, z_half[0], z_half[1],
+                                     LLVMConstVector(shuffles, 16), "");
+      *s_fb = LLVMBuildShuffleVector(builder, s_half[0], s_half[1],
+                                     LLVMConstVector(shuffles, 16), "");
+      lp_build_name(*z_fb, "z_dst");
+      lp_build_name(*s_fb, "s_dst");
+      return;
+   }
+
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
@@ -691,6 +739,47 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
 
    lp_build_context_init(&z_bld, gallivm, z_type);
 
+   if (format_desc->block.bits > 32) {
+      s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
+   }
+
+   if (mask) {
+      mask_value = lp_build_mask_value(mask);
+      z_value = lp_build_select(&z_bld, mask_value, z_value, z_fb);
+      if (format_desc->block.bits > 32) {
+         s_fb = LLVMBuildBitCast(builder, s_fb, z_bld.vec_type, "");
+         s_value = lp_build_select(&z_bld, mask_value, s_value, s_fb);
+      }
+   }
+
+   if (z_src_type.length == 16) {
+      /* The first and last two rows, as in the load above. */
+      struct lp_type half_type = z_src_type;
+      LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
+                                         lp_build_const_int32(gallivm, 1), "");
+      unsigned i;
+
+      assert(!is_1d);
+      half_type.length = 8;
+      for (i = 0; i < 2; i++) {
+         LLVMValueRef half_counter =
+            LLVMBuildAdd(builder, loopx2, lp_build_const_int32(gallivm, i), "");
+         LLVMValueRef s_half = NULL;
+         if (format_desc->block.bits > 32) {
+            s_half = lp_build_extract_range(gallivm, s_value, i * 8, 8);
+         }
+         lp_build_depth_stencil_write_swizzled(gallivm, half_type, format_desc,
+                                               is_1d, NULL, NULL, NULL,
+                                               half_counter, depth_ptr,
+                                               depth_stride,
+                                               lp_build_extract_range(gallivm,
+                                                                      z_value,
+                                                                      i * 8, 8),
+                                               s_half);
+      }
+      return;
+   }
+
    /*
     * This is far from ideal, at least for late depth write we should do this
     * outside the fs loop to avoid all the swizzle stuff.
@@ -728,18 +817,6 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
    zs_dst_ptr2 = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
    zs_dst_ptr2 = LLVMBuildBitCast(builder, zs_dst_ptr2, load_ptr_type, "");
 
-   if (format_desc->block.bits > 32) {
-      s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
-   }
-
-   if (mask) {
-      mask_value = lp_build_mask_value(mask);
-      z_value = lp_build_select(&z_bld, mask_value, z_value, z_fb);
-      if (format_desc->block.bits > 32) {
-         s_fb = LLVMBuildBitCast(builder, s_fb, z_bld.vec_type, "");
-         s_value = lp_build_select(&z_bld, mask_value, s_value, s_fb);
-      }
-   }
 
    if (zs_type.width < z_src_type.width) {
       /* Truncate ZS values (e.g., when writing to Z16_UNORM) */
@@ -48,6 +48,8 @@ struct draw_context;
 struct draw_stage;
 struct draw_vertex_shader;
 struct lp_fragment_shader;
+struct lp_fragment_shader_variant;
+struct lp_compute_shader;
 struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
@@ -63,6 +65,7 @@ struct llvmpipe_context {
    const struct pipe_depth_stencil_alpha_state *depth_stencil;
    const struct pipe_rasterizer_state *rasterizer;
    struct lp_fragment_shader *fs;
+   struct lp_compute_shader *cs;
    struct draw_vertex_shader *vs;
    const struct lp_geometry_shader *gs;
    const struct lp_velems_state *velems;
@@ -139,6 +142,9 @@ struct llvmpipe_context {
 
    unsigned tex_timestamp;
 
+   /** The fragment shader variant bound to setup */
+   struct lp_fragment_shader_variant *fs_variant;
+
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
@@ -0,0 +1,235 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "util/u_memory.h"
+#include "lp_cs_coro.h"
+
+#if LP_HAVE_CS_CORO
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+
+/**
+ * Stack size of each coroutine.  Only the pages actually touched by the
+ * shader get committed, so this can be generous.
+ */
+#define LP_CS_CORO_STACK_SIZE (256 * 1024)
+
+
+struct lp_cs_coro
+{
+   ucontext_t ctx;
+   ucontext_t *sched;
+
+   /** mmap'ed stack, with a guard page at the bottom */
+   void *stack;
+
+   lp_cs_coro_func func;
+   void *data;
+   unsigned index;
+   boolean done;
+};
+
+
+/**
+ * The coroutines of one thread.  Stacks are kept around and reused by
+ * later workgroups.
+ */
+struct lp_cs_coro_set
+{
+   ucontext_t sched;
+   struct lp_cs_coro *coros;
+   unsigned num_coros;
+};
+
+
+static void
+coro_entry(unsigned lo, unsigned hi)
+{
+   /* makecontext() only passes ints */
+   struct lp_cs_coro *coro =
+      (struct lp_cs_coro *)(uintptr_t)(((uint64_t)hi << 32) | lo);
+
+   coro->func(coro->data, coro->index, coro);
+   coro->done = TRUE;
+
+   /* returning resumes uc_link, i.e. the scheduler */
+}
+
+
+static boolean
+grow_set(struct lp_cs_coro_set *set, unsigned count)
+{
+   size_t page_size = sysconf(_SC_PAGESIZE);
+   struct lp_cs_coro *coros;
+   unsigned i;
+
+   coros = REALLOC(set->coros,
+                   set->num_coros * sizeof *coros,
+                   count * sizeof *coros);
+   if (!coros)
+      return FALSE;
+   set->coros = coros;
+
+   for (i = set->num_coros; i < count; i++) {
+      void *stack = mmap(NULL, LP_CS_CORO_STACK_SIZE,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (stack == MAP_FAILED)
+         return FALSE;
+
+      /* catch stack overflows rather than corrupting the neighbour */
+      mprotect(stack, page_size, PROT_NONE);
+
+      memset(&coros[i], 0, sizeof coros[i]);
+      coros[i].stack = stack;
+      set->num_coros = i + 1;
+   }
+
+   return TRUE;
+}
+
+
+struct lp_cs_coro_set *
+lp_cs_coro_set_create(void)
+{
+   return CALLOC_STRUCT(lp_cs_coro_set);
+}
+
+
+void
+lp_cs_coro_set_destroy(struct lp_cs_coro_set *set)
+{
+   unsigned i;
+
+   if (!set)
+      return;
+
+   for (i = 0; i < set->num_coros; i++)
+      munmap(set->coros[i].stack, LP_CS_CORO_STACK_SIZE);
+
+   FREE(set->coros);
+   FREE(set);
+}
+
+
+/**
+ * Run func(data, i, coro) for i in [0, count) as coroutines, resuming them
+ * in turn until all have returned.
+ */
+boolean
+lp_cs_coro_run(struct lp_cs_coro_set *set, unsigned count,
+               lp_cs_coro_func func, void *data)
+{
+   boolean pending;
+   unsigned i;
+
+   if (count > set->num_coros && !grow_set(set, count))
+      return FALSE;
+
+   for (i = 0; i < count; i++) {
+      struct lp_cs_coro *coro = &set->coros[i];
+      uint64_t ptr = (uintptr_t)coro;
+
+      getcontext(&coro->ctx);
+      coro->ctx.uc_stack.ss_sp = coro->stack;
+      coro->ctx.uc_stack.ss_size = LP_CS_CORO_STACK_SIZE;
+      coro->ctx.uc_link = &set->sched;
+      coro->sched = &set->sched;
+      coro->func = func;
+      coro->data = data;
+      coro->index = i;
+      coro->done = FALSE;
+
+      makecontext(&coro->ctx, (void (*)(void))coro_entry, 2,
+                  (unsigned)ptr, (unsigned)(ptr >> 32));
+   }
+
+   do {
+      pending = FALSE;
+      for (i = 0; i < count; i++) {
+         struct lp_cs_coro *coro = &set->coros[i];
+
+         if (coro->done)
+            continue;
+
+         swapcontext(&set->sched, &coro->ctx);
+
+         if (!coro->done)
+            pending = TRUE;
+      }
+   } while (pending);
+
+   return TRUE;
+}
+
+
+/**
+ * Called by the generated code at barriers.  Workgroups of a single SIMD
+ * vector run without coroutines, and there a barrier has nothing to wait
+ * for.
+ */
+void
+lp_cs_coro_yield(struct lp_cs_coro *coro)
+{
+   if (coro)
+      swapcontext(&coro->ctx, coro->sched);
+}
+
+
+#else /* !LP_HAVE_CS_CORO */
+
+
+struct lp_cs_coro_set *
+lp_cs_coro_set_create(void)
+{
+   return NULL;
+}
+
+
+void
+lp_cs_coro_set_destroy(struct lp_cs_coro_set *set)
+{
+}
+
+
+boolean
+lp_cs_coro_run(struct lp_cs_coro_set *set, unsigned count,
+               lp_cs_coro_func func, void *data)
+{
+   return FALSE;
+}
+
+
+void
+lp_cs_coro_yield(struct lp_cs_coro *coro)
+{
+   /* only single vector workgroups get here, see above */
+   assert(!coro);
+}
+
+
+#endif /* !LP_HAVE_CS_CORO */
@@ -0,0 +1,67 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Coroutines for running the SIMD invocations of a compute workgroup.
+ *
+ * Each SIMD vector of a workgroup runs as a coroutine on its own stack.
+ * When it reaches a barrier it yields back to the scheduler, which resumes
+ * the next one, so once every coroutine has yielded all invocations of the
+ * workgroup have reached the barrier.
+ */
+
+#ifndef LP_CS_CORO_H
+#define LP_CS_CORO_H
+
+#include "pipe/p_compiler.h"
+
+
+#if (defined(PIPE_OS_UNIX) && defined(__GLIBC__)) || \
+    defined(PIPE_OS_FREEBSD) || defined(PIPE_OS_NETBSD)
+#define LP_HAVE_CS_CORO 1
+#else
+#define LP_HAVE_CS_CORO 0
+#endif
+
+
+struct lp_cs_coro;
+struct lp_cs_coro_set;
+
+typedef void (*lp_cs_coro_func)(void *data, unsigned index,
+                                struct lp_cs_coro *coro);
+
+struct lp_cs_coro_set *
+lp_cs_coro_set_create(void);
+
+void
+lp_cs_coro_set_destroy(struct lp_cs_coro_set *set);
+
+boolean
+lp_cs_coro_run(struct lp_cs_coro_set *set, unsigned count,
+               lp_cs_coro_func func, void *data);
+
+void
+lp_cs_coro_yield(struct lp_cs_coro *coro);
+
+
+#endif /* LP_CS_CORO_H */
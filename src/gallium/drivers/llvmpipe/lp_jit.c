@@ -39,12 +39,14 @@
 #include "gallivm/lp_bld_format.h"
 #include "lp_context.h"
 #include "lp_jit.h"
+#include "lp_state_cs.h"
 
 
 static void
-lp_jit_create_types(struct lp_fragment_shader_variant *lp)
+lp_jit_create_types(struct gallivm_state *gallivm,
+                    LLVMTypeRef *jit_context_ptr_type,
+                    LLVMTypeRef *jit_thread_data_ptr_type)
 {
-   struct gallivm_state *gallivm = lp->gallivm;
    LLVMContextRef lc = gallivm->context;
    LLVMTypeRef viewport_type, texture_type, sampler_type;
 
@@ -210,7 +212,7 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       LP_CHECK_STRUCT_SIZE(struct lp_jit_context,
                            gallivm->target, context_type);
 
-      lp->jit_context_ptr_type = LLVMPointerType(context_type, 0);
+      *jit_context_ptr_type = LLVMPointerType(context_type, 0);
    }
 
    /* struct lp_jit_thread_data */
@@ -228,7 +230,7 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       thread_data_type = LLVMStructTypeInContext(lc, elem_types,
                                                  ARRAY_SIZE(elem_types), 0);
 
-      lp->jit_thread_data_ptr_type = LLVMPointerType(thread_data_type, 0);
+      *jit_thread_data_ptr_type = LLVMPointerType(thread_data_type, 0);
    }
 
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
@@ -261,5 +263,17 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp)
 {
    if (!lp->jit_context_ptr_type)
-      lp_jit_create_types(lp);
+      lp_jit_create_types(lp->gallivm,
+                          &lp->jit_context_ptr_type,
+                          &lp->jit_thread_data_ptr_type);
+}
+
+
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp)
+{
+   if (!lp->jit_context_ptr_type)
+      lp_jit_create_types(lp->gallivm,
+                          &lp->jit_context_ptr_type,
+                          &lp->jit_thread_data_ptr_type);
 }
@@ -45,6 +45,7 @@
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -269,6 +270,43 @@ typedef void
                     unsigned depth_stride);
 
 
+/**
+ * typedef for compute shader function
+ *
+ * Runs one SIMD vector worth of invocations of a workgroup.
+ *
+ * @param context       jit context, the blend/depth members are unused
+ * @param thread_data   task thread data
+ * @param block_x       workgroup id x
+ * @param block_y       workgroup id y
+ * @param block_z       workgroup id z
+ * @param grid_x        grid width in workgroups
+ * @param grid_y        grid height in workgroups
+ * @param grid_z        grid depth in workgroups
+ * @param block_width   workgroup width
+ * @param block_height  workgroup height
+ * @param block_depth   workgroup depth
+ * @param invocation    flattened local index of the first invocation
+ * @param shared        workgroup shared memory
+ * @param coro          coroutine to yield at barriers
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_context *context,
+                  struct lp_jit_thread_data *thread_data,
+                  uint32_t block_x,
+                  uint32_t block_y,
+                  uint32_t block_z,
+                  uint32_t grid_x,
+                  uint32_t grid_y,
+                  uint32_t grid_z,
+                  uint32_t block_width,
+                  uint32_t block_height,
+                  uint32_t block_depth,
+                  uint32_t invocation,
+                  void *shared,
+                  void *coro);
+
+
 void
 lp_jit_screen_cleanup(struct llvmpipe_screen *screen);
 
@@ -281,4 +319,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
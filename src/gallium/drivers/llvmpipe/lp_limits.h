@@ -61,7 +61,11 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Max number of scenes per context.  Scenes beyond the first allow binning
+ * to run ahead of rasterization; see LP_NUM_SCENES.
+ */
+#define LP_MAX_SCENES 8
 
 
 /**
@@ -91,4 +95,20 @@
  */
 #define LP_MAX_SETUP_VARIANTS 64
 
+/**
+ * Max number of threads compiling the optimized code of fragment shader
+ * variants in the background, for all contexts of a screen.
+ */
+#define LP_MAX_COMPILE_THREADS 2
+
+/**
+ * Default thresholds of the fragment shader tiers, in LLVM IR instructions:
+ * variants smaller than LP_FAST_TIER_INSTRS are never optimized, others get
+ * optimized once their number of draws times their size reaches
+ * LP_TIER_UP_INSTRS.  See LP_FAST_TIER_INSTRS and LP_TIER_UP_INSTRS in
+ * docs/envvars.html.
+ */
+#define LP_FAST_TIER_INSTRS 1024
+#define LP_TIER_UP_INSTRS (64 * 1024)
+
 #endif /* LP_LIMITS_H */
@@ -26,6 +26,8 @@
  **************************************************************************/
 
 #include <limits.h>
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -57,6 +59,52 @@ const struct lp_rasterizer_task *jit_task = NULL;
 #endif
 
 
+/* An empty bin is one that just loads the contents of the tile and
+ * stores them again unchanged.  This typically happens when bins have
+ * been flushed for some reason in the middle of a frame, or when
+ * incremental updates are being made to a render target.
+ * 
+ * Try to avoid doing pointless work in this case.
+ */
+static boolean
+is_empty_bin( const struct cmd_bin *bin )
+{
+   return bin->head == NULL;
+}
+
+
+/**
+ * Split the non-empty bins of a scene among the rasterizer threads.
+ *
+ * Each thread gets a contiguous run of bins in raster order, so that
+ * neighbouring tiles are normally rendered by the same thread, and threads
+ * with neighbouring indices (which share an L3 cache, see
+ * create_rast_threads()) get neighbouring runs.  Threads which run out of
+ * work steal from the others, see lp_rast_next_bin().
+ */
+static void
+lp_rast_distribute_bins( struct lp_rasterizer *rast,
+                         struct lp_scene *scene )
+{
+   const unsigned num_tasks = MAX2(1, rast->num_threads);
+   unsigned num_bins = 0;
+   unsigned x, y, i;
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         if (!is_empty_bin(lp_scene_get_bin(scene, x, y)))
+            rast->bins[num_bins++] = (y << 16) | x;
+      }
+   }
+
+   for (i = 0; i < num_tasks; i++) {
+      uint64_t first = (uint64_t)num_bins * i / num_tasks;
+      uint64_t last = (uint64_t)num_bins * (i + 1) / num_tasks;
+      rast->tasks[i].bin_range = first | (last << 32);
+   }
+}
+
+
 /**
  * Begin rasterizing a scene.
  * Called once per scene by one thread.
@@ -70,16 +118,36 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_rast_distribute_bins( rast, scene );
 }
 
 
+/**
+ * Finish rasterizing the current scene.
+ * Called once per scene by one thread, after all threads are done with it.
+ * Signalling the fence hands the scene back to the setup module, which
+ * may then recycle it at any time, so the scene must not be touched
+ * after that.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = NULL;
+
+   lp_scene_unmap_framebuffer( scene );
+
+   /* Hold our own reference, the scene's may go away as soon as the
+    * fence is signalled.
+    */
+   lp_fence_reference(&fence, scene->fence);
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 }
 
 
@@ -121,6 +189,12 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   /* The depth of the tile is unknown until it gets cleared */
+   for (i = 0; i < ARRAY_SIZE(task->hiz.zmin); i++) {
+      task->hiz.zmin[i] = -INFINITY;
+      task->hiz.zmax[i] = INFINITY;
+   }
 }
 
 
@@ -170,6 +244,60 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Set the hierarchical depth bounds of the tile after a z/stencil clear.
+ */
+static void
+lp_rast_hiz_clear(struct lp_rasterizer_task *task,
+                  uint64_t clear_value, uint64_t clear_mask)
+{
+   const enum pipe_format format = task->scene->fb.zsbuf->format;
+   const struct util_format_description *desc = util_format_description(format);
+   uint64_t zmask;
+   union {
+      uint8_t ub[8];
+      uint16_t us;
+      uint32_t ui;
+      uint64_t ul;
+   } packed;
+   float z, zmin, zmax;
+   unsigned i;
+
+   if (!util_format_has_depth(desc))
+      return;
+
+   zmask = util_pack64_mask_z(format, 0xffffffff);
+   if (!(clear_mask & zmask))
+      return;
+
+   if ((clear_mask & zmask) == zmask) {
+      switch (desc->block.bits) {
+      case 16:
+         packed.us = (uint16_t) clear_value;
+         break;
+      case 32:
+         packed.ui = (uint32_t) clear_value;
+         break;
+      default:
+         packed.ul = clear_value;
+         break;
+      }
+      desc->unpack_z_float(&z, 0, packed.ub, 0, 1, 1);
+      zmin = zmax = z;
+   }
+   else {
+      /* Only some of the depth bits were cleared */
+      zmin = -INFINITY;
+      zmax = INFINITY;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(task->hiz.zmin); i++) {
+      task->hiz.zmin[i] = zmin;
+      task->hiz.zmax[i] = zmax;
+   }
+}
+
+
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
@@ -281,6 +409,9 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          }
          dst_layer += scene->zsbuf.layer_stride;
       }
+
+      lp_rast_hiz_clear(task, arg.clear_zstencil.value,
+                        arg.clear_zstencil.mask);
    }
 }
 
@@ -300,7 +431,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
-   unsigned x, y;
+   unsigned x, y, hizmask, block;
 
    if (inputs->disable) {
       /* This command was partially binned and has been disabled */
@@ -316,6 +447,9 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
+   hizmask = lp_rast_hiz_cull_mask_16(task, inputs);
+   LP_COUNT_ADD(nr_hiz_culled_16, util_bitcount(hizmask));
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
@@ -325,6 +459,9 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          unsigned depth_stride = 0;
          unsigned i;
 
+         if (hizmask & (1 << lp_rast_hiz_index(x, y)))
+            continue;
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
@@ -348,6 +485,8 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          /* Propagate non-interpolated raster state. */
          task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
+         lp_rast_hiz_write_4(task, inputs, tile_x + x, tile_y + y);
+
          /* run shader on 4x4 block */
          BEGIN_JIT_CALL(state, task);
          variant->jit_function[RAST_WHOLE]( &state->jit_context,
@@ -365,6 +504,14 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          END_JIT_CALL();
       }
    }
+
+   for (block = 0; block < LP_HIZ_TILE_BLOCKS * LP_HIZ_TILE_BLOCKS; block++) {
+      if (!(hizmask & (1 << block))) {
+         lp_rast_hiz_write_16(task, inputs,
+                              tile_x + (block % LP_HIZ_TILE_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                              tile_y + (block / LP_HIZ_TILE_BLOCKS) * LP_HIZ_BLOCK_SIZE);
+      }
+   }
 }
 
 
@@ -449,6 +596,8 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
+      lp_rast_hiz_write_4(task, inputs, x, y);
+
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
@@ -469,6 +618,81 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Shade the part of an axis-aligned rectangle within the tile.  The
+ * coverage of each 4x4 block is the product of its row and column spans,
+ * so there are no edge functions to evaluate.
+ * This is a bin command called during bin processing.
+ */
+static void
+lp_rast_rectangle(struct lp_rasterizer_task *task,
+                  const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_rectangle *rect = arg.rectangle;
+   const struct lp_rast_shader_inputs *inputs = &rect->inputs;
+   struct u_rect box;
+   unsigned hizmask, block;
+   int x, y;
+
+   if (inputs->disable) {
+      /* This command was partially binned and has been disabled */
+      return;
+   }
+
+   LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
+
+   assert(task->state);
+   if (!task->state) {
+      return;
+   }
+
+   box.x0 = MAX2(rect->box.x0, (int)task->x);
+   box.y0 = MAX2(rect->box.y0, (int)task->y);
+   box.x1 = MIN2(rect->box.x1, (int)task->x + TILE_SIZE - 1);
+   box.y1 = MIN2(rect->box.y1, (int)task->y + TILE_SIZE - 1);
+
+   hizmask = lp_rast_hiz_cull_mask_16(task, inputs);
+
+   for (y = box.y0 & ~3; y <= box.y1; y += 4) {
+      unsigned top = MAX2(box.y0 - y, 0);
+      unsigned bottom = MIN2(box.y1 - y, 3);
+
+      for (x = box.x0 & ~3; x <= box.x1; x += 4) {
+         unsigned left = MAX2(box.x0 - x, 0);
+         unsigned right = MIN2(box.x1 - x, 3);
+         unsigned span = (0xf << left) & (0xf >> (3 - right));
+         unsigned mask = 0;
+         unsigned row;
+
+         if (hizmask & (1 << lp_rast_hiz_index(x, y)))
+            continue;
+
+         for (row = top; row <= bottom; row++) {
+            mask |= span << (row * 4);
+         }
+
+         if (mask == 0xffff) {
+            lp_rast_shade_quads_all(task, inputs, x, y);
+         }
+         else {
+            lp_rast_shade_quads_mask(task, inputs, x, y, mask);
+         }
+      }
+   }
+
+   for (block = 0; block < LP_HIZ_TILE_BLOCKS * LP_HIZ_TILE_BLOCKS; block++) {
+      x = task->x + (block % LP_HIZ_TILE_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+      y = task->y + (block / LP_HIZ_TILE_BLOCKS) * LP_HIZ_BLOCK_SIZE;
+      if (!(hizmask & (1 << block)) &&
+          x >= box.x0 && x + LP_HIZ_BLOCK_SIZE - 1 <= box.x1 &&
+          y >= box.y0 && y + LP_HIZ_BLOCK_SIZE - 1 <= box.y1) {
+         lp_rast_hiz_write_16(task, inputs, x, y);
+      }
+   }
+}
+
+
+
 /**
  * Begin a new occlusion query.
  * This is a bin command put in all bins.
@@ -530,11 +754,238 @@ lp_rast_end_query(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Whether no depth in [zmin, zmax] passes the depth test against a block
+ * whose depth is within [bmin, bmax].
+ */
+static inline boolean
+lp_rast_hiz_reject(unsigned func, float zmin, float zmax,
+                   float bmin, float bmax)
+{
+   switch (func) {
+   case PIPE_FUNC_NEVER:
+      return TRUE;
+   case PIPE_FUNC_LESS:
+      return zmin >= bmax;
+   case PIPE_FUNC_LEQUAL:
+      return zmin > bmax;
+   case PIPE_FUNC_GREATER:
+      return zmax <= bmin;
+   case PIPE_FUNC_GEQUAL:
+      return zmax < bmin;
+   case PIPE_FUNC_EQUAL:
+      return zmin > bmax || zmax < bmin;
+   default:
+      return FALSE;
+   }
+}
+
+
+/**
+ * Return the mask of the 16x16 blocks of the current tile, in the same
+ * order as the rasterizer's masks, whose pixels would all fail the depth
+ * test.
+ */
+unsigned
+lp_rast_hiz_cull_mask_16(const struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs)
+{
+   const struct lp_rast_hiz *hiz = &task->hiz;
+   unsigned mask = 0;
+   unsigned i;
+
+   if (hiz->cull_func == PIPE_FUNC_ALWAYS || inputs->layer)
+      return 0;
+
+   for (i = 0; i < LP_HIZ_TILE_BLOCKS * LP_HIZ_TILE_BLOCKS; i++) {
+      float zmin, zmax;
+
+      lp_rast_hiz_range(task, inputs,
+                        task->x + (i % LP_HIZ_TILE_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                        task->y + (i / LP_HIZ_TILE_BLOCKS) * LP_HIZ_BLOCK_SIZE,
+                        LP_HIZ_BLOCK_SIZE, &zmin, &zmax);
+
+      if (lp_rast_hiz_reject(hiz->cull_func, zmin, zmax,
+                             hiz->zmin[i], hiz->zmax[i]))
+         mask |= 1 << i;
+   }
+
+   return mask;
+}
+
+
+/**
+ * Return the mask of the 4x4 blocks of a 16x16 block whose pixels would
+ * all fail the depth test.
+ * \param x, y location of the 16x16 block in window coords
+ */
+unsigned
+lp_rast_hiz_cull_mask_4(const struct lp_rasterizer_task *task,
+                        const struct lp_rast_shader_inputs *inputs,
+                        unsigned x, unsigned y)
+{
+   const struct lp_rast_hiz *hiz = &task->hiz;
+   const unsigned block = lp_rast_hiz_index(x, y);
+   unsigned mask = 0;
+   unsigned i;
+
+   if (hiz->cull_func == PIPE_FUNC_ALWAYS || inputs->layer)
+      return 0;
+
+   for (i = 0; i < 16; i++) {
+      float zmin, zmax;
+
+      lp_rast_hiz_range(task, inputs, x + (i & 3) * 4, y + (i >> 2) * 4, 4,
+                        &zmin, &zmax);
+
+      if (lp_rast_hiz_reject(hiz->cull_func, zmin, zmax,
+                             hiz->zmin[block], hiz->zmax[block]))
+         mask |= 1 << i;
+   }
+
+   return mask;
+}
+
+
+/**
+ * Whether all pixels of a size x size block, which needn't be aligned to
+ * the blocks of the hierarchical depth, would fail the depth test.
+ * \param x, y location of the block in window coords, within the tile
+ */
+boolean
+lp_rast_hiz_cull_block(const struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       unsigned x, unsigned y, unsigned size)
+{
+   const struct lp_rast_hiz *hiz = &task->hiz;
+   const unsigned i0 = lp_rast_hiz_index(x, y);
+   const unsigned i1 = lp_rast_hiz_index(x + size - 1, y + size - 1);
+   float zmin, zmax, bmin, bmax;
+   unsigned i;
+
+   if (hiz->cull_func == PIPE_FUNC_ALWAYS || inputs->layer)
+      return FALSE;
+
+   bmin = hiz->zmin[i0];
+   bmax = hiz->zmax[i0];
+   for (i = i0 + 1; i <= i1; i++) {
+      if (i % LP_HIZ_TILE_BLOCKS >= i0 % LP_HIZ_TILE_BLOCKS &&
+          i % LP_HIZ_TILE_BLOCKS <= i1 % LP_HIZ_TILE_BLOCKS) {
+         bmin = MIN2(bmin, hiz->zmin[i]);
+         bmax = MAX2(bmax, hiz->zmax[i]);
+      }
+   }
+
+   lp_rast_hiz_range(task, inputs, x, y, size, &zmin, &zmax);
+
+   return lp_rast_hiz_reject(hiz->cull_func, zmin, zmax, bmin, bmax);
+}
+
+
+/**
+ * Account for the depth writes of shading all pixels of a 16x16 block,
+ * after lp_rast_hiz_write_4() was called for each of its 4x4 blocks.
+ * When every pixel is known to be written, the bounds can be narrowed.
+ * \param x, y location of the block in window coords
+ */
+void
+lp_rast_hiz_write_16(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y)
+{
+   struct lp_rast_hiz *hiz = &task->hiz;
+   const unsigned i = lp_rast_hiz_index(x, y);
+   float zmin, zmax;
+
+   if (hiz->write != LP_HIZ_WRITE_RANGE || !hiz->exact_write ||
+       inputs->layer)
+      return;
+
+   lp_rast_hiz_range(task, inputs, x, y, LP_HIZ_BLOCK_SIZE, &zmin, &zmax);
+
+   switch (hiz->write_func) {
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      /* Each pixel keeps the smaller of its old and new depth */
+      hiz->zmax[i] = MIN2(hiz->zmax[i], zmax);
+      break;
+   case PIPE_FUNC_GREATER:
+   case PIPE_FUNC_GEQUAL:
+      hiz->zmin[i] = MAX2(hiz->zmin[i], zmin);
+      break;
+   case PIPE_FUNC_ALWAYS:
+      hiz->zmin[i] = zmin;
+      hiz->zmax[i] = zmax;
+      break;
+   default:
+      break;
+   }
+}
+
+
+/**
+ * Derive how the hierarchical depth is used and kept up to date from the
+ * current state.
+ */
+static void
+lp_rast_hiz_set_state(struct lp_rasterizer_task *task)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct tgsi_shader_info *info = &variant->shader->info.base;
+   const struct util_format_description *desc;
+   struct lp_rast_hiz *hiz = &task->hiz;
+   boolean stencil_writes;
+
+   hiz->cull_func = PIPE_FUNC_ALWAYS;
+   hiz->write = LP_HIZ_WRITE_NONE;
+
+   if (!task->scene->fb.zsbuf || !key->depth.enabled)
+      return;
+
+   desc = util_format_description(key->zsbuf_format);
+   if (!util_format_has_depth(desc))
+      return;
+
+   hiz->unorm = desc->channel[desc->swizzle[0]].type != UTIL_FORMAT_TYPE_FLOAT;
+   hiz->eps = hiz->unorm ?
+      1.0f / (float)((1ULL << desc->channel[desc->swizzle[0]].size) - 1) : 0.0f;
+   hiz->depth_clamp = key->depth_clamp;
+
+   if (key->depth.writemask) {
+      hiz->write = info->writes_z ? LP_HIZ_WRITE_ANY : LP_HIZ_WRITE_RANGE;
+      hiz->write_func = key->depth.func;
+      hiz->exact_write = !key->stencil[0].enabled &&
+                         !key->alpha.enabled &&
+                         !key->blend.alpha_to_coverage &&
+                         !info->uses_kill &&
+                         !info->writes_samplemask;
+   }
+
+   /* Skipping pixels that fail the depth test must not skip anything
+    * else they would have done.
+    */
+   stencil_writes = key->stencil[0].enabled &&
+                    (key->stencil[0].writemask ||
+                     (key->stencil[1].enabled && key->stencil[1].writemask));
+
+   if (!(LP_PERF & PERF_NO_HIZ) &&
+       key->depth.func != PIPE_FUNC_NOTEQUAL &&
+       !info->writes_z &&
+       !info->writes_memory &&
+       !stencil_writes) {
+      hiz->cull_func = key->depth.func;
+   }
+}
+
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   lp_rast_hiz_set_state(task);
 }
 
 
@@ -588,7 +1039,8 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
    lp_rast_triangle_32_8,
    lp_rast_triangle_32_3_4,
    lp_rast_triangle_32_3_16,
-   lp_rast_triangle_32_4_16
+   lp_rast_triangle_32_4_16,
+   lp_rast_rectangle
 };
 
 
@@ -640,17 +1092,68 @@ rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
-/* An empty bin is one that just loads the contents of the tile and
- * stores them again unchanged.  This typically happens when bins have
- * been flushed for some reason in the middle of a frame, or when
- * incremental updates are being made to a render target.
- * 
- * Try to avoid doing pointless work in this case.
+/**
+ * Take one bin from the range of the given task: from the front when
+ * \p steal is false (the owner), from the back otherwise.
+ * \return FALSE if the range is empty
  */
 static boolean
-is_empty_bin( const struct cmd_bin *bin )
+take_bin(struct lp_rasterizer_task *task, boolean steal, unsigned *index)
 {
-   return bin->head == NULL;
+   uint64_t range = p_atomic_read(&task->bin_range);
+
+   for (;;) {
+      uint32_t first = (uint32_t)range;
+      uint32_t last = (uint32_t)(range >> 32);
+      uint64_t prev;
+
+      if (first >= last)
+         return FALSE;
+
+      if (steal)
+         *index = --last;
+      else
+         *index = first++;
+
+      prev = p_atomic_cmpxchg(&task->bin_range, range,
+                              first | ((uint64_t)last << 32));
+      if (prev == range)
+         return TRUE;
+
+      range = prev;
+   }
+}
+
+
+/**
+ * Return the next bin this thread should rasterize, or NULL if all bins of
+ * the scene have been handed out.
+ */
+static struct cmd_bin *
+lp_rast_next_bin(struct lp_rasterizer_task *task, int *x, int *y)
+{
+   struct lp_rasterizer *rast = task->rast;
+   const unsigned num_tasks = MAX2(1, rast->num_threads);
+   const unsigned me = task->thread_index;
+   unsigned index, d;
+   boolean found = take_bin(task, FALSE, &index);
+
+   /* Out of work: steal from the nearest threads first, as they own the
+    * neighbouring runs of bins and are most likely on the same L3.
+    */
+   for (d = 1; !found && d < num_tasks; d++) {
+      if (me + d < num_tasks)
+         found = take_bin(&rast->tasks[me + d], TRUE, &index);
+      if (!found && me >= d)
+         found = take_bin(&rast->tasks[me - d], TRUE, &index);
+   }
+
+   if (!found)
+      return NULL;
+
+   *x = rast->bins[index] & 0xffff;
+   *y = rast->bins[index] >> 16;
+   return lp_scene_get_bin(task->scene, *x, *y);
 }
 
 
@@ -682,9 +1185,9 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
-               rasterize_bin(task, bin, i, j);
+         while ((bin = lp_rast_next_bin(task, &i, &j))) {
+            assert(!is_empty_bin( bin ));
+            rasterize_bin(task, bin, i, j);
          }
       }
    }
@@ -704,10 +1207,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -737,8 +1236,6 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
       lp_rast_end( rast );
 
       util_fpstate_set(fpstate);
-
-      rast->curr_scene = NULL;
    }
    else {
       /* threaded rendering! */
@@ -756,20 +1253,38 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Run a job on all rasterizer threads and wait for it to complete.
+ * The job goes ahead of any scenes still queued, so the caller must wait
+ * for the scenes its job depends on first.  Called with the screen's
+ * rast_mutex held, which also keeps jobs from different contexts apart.
+ */
 void
-lp_rast_finish( struct lp_rasterizer *rast )
+lp_rast_run_job( struct lp_rasterizer *rast,
+                 lp_rast_job_func func,
+                 void *data )
 {
+   unsigned i;
+
    if (rast->num_threads == 0) {
-      /* nothing to do */
+      unsigned fpstate = util_fpstate_get();
+
+      util_fpstate_set_denorms_to_zero(fpstate);
+
+      func(data, 0, &rast->tasks[0].thread_data);
+
+      util_fpstate_set(fpstate);
+      return;
    }
-   else {
-      int i;
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
+   rast->next_job = func;
+   rast->next_job_data = data;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      pipe_semaphore_signal(&rast->tasks[i].work_ready);
    }
+
+   pipe_semaphore_wait(&rast->job_done);
 }
 
 
@@ -778,7 +1293,7 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. signal the scene's fence (see lp_rast_end())
  */
 static int
 thread_function(void *init_data)
@@ -809,11 +1324,19 @@ thread_function(void *init_data)
 
       if (task->thread_index == 0) {
          /* thread[0]:
+          *  - pick up a pending job, or else
           *  - get next scene to rasterize
           *  - map the framebuffer surfaces
           */
-         lp_rast_begin( rast, 
-                        lp_scene_dequeue( rast->full_scenes, TRUE ) );
+         if (rast->next_job) {
+            rast->curr_job = rast->next_job;
+            rast->curr_job_data = rast->next_job_data;
+            rast->next_job = NULL;
+         }
+         else {
+            lp_rast_begin( rast, 
+                           lp_scene_dequeue( rast->full_scenes, TRUE ) );
+         }
       }
 
       /* Wait for all threads to get here so that threads[1+] don't
@@ -821,6 +1344,19 @@ thread_function(void *init_data)
        */
       util_barrier_wait( &rast->barrier );
 
+      if (rast->curr_job) {
+         rast->curr_job(rast->curr_job_data, task->thread_index,
+                        &task->thread_data);
+
+         util_barrier_wait( &rast->barrier );
+
+         if (task->thread_index == 0) {
+            rast->curr_job = NULL;
+            pipe_semaphore_signal(&rast->job_done);
+         }
+         continue;
+      }
+
       /* do work */
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
@@ -831,17 +1367,16 @@ thread_function(void *init_data)
       /* wait for all threads to finish with this scene */
       util_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
+      /* thread[0]:
+       *  - unmap the framebuffer surfaces
+       *  - signal the scene's fence
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -867,6 +1402,23 @@ create_rast_threads(struct lp_rasterizer *rast)
       rast->threads[i] = u_thread_create(thread_function,
                                             (void *) &rast->tasks[i]);
    }
+
+   /* On CPUs with several L3 caches, keep threads with neighbouring
+    * indices on the same L3, since they render neighbouring tiles and
+    * steal work from each other first.
+    */
+   if (rast->num_threads > 1 &&
+       util_cpu_caps.cores_per_L3 < util_cpu_caps.nr_cpus &&
+       debug_get_bool_option("LP_PIN_THREADS", TRUE)) {
+      unsigned num_L3 = DIV_ROUND_UP(util_cpu_caps.nr_cpus,
+                                     util_cpu_caps.cores_per_L3);
+
+      for (i = 0; i < rast->num_threads; i++) {
+         util_pin_thread_to_L3(rast->threads[i],
+                               i * num_L3 / rast->num_threads,
+                               util_cpu_caps.cores_per_L3);
+      }
+   }
 }
 
 
@@ -892,6 +1444,13 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof(*rast->threads));
+   rast->bins = MALLOC(TILES_X * TILES_Y * sizeof(*rast->bins));
+   if (!rast->tasks || !rast->threads || !rast->bins) {
+      goto no_thread_data_cache;
+   }
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
@@ -912,6 +1471,7 @@ lp_rast_create( unsigned num_threads )
    /* for synchronizing rasterization threads */
    if (rast->num_threads > 0) {
       util_barrier_init( &rast->barrier, rast->num_threads );
+      pipe_semaphore_init( &rast->job_done, 0 );
    }
 
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
@@ -919,12 +1479,17 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
-      if (rast->tasks[i].thread_data.cache) {
-         align_free(rast->tasks[i].thread_data.cache);
+   if (rast->tasks) {
+      for (i = 0; i < MAX2(1, num_threads); i++) {
+         if (rast->tasks[i].thread_data.cache) {
+            align_free(rast->tasks[i].thread_data.cache);
+         }
       }
    }
 
+   FREE(rast->tasks);
+   FREE(rast->threads);
+   FREE(rast->bins);
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -971,10 +1536,14 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
    /* for synchronizing rasterization threads */
    if (rast->num_threads > 0) {
       util_barrier_destroy( &rast->barrier );
+      pipe_semaphore_destroy( &rast->job_done );
    }
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->tasks);
+   FREE(rast->threads);
+   FREE(rast->bins);
    FREE(rast);
 }
 
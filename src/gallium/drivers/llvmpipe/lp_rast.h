@@ -39,6 +39,7 @@
 
 #include "pipe/p_compiler.h"
 #include "util/u_pack_color.h"
+#include "util/u_rect.h"
 #include "lp_jit.h"
 
 
@@ -143,6 +144,21 @@ struct lp_rast_triangle {
 };
 
 
+/**
+ * An axis-aligned rectangle, which the rasterizer shades span by span
+ * rather than evaluating edge functions.
+ * Objects of this type are put into the lp_setup_context::data buffer.
+ */
+struct lp_rast_rectangle {
+   /* inclusive pixel bounds, clipped to the scissor and framebuffer */
+   struct u_rect box;
+
+   /* inputs for the shader */
+   struct lp_rast_shader_inputs inputs;
+   /* followed by a0, dadx, dady */
+};
+
+
 struct lp_rast_clear_rb {
    union util_color color_val;
    unsigned cbuf;
@@ -166,8 +182,17 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
+/**
+ * A job run by every rasterizer thread, e.g. a compute grid launch.
+ * thread_index is in [0, max(1, num_threads)).
+ */
+typedef void (*lp_rast_job_func)(void *data, unsigned thread_index,
+                                 struct lp_jit_thread_data *thread_data);
+
 void
-lp_rast_finish( struct lp_rasterizer *rast );
+lp_rast_run_job( struct lp_rasterizer *rast,
+                 lp_rast_job_func func,
+                 void *data );
 
 
 union lp_rast_cmd_arg {
@@ -176,6 +201,7 @@ union lp_rast_cmd_arg {
       const struct lp_rast_triangle *tri;
       unsigned plane_mask;
    } triangle;
+   const struct lp_rast_rectangle *rectangle;
    const struct lp_rast_state *set_state;
    const struct lp_rast_clear_rb *clear_rb;
    struct {
@@ -224,6 +250,14 @@ lp_rast_arg_triangle_contained( const struct lp_rast_triangle *triangle,
    return arg;
 }
 
+static inline union lp_rast_cmd_arg
+lp_rast_arg_rectangle( const struct lp_rast_rectangle *rectangle )
+{
+   union lp_rast_cmd_arg arg;
+   arg.rectangle = rectangle;
+   return arg;
+}
+
 static inline union lp_rast_cmd_arg
 lp_rast_arg_state( const struct lp_rast_state *state )
 {
@@ -302,8 +336,9 @@ lp_rast_arg_null( void )
 #define LP_RAST_OP_TRIANGLE_32_3_4   0x1a
 #define LP_RAST_OP_TRIANGLE_32_3_16  0x1b
 #define LP_RAST_OP_TRIANGLE_32_4_16  0x1c
+#define LP_RAST_OP_RECTANGLE         0x1d
 
-#define LP_RAST_OP_MAX               0x1d
+#define LP_RAST_OP_MAX               0x1e
 #define LP_RAST_OP_MASK              0xff
 
 void
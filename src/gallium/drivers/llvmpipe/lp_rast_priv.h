@@ -29,6 +29,7 @@
 #define LP_RAST_PRIV_H
 
 #include "util/u_format.h"
+#include "util/u_math.h"
 #include "util/u_thread.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
@@ -42,6 +43,15 @@
 #define TILE_VECTOR_HEIGHT 4
 #define TILE_VECTOR_WIDTH 4
 
+/** Size of the blocks of the hierarchical depth bounds, in pixels */
+#define LP_HIZ_BLOCK_SIZE 16
+#define LP_HIZ_TILE_BLOCKS (TILE_SIZE / LP_HIZ_BLOCK_SIZE)
+
+/** How the current state writes depth, see lp_rast_hiz::write */
+#define LP_HIZ_WRITE_NONE  0   /**< depth is not written */
+#define LP_HIZ_WRITE_RANGE 1   /**< the interpolated z is written */
+#define LP_HIZ_WRITE_ANY   2   /**< the shader outputs depth */
+
 /* If we crash in a jitted function, we can examine jit_line and jit_state
  * to get some info.  This is not thread-safe, however.
  */
@@ -76,6 +86,33 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+
+/**
+ * Hierarchical depth: conservative bounds of the depth values of the
+ * current tile, for each 16x16 block of it, in [-inf, +inf] when unknown.
+ *
+ * Triangles whose depth over a block can't pass the depth test against
+ * these bounds don't get rasterized nor shaded there.  The bounds are
+ * forgotten at the beginning of each tile, set by depth clears, and kept
+ * enclosing the depth buffer by every command which runs the shader.
+ * Only layer 0 is tracked.
+ */
+struct lp_rast_hiz
+{
+   float zmin[LP_HIZ_TILE_BLOCKS * LP_HIZ_TILE_BLOCKS];
+   float zmax[LP_HIZ_TILE_BLOCKS * LP_HIZ_TILE_BLOCKS];
+
+   /* Derived from the current state by lp_rast_set_state() */
+   unsigned cull_func;     /**< PIPE_FUNC_x to reject with, or ALWAYS */
+   unsigned write;         /**< LP_HIZ_WRITE_x */
+   unsigned write_func;    /**< PIPE_FUNC_x of the depth writes */
+   boolean exact_write;    /**< every covered pixel passes all but the
+                                depth test */
+   boolean unorm;          /**< depth is clamped to [0, 1] when stored */
+   boolean depth_clamp;    /**< depth is clamped to the viewport range */
+   float eps;              /**< one unit of the depth format */
+};
+
 /**
  * Per-thread rasterization state
  */
@@ -97,9 +134,20 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /**
+    * The bins of the current scene assigned to this thread, as a
+    * [first, last) range of lp_rasterizer::bins.  First is in the low
+    * 32 bits and last in the high 32 bits, so that the owner (taking bins
+    * from the front) and other threads (stealing from the back) can both
+    * update it with a single compare-and-swap.
+    */
+   uint64_t bin_range;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   struct lp_rast_hiz hiz;
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -121,11 +169,23 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
+   /** A job to run on all threads before the next scene, and the job
+    * the threads are currently running, if any.  See lp_rast_run_job().
+    */
+   lp_rast_job_func next_job, curr_job;
+   void *next_job_data, *curr_job_data;
+   pipe_semaphore job_done;
+
+   /** Non-empty bins of the current scene, as (y << 16) | x, in the
+    * order they are handed out to the threads.
+    */
+   unsigned *bins;
+
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -138,6 +198,132 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          unsigned x, unsigned y,
                          unsigned mask);
 
+unsigned
+lp_rast_hiz_cull_mask_16(const struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs);
+
+unsigned
+lp_rast_hiz_cull_mask_4(const struct lp_rasterizer_task *task,
+                        const struct lp_rast_shader_inputs *inputs,
+                        unsigned x, unsigned y);
+
+boolean
+lp_rast_hiz_cull_block(const struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       unsigned x, unsigned y, unsigned size);
+
+void
+lp_rast_hiz_write_16(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y);
+
+
+/**
+ * Index of the hierarchical depth block of a pixel of the current tile.
+ */
+static inline unsigned
+lp_rast_hiz_index(unsigned x, unsigned y)
+{
+   return ((y % TILE_SIZE) / LP_HIZ_BLOCK_SIZE) * LP_HIZ_TILE_BLOCKS +
+          (x % TILE_SIZE) / LP_HIZ_BLOCK_SIZE;
+}
+
+
+/**
+ * Compute bounds of the depth the shader sees over a size x size block of
+ * pixels, as it ends up in the depth buffer.  The plane is evaluated over
+ * the whole block, so this is conservative wherever the block is covered.
+ * \param x, y  location of the block in window coords
+ */
+static inline void
+lp_rast_hiz_range(const struct lp_rasterizer_task *task,
+                  const struct lp_rast_shader_inputs *inputs,
+                  unsigned x, unsigned y, unsigned size,
+                  float *zmin, float *zmax)
+{
+   const struct lp_rast_hiz *hiz = &task->hiz;
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float zx = dzdx * x, zy = dzdy * y;
+   const float ex = dzdx * (size - 1), ey = dzdy * (size - 1);
+   const float z = a0 + zx + zy;
+   float err;
+
+   /* Allow for the rounding of the shader's own evaluation of the plane,
+    * and of the conversion to the depth format.
+    */
+   err = (fabsf(a0) + fabsf(zx) + fabsf(zy) + fabsf(ex) + fabsf(ey)) *
+         (8.0f * FLT_EPSILON) + hiz->eps;
+
+   *zmin = z + MIN2(ex, 0.0f) + MIN2(ey, 0.0f) - err;
+   *zmax = z + MAX2(ex, 0.0f) + MAX2(ey, 0.0f) + err;
+
+   if (!(*zmin <= *zmax)) {
+      /* NaN */
+      *zmin = -INFINITY;
+      *zmax = INFINITY;
+   }
+
+   if (hiz->depth_clamp) {
+      const struct lp_jit_viewport *vp =
+         &task->state->jit_context.viewports[inputs->viewport_index];
+      *zmin = CLAMP(*zmin, vp->min_depth, vp->max_depth);
+      *zmax = CLAMP(*zmax, vp->min_depth, vp->max_depth);
+   }
+
+   if (hiz->unorm) {
+      *zmin = CLAMP(*zmin, 0.0f, 1.0f);
+      *zmax = CLAMP(*zmax, 0.0f, 1.0f);
+   }
+}
+
+
+/**
+ * Account for the depth writes of shading a 4x4 block.  Partial coverage
+ * can only extend the bounds, see lp_rast_hiz_write_16() for narrowing
+ * them.
+ * \param x, y location of 4x4 block in window coords
+ */
+static inline void
+lp_rast_hiz_write_4(struct lp_rasterizer_task *task,
+                    const struct lp_rast_shader_inputs *inputs,
+                    unsigned x, unsigned y)
+{
+   struct lp_rast_hiz *hiz = &task->hiz;
+   const unsigned i = lp_rast_hiz_index(x, y);
+   float zmin, zmax;
+
+   if (hiz->write == LP_HIZ_WRITE_NONE || inputs->layer)
+      return;
+
+   if (hiz->write == LP_HIZ_WRITE_ANY) {
+      hiz->zmin[i] = -INFINITY;
+      hiz->zmax[i] = INFINITY;
+      return;
+   }
+
+   lp_rast_hiz_range(task, inputs, x, y, 4, &zmin, &zmax);
+
+   switch (hiz->write_func) {
+   case PIPE_FUNC_NEVER:
+   case PIPE_FUNC_EQUAL:
+      break;
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      hiz->zmin[i] = MIN2(hiz->zmin[i], zmin);
+      break;
+   case PIPE_FUNC_GREATER:
+   case PIPE_FUNC_GEQUAL:
+      hiz->zmax[i] = MAX2(hiz->zmax[i], zmax);
+      break;
+   default:
+      hiz->zmin[i] = MIN2(hiz->zmin[i], zmin);
+      hiz->zmax[i] = MAX2(hiz->zmax[i], zmax);
+      break;
+   }
+}
+
 
 /**
  * Get the pointer to a 4x4 color block (within a 64x64 tile).
@@ -260,6 +446,8 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
+      lp_rast_hiz_write_4(task, inputs, x, y);
+
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_WHOLE]( &state->jit_context,
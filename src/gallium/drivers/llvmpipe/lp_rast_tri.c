@@ -61,6 +61,8 @@ block_full_16(struct lp_rasterizer_task *task,
    for (iy = 0; iy < 16; iy += 4)
       for (ix = 0; ix < 16; ix += 4)
 	 block_full_4(task, tri, x + ix, y + iy);
+
+   lp_rast_hiz_write_16(task, &tri->inputs, x, y);
 }
 
 static inline unsigned
@@ -265,6 +267,11 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (lp_rast_hiz_cull_block(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &unused, &dcdx, &dcdy);
 
@@ -373,6 +380,11 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (lp_rast_hiz_cull_block(task, &tri->inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_culled_4);
+      return;
+   }
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &unused, &dcdx, &dcdy);
 
@@ -566,6 +578,11 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    vshuf_mask2 = (__m128i) vec_splats((unsigned int) 0x04050607);
 #endif
 
+   if (lp_rast_hiz_cull_block(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &rej4);
 
@@ -78,7 +78,7 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
                  int x, int y,
                  const int64_t *c)
 {
-   unsigned outmask, inmask, partmask, partial_mask;
+   unsigned outmask, inmask, partmask, partial_mask, hizmask;
    unsigned j;
 
    outmask = 0;                 /* outside one or more trivial reject planes */
@@ -117,6 +117,17 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
    if (outmask == 0xffff)
       return;
 
+   /* Sub-blocks entirely behind the depth buffer are as good as outside:
+    */
+   hizmask = lp_rast_hiz_cull_mask_4(task, &tri->inputs, x, y) & ~outmask;
+   if (hizmask) {
+      LP_COUNT_ADD(nr_hiz_culled_4, util_bitcount(hizmask));
+      outmask |= hizmask;
+      partmask |= hizmask;
+      if (outmask == 0xffff)
+         return;
+   }
+
    /* Mask of sub-blocks which are inside all trivial accept planes:
     */
    inmask = ~partmask & 0xffff;
@@ -183,7 +194,7 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
    const int x = task->x, y = task->y;
    struct lp_rast_plane plane[NR_PLANES];
    int64_t c[NR_PLANES];
-   unsigned outmask, inmask, partmask, partial_mask;
+   unsigned outmask, inmask, partmask, partial_mask, hizmask;
    unsigned j = 0;
 
    if (tri->inputs.disable) {
@@ -271,6 +282,17 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
    if (outmask == 0xffff)
       return;
 
+   /* Blocks entirely behind the depth buffer are as good as outside:
+    */
+   hizmask = lp_rast_hiz_cull_mask_16(task, &tri->inputs) & ~outmask;
+   if (hizmask) {
+      LP_COUNT_ADD(nr_hiz_culled_16, util_bitcount(hizmask));
+      outmask |= hizmask;
+      partmask |= hizmask;
+      if (outmask == 0xffff)
+         return;
+   }
+
    /* Mask of sub-blocks which are inside all trivial accept planes:
     */
    inmask = ~partmask & 0xffff;
@@ -345,6 +367,11 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (lp_rast_hiz_cull_block(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
@@ -410,6 +437,11 @@ TRI_4(struct lp_rasterizer_task *task,
    const int y = task->y + (mask >> 8);
    unsigned j;
 
+   if (lp_rast_hiz_cull_block(task, &tri->inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_culled_4);
+      return;
+   }
+
    /* Iterate over partials:
     */
    {
@@ -122,8 +122,8 @@ struct resource_ref;
  * Per-bin data goes into the 'tile' bins.
  * Shared data goes into the 'data' buffer.
  *
- * When there are multiple threads, will want to double-buffer between
- * scenes:
+ * Each setup context owns a small ring of scenes so that binning of one
+ * scene can overlap with rasterization of the previous ones.
  */
 struct lp_scene {
    struct pipe_context *pipe;
@@ -172,8 +172,6 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -196,10 +194,11 @@ struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
 
 boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
-                                        boolean initializing_scene);
+                                        boolean initializing_scene,
+                                        boolean writeable);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 
 /**
@@ -377,12 +376,6 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 }
 
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
-
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
-
 
 
 /* Begin/end binning of a scene
@@ -400,6 +393,9 @@ lp_scene_end_binning(struct lp_scene *scene);
 void
 lp_scene_begin_rasterization(struct lp_scene *scene);
 
+void
+lp_scene_unmap_framebuffer(struct lp_scene *scene);
+
 void
 lp_scene_end_rasterization(struct lp_scene *scene);
 
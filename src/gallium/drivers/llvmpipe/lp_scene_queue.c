@@ -36,10 +36,14 @@
 #include "util/u_memory.h"
 #include "lp_scene_queue.h"
 #include "util/u_math.h"
+#include "lp_limits.h"
 
 
 
-#define SCENE_QUEUE_SIZE 4
+/* Large enough that a single context never blocks here before it runs out
+ * of scenes.
+ */
+#define SCENE_QUEUE_SIZE LP_MAX_SCENES
 
 
 
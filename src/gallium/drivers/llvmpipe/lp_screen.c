@@ -26,6 +26,7 @@
  **************************************************************************/
 
 
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_cpu_detect.h"
@@ -36,8 +37,13 @@
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_nir.h"
 #include "gallivm/lp_bld_type.h"
 
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
 #include "util/os_misc.h"
 #include "util/os_time.h"
 #include "lp_texture.h"
@@ -49,6 +55,7 @@
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_cs_coro.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -68,6 +75,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "fence", DEBUG_FENCE, NULL },
    { "mem", DEBUG_MEM, NULL },
    { "fs", DEBUG_FS, NULL },
+   { "cache_stats", DEBUG_CACHE_STATS, NULL },
    DEBUG_NAMED_VALUE_END
 };
 #endif
@@ -82,6 +90,9 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_async_compile", PERF_NO_ASYNC_COMPILE, NULL },
+   { "no_rect",        PERF_NO_RECT, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -216,7 +227,8 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
-      return 0;
+      /* Barriers need coroutines. */
+      return LP_HAVE_CS_CORO;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
       return 1;
    case PIPE_CAP_VERTEX_BUFFER_OFFSET_4BYTE_ALIGNED_ONLY:
@@ -392,6 +404,48 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    }
 }
 
+static const void *
+llvmpipe_get_compiler_options(struct pipe_screen *screen,
+                              enum pipe_shader_ir ir,
+                              enum pipe_shader_type shader)
+{
+   assert(ir == PIPE_SHADER_IR_NIR);
+   return &gallivm_nir_options;
+}
+
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+#define QUERY(NAME, STAT, UNITS) \
+   {NAME, PIPE_QUERY_DRIVER_SPECIFIC + STAT, {0}, UNITS, \
+    PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE, 0, 0x0}
+
+   static const struct pipe_driver_query_info queries[] = {
+      QUERY("fs-compile-time", LP_FS_STAT_COMPILE_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+      QUERY("fs-code-size", LP_FS_STAT_CODE_SIZE,
+            PIPE_DRIVER_QUERY_TYPE_BYTES),
+      QUERY("fs-fast-compiles", LP_FS_STAT_FAST_COMPILES,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("fs-optimized-compiles", LP_FS_STAT_OPTIMIZED_COMPILES,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+   };
+#undef QUERY
+
+   STATIC_ASSERT(ARRAY_SIZE(queries) == LP_FS_STAT_COUNT);
+
+   if (!info)
+      return ARRAY_SIZE(queries);
+
+   if (index >= ARRAY_SIZE(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
 static int
 llvmpipe_get_shader_param(struct pipe_screen *screen,
                           enum pipe_shader_type shader,
@@ -401,6 +455,13 @@ llvmpipe_get_shader_param(struct pipe_screen *screen,
    {
    case PIPE_SHADER_FRAGMENT:
       switch (param) {
+      case PIPE_SHADER_CAP_SUPPORTED_IRS:
+         /*
+          * NIR goes straight to lp_build_nir_soa.  TGSI stays preferred, as
+          * the state tracker links all the stages with the IR the vertex
+          * shader prefers, and the draw module only runs TGSI.
+          */
+         return (1 << PIPE_SHADER_IR_TGSI) | (1 << PIPE_SHADER_IR_NIR);
       default:
          return gallivm_get_shader_param(param);
       }
@@ -424,11 +485,76 @@ llvmpipe_get_shader_param(struct pipe_screen *screen,
       default:
          return draw_get_shader_param(shader, param);
       }
+   case PIPE_SHADER_COMPUTE:
+      if (!LP_HAVE_CS_CORO)
+         return 0;
+      switch (param) {
+      case PIPE_SHADER_CAP_MAX_INPUTS:
+      case PIPE_SHADER_CAP_MAX_OUTPUTS:
+         return 0;
+      case PIPE_SHADER_CAP_SUPPORTED_IRS:
+         return 1 << PIPE_SHADER_IR_TGSI;
+      default:
+         return gallivm_get_shader_param(param);
+      }
    default:
       return 0;
    }
 }
 
+static int
+llvmpipe_get_compute_param(struct pipe_screen *_screen,
+                           enum pipe_shader_ir ir_type,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   switch (param) {
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      return 0;
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      if (ret) {
+         uint64_t *grid_size = ret;
+         grid_size[0] = 65535;
+         grid_size[1] = 65535;
+         grid_size[2] = 65535;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      if (ret) {
+         uint64_t *block_size = ret;
+         block_size[0] = 1024;
+         block_size[1] = 1024;
+         block_size[2] = 1024;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      if (ret) {
+         uint64_t *max_threads_per_block = ret;
+         *max_threads_per_block = 1024;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      if (ret) {
+         uint64_t *max_local_size = ret;
+         *max_local_size = 32768;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_CLOCK_FREQUENCY:
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+   case PIPE_COMPUTE_CAP_ADDRESS_BITS:
+   case PIPE_COMPUTE_CAP_MAX_VARIABLE_THREADS_PER_BLOCK:
+      break;
+   }
+   return 0;
+}
+
 static float
 llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
 {
@@ -598,8 +724,24 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   if (screen->cs_coros) {
+      unsigned i;
+      for (i = 0; i < MAX2(1, screen->num_threads); i++)
+         lp_cs_coro_set_destroy(screen->cs_coros[i]);
+      FREE(screen->cs_coros);
+   }
+
+   if (util_queue_is_initialized(&screen->fs_compile_queue))
+      util_queue_destroy(&screen->fs_compile_queue);
+
    lp_jit_screen_cleanup(screen);
 
+   if (LP_DEBUG & DEBUG_CACHE_STATS)
+      debug_printf("llvmpipe: disk shader cache hits = %u, misses = %u\n",
+                   screen->num_disk_shader_cache_hits,
+                   screen->num_disk_shader_cache_misses);
+   disk_cache_destroy(screen->disk_shader_cache);
+
    if(winsys->destroy)
       winsys->destroy(winsys);
 
@@ -655,6 +797,86 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+static void
+lp_disk_cache_create(struct llvmpipe_screen *screen)
+{
+#ifdef HAVE_DLFCN_H
+   struct util_cpu_caps cpu_caps = util_cpu_caps;
+   unsigned llvm_version = HAVE_LLVM;
+   struct mesa_sha1 ctx;
+   unsigned char sha1[20];
+   char cache_id[20 * 2 + 1];
+
+   _mesa_sha1_init(&ctx);
+
+   /* The machine code depends on the builds of llvmpipe and LLVM, */
+   if (!disk_cache_get_function_identifier(lp_disk_cache_create, &ctx) ||
+       !disk_cache_get_function_identifier(LLVMLinkInMCJIT, &ctx))
+      return;
+   _mesa_sha1_update(&ctx, &llvm_version, sizeof(llvm_version));
+
+   /* and on the features of the CPU it was generated for. */
+   cpu_caps.nr_cpus = 0;
+   _mesa_sha1_update(&ctx, &cpu_caps, sizeof(cpu_caps));
+   _mesa_sha1_update(&ctx, &lp_native_vector_width,
+                     sizeof(lp_native_vector_width));
+
+   _mesa_sha1_final(&ctx, sha1);
+   disk_cache_format_hex_id(cache_id, sha1, 20 * 2);
+
+   screen->disk_shader_cache =
+      disk_cache_create("llvmpipe", cache_id,
+                        (uint64_t)LP_PERF << 32 | gallivm_perf);
+#endif
+}
+
+
+/**
+ * Look the machine code of a shader variant up in the disk cache.  On a
+ * hit, cache->data is set and must be freed by the caller.
+ */
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+   size_t size;
+
+   if (!screen->disk_shader_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key, 20,
+                          sha1);
+
+   cache->data = disk_cache_get(screen->disk_shader_cache, sha1, &size);
+   if (!cache->data) {
+      p_atomic_inc(&screen->num_disk_shader_cache_misses);
+      return;
+   }
+
+   cache->data_size = size;
+   p_atomic_inc(&screen->num_disk_shader_cache_hits);
+}
+
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key, 20,
+                          sha1);
+   disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
+                  cache->data_size, NULL);
+}
+
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -681,6 +903,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
       return NULL;
    }
 
+   lp_disk_cache_create(screen);
+
    screen->winsys = winsys;
 
    screen->base.destroy = llvmpipe_destroy_screen;
@@ -690,7 +914,10 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_device_vendor = llvmpipe_get_vendor; // TODO should be the CPU vendor
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
+   screen->base.get_compiler_options = llvmpipe_get_compiler_options;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
    screen->base.context_create = llvmpipe_create_context;
@@ -707,15 +934,39 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = 0;
 #endif
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
-   screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
+
+   /* Without rasterizer threads scenes are rendered synchronously when
+    * queued, so there is nothing to overlap with.
+    */
+   screen->num_scenes = screen->num_threads ? 4 : 1;
+   screen->num_scenes = debug_get_num_option("LP_NUM_SCENES", screen->num_scenes);
+   screen->num_scenes = CLAMP(screen->num_scenes, 1, LP_MAX_SCENES);
 
    screen->rast = lp_rast_create(screen->num_threads);
    if (!screen->rast) {
+      disk_cache_destroy(screen->disk_shader_cache);
       lp_jit_screen_cleanup(screen);
       FREE(screen);
       return NULL;
    }
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
+   screen->use_nir = debug_get_bool_option("LP_NIR", FALSE);
+
+   /* Without a spare CPU, compiling in the background would only delay the
+    * rendering.  Failing to create the queue just disables it.
+    */
+   if (util_cpu_caps.nr_cpus > 1 && !(LP_PERF & PERF_NO_ASYNC_COMPILE)) {
+      util_queue_init(&screen->fs_compile_queue, "llvmpipe_fs", 32,
+                      MIN2(util_cpu_caps.nr_cpus - 1, LP_MAX_COMPILE_THREADS),
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                      UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY);
+   }
+
+   screen->fs_fast_tier_instrs = debug_get_num_option("LP_FAST_TIER_INSTRS",
+                                                      LP_FAST_TIER_INSTRS);
+   screen->fs_tier_up_instrs = debug_get_num_option("LP_TIER_UP_INSTRS",
+                                                    LP_TIER_UP_INSTRS);
+
    return &screen->base;
 }
@@ -37,10 +37,28 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld.h"
 
 
 struct sw_winsys;
+struct lp_cs_coro_set;
+struct lp_cached_code;
+struct disk_cache;
+
+
+/**
+ * Counters of the fragment shader compilation, which the driver queries of
+ * the same index from PIPE_QUERY_DRIVER_SPECIFIC return for the HUD.
+ */
+enum lp_fs_compile_stat
+{
+   LP_FS_STAT_COMPILE_TIME,         /**< usecs building and compiling code */
+   LP_FS_STAT_CODE_SIZE,            /**< bytes of machine code generated */
+   LP_FS_STAT_FAST_COMPILES,        /**< variants compiled for the fast tier */
+   LP_FS_STAT_OPTIMIZED_COMPILES,   /**< variants compiled optimized */
+   LP_FS_STAT_COUNT
+};
 
 
 struct llvmpipe_screen
@@ -51,12 +69,41 @@ struct llvmpipe_screen
 
    unsigned num_threads;
 
+   /** Max number of scenes each context may have in flight */
+   unsigned num_scenes;
+
    /* Increments whenever textures are modified.  Contexts can track this.
     */
    unsigned timestamp;
 
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
+
+   /** Per rasterizer thread coroutines for compute shader barriers,
+    * created on first use, protected by rast_mutex.
+    */
+   struct lp_cs_coro_set **cs_coros;
+
+   /** Machine code of the shader variants, see lp_disk_cache_find_shader */
+   struct disk_cache *disk_shader_cache;
+   unsigned num_disk_shader_cache_hits;
+   unsigned num_disk_shader_cache_misses;
+
+   /** Compiles the optimized code of the fragment shader variants */
+   struct util_queue fs_compile_queue;
+
+   /** Variants of fewer IR instructions than this stay unoptimized, while
+    * the others get optimized once the number of draws using them times
+    * their number of instructions reaches fs_tier_up_instrs.
+    */
+   unsigned fs_fast_tier_instrs;
+   unsigned fs_tier_up_instrs;
+
+   /** Updated atomically, as compile threads update them too */
+   uint64_t fs_compile_stats[LP_FS_STAT_COUNT];
+
+   /** Translate the fragment shaders which allow it through NIR (LP_NIR) */
+   boolean use_nir;
 };
 
 
@@ -70,4 +117,15 @@ llvmpipe_screen( struct pipe_screen *pipe )
 
 
 
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20]);
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20]);
+
+
 #endif /* LP_SCREEN_H */
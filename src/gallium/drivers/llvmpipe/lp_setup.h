@@ -130,6 +130,10 @@ lp_setup_set_viewports(struct lp_setup_context *setup,
                        unsigned num_viewports,
                        const struct pipe_viewport_state *viewports);
 
+void
+lp_setup_fill_jit_texture(struct lp_jit_texture *jit_tex,
+                          struct pipe_sampler_view *view);
+
 void
 lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                                     unsigned num,
@@ -0,0 +1,338 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Binning code for axis-aligned rectangles, i.e. pairs of triangles which
+ * split one along a diagonal, as drawn for blits, clears and most 2D
+ * rendering.  These are binned as a single command which the rasterizer
+ * shades span by span, without any edge function.
+ */
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_rect.h"
+#include "lp_setup_context.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_state_fs.h"
+#include "lp_state_setup.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+
+#define NUM_CHANNELS 4
+
+
+/**
+ * Whether a3 is the value of the plane through a0, a1, a2 at the vertex
+ * opposite a0's in the parallelogram a0, a1, a3, a2.
+ */
+static inline boolean
+is_coplanar(float a0, float a1, float a2, float a3)
+{
+   float expected = a1 + a2 - a0;
+
+   /* Allow for the rounding of the above. */
+   return fabsf(a3 - expected) <=
+          1e-6f * (fabsf(a0) + fabsf(a1) + fabsf(a2));
+}
+
+
+static inline int
+snap_coord(float a, float max)
+{
+   /* Clamping outside of the framebuffer doesn't change coverage, but
+    * keeps the fixed point values from overflowing.
+    */
+   return util_iround(FIXED_ONE * CLAMP(a, -1.0f, max + 1.0f));
+}
+
+
+/**
+ * Bin a rectangle of the interpolants of the triangle v0, v1, v2.
+ * \param box  the covered pixels, clipped to the draw region
+ */
+static boolean
+do_rect(struct lp_setup_context *setup,
+        const struct u_rect *box,
+        const float (*v0)[4],
+        const float (*v1)[4],
+        const float (*v2)[4],
+        boolean frontfacing,
+        unsigned viewport_index,
+        unsigned layer)
+{
+   struct lp_scene *scene = setup->scene;
+   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
+   unsigned input_array_sz = NUM_CHANNELS * (key->num_inputs + 1) * sizeof(float);
+   struct lp_rast_rectangle *rect;
+   int ix0 = box->x0 / TILE_SIZE;
+   int iy0 = box->y0 / TILE_SIZE;
+   int ix1 = box->x1 / TILE_SIZE;
+   int iy1 = box->y1 / TILE_SIZE;
+   int x, y;
+
+   rect = lp_scene_alloc_aligned(scene, sizeof *rect + 3 * input_array_sz, 16);
+   if (!rect)
+      return FALSE;
+
+   rect->box = *box;
+   rect->inputs.stride = input_array_sz;
+
+   setup->setup.variant->jit_function(v0, v1, v2,
+                                      frontfacing,
+                                      GET_A0(&rect->inputs),
+                                      GET_DADX(&rect->inputs),
+                                      GET_DADY(&rect->inputs));
+
+   rect->inputs.frontfacing = frontfacing;
+   rect->inputs.disable = FALSE;
+   rect->inputs.opaque = setup->fs.current.variant->opaque;
+   rect->inputs.layer = layer;
+   rect->inputs.viewport_index = viewport_index;
+
+   LP_COUNT(nr_rects);
+
+   for (y = iy0; y <= iy1; y++) {
+      int tile_y1 = MIN2(y * TILE_SIZE + TILE_SIZE - 1,
+                         (int)setup->fb.height - 1);
+
+      for (x = ix0; x <= ix1; x++) {
+         int tile_x1 = MIN2(x * TILE_SIZE + TILE_SIZE - 1,
+                            (int)setup->fb.width - 1);
+
+         if (box->x0 <= x * TILE_SIZE && box->x1 >= tile_x1 &&
+             box->y0 <= y * TILE_SIZE && box->y1 >= tile_y1) {
+            if (!lp_setup_whole_tile(setup, &rect->inputs, x, y))
+               goto fail;
+         }
+         else {
+            LP_COUNT(nr_partially_covered_64);
+            if (!lp_scene_bin_cmd_with_state(scene, x, y,
+                                             setup->fs.stored,
+                                             LP_RAST_OP_RECTANGLE,
+                                             lp_rast_arg_rectangle(rect)))
+               goto fail;
+         }
+      }
+   }
+
+   return TRUE;
+
+fail:
+   /* Need to disable any partially binned rectangle, as with triangles. */
+   rect->inputs.disable = TRUE;
+   return FALSE;
+}
+
+
+/**
+ * Draw the triangles v0, v1, v2 and v3, v4, v5 as one rectangle, if they
+ * split an axis-aligned rectangle along a diagonal with the same
+ * interpolants.
+ * \return FALSE if the triangles need to be drawn as such
+ */
+boolean
+lp_setup_rect(struct lp_setup_context *setup,
+              const float (*v0)[4],
+              const float (*v1)[4],
+              const float (*v2)[4],
+              const float (*v3)[4],
+              const float (*v4)[4],
+              const float (*v5)[4])
+{
+   const struct lp_setup_variant_key *key = &setup->setup.variant->key;
+   struct llvmpipe_context *lp_context = (struct llvmpipe_context *)setup->pipe;
+   const float (*v[6])[4] = { v0, v1, v2, v3, v4, v5 };
+   const float (*corner[4])[4] = { NULL, NULL, NULL, NULL };
+   const float (*pv[2])[4];
+   const float (*far)[4] = NULL;
+   unsigned mask[2] = { 0, 0 };
+   unsigned corner_of[6];
+   unsigned near, diag0, diag1;
+   unsigned nr_floats = setup->vertex_info->size;
+   unsigned viewport_index = 0;
+   unsigned layer = 0;
+   float xmin, xmax, ymin, ymax;
+   float area[2];
+   boolean frontfacing;
+   struct u_rect box;
+   int fx0, fx1, fy0, fy1;
+   unsigned i, j;
+
+   if ((LP_PERF & PERF_NO_RECT) || setup->rasterizer_discard)
+      return FALSE;
+
+   xmin = xmax = v0[0][0];
+   ymin = ymax = v0[0][1];
+   for (i = 1; i < 6; i++) {
+      xmin = MIN2(xmin, v[i][0][0]);
+      xmax = MAX2(xmax, v[i][0][0]);
+      ymin = MIN2(ymin, v[i][0][1]);
+      ymax = MAX2(ymax, v[i][0][1]);
+   }
+   if (!(xmin < xmax && ymin < ymax))
+      return FALSE;
+
+   /*
+    * Every vertex must be a corner, numbered by its right and bottom bits,
+    * and each triangle must use three different ones.
+    */
+   for (i = 0; i < 6; i++) {
+      boolean right = v[i][0][0] == xmax;
+      boolean bottom = v[i][0][1] == ymax;
+      unsigned c = right | (bottom << 1);
+
+      if ((!right && v[i][0][0] != xmin) ||
+          (!bottom && v[i][0][1] != ymin) ||
+          (mask[i / 3] & (1 << c)))
+         return FALSE;
+
+      mask[i / 3] |= 1 << c;
+      corner_of[i] = c;
+      if (i < 3)
+         corner[c] = v[i];
+      else if (!(mask[0] & (1 << c)))
+         far = v[i];
+   }
+
+   /*
+    * The corners the triangles lack must be opposite, so that they share
+    * the other diagonal.
+    */
+   near = util_logbase2(~mask[1] & 0xf);
+   if ((~mask[0] & 0xf) != (1 << (3 - near)))
+      return FALSE;
+   diag0 = near ^ 1;
+   diag1 = near ^ 2;
+
+   /*
+    * The second triangle must share the first one's diagonal vertices,
+    * and its far vertex be in the plane of the first one, with the same
+    * w so that perspective interpolation is linear.
+    */
+   for (i = 3; i < 6; i++) {
+      const float (*shared)[4] = corner[corner_of[i]];
+      if (v[i] != far && v[i] != shared &&
+          memcmp(v[i], shared, nr_floats * sizeof(float)) != 0)
+         return FALSE;
+   }
+   if (far[0][3] != corner[near][0][3] ||
+       corner[diag0][0][3] != corner[near][0][3] ||
+       corner[diag1][0][3] != corner[near][0][3])
+      return FALSE;
+   for (i = 2; i < nr_floats; i++) {
+      if (!is_coplanar(corner[near][0][i], corner[diag0][0][i],
+                       corner[diag1][0][i], far[0][i]))
+         return FALSE;
+   }
+
+   /*
+    * And both provoking vertices must agree on everything flat: the
+    * constant inputs, viewport and layer.
+    */
+   pv[0] = setup->flatshade_first ? v0 : v2;
+   pv[1] = setup->flatshade_first ? v3 : v5;
+   for (i = 0; i < key->num_inputs; i++) {
+      if (key->inputs[i].interp == LP_INTERP_CONSTANT) {
+         const float *a = pv[0][key->inputs[i].src_index];
+         const float *b = pv[1][key->inputs[i].src_index];
+         for (j = 0; j < NUM_CHANNELS; j++) {
+            if (a[j] != b[j])
+               return FALSE;
+         }
+      }
+   }
+   if (setup->viewport_index_slot > 0) {
+      unsigned *udata0 = (unsigned*)pv[0][setup->viewport_index_slot];
+      unsigned *udata1 = (unsigned*)pv[1][setup->viewport_index_slot];
+      if (*udata0 != *udata1)
+         return FALSE;
+      viewport_index = lp_clamp_viewport_idx(*udata0);
+   }
+   if (setup->layer_slot > 0) {
+      unsigned *udata0 = (unsigned*)pv[0][setup->layer_slot];
+      unsigned *udata1 = (unsigned*)pv[1][setup->layer_slot];
+      if (*udata0 != *udata1)
+         return FALSE;
+      layer = MIN2(*udata0, setup->scene->fb_max_layer);
+   }
+
+   /* Both triangles must have the same winding to be culled alike. */
+   for (i = 0; i < 2; i++) {
+      const float (*a)[4] = v[3 * i];
+      const float (*b)[4] = v[3 * i + 1];
+      const float (*c)[4] = v[3 * i + 2];
+      area[i] = (a[0][0] - b[0][0]) * (c[0][1] - a[0][1]) -
+                (c[0][0] - a[0][0]) * (a[0][1] - b[0][1]);
+   }
+   if ((area[0] > 0) != (area[1] > 0))
+      return FALSE;
+
+   if (lp_context->active_statistics_queries) {
+      lp_context->pipeline_statistics.c_primitives += 2;
+   }
+
+   frontfacing = (area[0] > 0) == setup->ccw_is_frontface;
+   if (setup->cullmode & (frontfacing ? PIPE_FACE_FRONT : PIPE_FACE_BACK))
+      return TRUE;
+
+   /*
+    * Pixel centers on the left edge are inside, as are those on the top
+    * edge, or on the bottom edge with the bottom-left fill convention.
+    */
+   fx0 = snap_coord(xmin - setup->pixel_offset, setup->fb.width);
+   fx1 = snap_coord(xmax - setup->pixel_offset, setup->fb.width);
+   fy0 = snap_coord(ymin - setup->pixel_offset, setup->fb.height);
+   fy1 = snap_coord(ymax - setup->pixel_offset, setup->fb.height);
+
+   box.x0 = (fx0 + FIXED_ONE - 1) >> FIXED_ORDER;
+   box.x1 = (fx1 - 1) >> FIXED_ORDER;
+   if (setup->bottom_edge_rule == 0) {
+      box.y0 = (fy0 + FIXED_ONE - 1) >> FIXED_ORDER;
+      box.y1 = (fy1 - 1) >> FIXED_ORDER;
+   }
+   else {
+      box.y0 = (fy0 + FIXED_ONE) >> FIXED_ORDER;
+      box.y1 = fy1 >> FIXED_ORDER;
+   }
+
+   if (box.x1 < box.x0 || box.y1 < box.y0 ||
+       !u_rect_test_intersection(&setup->draw_regions[viewport_index], &box)) {
+      LP_COUNT(nr_culled_tris);
+      return TRUE;
+   }
+   u_rect_find_intersection(&setup->draw_regions[viewport_index], &box);
+
+   if (!do_rect(setup, &box, v0, v1, v2, frontfacing, viewport_index, layer)) {
+      if (!lp_setup_flush_and_restart(setup))
+         return TRUE;
+
+      do_rect(setup, &box, v0, v1, v2, frontfacing, viewport_index, layer);
+   }
+
+   return TRUE;
+}
@@ -211,7 +211,7 @@ lp_rast_32_tri_tab[MAX_PLANES+1] = {
  *
  * \param tx, ty  the tile position in tiles, not pixels
  */
-static boolean
+boolean
 lp_setup_whole_tile(struct lp_setup_context *setup,
                     const struct lp_rast_shader_inputs *inputs,
                     int tx, int ty)
@@ -185,6 +185,17 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 
    case PIPE_PRIM_TRIANGLES:
       for (i = 2; i < nr; i += 3) {
+         if (i + 3 < nr &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, indices[i-2], stride),
+                            get_vert(vertex_buffer, indices[i-1], stride),
+                            get_vert(vertex_buffer, indices[i-0], stride),
+                            get_vert(vertex_buffer, indices[i+1], stride),
+                            get_vert(vertex_buffer, indices[i+2], stride),
+                            get_vert(vertex_buffer, indices[i+3], stride) )) {
+            i += 3;
+            continue;
+         }
          setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-2], stride),
                           get_vert(vertex_buffer, indices[i-1], stride),
@@ -194,6 +205,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 
    case PIPE_PRIM_TRIANGLE_STRIP:
       if (flatshade_first) {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, indices[0], stride),
+                            get_vert(vertex_buffer, indices[1], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[1], stride),
+                            get_vert(vertex_buffer, indices[3], stride),
+                            get_vert(vertex_buffer, indices[2], stride) ))
+            break;
          for (i = 2; i < nr; i += 1) {
             /* emit first triangle vertex as first triangle vertex */
             setup->triangle( setup,
@@ -204,6 +224,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
          }
       }
       else {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, indices[0], stride),
+                            get_vert(vertex_buffer, indices[1], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[1], stride),
+                            get_vert(vertex_buffer, indices[3], stride) ))
+            break;
          for (i = 2; i < nr; i += 1) {
             /* emit last triangle vertex as last triangle vertex */
             setup->triangle( setup,
@@ -216,6 +245,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 
    case PIPE_PRIM_TRIANGLE_FAN:
       if (flatshade_first) {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, indices[1], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[0], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[3], stride),
+                            get_vert(vertex_buffer, indices[0], stride) ))
+            break;
          for (i = 2; i < nr; i += 1) {
             /* emit first non-spoke vertex as first vertex */
             setup->triangle( setup,
@@ -225,6 +263,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
          }
       }
       else {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, indices[0], stride),
+                            get_vert(vertex_buffer, indices[1], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[0], stride),
+                            get_vert(vertex_buffer, indices[2], stride),
+                            get_vert(vertex_buffer, indices[3], stride) ))
+            break;
          for (i = 2; i < nr; i += 1) {
             /* emit last non-spoke vertex as last vertex */
             setup->triangle( setup,
@@ -240,6 +287,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (lp_setup_rect( setup,
+                               get_vert(vertex_buffer, indices[i-0], stride),
+                               get_vert(vertex_buffer, indices[i-3], stride),
+                               get_vert(vertex_buffer, indices[i-2], stride),
+                               get_vert(vertex_buffer, indices[i-0], stride),
+                               get_vert(vertex_buffer, indices[i-2], stride),
+                               get_vert(vertex_buffer, indices[i-1], stride) ))
+               continue;
+
             setup->triangle( setup,
                              get_vert(vertex_buffer, indices[i-0], stride),
                              get_vert(vertex_buffer, indices[i-3], stride),
@@ -254,6 +310,15 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (lp_setup_rect( setup,
+                               get_vert(vertex_buffer, indices[i-3], stride),
+                               get_vert(vertex_buffer, indices[i-2], stride),
+                               get_vert(vertex_buffer, indices[i-0], stride),
+                               get_vert(vertex_buffer, indices[i-2], stride),
+                               get_vert(vertex_buffer, indices[i-1], stride),
+                               get_vert(vertex_buffer, indices[i-0], stride) ))
+               continue;
+
             setup->triangle( setup,
                           get_vert(vertex_buffer, indices[i-3], stride),
                           get_vert(vertex_buffer, indices[i-2], stride),
@@ -383,6 +448,17 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
    case PIPE_PRIM_TRIANGLES:
       for (i = 2; i < nr; i += 3) {
+         if (i + 3 < nr &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, i-2, stride),
+                            get_vert(vertex_buffer, i-1, stride),
+                            get_vert(vertex_buffer, i-0, stride),
+                            get_vert(vertex_buffer, i+1, stride),
+                            get_vert(vertex_buffer, i+2, stride),
+                            get_vert(vertex_buffer, i+3, stride) )) {
+            i += 3;
+            continue;
+         }
          setup->triangle( setup,
                           get_vert(vertex_buffer, i-2, stride),
                           get_vert(vertex_buffer, i-1, stride),
@@ -392,6 +468,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
    case PIPE_PRIM_TRIANGLE_STRIP:
       if (flatshade_first) {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, 0, stride),
+                            get_vert(vertex_buffer, 1, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 1, stride),
+                            get_vert(vertex_buffer, 3, stride),
+                            get_vert(vertex_buffer, 2, stride) ))
+            break;
          for (i = 2; i < nr; i++) {
             /* emit first triangle vertex as first triangle vertex */
             setup->triangle( setup,
@@ -401,6 +486,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
          }
       }
       else {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, 0, stride),
+                            get_vert(vertex_buffer, 1, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 1, stride),
+                            get_vert(vertex_buffer, 3, stride) ))
+            break;
          for (i = 2; i < nr; i++) {
             /* emit last triangle vertex as last triangle vertex */
             setup->triangle( setup,
@@ -413,6 +507,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
    case PIPE_PRIM_TRIANGLE_FAN:
       if (flatshade_first) {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, 1, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 0, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 3, stride),
+                            get_vert(vertex_buffer, 0, stride) ))
+            break;
          for (i = 2; i < nr; i += 1) {
             /* emit first non-spoke vertex as first vertex */
             setup->triangle( setup,
@@ -422,6 +525,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
          }
       }
       else {
+         if (nr == 4 &&
+             lp_setup_rect( setup,
+                            get_vert(vertex_buffer, 0, stride),
+                            get_vert(vertex_buffer, 1, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 0, stride),
+                            get_vert(vertex_buffer, 2, stride),
+                            get_vert(vertex_buffer, 3, stride) ))
+            break;
          for (i = 2; i < nr; i += 1) {
             /* emit last non-spoke vertex as last vertex */
             setup->triangle( setup,
@@ -437,6 +549,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (lp_setup_rect( setup,
+                               get_vert(vertex_buffer, i-0, stride),
+                               get_vert(vertex_buffer, i-3, stride),
+                               get_vert(vertex_buffer, i-2, stride),
+                               get_vert(vertex_buffer, i-0, stride),
+                               get_vert(vertex_buffer, i-2, stride),
+                               get_vert(vertex_buffer, i-1, stride) ))
+               continue;
+
             setup->triangle( setup,
                              get_vert(vertex_buffer, i-0, stride),
                              get_vert(vertex_buffer, i-3, stride),
@@ -450,6 +571,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 4) {
+            if (lp_setup_rect( setup,
+                               get_vert(vertex_buffer, i-3, stride),
+                               get_vert(vertex_buffer, i-2, stride),
+                               get_vert(vertex_buffer, i-0, stride),
+                               get_vert(vertex_buffer, i-2, stride),
+                               get_vert(vertex_buffer, i-1, stride),
+                               get_vert(vertex_buffer, i-0, stride) ))
+               continue;
+
             setup->triangle( setup,
                              get_vert(vertex_buffer, i-3, stride),
                              get_vert(vertex_buffer, i-2, stride),
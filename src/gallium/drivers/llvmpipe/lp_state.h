@@ -91,6 +91,9 @@ llvmpipe_set_framebuffer_state(struct pipe_context *,
 void
 llvmpipe_update_fs(struct llvmpipe_context *lp);
 
+void
+llvmpipe_count_fs_draw(struct llvmpipe_context *lp);
+
 void 
 llvmpipe_update_setup(struct llvmpipe_context *lp);
 
@@ -121,6 +124,9 @@ llvmpipe_init_vs_funcs(struct llvmpipe_context *llvmpipe);
 void
 llvmpipe_init_gs_funcs(struct llvmpipe_context *llvmpipe);
 
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
 void
 llvmpipe_init_rasterizer_funcs(struct llvmpipe_context *llvmpipe);
 
@@ -0,0 +1,783 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Compute shaders.
+ *
+ * A compute shader variant is a function which runs one SIMD vector worth
+ * of invocations of a workgroup.  Grid launches are handed to the
+ * rasterizer threads as a job; each thread grabs whole workgroups and runs
+ * their SIMD vectors one after the other, or as coroutines which yield to
+ * each other at barriers if the shader has any.
+ */
+
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_atomic.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_pointer.h"
+#include "util/simple_list.h"
+#include "util/os_time.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_context.h"
+#include "lp_cs_coro.h"
+#include "lp_debug.h"
+#include "lp_flush.h"
+#include "lp_limits.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_setup.h"
+#include "lp_state.h"
+#include "lp_state_cs.h"
+#include "lp_tex_sample.h"
+#include "lp_texture.h"
+
+
+/** shader number (for debugging) */
+static unsigned cs_no = 0;
+
+
+/**
+ * Barrier interface for the TGSI translation: yield the coroutine passed
+ * as the last function argument.
+ */
+struct lp_cs_iface
+{
+   struct lp_build_tgsi_cs_iface base;
+   LLVMValueRef coro;
+};
+
+
+static void
+cs_emit_barrier(const struct lp_build_tgsi_cs_iface *cs_iface,
+                struct lp_build_tgsi_context *bld_base)
+{
+   const struct lp_cs_iface *iface = (const struct lp_cs_iface *)cs_iface;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMTypeRef arg_type = LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMValueRef func;
+   LLVMValueRef coro = iface->coro;
+
+   func = lp_build_const_func_pointer(gallivm,
+                                      func_to_pointer((func_pointer)lp_cs_coro_yield),
+                                      LLVMVoidTypeInContext(gallivm->context),
+                                      &arg_type, 1, "lp_cs_coro_yield");
+
+   LLVMBuildCall(gallivm->builder, func, &coro, 1, "");
+}
+
+
+static void
+generate_compute(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   const struct lp_compute_shader_variant_key *key = &variant->key;
+   char func_name[64];
+   struct lp_type cs_type;
+   LLVMTypeRef arg_types[14];
+   LLVMTypeRef func_type;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMValueRef context_ptr;
+   LLVMValueRef thread_data_ptr;
+   LLVMValueRef block_id[3], grid_size[3], block_size[3];
+   LLVMValueRef invocation;
+   LLVMValueRef shared_ptr;
+   LLVMValueRef coro;
+   LLVMValueRef function;
+   LLVMBasicBlockRef block;
+   LLVMBuilderRef builder;
+   struct lp_build_context uint_bld;
+   struct lp_build_sampler_soa *sampler;
+   struct lp_build_mask_context mask;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_build_tgsi_params params;
+   struct lp_cs_iface cs_iface;
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   LLVMValueRef lane_index[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef index, total, mask_val;
+   unsigned i;
+
+   memset(&cs_type, 0, sizeof cs_type);
+   cs_type.floating = TRUE;      /* floating point values */
+   cs_type.sign = TRUE;          /* values are signed */
+   cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
+   cs_type.width = 32;           /* 32-bit float */
+   cs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+
+   /*
+    * Generate the function prototype. Any change here must be reflected in
+    * lp_jit.h's lp_jit_cs_func function pointer type, and vice-versa.
+    */
+
+   snprintf(func_name, sizeof(func_name), "cs%u_variant%u",
+            shader->no, variant->no);
+
+   arg_types[0] = variant->jit_context_ptr_type;       /* context */
+   arg_types[1] = variant->jit_thread_data_ptr_type;   /* per thread data */
+   arg_types[2] = int32_type;                          /* block_x */
+   arg_types[3] = int32_type;                          /* block_y */
+   arg_types[4] = int32_type;                          /* block_z */
+   arg_types[5] = int32_type;                          /* grid_x */
+   arg_types[6] = int32_type;                          /* grid_y */
+   arg_types[7] = int32_type;                          /* grid_z */
+   arg_types[8] = int32_type;                          /* block_width */
+   arg_types[9] = int32_type;                          /* block_height */
+   arg_types[10] = int32_type;                         /* block_depth */
+   arg_types[11] = int32_type;                         /* invocation */
+   arg_types[12] = int8_ptr_type;                      /* shared */
+   arg_types[13] = int8_ptr_type;                      /* coro */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function = function;
+
+   for (i = 0; i < 2; ++i)
+      lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
+
+   context_ptr     = LLVMGetParam(function, 0);
+   thread_data_ptr = LLVMGetParam(function, 1);
+   for (i = 0; i < 3; i++) {
+      block_id[i]   = LLVMGetParam(function, 2 + i);
+      grid_size[i]  = LLVMGetParam(function, 5 + i);
+      block_size[i] = LLVMGetParam(function, 8 + i);
+   }
+   invocation      = LLVMGetParam(function, 11);
+   shared_ptr      = LLVMGetParam(function, 12);
+   coro            = LLVMGetParam(function, 13);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(thread_data_ptr, "thread_data");
+   lp_build_name(invocation, "invocation");
+   lp_build_name(shared_ptr, "shared");
+   lp_build_name(coro, "coro");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context, function, "entry");
+   builder = gallivm->builder;
+   assert(builder);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(cs_type));
+
+   /* flattened local invocation index of each lane */
+   for (i = 0; i < cs_type.length; i++)
+      lane_index[i] = lp_build_const_int32(gallivm, i);
+   index = lp_build_broadcast_scalar(&uint_bld, invocation);
+   index = LLVMBuildAdd(builder, index,
+                        LLVMConstVector(lane_index, cs_type.length), "");
+
+   memset(&system_values, 0, sizeof system_values);
+   for (i = 0; i < 3; i++) {
+      system_values.block_id[i] = block_id[i];
+      system_values.grid_size[i] = grid_size[i];
+      system_values.block_size[i] = block_size[i];
+   }
+   {
+      LLVMValueRef width = lp_build_broadcast_scalar(&uint_bld, block_size[0]);
+      LLVMValueRef height = lp_build_broadcast_scalar(&uint_bld, block_size[1]);
+      LLVMValueRef row = LLVMBuildUDiv(builder, index, width, "");
+
+      system_values.thread_id[0] = LLVMBuildURem(builder, index, width, "");
+      system_values.thread_id[1] = LLVMBuildURem(builder, row, height, "");
+      system_values.thread_id[2] = LLVMBuildUDiv(builder, row, height, "");
+   }
+
+   /* lanes past the end of the workgroup are masked off */
+   total = LLVMBuildMul(builder, block_size[0], block_size[1], "");
+   total = LLVMBuildMul(builder, total, block_size[2], "");
+   total = lp_build_broadcast_scalar(&uint_bld, total);
+   mask_val = lp_build_cmp(&uint_bld, PIPE_FUNC_LESS, index, total);
+
+   lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
+
+   /* code generated texture sampling */
+   sampler = lp_llvm_sampler_soa_create(key->state);
+
+   cs_iface.base.emit_barrier = cs_emit_barrier;
+   cs_iface.coro = coro;
+
+   memset(outputs, 0, sizeof outputs);
+   memset(&params, 0, sizeof(params));
+
+   params.type = cs_type;
+   params.mask = &mask;
+   params.consts_ptr = lp_jit_context_constants(gallivm, context_ptr);
+   params.const_sizes_ptr = lp_jit_context_num_constants(gallivm, context_ptr);
+   params.system_values = &system_values;
+   params.context_ptr = context_ptr;
+   params.thread_data_ptr = thread_data_ptr;
+   params.sampler = sampler;
+   params.info = &shader->info.base;
+   params.ssbo_ptr = lp_jit_context_ssbos(gallivm, context_ptr);
+   params.ssbo_sizes_ptr = lp_jit_context_num_ssbos(gallivm, context_ptr);
+   params.cs_iface = &cs_iface.base;
+   params.shared_ptr = LLVMBuildBitCast(builder, shared_ptr,
+                                        LLVMPointerType(int32_type, 0), "");
+
+   lp_build_tgsi_soa(gallivm, shader->base.prog, &params, outputs);
+
+   sampler->destroy(sampler);
+
+   lp_build_mask_end(&mask);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 const struct lp_compute_shader_variant_key *key)
+{
+   struct lp_compute_shader_variant *variant;
+   char module_name[64];
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   snprintf(module_name, sizeof(module_name), "cs%u_variant%u",
+            shader->no, shader->variants_created);
+
+   variant->gallivm = gallivm_create(module_name, lp->context, NULL);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   variant->shader = shader;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+
+   memcpy(&variant->key, key, shader->variant_key_size);
+
+   lp_jit_init_cs_types(variant);
+
+   generate_compute(lp, shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   variant->jit_function = (lp_jit_cs_func)
+         gallivm_jit_function(variant->gallivm, variant->function);
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant;
+}
+
+
+static void
+remove_cs_variant(struct lp_compute_shader_variant *variant)
+{
+   if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
+      debug_printf("llvmpipe: del cs #%u var %u v created %u v cached %u "
+                   "inst %u\n",
+                   variant->shader->no, variant->no,
+                   variant->shader->variants_created,
+                   variant->shader->variants_cached,
+                   variant->nr_instrs);
+   }
+
+   gallivm_destroy(variant->gallivm);
+
+   remove_from_list(&variant->list_item_local);
+   variant->shader->variants_cached--;
+
+   FREE(variant);
+}
+
+
+static void
+make_variant_key(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant_key *key)
+{
+   unsigned i;
+
+   memset(key, 0, shader->variant_key_size);
+
+   key->nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
+
+   for(i = 0; i < key->nr_samplers; ++i) {
+      if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
+         lp_sampler_static_sampler_state(&key->state[i].sampler_state,
+                                         lp->samplers[PIPE_SHADER_COMPUTE][i]);
+      }
+   }
+
+   /* Same as for fragment shaders, see make_variant_key in lp_state_fs.c */
+   if (shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] != -1) {
+      key->nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
+      for(i = 0; i < key->nr_sampler_views; ++i) {
+         if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
+            lp_sampler_static_texture_state(&key->state[i].texture_state,
+                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+         }
+      }
+   }
+   else {
+      key->nr_sampler_views = key->nr_samplers;
+      for(i = 0; i < key->nr_sampler_views; ++i) {
+         if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
+            lp_sampler_static_texture_state(&key->state[i].texture_state,
+                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+         }
+      }
+   }
+}
+
+
+/**
+ * Find or create the variant of the bound compute shader matching the
+ * current sampler state.
+ */
+static struct lp_compute_shader_variant *
+llvmpipe_update_cs(struct llvmpipe_context *lp)
+{
+   struct lp_compute_shader *shader = lp->cs;
+   struct lp_compute_shader_variant_key key;
+   struct lp_compute_shader_variant *variant = NULL;
+   struct lp_cs_variant_list_item *li;
+
+   make_variant_key(lp, shader, &key);
+
+   /* Search the variants for one which matches the key */
+   foreach(li, &shader->variants) {
+      if(memcmp(&li->base->key, &key, shader->variant_key_size) == 0) {
+         variant = li->base;
+         break;
+      }
+   }
+
+   if (variant) {
+      move_to_head(&shader->variants, &variant->list_item_local);
+   }
+   else {
+      int64_t t0, t1, dt;
+
+      /* Grids run synchronously, so old variants can go right away. */
+      if (shader->variants_cached >= LP_MAX_SHADER_VARIANTS)
+         remove_cs_variant(last_elem(&shader->variants)->base);
+
+      t0 = os_time_get();
+      variant = generate_variant(lp, shader, &key);
+      t1 = os_time_get();
+      dt = t1 - t0;
+      LP_COUNT_ADD(llvm_compile_time, dt);
+      LP_COUNT_ADD(nr_llvm_compiles, 1);
+
+      if (variant) {
+         insert_at_head(&shader->variants, &variant->list_item_local);
+         shader->variants_cached++;
+      }
+   }
+
+   return variant;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct lp_compute_shader *shader;
+   int nr_samplers;
+   int nr_sampler_views;
+
+   if (templ->ir_type != PIPE_SHADER_IR_TGSI)
+      return NULL;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   lp_build_tgsi_info(templ->prog, &shader->info);
+
+   shader->has_barrier =
+      shader->info.base.opcode_count[TGSI_OPCODE_BARRIER] > 0;
+
+   /* Without coroutines the invocations of a workgroup cannot wait for
+    * each other, so barriers could not be honoured.
+    */
+   if (shader->has_barrier && !LP_HAVE_CS_CORO) {
+      debug_printf("llvmpipe: compute shader barriers are not supported "
+                   "on this platform\n");
+      FREE(shader);
+      return NULL;
+   }
+
+   shader->no = cs_no++;
+   make_empty_list(&shader->variants);
+
+   shader->base = *templ;
+   shader->base.prog = tgsi_dup_tokens(templ->prog);
+
+   nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
+   nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
+
+   shader->variant_key_size = Offset(struct lp_compute_shader_variant_key,
+                                     state[MAX2(nr_samplers, nr_sampler_views)]);
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->base.prog, 0);
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *) cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   ASSERTED struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct lp_compute_shader *shader = cs;
+   struct lp_cs_variant_list_item *li;
+
+   assert(cs != llvmpipe->cs);
+
+   /* Grids run synchronously, nothing can still be using the variants. */
+   li = first_elem(&shader->variants);
+   while(!at_end(&shader->variants, li)) {
+      struct lp_cs_variant_list_item *next = next_elem(li);
+      remove_cs_variant(li->base);
+      li = next;
+   }
+
+   assert(shader->variants_cached == 0);
+   FREE((void *) shader->base.prog);
+   FREE(shader);
+}
+
+
+/**
+ * Everything the threads need to run a grid.
+ */
+struct lp_cs_job
+{
+   struct lp_jit_context jit_context;
+   lp_jit_cs_func jit_function;
+
+   uint32_t grid_size[3];
+   uint32_t block_size[3];
+
+   /** SIMD vectors per workgroup */
+   unsigned num_vectors;
+   unsigned vector_length;
+
+   uint64_t num_groups;
+   uint64_t next_group;
+
+   /** One block of shared memory per thread */
+   uint8_t *shared;
+   unsigned shared_size;
+
+   /** Per thread coroutines, NULL if the shader has no barriers */
+   struct lp_cs_coro_set **coros;
+};
+
+
+/** Per thread state while running a workgroup */
+struct lp_cs_exec
+{
+   const struct lp_cs_job *job;
+   struct lp_jit_thread_data *thread_data;
+   uint32_t block_id[3];
+   void *shared;
+};
+
+
+static void
+cs_run_vector(void *data, unsigned index, struct lp_cs_coro *coro)
+{
+   const struct lp_cs_exec *exec = data;
+   const struct lp_cs_job *job = exec->job;
+
+   job->jit_function(&job->jit_context, exec->thread_data,
+                     exec->block_id[0], exec->block_id[1], exec->block_id[2],
+                     job->grid_size[0], job->grid_size[1], job->grid_size[2],
+                     job->block_size[0], job->block_size[1], job->block_size[2],
+                     index * job->vector_length,
+                     exec->shared, coro);
+}
+
+
+/**
+ * Rasterizer thread job: run workgroups until there are none left.
+ */
+static void
+cs_job_run(void *data, unsigned thread_index,
+           struct lp_jit_thread_data *thread_data)
+{
+   struct lp_cs_job *job = data;
+   struct lp_cs_exec exec;
+   uint64_t group;
+   unsigned i;
+
+   exec.job = job;
+   exec.thread_data = thread_data;
+   exec.shared = job->shared + thread_index * job->shared_size;
+
+   while ((group = p_atomic_inc_return(&job->next_group) - 1) < job->num_groups) {
+      exec.block_id[0] = group % job->grid_size[0];
+      group /= job->grid_size[0];
+      exec.block_id[1] = group % job->grid_size[1];
+      exec.block_id[2] = group / job->grid_size[1];
+
+      if (job->coros) {
+         if (!lp_cs_coro_run(job->coros[thread_index], job->num_vectors,
+                             cs_run_vector, &exec)) {
+            debug_printf("llvmpipe: out of memory for compute workgroup\n");
+         }
+      }
+      else {
+         for (i = 0; i < job->num_vectors; i++)
+            cs_run_vector(&exec, i, NULL);
+      }
+   }
+}
+
+
+static void
+fill_grid_size(const struct pipe_grid_info *info,
+               uint32_t grid_size[3])
+{
+   const uint32_t *params;
+
+   if (!info->indirect) {
+      grid_size[0] = info->grid[0];
+      grid_size[1] = info->grid[1];
+      grid_size[2] = info->grid[2];
+      return;
+   }
+
+   params = (const uint32_t *)
+      ((const uint8_t *)llvmpipe_resource_data(info->indirect) +
+       info->indirect_offset);
+   grid_size[0] = params[0];
+   grid_size[1] = params[1];
+   grid_size[2] = params[2];
+}
+
+
+static void
+fill_jit_context(struct llvmpipe_context *lp,
+                 struct lp_jit_context *jit_context)
+{
+   static const float fake_const_buf[4];
+   unsigned i;
+
+   memset(jit_context, 0, sizeof *jit_context);
+
+   for (i = 0; i < ARRAY_SIZE(lp->constants[PIPE_SHADER_COMPUTE]); i++) {
+      const struct pipe_constant_buffer *cb = &lp->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         unsigned size = MIN2(cb->buffer_size, LP_MAX_TGSI_CONST_BUFFER_SIZE);
+
+         jit_context->constants[i] = (const float *)(data + cb->buffer_offset);
+         jit_context->num_constants[i] = size / (sizeof(float) * 4);
+      }
+      else {
+         jit_context->constants[i] = fake_const_buf;
+         jit_context->num_constants[i] = 0;
+      }
+   }
+
+   for (i = 0; i < ARRAY_SIZE(lp->ssbos[PIPE_SHADER_COMPUTE]); i++) {
+      const struct pipe_shader_buffer *sb = &lp->ssbos[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (sb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(sb->buffer);
+
+      if (data) {
+         jit_context->ssbos[i] = (const uint32_t *)(data + sb->buffer_offset);
+         jit_context->num_ssbos[i] = sb->buffer_size;
+      }
+   }
+
+   for (i = 0; i < lp->num_sampler_views[PIPE_SHADER_COMPUTE]; i++) {
+      struct pipe_sampler_view *view = lp->sampler_views[PIPE_SHADER_COMPUTE][i];
+
+      if (view)
+         lp_setup_fill_jit_texture(&jit_context->textures[i], view);
+   }
+
+   for (i = 0; i < lp->num_samplers[PIPE_SHADER_COMPUTE]; i++) {
+      const struct pipe_sampler_state *sampler = lp->samplers[PIPE_SHADER_COMPUTE][i];
+
+      if (sampler) {
+         struct lp_jit_sampler *jit_sam = &jit_context->samplers[i];
+
+         jit_sam->min_lod = sampler->min_lod;
+         jit_sam->max_lod = sampler->max_lod;
+         jit_sam->lod_bias = sampler->lod_bias;
+         COPY_4V(jit_sam->border_color, sampler->border_color.f);
+      }
+   }
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const struct pipe_grid_info *info)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader *shader = lp->cs;
+   struct lp_compute_shader_variant *variant;
+   struct lp_cs_job job;
+   unsigned num_threads = MAX2(1, screen->num_threads);
+   unsigned block_threads;
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   memset(&job, 0, sizeof job);
+
+   /* The grid may consume anything rendered so far, including the
+    * indirect parameters.
+    */
+   llvmpipe_finish(pipe, __FUNCTION__);
+
+   fill_grid_size(info, job.grid_size);
+   for (i = 0; i < 3; i++)
+      job.block_size[i] = info->block[i];
+
+   job.num_groups = (uint64_t)job.grid_size[0] * job.grid_size[1] *
+                    job.grid_size[2];
+   block_threads = job.block_size[0] * job.block_size[1] * job.block_size[2];
+   if (!job.num_groups || !block_threads)
+      return;
+
+   variant = llvmpipe_update_cs(lp);
+   if (!variant)
+      return;
+
+   job.jit_function = variant->jit_function;
+   job.vector_length = MIN2(lp_native_vector_width / 32, 16);
+   job.num_vectors = DIV_ROUND_UP(block_threads, job.vector_length);
+
+   fill_jit_context(lp, &job.jit_context);
+
+   job.shared_size = align(shader->base.req_local_mem, 16);
+   if (job.shared_size) {
+      job.shared = align_malloc(job.shared_size * num_threads, 16);
+      if (!job.shared)
+         return;
+   }
+
+   mtx_lock(&screen->rast_mutex);
+
+   if (shader->has_barrier && job.num_vectors > 1) {
+      if (!screen->cs_coros) {
+         struct lp_cs_coro_set **coros = CALLOC(num_threads, sizeof *coros);
+         boolean ok = coros != NULL;
+
+         for (i = 0; ok && i < num_threads; i++) {
+            coros[i] = lp_cs_coro_set_create();
+            ok = coros[i] != NULL;
+         }
+         if (ok) {
+            screen->cs_coros = coros;
+         }
+         else if (coros) {
+            for (i = 0; i < num_threads; i++)
+               lp_cs_coro_set_destroy(coros[i]);
+            FREE(coros);
+         }
+      }
+      job.coros = screen->cs_coros;
+   }
+
+   if (!shader->has_barrier || job.num_vectors == 1 || job.coros) {
+      lp_rast_run_job(screen->rast, cs_job_run, &job);
+   }
+   else {
+      debug_printf("llvmpipe: out of memory for compute coroutines\n");
+   }
+
+   mtx_unlock(&screen->rast_mutex);
+
+   align_free(job.shared);
+
+   if (lp->active_statistics_queries) {
+      lp->pipeline_statistics.cs_invocations +=
+         job.num_groups * block_threads;
+   }
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
@@ -67,12 +67,18 @@
 #include "util/u_string.h"
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/mesa-sha1.h"
 #include "util/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "tgsi/tgsi_dump.h"
 #include "tgsi/tgsi_scan.h"
 #include "tgsi/tgsi_parse.h"
+#include "nir/tgsi_to_nir.h"
+#include "nir/nir_to_tgsi_info.h"
+#include "compiler/blob.h"
+#include "compiler/nir/nir.h"
+#include "compiler/nir/nir_serialize.h"
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_conv.h"
@@ -80,6 +86,7 @@
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_logic.h"
 #include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_nir.h"
 #include "gallivm/lp_bld_swizzle.h"
 #include "gallivm/lp_bld_flow.h"
 #include "gallivm/lp_bld_debug.h"
@@ -96,6 +103,7 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_tex_sample.h"
@@ -495,8 +503,11 @@ generate_fs_loop(struct gallivm_state *gallivm,
    params.ssbo_sizes_ptr = num_ssbo_ptr;
 
    /* Build the actual shader */
-   lp_build_tgsi_soa(gallivm, tokens, &params,
-                     outputs);
+   if (shader->nir)
+      lp_build_nir_soa(gallivm, shader->nir, &params, outputs);
+   else
+      lp_build_tgsi_soa(gallivm, tokens, &params,
+                        outputs);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -1755,6 +1766,8 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    LLVMValueRef src[4 * 4];
    LLVMValueRef src1[4 * 4];
    LLVMValueRef dst[4 * 4];
+   LLVMValueRef half_mask[2];
+   LLVMValueRef half_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][4];
    LLVMValueRef blend_color;
    LLVMValueRef blend_alpha;
    LLVMValueRef i32_zero;
@@ -1833,9 +1846,6 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    partial_mask |= !variant->opaque;
    i32_zero = lp_build_const_int32(gallivm, 0);
 
-   undef_src_val = lp_build_undef(gallivm, fs_type);
-
-   row_type.length = fs_type.length;
    vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
@@ -1902,6 +1912,62 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
       }
    }
 
+   /*
+    * We actually should generally do conversion first (for non-1d cases)
+    * when the blend format is 8 or 16 bits. The reason is obvious,
+    * there's 2 or 4 times less vectors to deal with for the interleave...
+    * Albeit for the AVX (not AVX2) case there's no benefit with 16 bit
+    * vectors (as it can do 32bit unpack with 256bit vectors, but 8/16bit
+    * unpack only with 128bit vectors).
+    * Note: for 16bit sizes really need matching pack conversion code
+    */
+   if (!is_1d && dst_channels != 3 && dst_type.width == 8) {
+      twiddle_after_convert = TRUE;
+   }
+
+   if (fs_type.length == 16 && !twiddle_after_convert) {
+      /*
+       * The twiddle before conversion handles at most 8 pixels per vector,
+       * so split the 4x4 stamp in the upper and lower halves 16 wide
+       * shading yields.
+       */
+      struct lp_type half_type = fs_type;
+      LLVMTypeRef half_vec_type;
+      unsigned k;
+
+      half_type.length = 8;
+      half_vec_type = lp_build_vec_type(gallivm, half_type);
+
+      half_mask[1] = lp_build_extract_range(gallivm, fs_mask[0], 8, 8);
+      half_mask[0] = lp_build_extract_range(gallivm, fs_mask[0], 0, 8);
+      for (k = 0; k < 2; k++) {
+         /* dual source blending reads output 1 as well */
+         unsigned cbuf = k ? 1 : rt;
+
+         if (k && !dual_source_blend)
+            break;
+
+         for (j = 0; j < TGSI_NUM_CHANNELS; ++j) {
+            LLVMValueRef color =
+               LLVMBuildLoad(builder, fs_out_color[cbuf][j][0], "");
+            for (i = 0; i < 2; i++) {
+               LLVMValueRef ptr = lp_build_alloca(gallivm, half_vec_type, "");
+               LLVMBuildStore(builder,
+                              lp_build_extract_range(gallivm, color, i * 8, 8),
+                              ptr);
+               half_out_color[cbuf][j][i] = ptr;
+            }
+         }
+      }
+      fs_mask = half_mask;
+      fs_out_color = half_out_color;
+      fs_type = half_type;
+      num_fs = num_fullblock_fs = 2;
+   }
+
+   undef_src_val = lp_build_undef(gallivm, fs_type);
+   row_type.length = fs_type.length;
+
    /*
     * Load shader output
     */
@@ -1937,15 +2003,17 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
       }
 
       /* We split the row_mask and row_alpha as we want 128bit interleave */
-      if (fs_type.length == 8) {
-         src_mask[i*2 + 0]  = lp_build_extract_range(gallivm, fs_mask[i],
-                                                     0, src_channels);
-         src_mask[i*2 + 1]  = lp_build_extract_range(gallivm, fs_mask[i],
-                                                     src_channels, src_channels);
-
-         src_alpha[i*2 + 0] = lp_build_extract_range(gallivm, alpha, 0, src_channels);
-         src_alpha[i*2 + 1] = lp_build_extract_range(gallivm, alpha,
-                                                     src_channels, src_channels);
+      if (fs_type.length > 4) {
+         unsigned n = fs_type.length / src_channels;
+
+         for (j = 0; j < n; ++j) {
+            src_mask[i*n + j]  = lp_build_extract_range(gallivm, fs_mask[i],
+                                                        j * src_channels,
+                                                        src_channels);
+            src_alpha[i*n + j] = lp_build_extract_range(gallivm, alpha,
+                                                        j * src_channels,
+                                                        src_channels);
+         }
       } else {
          src_mask[i] = fs_mask[i];
          src_alpha[i] = alpha;
@@ -1974,10 +2042,14 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
          if (dst_channels == 3 && !has_alpha) {
             fs_src1[i][3] = alpha;
          }
-         if (fs_type.length == 8) {
-            src1_alpha[i*2 + 0] = lp_build_extract_range(gallivm, alpha, 0, src_channels);
-            src1_alpha[i*2 + 1] = lp_build_extract_range(gallivm, alpha,
-                                                         src_channels, src_channels);
+         if (fs_type.length > 4) {
+            unsigned n = fs_type.length / src_channels;
+
+            for (j = 0; j < n; ++j) {
+               src1_alpha[i*n + j] = lp_build_extract_range(gallivm, alpha,
+                                                            j * src_channels,
+                                                            src_channels);
+            }
          } else {
             src1_alpha[i] = alpha;
          }
@@ -2003,19 +2075,6 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
       }
    }
 
-   /*
-    * We actually should generally do conversion first (for non-1d cases)
-    * when the blend format is 8 or 16 bits. The reason is obvious,
-    * there's 2 or 4 times less vectors to deal with for the interleave...
-    * Albeit for the AVX (not AVX2) case there's no benefit with 16 bit
-    * vectors (as it can do 32bit unpack with 256bit vectors, but 8/16bit
-    * unpack only with 128bit vectors).
-    * Note: for 16bit sizes really need matching pack conversion code
-    */
-   if (!is_1d && dst_channels != 3 && dst_type.width == 8) {
-      twiddle_after_convert = TRUE;
-   }
-
    /*
     * Pixel twiddle from fragment shader order to memory order
     */
@@ -2414,8 +2473,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2486,6 +2544,9 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
    fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   /* 1d resources only shade the upper half of the stamp */
+   if (key->resource_1d)
+      fs_type.length = MIN2(fs_type.length, 8);
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -2503,8 +2564,11 @@ generate_fragment(struct llvmpipe_context *lp,
 
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
-   snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-            shader->no, variant->no, partial_mask ? "partial" : "whole");
+   /* The name must not depend on the order the shaders and variants are
+    * created in, for the machine code cache.
+    */
+   snprintf(func_name, sizeof(func_name), "fs_variant_%s",
+            partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2817,26 +2881,190 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
 {
    debug_printf("llvmpipe: Fragment shader #%u variant #%u:\n", 
                 variant->shader->no, variant->no);
-   tgsi_dump(variant->shader->base.tokens, 0);
+   if (variant->shader->base.tokens)
+      tgsi_dump(variant->shader->base.tokens, 0);
+   else
+      nir_print_shader(variant->shader->nir, stderr);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
    debug_printf("\n");
 }
 
 
+/**
+ * Generate the functions of a variant in its gallivm.
+ * This doesn't touch the context, so it may run in any thread.
+ */
+static void
+generate_variant_functions(struct lp_fragment_shader *shader,
+                           struct lp_fragment_shader_variant *variant)
+{
+   lp_jit_init_types(variant);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, variant, RAST_WHOLE);
+      }
+   }
+}
+
+
+/**
+ * Compile the functions generated in the gallivm of a variant, and account
+ * for it in the compile statistics of the screen.  Like
+ * generate_variant_functions(), this may run in any thread.
+ */
+static void
+compile_variant(struct llvmpipe_screen *screen,
+                struct lp_fragment_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+
+   gallivm_compile_module(gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   p_atomic_add(&screen->fs_compile_stats[LP_FS_STAT_CODE_SIZE],
+                (uint64_t)gallivm->stats.code_size);
+   if (!gallivm->cache || !gallivm->cache->data_size) {
+      p_atomic_inc(&screen->fs_compile_stats[gallivm->fast_compile ?
+                                             LP_FS_STAT_FAST_COMPILES :
+                                             LP_FS_STAT_OPTIMIZED_COMPILES]);
+   }
+}
+
+
+/**
+ * Background compilation of the optimized code of a variant.
+ */
+struct lp_fs_compile_job
+{
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+   boolean needs_caching;
+   unsigned char ir_sha1_cache_key[20];
+};
+
+
+static void
+lp_fs_compile_job_execute(void *data, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader *shader = variant->shader;
+   struct lp_fragment_shader_variant *optimized;
+   struct lp_cached_code cached = { 0 };
+   LLVMContextRef context;
+   char module_name[64];
+   int64_t t0 = os_time_get();
+
+   /* The LLVM types and functions of a variant belong to its gallivm, so
+    * the optimized code is generated in a copy of the variant, with its
+    * own LLVM context since a context can't be shared between threads.
+    */
+   optimized = CALLOC_STRUCT(lp_fragment_shader_variant);
+   if (!optimized)
+      return;
+
+   memcpy(&optimized->key, &variant->key, shader->variant_key_size);
+   optimized->opaque = variant->opaque;
+   optimized->shader = shader;
+   optimized->no = variant->no;
+
+   context = LLVMContextCreate();
+   if (!context) {
+      FREE(optimized);
+      return;
+   }
+
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u_opt",
+            shader->no, variant->no);
+
+   optimized->gallivm = gallivm_create(module_name, context,
+                                       job->needs_caching ? &cached : NULL);
+   if (!optimized->gallivm) {
+      LLVMContextDispose(context);
+      FREE(optimized);
+      return;
+   }
+
+   generate_variant_functions(shader, optimized);
+   compile_variant(job->screen, optimized);
+
+   if (job->needs_caching)
+      lp_disk_cache_insert_shader(job->screen, &cached,
+                                  job->ir_sha1_cache_key);
+   gallivm_free_ir(optimized->gallivm);
+   free(cached.data);
+   LLVMContextDispose(context);
+
+   /* Switch the variant to the optimized code.  The rasterizer threads may
+    * be calling either function at this point, which both do the same.
+    */
+   variant->optimized_gallivm = optimized->gallivm;
+   p_atomic_set(&variant->jit_function[RAST_EDGE_TEST],
+                optimized->jit_function[RAST_EDGE_TEST]);
+   p_atomic_set(&variant->jit_function[RAST_WHOLE],
+                optimized->jit_function[RAST_WHOLE]);
+
+   FREE(optimized);
+
+   p_atomic_add(&job->screen->fs_compile_stats[LP_FS_STAT_COMPILE_TIME],
+                (uint64_t)(os_time_get() - t0));
+}
+
+
+static void
+lp_fs_compile_job_cleanup(void *data, int thread_index)
+{
+   FREE(data);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * Variants come in two tiers.  The fast tier is compiled without
+ * optimization, which is several times faster: it is used for the variants
+ * too small to be worth optimizing and, when the screen has a compile queue,
+ * for the first uses of the others.  The optimized tier of those is then
+ * compiled in the background once they are used enough, see
+ * llvmpipe_count_fs_draw(), to replace the fast code once ready.
+ * The machine code loaded from the disk cache is used as is.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc = NULL;
    boolean fullcolormask;
    char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
+   boolean tier_up = FALSE;
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if (!variant)
@@ -2845,12 +3073,37 @@ generate_variant(struct llvmpipe_context *lp,
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
             shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (screen->disk_shader_cache) {
+      struct mesa_sha1 ctx;
+      /* The code translated from NIR differs from the TGSI one. */
+      const uint8_t use_nir = shader->nir != NULL;
+
+      _mesa_sha1_init(&ctx);
+      _mesa_sha1_update(&ctx, key, shader->variant_key_size);
+      if (shader->base.tokens)
+         _mesa_sha1_update(&ctx, shader->base.tokens,
+                           tgsi_num_tokens(shader->base.tokens) *
+                           sizeof(struct tgsi_token));
+      else
+         _mesa_sha1_update(&ctx, shader->nir_sha1, sizeof shader->nir_sha1);
+      _mesa_sha1_update(&ctx, &use_nir, sizeof use_nir);
+      _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      needs_caching = !cached.data_size;
+   }
+
+   variant->gallivm = gallivm_create(module_name, lp->context,
+                                     screen->disk_shader_cache ?
+                                     &cached : NULL);
    if (!variant->gallivm) {
+      free(cached.data);
       FREE(variant);
       return NULL;
    }
 
+   util_queue_fence_init(&variant->compile_fence);
+
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -2883,43 +3136,236 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+   generate_variant_functions(shader, variant);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+   if (!cached.data_size) {
+      boolean small = lp_build_count_ir_module(variant->gallivm->module) <
+                      screen->fs_fast_tier_instrs;
+
+      tier_up = !small && util_queue_is_initialized(&screen->fs_compile_queue);
+      variant->gallivm->fast_compile = small || tier_up;
+
+      /* The code to be replaced by the optimized one isn't worth caching. */
+      cached.dont_cache |= tier_up;
+   }
+
+   compile_variant(screen, variant);
+
+   if (needs_caching && !tier_up)
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   gallivm_free_ir(variant->gallivm);
+   free(cached.data);
+
+   if (tier_up) {
+      struct lp_fs_compile_job *job = CALLOC_STRUCT(lp_fs_compile_job);
+
+      /* Keep the unoptimized code if out of memory. */
+      if (job) {
+         job->screen = screen;
+         job->variant = variant;
+         job->needs_caching = needs_caching;
+         memcpy(job->ir_sha1_cache_key, ir_sha1_cache_key,
+                sizeof(ir_sha1_cache_key));
+         variant->tier_up_job = job;
       }
    }
 
-   /*
-    * Compile everything
-    */
+   return variant;
+}
 
-   gallivm_compile_module(variant->gallivm);
 
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+/**
+ * Whether the shader only uses the features which both tgsi_to_nir and
+ * the NIR translator support, so that it can go through NIR.
+ */
+static boolean
+fs_nir_supported(const struct tgsi_shader_info *info)
+{
+   unsigned i;
 
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
+   if ((info->indirect_files & ~(1 << TGSI_FILE_CONSTANT)) ||
+       info->dim_indirect_files ||
+       info->num_system_values ||
+       info->array_max[TGSI_FILE_INPUT] ||
+       info->array_max[TGSI_FILE_OUTPUT] ||
+       info->file_count[TGSI_FILE_BUFFER] ||
+       info->file_count[TGSI_FILE_IMAGE] ||
+       info->file_count[TGSI_FILE_MEMORY] ||
+       info->file_count[TGSI_FILE_HW_ATOMIC])
+      return FALSE;
+
+   for (i = 0; i < info->num_inputs; i++) {
+      switch (info->input_semantic_name[i]) {
+      case TGSI_SEMANTIC_POSITION:
+      case TGSI_SEMANTIC_COLOR:
+      case TGSI_SEMANTIC_BCOLOR:
+      case TGSI_SEMANTIC_FOG:
+      case TGSI_SEMANTIC_GENERIC:
+      case TGSI_SEMANTIC_TEXCOORD:
+      case TGSI_SEMANTIC_PCOORD:
+      case TGSI_SEMANTIC_FACE:
+      case TGSI_SEMANTIC_CLIPDIST:
+      case TGSI_SEMANTIC_PRIMID:
+      case TGSI_SEMANTIC_LAYER:
+      case TGSI_SEMANTIC_VIEWPORT_INDEX:
+         break;
+      default:
+         return FALSE;
+      }
    }
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   for (i = 0; i < info->num_outputs; i++) {
+      switch (info->output_semantic_name[i]) {
+      case TGSI_SEMANTIC_COLOR:
+      case TGSI_SEMANTIC_POSITION:
+      case TGSI_SEMANTIC_STENCIL:
+         break;
+      default:
+         return FALSE;
+      }
    }
 
-   gallivm_free_ir(variant->gallivm);
+   for (i = 0; i < TGSI_PROPERTY_COUNT; i++) {
+      switch (i) {
+      case TGSI_PROPERTY_FS_COORD_ORIGIN:
+      case TGSI_PROPERTY_FS_COORD_PIXEL_CENTER:
+      case TGSI_PROPERTY_FS_COLOR0_WRITES_ALL_CBUFS:
+      case TGSI_PROPERTY_FS_DEPTH_LAYOUT:
+      case TGSI_PROPERTY_NEXT_SHADER:
+         break;
+      default:
+         if (info->properties[i])
+            return FALSE;
+      }
+   }
 
-   return variant;
+   for (i = 0; i < ARRAY_SIZE(info->sampler_targets); i++) {
+      if (info->sampler_targets[i] == TGSI_TEXTURE_2D_MSAA ||
+          info->sampler_targets[i] == TGSI_TEXTURE_2D_ARRAY_MSAA)
+         return FALSE;
+   }
+
+   for (i = 0; i < TGSI_OPCODE_LAST; i++) {
+      if (!info->opcode_count[i])
+         continue;
+
+      switch (i) {
+      case TGSI_OPCODE_ARL:
+      case TGSI_OPCODE_ARR:
+      case TGSI_OPCODE_UARL:
+      case TGSI_OPCODE_MOV:
+      case TGSI_OPCODE_LIT:
+      case TGSI_OPCODE_RCP:
+      case TGSI_OPCODE_RSQ:
+      case TGSI_OPCODE_EXP:
+      case TGSI_OPCODE_LOG:
+      case TGSI_OPCODE_MUL:
+      case TGSI_OPCODE_ADD:
+      case TGSI_OPCODE_DP2:
+      case TGSI_OPCODE_DP3:
+      case TGSI_OPCODE_DP4:
+      case TGSI_OPCODE_DST:
+      case TGSI_OPCODE_MIN:
+      case TGSI_OPCODE_MAX:
+      case TGSI_OPCODE_SLT:
+      case TGSI_OPCODE_SGE:
+      case TGSI_OPCODE_SGT:
+      case TGSI_OPCODE_SLE:
+      case TGSI_OPCODE_SEQ:
+      case TGSI_OPCODE_SNE:
+      case TGSI_OPCODE_MAD:
+      case TGSI_OPCODE_LRP:
+      case TGSI_OPCODE_SQRT:
+      case TGSI_OPCODE_FRC:
+      case TGSI_OPCODE_FLR:
+      case TGSI_OPCODE_ROUND:
+      case TGSI_OPCODE_CEIL:
+      case TGSI_OPCODE_TRUNC:
+      case TGSI_OPCODE_EX2:
+      case TGSI_OPCODE_LG2:
+      case TGSI_OPCODE_POW:
+      case TGSI_OPCODE_COS:
+      case TGSI_OPCODE_SIN:
+      case TGSI_OPCODE_DDX:
+      case TGSI_OPCODE_DDY:
+      case TGSI_OPCODE_DDX_FINE:
+      case TGSI_OPCODE_DDY_FINE:
+      case TGSI_OPCODE_CMP:
+      case TGSI_OPCODE_UCMP:
+      case TGSI_OPCODE_SSG:
+      case TGSI_OPCODE_DIV:
+      case TGSI_OPCODE_I2F:
+      case TGSI_OPCODE_U2F:
+      case TGSI_OPCODE_F2I:
+      case TGSI_OPCODE_F2U:
+      case TGSI_OPCODE_NOT:
+      case TGSI_OPCODE_AND:
+      case TGSI_OPCODE_OR:
+      case TGSI_OPCODE_XOR:
+      case TGSI_OPCODE_SHL:
+      case TGSI_OPCODE_ISHR:
+      case TGSI_OPCODE_USHR:
+      case TGSI_OPCODE_FSEQ:
+      case TGSI_OPCODE_FSGE:
+      case TGSI_OPCODE_FSLT:
+      case TGSI_OPCODE_FSNE:
+      case TGSI_OPCODE_IDIV:
+      case TGSI_OPCODE_IMAX:
+      case TGSI_OPCODE_IMIN:
+      case TGSI_OPCODE_INEG:
+      case TGSI_OPCODE_IABS:
+      case TGSI_OPCODE_ISSG:
+      case TGSI_OPCODE_ISGE:
+      case TGSI_OPCODE_ISLT:
+      case TGSI_OPCODE_UADD:
+      case TGSI_OPCODE_UDIV:
+      case TGSI_OPCODE_UMOD:
+      case TGSI_OPCODE_UMAD:
+      case TGSI_OPCODE_UMAX:
+      case TGSI_OPCODE_UMIN:
+      case TGSI_OPCODE_UMUL:
+      case TGSI_OPCODE_IMUL_HI:
+      case TGSI_OPCODE_UMUL_HI:
+      case TGSI_OPCODE_USEQ:
+      case TGSI_OPCODE_USGE:
+      case TGSI_OPCODE_USLT:
+      case TGSI_OPCODE_USNE:
+      case TGSI_OPCODE_IBFE:
+      case TGSI_OPCODE_UBFE:
+      case TGSI_OPCODE_BFI:
+      case TGSI_OPCODE_BREV:
+      case TGSI_OPCODE_POPC:
+      case TGSI_OPCODE_LSB:
+      case TGSI_OPCODE_IMSB:
+      case TGSI_OPCODE_UMSB:
+      case TGSI_OPCODE_KILL:
+      case TGSI_OPCODE_KILL_IF:
+      case TGSI_OPCODE_TEX:
+      case TGSI_OPCODE_TEX_LZ:
+      case TGSI_OPCODE_TXP:
+      case TGSI_OPCODE_TXB:
+      case TGSI_OPCODE_TXL:
+      case TGSI_OPCODE_TXD:
+      case TGSI_OPCODE_TXF:
+      case TGSI_OPCODE_TXF_LZ:
+      case TGSI_OPCODE_TXQ:
+      case TGSI_OPCODE_IF:
+      case TGSI_OPCODE_UIF:
+      case TGSI_OPCODE_ELSE:
+      case TGSI_OPCODE_ENDIF:
+      case TGSI_OPCODE_BGNLOOP:
+      case TGSI_OPCODE_ENDLOOP:
+      case TGSI_OPCODE_BRK:
+      case TGSI_OPCODE_CONT:
+      case TGSI_OPCODE_NOP:
+      case TGSI_OPCODE_END:
+         break;
+      default:
+         return FALSE;
+      }
+   }
+
+   return TRUE;
 }
 
 
@@ -2940,19 +3386,50 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    shader->no = fs_no++;
    make_empty_list(&shader->variants);
 
-   /* get/save the summary info for this shader */
-   lp_build_tgsi_info(templ->tokens, &shader->info);
+   if (templ->type == PIPE_SHADER_IR_NIR) {
+      /*
+       * The shader is ours.  It is only described with the TGSI info,
+       * which leaves the TGSI specific texture analysis out.
+       */
+      shader->nir = templ->ir.nir;
+      nir_tgsi_scan_shader(shader->nir,
+                           pipe->screen->get_param(pipe->screen,
+                                                   PIPE_CAP_TGSI_TEXCOORD),
+                           &shader->info.base);
+   } else {
+      /* get/save the summary info for this shader */
+      lp_build_tgsi_info(templ->tokens, &shader->info);
 
-   /* we need to keep a local copy of the tokens */
-   shader->base.tokens = tgsi_dup_tokens(templ->tokens);
+      /* we need to keep a local copy of the tokens */
+      shader->base.tokens = tgsi_dup_tokens(templ->tokens);
+   }
 
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
+      ralloc_free(shader->nir);
       FREE((void *) shader->base.tokens);
       FREE(shader);
       return NULL;
    }
 
+   /* The variants are translated from the lowered NIR, which must not
+    * change afterwards, as they may be compiled on other threads.
+    */
+   if (shader->nir) {
+      struct blob blob;
+
+      lp_build_nir_prepasses(shader->nir);
+
+      blob_init(&blob);
+      nir_serialize(&blob, shader->nir);
+      _mesa_sha1_compute(blob.data, blob.size, shader->nir_sha1);
+      blob_finish(&blob);
+   } else if (llvmpipe_screen(pipe->screen)->use_nir &&
+              fs_nir_supported(&shader->info.base)) {
+      shader->nir = tgsi_to_nir(shader->base.tokens, pipe->screen);
+      lp_build_nir_prepasses(shader->nir);
+   }
+
    nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
    nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
 
@@ -3001,7 +3478,10 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       unsigned attrib;
       debug_printf("llvmpipe: Create fragment shader #%u %p:\n",
                    shader->no, (void *) shader);
-      tgsi_dump(templ->tokens, 0);
+      if (shader->base.tokens)
+         tgsi_dump(shader->base.tokens, 0);
+      if (shader->nir)
+         nir_print_shader(shader->nir, stderr);
       debug_printf("usage masks:\n");
       for (attrib = 0; attrib < shader->info.base.num_inputs; ++attrib) {
          unsigned usage_mask = shader->info.base.input_usage_mask[attrib];
@@ -3044,6 +3524,8 @@ static void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
@@ -3053,7 +3535,19 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
+
+   /* Don't compile the optimized code anymore, or wait until it's done. */
+   if (variant->tier_up_job)
+      FREE(variant->tier_up_job);
+   else if (util_queue_is_initialized(&screen->fs_compile_queue))
+      util_queue_drop_job(&screen->fs_compile_queue, &variant->compile_fence);
+   util_queue_fence_destroy(&variant->compile_fence);
+
    gallivm_destroy(variant->gallivm);
+   if (variant->optimized_gallivm)
+      gallivm_destroy(variant->optimized_gallivm);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
@@ -3096,6 +3590,7 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
    draw_delete_fragment_shader(llvmpipe->draw, shader->draw_data);
 
    assert(shader->variants_cached == 0);
+   ralloc_free(shader->nir);
    FREE((void *) shader->base.tokens);
    FREE(shader);
 }
@@ -3436,6 +3931,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
    else {
       /* variant not found, create it now */
+      struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
       int64_t t0, t1, dt;
       unsigned i;
       unsigned variants_to_cull;
@@ -3497,6 +3993,8 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       t1 = os_time_get();
       dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
+      p_atomic_add(&screen->fs_compile_stats[LP_FS_STAT_COMPILE_TIME],
+                   (uint64_t)dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
@@ -3510,10 +4008,40 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
 
+/**
+ * Account for a draw with the bound fragment shader variant, and queue the
+ * compilation of its optimized code once it has been used enough.  The
+ * bigger the variant, the sooner, as its unoptimized code is slower and
+ * its optimized one takes longer to compile.
+ */
+void
+llvmpipe_count_fs_draw(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+   struct llvmpipe_screen *screen;
+
+   if (!variant || !variant->tier_up_job)
+      return;
+
+   screen = llvmpipe_screen(lp->pipe.screen);
+   variant->num_draws++;
+   if ((uint64_t)variant->num_draws * variant->gallivm->stats.nr_instrs <
+       screen->fs_tier_up_instrs)
+      return;
+
+   util_queue_add_job(&screen->fs_compile_queue, variant->tier_up_job,
+                      &variant->compile_fence,
+                      lp_fs_compile_job_execute,
+                      lp_fs_compile_job_cleanup);
+   variant->tier_up_job = NULL;
+}
+
+
 
 
 
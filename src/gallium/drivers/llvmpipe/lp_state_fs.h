@@ -33,6 +33,7 @@
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "util/u_queue.h" /* for util_queue_fence */
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
@@ -40,6 +41,8 @@
 
 struct tgsi_token;
 struct lp_fragment_shader;
+struct nir_shader;
+struct lp_fs_compile_job;
 
 
 /** Indexes into jit_function[] array */
@@ -109,6 +112,24 @@ struct lp_fragment_shader_variant
 
    lp_jit_frag_func jit_function[2];
 
+   /**
+    * Optimized code of the variant, compiled in the background while the
+    * unoptimized code of gallivm runs.  Once compiled, it replaces that
+    * code in jit_function and compile_fence is signalled, but both stay
+    * alive as long as the variant, since scenes in flight may still be
+    * running the unoptimized code.
+    */
+   struct gallivm_state *optimized_gallivm;
+   struct util_queue_fence compile_fence;
+
+   /**
+    * Compilation of the optimized code, to be queued once the variant is
+    * used enough (see llvmpipe_count_fs_draw), or NULL if already queued or
+    * if the variant stays in the fast tier.
+    */
+   struct lp_fs_compile_job *tier_up_job;
+   unsigned num_draws;
+
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
@@ -131,6 +152,12 @@ struct lp_fragment_shader
 
    struct draw_fragment_shader *draw_data;
 
+   /** The shader lowered for lp_build_nir_soa, or NULL to use the TGSI */
+   struct nir_shader *nir;
+
+   /** The SHA1 of the NIR given by the state tracker, which has no TGSI */
+   unsigned char nir_sha1[20];
+
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
    unsigned no;
@@ -0,0 +1,291 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Test the machine code cache of gallivm: a module loaded from the code
+ * cached by a previous compilation must behave like the original one.
+ * With -v, also prints how long the compilation and the load took, which
+ * is what the cache saves at startup for each shader variant.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/u_pointer.h"
+#include "util/u_memory.h"
+#include "util/os_time.h"
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_printf.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_test.h"
+
+
+#define NUM_STAGES 16
+#define NUM_RUNS 8
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cold_ms\t"
+           "cached_ms\n");
+
+   fflush(fp);
+}
+
+
+typedef void (*cache_test_func_t)(float *out, const float *in);
+
+
+/*
+ * Something about as long to compile as a typical shader: a chain of
+ * transcendental functions, which expand to a lot of IR.
+ */
+static LLVMValueRef
+add_cache_test(struct gallivm_state *gallivm, struct lp_type type)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMTypeRef vf32t = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef args[2] = { LLVMPointerType(vf32t, 0),
+                           LLVMPointerType(vf32t, 0) };
+   LLVMValueRef func =
+      LLVMAddFunction(gallivm->module, "test_cache",
+                      LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                       args, ARRAY_SIZE(args), 0));
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMBasicBlockRef block =
+      LLVMAppendBasicBlockInContext(context, func, "entry");
+   struct lp_build_context bld;
+   LLVMValueRef x, acc;
+   unsigned i;
+
+   lp_build_context_init(&bld, gallivm, type);
+
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   x = LLVMBuildLoad(builder, LLVMGetParam(func, 1), "");
+   acc = bld.zero;
+
+   for (i = 0; i < NUM_STAGES; i++) {
+      LLVMValueRef scale = lp_build_const_vec(gallivm, type, 1.0 + i / 8.0);
+      LLVMValueRef t;
+
+      t = lp_build_mul(&bld, x, scale);
+      t = lp_build_add(&bld, lp_build_sin(&bld, t), lp_build_cos(&bld, t));
+      t = lp_build_exp2(&bld, t);
+      t = lp_build_log2(&bld, lp_build_add(&bld, t, bld.one));
+      acc = lp_build_add(&bld, acc, t);
+   }
+
+   LLVMBuildStore(builder, acc, LLVMGetParam(func, 0));
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/*
+ * Build, compile and run the test function.
+ * \return the time it took to get the function, in microseconds
+ */
+static int64_t
+run_cache_test(struct lp_cached_code *cached, struct lp_type type,
+               float *out, const float *in)
+{
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   LLVMValueRef test;
+   cache_test_func_t test_func;
+   int64_t start, end;
+
+   context = LLVMContextCreate();
+
+   start = os_time_get();
+
+   gallivm = gallivm_create("test_module", context, cached);
+   test = add_cache_test(gallivm, type);
+   gallivm_compile_module(gallivm);
+   test_func = (cache_test_func_t) gallivm_jit_function(gallivm, test);
+   gallivm_free_ir(gallivm);
+
+   end = os_time_get();
+
+   test_func(out, in);
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   return end - start;
+}
+
+
+/*
+ * Modules calling functions of the process by address must not be cached.
+ */
+static boolean
+test_dont_cache(unsigned verbose, FILE *fp)
+{
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   struct lp_cached_code cached = { 0 };
+   LLVMValueRef func;
+   boolean success;
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_module", context, &cached);
+
+   func = LLVMAddFunction(gallivm->module, "test_dont_cache",
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           NULL, 0, 0));
+   LLVMPositionBuilderAtEnd(gallivm->builder,
+                            LLVMAppendBasicBlockInContext(context, func,
+                                                          "entry"));
+   lp_build_printf(gallivm, "");
+   LLVMBuildRetVoid(gallivm->builder);
+   gallivm_verify_function(gallivm, func);
+
+   gallivm_compile_module(gallivm);
+   gallivm_jit_function(gallivm, func);
+   gallivm_free_ir(gallivm);
+
+   success = cached.dont_cache && !cached.data;
+   if (!success || verbose)
+      printf("dont_cache: %s\n", success ? "PASS" : "FAIL");
+
+   free(cached.data);
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   return success;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_cache(unsigned verbose, FILE *fp)
+{
+   struct lp_type type = lp_type_float_vec(32, 128);
+   struct lp_cached_code cached = { 0 };
+   PIPE_ALIGN_VAR(16) float in[4] = { -2.5f, 0.0f, 0.75f, 3.0f };
+   PIPE_ALIGN_VAR(16) float ref[4];
+   PIPE_ALIGN_VAR(16) float out[4];
+   int64_t cold_time = 0, cached_time = 0;
+   boolean success = TRUE;
+   unsigned i;
+
+   /* Compile without cached code, to get the reference and the code. */
+   for (i = 0; i < NUM_RUNS; i++) {
+      struct lp_cached_code collect = { 0 };
+
+      cold_time += run_cache_test(&collect, type, ref, in);
+
+      if (!cached.data) {
+         cached = collect;
+      } else {
+         free(collect.data);
+      }
+   }
+
+   if (!cached.data_size) {
+      printf("cache: no code was returned: FAIL\n");
+      return FALSE;
+   }
+
+   /* Load the cached code. */
+   for (i = 0; i < NUM_RUNS; i++) {
+      cached_time += run_cache_test(&cached, type, out, in);
+
+      if (memcmp(out, ref, sizeof(out)) != 0) {
+         printf("cache: result %g %g %g %g, expected %g %g %g %g: FAIL\n",
+                out[0], out[1], out[2], out[3],
+                ref[0], ref[1], ref[2], ref[3]);
+         success = FALSE;
+         break;
+      }
+   }
+
+   if (verbose || !success) {
+      printf("cache: %u bytes of code, cold %.3f ms, cached %.3f ms: %s\n",
+             (unsigned)cached.data_size, cold_time / 1000.0 / NUM_RUNS,
+             cached_time / 1000.0 / NUM_RUNS, success ? "PASS" : "FAIL");
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%f\t%f\n", success ? "pass" : "fail",
+              cold_time / 1000.0 / NUM_RUNS,
+              cached_time / 1000.0 / NUM_RUNS);
+      fflush(fp);
+   }
+
+   free(cached.data);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+
+   if (!test_cache(verbose, fp))
+      success = FALSE;
+
+   if (!test_dont_cache(verbose, fp))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
@@ -0,0 +1,282 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Test the compute shaders of llvmpipe: each invocation of a workgroup
+ * writes its index to shared memory, waits at a barrier, and copies the
+ * slot of the mirrored invocation to a shader buffer.  That only gives the
+ * right result if the SIMD vectors of a workgroup really wait for each
+ * other at the barrier, so both the coroutines of workgroups of several
+ * vectors and workgroups of a single vector are covered.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_text.h"
+#include "state_tracker/sw_winsys.h"
+
+#include "gallivm/lp_bld_init.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define MAX_BLOCK_THREADS 64
+#define NUM_BLOCKS 7
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "block\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * out[group * threads + local] = group * threads + (threads - 1 - local),
+ * where local is the flattened index of the invocation in a 2D workgroup
+ * and group the flattened index of the workgroup in a 2D grid.
+ */
+static const char cs_text[] =
+   "COMP\n"
+   "DCL SV[0], THREAD_ID\n"
+   "DCL SV[1], BLOCK_ID\n"
+   "DCL SV[2], BLOCK_SIZE\n"
+   "DCL SV[3], GRID_SIZE\n"
+   "DCL BUFFER[0]\n"
+   "DCL MEMORY[0], SHARED\n"
+   "DCL TEMP[0..4]\n"
+   "IMM[0] UINT32 {4, 1, 0, 0}\n"
+   /* TEMP[0].x = local, TEMP[0].y = threads */
+   "UMAD TEMP[0].x, SV[0].yyyy, SV[2].xxxx, SV[0].xxxx\n"
+   "UMUL TEMP[0].y, SV[2].xxxx, SV[2].yyyy\n"
+   /* TEMP[1].x = global index */
+   "UMAD TEMP[1].x, SV[1].yyyy, SV[3].xxxx, SV[1].xxxx\n"
+   "UMAD TEMP[1].x, TEMP[1].xxxx, TEMP[0].yyyy, TEMP[0].xxxx\n"
+   "UMUL TEMP[2].x, TEMP[0].xxxx, IMM[0].xxxx\n"
+   "STORE MEMORY[0].x, TEMP[2].xxxx, TEMP[1].xxxx\n"
+   "BARRIER\n"
+   /* read the slot of threads - 1 - local */
+   "INEG TEMP[3].x, TEMP[0].xxxx\n"
+   "UADD TEMP[3].x, TEMP[3].xxxx, TEMP[0].yyyy\n"
+   "INEG TEMP[4].x, IMM[0].yyyy\n"
+   "UADD TEMP[3].x, TEMP[3].xxxx, TEMP[4].xxxx\n"
+   "UMUL TEMP[3].x, TEMP[3].xxxx, IMM[0].xxxx\n"
+   "LOAD TEMP[4].x, MEMORY[0], TEMP[3].xxxx\n"
+   "UMUL TEMP[1].x, TEMP[1].xxxx, IMM[0].xxxx\n"
+   "STORE BUFFER[0].x, TEMP[1].xxxx, TEMP[4].xxxx\n"
+   "END\n";
+
+
+static boolean
+test_block(unsigned verbose, FILE *fp,
+           struct pipe_context *pipe,
+           const unsigned block[3], const unsigned grid[3])
+{
+   unsigned threads = block[0] * block[1] * block[2];
+   unsigned groups = grid[0] * grid[1] * grid[2];
+   unsigned size = groups * threads * sizeof(uint32_t);
+   struct pipe_resource *buf;
+   struct pipe_shader_buffer sb;
+   struct pipe_grid_info info;
+   uint32_t *res;
+   boolean success = TRUE;
+   unsigned i;
+
+   assert(block[2] == 1 && grid[2] == 1);
+
+   buf = pipe_buffer_create(pipe->screen, PIPE_BIND_SHADER_BUFFER,
+                            PIPE_USAGE_DEFAULT, size);
+   res = MALLOC(size);
+   if (!buf || !res) {
+      pipe_resource_reference(&buf, NULL);
+      FREE(res);
+      return FALSE;
+   }
+
+   /* garbage, so that a missing store can't go unnoticed */
+   memset(res, 0xcd, size);
+   pipe_buffer_write(pipe, buf, 0, size, res);
+
+   memset(&sb, 0, sizeof sb);
+   sb.buffer = buf;
+   sb.buffer_size = size;
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, &sb, 1);
+
+   memset(&info, 0, sizeof info);
+   for (i = 0; i < 3; i++) {
+      info.block[i] = block[i];
+      info.grid[i] = grid[i];
+   }
+   pipe->launch_grid(pipe, &info);
+
+   pipe_buffer_read(pipe, buf, 0, size, res);
+
+   for (i = 0; i < groups * threads; i++) {
+      unsigned local = i % threads;
+      uint32_t ref = i - local + (threads - 1 - local);
+
+      if (res[i] != ref) {
+         if (success || verbose >= 1)
+            printf("cs: block %ux%u, grid %ux%u: out[%u] = %u, expected %u\n",
+                   block[0], block[1], grid[0], grid[1], i, res[i], ref);
+         success = FALSE;
+      }
+   }
+
+   if (verbose >= 1 || !success)
+      printf("cs: block %ux%u: %s\n", block[0], block[1],
+             success ? "PASS" : "FAIL");
+
+   if (fp) {
+      fprintf(fp, "%s\t%ux%u\n", success ? "pass" : "fail",
+              block[0], block[1]);
+      fflush(fp);
+   }
+
+   memset(&sb, 0, sizeof sb);
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, &sb, 0);
+   pipe_resource_reference(&buf, NULL);
+   FREE(res);
+
+   return success;
+}
+
+
+static boolean
+test_blocks(unsigned verbose, FILE *fp, unsigned n)
+{
+   /* one SIMD vector, see generate_compute() */
+   const unsigned vector_length = MIN2(lp_native_vector_width / 32, 16);
+   const unsigned blocks[NUM_BLOCKS][3] = {
+      { 1, 1, 1 },
+      { vector_length, 1, 1 },
+      { vector_length - 1, 1, 1 },
+      { vector_length + 1, 1, 1 },
+      { 5, 3, 1 },
+      { 16, 4, 1 },
+      { MAX_BLOCK_THREADS, 1, 1 },
+   };
+   const unsigned grid[3] = { n, MIN2(n, 2), 1 };
+   struct sw_winsys winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct pipe_compute_state cs_state;
+   struct tgsi_token tokens[1024];
+   void *cs;
+   boolean success = TRUE;
+   unsigned i;
+
+   memset(&winsys, 0, sizeof winsys);
+   screen = llvmpipe_create_screen(&winsys);
+   if (!screen) {
+      printf("cs: can't create the screen: FAIL\n");
+      return FALSE;
+   }
+
+   if (!screen->get_param(screen, PIPE_CAP_COMPUTE)) {
+      printf("cs: compute shaders are not supported, skipping\n");
+      screen->destroy(screen);
+      return TRUE;
+   }
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe) {
+      printf("cs: can't create the context: FAIL\n");
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   if (!tgsi_text_translate(cs_text, tokens, ARRAY_SIZE(tokens))) {
+      printf("cs: can't translate the shader: FAIL\n");
+      pipe->destroy(pipe);
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   memset(&cs_state, 0, sizeof cs_state);
+   cs_state.ir_type = PIPE_SHADER_IR_TGSI;
+   cs_state.prog = tokens;
+   cs_state.req_local_mem = MAX_BLOCK_THREADS * sizeof(uint32_t);
+   cs = pipe->create_compute_state(pipe, &cs_state);
+   if (!cs) {
+      printf("cs: can't create the shader: FAIL\n");
+      pipe->destroy(pipe);
+      screen->destroy(screen);
+      return FALSE;
+   }
+   pipe->bind_compute_state(pipe, cs);
+
+   for (i = 0; i < NUM_BLOCKS; i++) {
+      assert(blocks[i][0] * blocks[i][1] <= MAX_BLOCK_THREADS);
+      if (!test_block(verbose, fp, pipe, blocks[i], grid))
+         success = FALSE;
+   }
+
+   pipe->bind_compute_state(pipe, NULL);
+   pipe->delete_compute_state(pipe, cs);
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_blocks(verbose, fp, 8);
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_blocks(verbose, fp, MAX2(n / NUM_BLOCKS, 1));
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_blocks(verbose, fp, 1);
+}
@@ -0,0 +1,595 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Test the hierarchical depth culling of the rasterizer: each scene of
+ * clears and of quads, some of them occluded, is rendered with and
+ * without the culling (LP_PERF=no_hiz), and must give the same color and
+ * depth buffers.  The scenes cover the bounds set by depth clears, also in
+ * the middle of a scene, narrowed by the depth written by the fragment
+ * functions, and widened by the depth output of a shader.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_text.h"
+#include "state_tracker/sw_winsys.h"
+
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+/* Not a multiple of the tile size, to cover partial tiles too */
+#define WIDTH 150
+#define HEIGHT 100
+
+#define MAX_OPS 8
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "format\t"
+           "scene\n");
+
+   fflush(fp);
+}
+
+
+enum hiz_op_type
+{
+   HIZ_END = 0,
+   HIZ_CLEAR,
+   HIZ_QUAD,
+};
+
+
+/**
+ * A depth/stencil clear, or a quad whose depth goes from z0 on its left
+ * edge to z1 on its right edge.  The coordinates are in pixels.
+ */
+struct hiz_op
+{
+   enum hiz_op_type type;
+   unsigned clear_flags;   /**< PIPE_CLEAR_x */
+   float z0, z1;           /**< clear depth in z0 */
+   float x0, y0, x1, y1;
+   unsigned func;          /**< PIPE_FUNC_x of the depth test */
+   /** The shader outputs this depth instead of the interpolated one */
+   boolean shader_z;
+   float z;
+};
+
+
+#define CLEAR(flags, z) \
+   { HIZ_CLEAR, flags, z, z, 0, 0, 0, 0, 0, FALSE, 0 }
+#define QUAD(x0, y0, x1, y1, z0, z1, func) \
+   { HIZ_QUAD, 0, z0, z1, x0, y0, x1, y1, PIPE_FUNC_##func, FALSE, 0 }
+#define QUAD_Z(x0, y0, x1, y1, z0, z1, func, z) \
+   { HIZ_QUAD, 0, z0, z1, x0, y0, x1, y1, PIPE_FUNC_##func, TRUE, z }
+
+#define DEPTH PIPE_CLEAR_DEPTH
+#define DEPTH_STENCIL PIPE_CLEAR_DEPTHSTENCIL
+
+
+struct hiz_scene
+{
+   const char *name;
+   struct hiz_op ops[MAX_OPS];
+};
+
+
+static const struct hiz_scene scenes[] = {
+   {
+      "clear", {
+         CLEAR(DEPTH_STENCIL, 0.5f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.75f, 0.75f, LESS),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.25f, 0.75f, LESS),
+         /* small enough for the small triangle paths */
+         QUAD(37, 21, 47, 27, 0.9f, 0.9f, LESS),
+         QUAD(70, 61, 82, 73, 0.1f, 0.1f, LESS),
+      }
+   },
+   {
+      "fragment depth write", {
+         CLEAR(DEPTH_STENCIL, 1.0f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.2f, 0.2f, LESS),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.6f, 0.6f, LESS),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.2f, 0.2f, LESS),
+         QUAD(13, 5, 141, 94, 0.2f, 0.2f, LEQUAL),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.0f, 0.4f, LEQUAL),
+         QUAD(3, 50, 9, 58, 0.3f, 0.3f, LESS),
+      }
+   },
+   {
+      "shader depth write", {
+         CLEAR(DEPTH_STENCIL, 1.0f),
+         /* the shader depth is further than the interpolated one */
+         QUAD_Z(0, 0, WIDTH, HEIGHT, 0.1f, 0.1f, LESS, 0.9f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.5f, 0.5f, LESS),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.95f, 0.95f, LESS),
+         QUAD_Z(20, 10, 120, 60, 0.8f, 0.8f, LESS, 0.05f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.3f, 0.3f, LESS),
+      }
+   },
+   {
+      "clear resync", {
+         CLEAR(DEPTH_STENCIL, 1.0f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.2f, 0.2f, LESS),
+         /* in the middle of the scene */
+         CLEAR(DEPTH, 1.0f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.5f, 0.5f, LESS),
+         /* leaves the depth alone */
+         CLEAR(PIPE_CLEAR_STENCIL, 0.0f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.6f, 0.6f, LESS),
+         /* keeps the colors of the right half */
+         CLEAR(DEPTH, 0.0f),
+         QUAD(0, 0, WIDTH / 2, HEIGHT, 0.3f, 0.3f, GREATER),
+      }
+   },
+   {
+      "greater", {
+         CLEAR(DEPTH_STENCIL, 0.0f),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.8f, 0.8f, GREATER),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.5f, 0.5f, GREATER),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.6f, 1.0f, GEQUAL),
+         QUAD(0, 0, WIDTH, HEIGHT, 0.8f, 0.8f, EQUAL),
+      }
+   },
+};
+
+
+static const enum pipe_format formats[] = {
+   PIPE_FORMAT_Z32_FLOAT,
+   PIPE_FORMAT_Z24_UNORM_S8_UINT,
+   PIPE_FORMAT_Z16_UNORM,
+};
+
+
+static const char vs_text[] =
+   "VERT\n"
+   "DCL IN[0]\n"
+   "DCL IN[1]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "MOV OUT[0], IN[0]\n"
+   "MOV OUT[1], IN[1]\n"
+   "END\n";
+
+static const char fs_text[] =
+   "FRAG\n"
+   "DCL IN[0], GENERIC[0], CONSTANT\n"
+   "DCL OUT[0], COLOR\n"
+   "MOV OUT[0], IN[0]\n"
+   "END\n";
+
+/* the depth is in the alpha of the color */
+static const char fs_z_text[] =
+   "FRAG\n"
+   "DCL IN[0], GENERIC[0], CONSTANT\n"
+   "DCL OUT[0], COLOR\n"
+   "DCL OUT[1], POSITION\n"
+   "MOV OUT[0], IN[0]\n"
+   "MOV OUT[1].z, IN[0].wwww\n"
+   "END\n";
+
+
+struct hiz_context
+{
+   struct pipe_context *pipe;
+   struct pipe_resource *cbuf;
+   struct pipe_resource *zsbuf;
+   void *vs, *fs, *fs_z;
+   void *dsa[PIPE_FUNC_ALWAYS + 1];
+   void *blend, *rast, *velems;
+};
+
+
+static void *
+create_shader(struct pipe_context *pipe, const char *text, boolean fs)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_shader_state state;
+
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof state);
+   state.type = PIPE_SHADER_IR_TGSI;
+   state.tokens = tokens;
+
+   return fs ? pipe->create_fs_state(pipe, &state) :
+               pipe->create_vs_state(pipe, &state);
+}
+
+
+static boolean
+create_state(struct hiz_context *ctx)
+{
+   struct pipe_context *pipe = ctx->pipe;
+   struct pipe_blend_state blend;
+   struct pipe_rasterizer_state rast;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_vertex_element velems[2];
+   struct pipe_viewport_state vp;
+   unsigned func;
+
+   ctx->vs = create_shader(pipe, vs_text, FALSE);
+   ctx->fs = create_shader(pipe, fs_text, TRUE);
+   ctx->fs_z = create_shader(pipe, fs_z_text, TRUE);
+   if (!ctx->vs || !ctx->fs || !ctx->fs_z)
+      return FALSE;
+   pipe->bind_vs_state(pipe, ctx->vs);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   ctx->blend = pipe->create_blend_state(pipe, &blend);
+   pipe->bind_blend_state(pipe, ctx->blend);
+
+   memset(&rast, 0, sizeof rast);
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.bottom_edge_rule = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast.clip_halfz = 1;
+   rast.flatshade = 1;
+   ctx->rast = pipe->create_rasterizer_state(pipe, &rast);
+   pipe->bind_rasterizer_state(pipe, ctx->rast);
+
+   for (func = PIPE_FUNC_NEVER; func <= PIPE_FUNC_ALWAYS; func++) {
+      memset(&dsa, 0, sizeof dsa);
+      dsa.depth.enabled = 1;
+      dsa.depth.writemask = 1;
+      dsa.depth.func = func;
+      ctx->dsa[func] = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   }
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = 4 * sizeof(float);
+   ctx->velems = pipe->create_vertex_elements_state(pipe, 2, velems);
+   pipe->bind_vertex_elements_state(pipe, ctx->velems);
+
+   memset(&vp, 0, sizeof vp);
+   vp.scale[0] = WIDTH / 2.0f;
+   vp.scale[1] = HEIGHT / 2.0f;
+   vp.scale[2] = 1.0f;
+   vp.translate[0] = WIDTH / 2.0f;
+   vp.translate[1] = HEIGHT / 2.0f;
+   pipe->set_viewport_states(pipe, 0, 1, &vp);
+
+   return TRUE;
+}
+
+
+static void
+destroy_state(struct hiz_context *ctx)
+{
+   struct pipe_context *pipe = ctx->pipe;
+   unsigned func;
+
+   pipe->bind_vs_state(pipe, NULL);
+   pipe->bind_fs_state(pipe, NULL);
+   pipe->bind_depth_stencil_alpha_state(pipe, NULL);
+   pipe->bind_vertex_elements_state(pipe, NULL);
+   pipe->bind_blend_state(pipe, NULL);
+   pipe->bind_rasterizer_state(pipe, NULL);
+
+   if (ctx->vs)
+      pipe->delete_vs_state(pipe, ctx->vs);
+   if (ctx->fs)
+      pipe->delete_fs_state(pipe, ctx->fs);
+   if (ctx->fs_z)
+      pipe->delete_fs_state(pipe, ctx->fs_z);
+   for (func = PIPE_FUNC_NEVER; func <= PIPE_FUNC_ALWAYS; func++) {
+      if (ctx->dsa[func])
+         pipe->delete_depth_stencil_alpha_state(pipe, ctx->dsa[func]);
+   }
+   if (ctx->velems)
+      pipe->delete_vertex_elements_state(pipe, ctx->velems);
+   if (ctx->blend)
+      pipe->delete_blend_state(pipe, ctx->blend);
+   if (ctx->rast)
+      pipe->delete_rasterizer_state(pipe, ctx->rast);
+}
+
+
+/**
+ * Copy a whole resource to memory, as tightly packed rows.
+ */
+static void
+read_resource(struct pipe_context *pipe, struct pipe_resource *res,
+              uint8_t *data)
+{
+   unsigned stride = util_format_get_stride(res->format, res->width0);
+   struct pipe_transfer *transfer;
+   struct pipe_box box;
+   const uint8_t *map;
+   unsigned y;
+
+   u_box_2d(0, 0, res->width0, res->height0, &box);
+   map = pipe->transfer_map(pipe, res, 0, PIPE_TRANSFER_READ, &box,
+                            &transfer);
+   for (y = 0; y < res->height0; y++)
+      memcpy(data + y * stride, map + y * transfer->stride, stride);
+   pipe->transfer_unmap(pipe, transfer);
+}
+
+
+/**
+ * Render a scene, and read back the color and depth buffers.
+ */
+static void
+render_scene(struct hiz_context *ctx, const struct hiz_scene *scene,
+             uint8_t *color, uint8_t *depth)
+{
+   struct pipe_context *pipe = ctx->pipe;
+   static const union pipe_color_union clear_color;
+   float verts[MAX_OPS][4][8];
+   struct pipe_vertex_buffer vb;
+   struct pipe_draw_info info;
+   unsigned i, j;
+
+   memset(verts, 0, sizeof verts);
+   for (i = 0; i < MAX_OPS && scene->ops[i].type != HIZ_END; i++) {
+      const struct hiz_op *op = &scene->ops[i];
+
+      for (j = 0; j < 4; j++) {
+         float x = j & 1 ? op->x1 : op->x0;
+         float y = j & 2 ? op->y1 : op->y0;
+
+         verts[i][j][0] = x / WIDTH * 2.0f - 1.0f;
+         verts[i][j][1] = y / HEIGHT * 2.0f - 1.0f;
+         verts[i][j][2] = j & 1 ? op->z1 : op->z0;
+         verts[i][j][3] = 1.0f;
+         /* a different color for each quad */
+         verts[i][j][4] = (float)((i + 1) & 1);
+         verts[i][j][5] = (float)(((i + 1) >> 1) & 1);
+         verts[i][j][6] = (float)(((i + 1) >> 2) & 1);
+         verts[i][j][7] = op->shader_z ? op->z : 1.0f;
+      }
+   }
+
+   memset(&vb, 0, sizeof vb);
+   vb.stride = sizeof verts[0][0];
+   vb.is_user_buffer = true;
+   vb.buffer.user = verts;
+   pipe->set_vertex_buffers(pipe, 0, 1, &vb);
+
+   pipe->clear(pipe, PIPE_CLEAR_COLOR, &clear_color, 0.0, 0);
+
+   for (i = 0; i < MAX_OPS && scene->ops[i].type != HIZ_END; i++) {
+      const struct hiz_op *op = &scene->ops[i];
+
+      if (op->type == HIZ_CLEAR) {
+         pipe->clear(pipe, op->clear_flags, NULL, op->z0, 0x55);
+         continue;
+      }
+
+      pipe->bind_fs_state(pipe, op->shader_z ? ctx->fs_z : ctx->fs);
+      pipe->bind_depth_stencil_alpha_state(pipe, ctx->dsa[op->func]);
+
+      memset(&info, 0, sizeof info);
+      info.mode = PIPE_PRIM_TRIANGLE_STRIP;
+      info.start = i * 4;
+      info.count = 4;
+      info.max_index = MAX_OPS * 4 - 1;
+      info.instance_count = 1;
+      pipe->draw_vbo(pipe, &info);
+   }
+
+   read_resource(pipe, ctx->cbuf, color);
+   read_resource(pipe, ctx->zsbuf, depth);
+}
+
+
+static boolean
+test_format(unsigned verbose, FILE *fp,
+            struct pipe_context *pipe, enum pipe_format format,
+            unsigned num_scenes)
+{
+   struct pipe_screen *screen = pipe->screen;
+   struct hiz_context ctx;
+   struct pipe_resource templ;
+   struct pipe_surface surf_templ;
+   struct pipe_framebuffer_state fb;
+   unsigned color_size = WIDTH * HEIGHT * 4;
+   unsigned depth_size = util_format_get_stride(format, WIDTH) * HEIGHT;
+   uint8_t *ref_color, *ref_depth, *res_color, *res_depth;
+   int perf = LP_PERF;
+   boolean success = TRUE;
+   unsigned i;
+
+   memset(&ctx, 0, sizeof ctx);
+   ctx.pipe = pipe;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templ.width0 = WIDTH;
+   templ.height0 = HEIGHT;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_RENDER_TARGET;
+   ctx.cbuf = screen->resource_create(screen, &templ);
+   templ.format = format;
+   templ.bind = PIPE_BIND_DEPTH_STENCIL;
+   ctx.zsbuf = screen->resource_create(screen, &templ);
+
+   ref_color = MALLOC(color_size);
+   res_color = MALLOC(color_size);
+   ref_depth = MALLOC(depth_size);
+   res_depth = MALLOC(depth_size);
+
+   if (!ctx.cbuf || !ctx.zsbuf ||
+       !ref_color || !res_color || !ref_depth || !res_depth ||
+       !create_state(&ctx)) {
+      printf("hiz: %s: can't create the resources: FAIL\n",
+             util_format_short_name(format));
+      success = FALSE;
+      goto out;
+   }
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.nr_cbufs = 1;
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   fb.cbufs[0] = pipe->create_surface(pipe, ctx.cbuf, &surf_templ);
+   surf_templ.format = format;
+   fb.zsbuf = pipe->create_surface(pipe, ctx.zsbuf, &surf_templ);
+   pipe->set_framebuffer_state(pipe, &fb);
+
+   for (i = 0; i < num_scenes; i++) {
+      const struct hiz_scene *scene = &scenes[i];
+      unsigned culled;
+      boolean pass;
+
+      LP_PERF = perf | PERF_NO_HIZ;
+      render_scene(&ctx, scene, ref_color, ref_depth);
+
+      culled = LP_COUNT_GET(nr_hiz_culled_16) + LP_COUNT_GET(nr_hiz_culled_4);
+      LP_PERF = perf & ~PERF_NO_HIZ;
+      render_scene(&ctx, scene, res_color, res_depth);
+      culled = LP_COUNT_GET(nr_hiz_culled_16) + LP_COUNT_GET(nr_hiz_culled_4) -
+               culled;
+
+      pass = memcmp(ref_color, res_color, color_size) == 0 &&
+             memcmp(ref_depth, res_depth, depth_size) == 0;
+
+      if (verbose >= 1 || !pass) {
+         printf("hiz: %s: %s: %u blocks culled: %s\n",
+                util_format_short_name(format), scene->name, culled,
+                pass ? "PASS" : "FAIL");
+      }
+
+      if (fp) {
+         fprintf(fp, "%s\t%s\t%s\n", pass ? "pass" : "fail",
+                 util_format_short_name(format), scene->name);
+         fflush(fp);
+      }
+
+      if (!pass)
+         success = FALSE;
+   }
+
+   LP_PERF = perf;
+
+   pipe_surface_reference(&fb.cbufs[0], NULL);
+   pipe_surface_reference(&fb.zsbuf, NULL);
+   memset(&fb, 0, sizeof fb);
+   pipe->set_framebuffer_state(pipe, &fb);
+
+out:
+   destroy_state(&ctx);
+   pipe_resource_reference(&ctx.cbuf, NULL);
+   pipe_resource_reference(&ctx.zsbuf, NULL);
+   FREE(ref_color);
+   FREE(res_color);
+   FREE(ref_depth);
+   FREE(res_depth);
+
+   return success;
+}
+
+
+static boolean
+test_formats(unsigned verbose, FILE *fp,
+             unsigned num_formats, unsigned num_scenes)
+{
+   struct sw_winsys winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   boolean success = TRUE;
+   unsigned i;
+
+   memset(&winsys, 0, sizeof winsys);
+   screen = llvmpipe_create_screen(&winsys);
+   if (!screen) {
+      printf("hiz: can't create the screen: FAIL\n");
+      return FALSE;
+   }
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe) {
+      printf("hiz: can't create the context: FAIL\n");
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   for (i = 0; i < num_formats; i++) {
+      if (!test_format(verbose, fp, pipe, formats[i], num_scenes))
+         success = FALSE;
+   }
+
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_formats(verbose, fp, ARRAY_SIZE(formats), ARRAY_SIZE(scenes));
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_formats(verbose, fp, ARRAY_SIZE(formats),
+                       MIN2(MAX2(n / ARRAY_SIZE(formats), 1),
+                            ARRAY_SIZE(scenes)));
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_formats(verbose, fp, 1, ARRAY_SIZE(scenes));
+}
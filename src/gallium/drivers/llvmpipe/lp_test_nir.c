@@ -0,0 +1,854 @@
+/**************************************************************************
+ *
+ * Copyright 2019 FMSoft Technologies
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Test the NIR translator of gallivm, which llvmpipe uses with LP_NIR=true:
+ * each fragment shader goes through tgsi_to_nir and lp_build_nir_soa(),
+ * the way lp_state_fs.c does it, and must give the same outputs and the
+ * same fragment mask as the TGSI translator on the same inputs.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/u_pointer.h"
+#include "util/u_memory.h"
+#include "util/ralloc.h"
+#include "tgsi/tgsi_text.h"
+#include "tgsi/tgsi_scan.h"
+#include "nir/tgsi_to_nir.h"
+#include "compiler/nir/nir.h"
+#include "compiler/nir/nir_builder.h"
+#include "state_tracker/sw_winsys.h"
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_nir.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define NUM_INPUTS 2
+#define NUM_OUTPUTS 2
+#define NUM_CONSTS 4
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "shader\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * The inputs and outputs are arrays of vectors, indexed by slot * 4 + chan.
+ * The mask is the mask of the live fragments, updated by the shader.
+ */
+typedef void (*nir_test_func_t)(float *out, const float *in,
+                                const float *const *consts,
+                                const int *num_consts, int32_t *mask);
+
+
+/**
+ * The outputs of one fragment, as computed by the C code.
+ */
+typedef void (*nir_test_ref_t)(uint32_t out[NUM_OUTPUTS][4],
+                               const float in[NUM_INPUTS][4],
+                               const float consts[NUM_CONSTS][4]);
+
+
+struct nir_test_shader
+{
+   const char *name;
+   /** Whether the outputs are floats, which may differ by rounding */
+   boolean float_outputs;
+   const char *text;
+   /**
+    * The reference for the shaders using ops which the TGSI translator
+    * doesn't implement, but the NIR one does.
+    */
+   nir_test_ref_t reference;
+   /**
+    * Build the shader directly in NIR instead, for the 64-bit and 16-bit
+    * types TGSI has no registers for.  The text is NULL then.
+    */
+   void (*build)(nir_builder *b);
+};
+
+
+static int
+find_msb(uint32_t val)
+{
+   return val ? (int)util_last_bit(val) - 1 : -1;
+}
+
+
+static uint32_t
+float_bits(float val)
+{
+   uint32_t bits;
+
+   memcpy(&bits, &val, sizeof bits);
+   return bits;
+}
+
+
+static void
+bits_ref(uint32_t out[NUM_OUTPUTS][4], const float in[NUM_INPUTS][4],
+         const float consts[NUM_CONSTS][4])
+{
+   uint32_t a = (uint32_t)(in[0][1] * 1000.0f);
+   uint32_t b = (uint32_t)(in[0][2] * 1000.0f);
+   int32_t c = (int32_t)((in[1][0] - 4.0f) * 1000.0f);
+   int32_t d = (int32_t)((in[1][3] - 4.0f) * 1000.0f);
+
+   out[0][0] = find_msb(c < 0 ? ~c : c);
+   out[0][1] = find_msb(a);
+   out[0][2] = b ? ffs(b) - 1 : -1;
+   out[0][3] = util_bitcount(d);
+}
+
+
+/*
+ * Inputs and outputs as the state tracker lays them out: IN[0], IN[1] and
+ * OUT[0], OUT[1], with the 64-bit components taking two channels each.
+ */
+static nir_variable *
+create_io_var(nir_shader *nir, nir_variable_mode mode,
+              const struct glsl_type *type, unsigned index)
+{
+   nir_variable *var = nir_variable_create(nir, mode, type, NULL);
+
+   if (mode == nir_var_shader_in) {
+      var->data.location = VARYING_SLOT_VAR0 + index;
+      nir->num_inputs = MAX2(nir->num_inputs, index + 1);
+   } else {
+      var->data.location = FRAG_RESULT_DATA0 + index;
+      nir->num_outputs = MAX2(nir->num_outputs, index + 1);
+   }
+   var->data.driver_location = index;
+
+   return var;
+}
+
+
+static nir_ssa_def *
+load_uniform(nir_builder *b, unsigned num_components, unsigned bit_size,
+             unsigned base)
+{
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(b->shader, nir_intrinsic_load_uniform);
+
+   load->num_components = num_components;
+   load->src[0] = nir_src_for_ssa(nir_imm_int(b, 0));
+   nir_intrinsic_set_base(load, base);
+   nir_intrinsic_set_range(load, NUM_CONSTS * 16);
+   nir_ssa_dest_init(&load->instr, &load->dest, num_components, bit_size,
+                     NULL);
+   nir_builder_instr_insert(b, &load->instr);
+
+   return &load->dest.ssa;
+}
+
+
+static void
+build_64bit(nir_builder *b)
+{
+   nir_variable *in0 = create_io_var(b->shader, nir_var_shader_in,
+                                     glsl_dvec_type(2), 0);
+   nir_variable *in1 = create_io_var(b->shader, nir_var_shader_in,
+                                     glsl_vec4_type(), 1);
+   nir_variable *out0 = create_io_var(b->shader, nir_var_shader_out,
+                                      glsl_dvec_type(2), 0);
+   nir_ssa_def *a = nir_load_var(b, in0);
+   nir_ssa_def *f = nir_load_var(b, in1);
+   nir_ssa_def *c = load_uniform(b, 2, 64, 0);
+   nir_ssa_def *a0 = nir_channel(b, a, 0), *a1 = nir_channel(b, a, 1);
+   nir_ssa_def *c0 = nir_channel(b, c, 0), *c1 = nir_channel(b, c, 1);
+   nir_ssa_def *r, *d;
+
+   r = nir_iadd(b, a0, nir_imul(b, c1, nir_imm_int64(b, 3)));
+   r = nir_ixor(b, r, nir_ushr(b, c0, nir_imm_int(b, 7)));
+   r = nir_bcsel(b, nir_ult(b, a0, c0), r, nir_isub(b, a0, a1));
+
+   d = nir_fmul(b, nir_f2f64(b, nir_channel(b, f, 0)),
+                nir_f2f64(b, nir_channel(b, f, 1)));
+   d = nir_fsqrt(b, nir_fadd(b, d, nir_f2f64(b, nir_channel(b, f, 2))));
+   d = nir_fadd(b, d, nir_ffloor(b, nir_fmul(b, nir_f2f64(b, nir_channel(b, f, 3)),
+                                             nir_imm_double(b, 0.3))));
+   d = nir_fadd(b, d, nir_u2f64(b, nir_ushr(b, a1, nir_imm_int(b, 40))));
+
+   nir_store_var(b, out0, nir_vec2(b, r, d), 0x3);
+}
+
+
+static void
+ref_64bit(uint32_t out[NUM_OUTPUTS][4], const float in[NUM_INPUTS][4],
+          const float consts[NUM_CONSTS][4])
+{
+   uint64_t a0 = float_bits(in[0][0]) | (uint64_t)float_bits(in[0][1]) << 32;
+   uint64_t a1 = float_bits(in[0][2]) | (uint64_t)float_bits(in[0][3]) << 32;
+   uint64_t c0 = float_bits(consts[0][0]) |
+                 (uint64_t)float_bits(consts[0][1]) << 32;
+   uint64_t c1 = float_bits(consts[0][2]) |
+                 (uint64_t)float_bits(consts[0][3]) << 32;
+   uint64_t r, d_bits;
+   double d;
+
+   r = (a0 + c1 * 3) ^ (c0 >> 7);
+   r = a0 < c0 ? r : a0 - a1;
+
+   d = sqrt((double)in[1][0] * (double)in[1][1] + (double)in[1][2]);
+   d += floor((double)in[1][3] * 0.3);
+   d += (double)(a1 >> 40);
+   memcpy(&d_bits, &d, sizeof d_bits);
+
+   out[0][0] = r;
+   out[0][1] = r >> 32;
+   out[0][2] = d_bits;
+   out[0][3] = d_bits >> 32;
+}
+
+
+static void
+build_16bit(nir_builder *b)
+{
+   nir_variable *in0 = create_io_var(b->shader, nir_var_shader_in,
+                                     glsl_vector_type(GLSL_TYPE_FLOAT16, 4),
+                                     0);
+   nir_variable *in1 = create_io_var(b->shader, nir_var_shader_in,
+                                     glsl_vec4_type(), 1);
+   nir_variable *out0 = create_io_var(b->shader, nir_var_shader_out,
+                                      glsl_vector_type(GLSL_TYPE_FLOAT16, 2),
+                                      0);
+   nir_variable *out1 = create_io_var(b->shader, nir_var_shader_out,
+                                      glsl_vector_type(GLSL_TYPE_INT16, 2),
+                                      1);
+   nir_ssa_def *h = nir_load_var(b, in0);
+   nir_ssa_def *f = nir_load_var(b, in1);
+   nir_ssa_def *u = load_uniform(b, 2, 16, 0);
+   nir_ssa_def *u0 = nir_channel(b, u, 0), *u1 = nir_channel(b, u, 1);
+   nir_ssa_def *x, *y, *i, *n;
+
+   x = nir_fadd(b, nir_fmul(b, nir_channel(b, h, 0), nir_channel(b, h, 1)),
+                nir_channel(b, h, 2));
+   y = nir_fsub(b, nir_channel(b, h, 0), nir_channel(b, h, 3));
+   nir_store_var(b, out0, nir_vec2(b, x, y), 0x3);
+
+   i = nir_imul(b, nir_iadd(b, u0, nir_ishl(b, u1, nir_imm_int(b, 3))), u1);
+   n = nir_fmul(b, nir_fsub(b, nir_channel(b, f, 0), nir_imm_float(b, 4.0f)),
+                nir_imm_float(b, 1000.0f));
+   n = nir_f2i16(b, n);
+   nir_store_var(b, out1, nir_vec2(b, i, n), 0x3);
+}
+
+
+/**
+ * gallivm converts floats to halfs rounding towards zero, which for the
+ * normal values of the test drops the low 13 bits of the mantissa.
+ */
+static float
+round_half(float val)
+{
+   uint32_t bits = float_bits(val) & ~0x1fff;
+
+   memcpy(&val, &bits, sizeof val);
+   return val;
+}
+
+
+static void
+ref_16bit(uint32_t out[NUM_OUTPUTS][4], const float in[NUM_INPUTS][4],
+          const float consts[NUM_CONSTS][4])
+{
+   uint16_t u0 = float_bits(consts[0][0]);
+   uint16_t u1 = float_bits(consts[0][0]) >> 16;
+   int16_t i = (uint16_t)((u0 + (u1 << 3)) * u1);
+   int16_t n = (int16_t)((in[1][0] - 4.0f) * 1000.0f);
+
+   /* The inputs are exact in 16 bits. */
+   out[0][0] = float_bits(round_half(round_half(in[0][0] * in[0][1]) +
+                                     in[0][2]));
+   out[0][1] = float_bits(round_half(in[0][0] - in[0][3]));
+   out[1][0] = (int32_t)i;
+   out[1][1] = (int32_t)n;
+}
+
+
+static const struct nir_test_shader shaders[] = {
+   {
+      "arith", TRUE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL CONST[0..1]\n"
+      "DCL TEMP[0..1]\n"
+      "IMM[0] FLT32 {    0.5000,     2.0000,    -1.0000,     0.0000}\n"
+      "  0: MAD TEMP[0], IN[0], CONST[0], IN[1].wzyx\n"
+      "  1: DP3 TEMP[1].x, TEMP[0], IN[1]\n"
+      "  2: FRC TEMP[1].y, TEMP[0].zzzz\n"
+      "  3: MIN TEMP[1].z, |TEMP[0].xxxx|, -IN[1].yyyy\n"
+      "  4: MAX TEMP[1].w, TEMP[0].wwww, CONST[1].xxxx\n"
+      "  5: FLR TEMP[0].x, TEMP[1].yyyy\n"
+      "  6: LRP TEMP[1].y, IMM[0].xxxx, TEMP[1].yyyy, IN[0].zzzz\n"
+      "  7: SLT TEMP[0].y, TEMP[1].xxxx, IMM[0].yyyy\n"
+      "  8: MUL TEMP[1].z, TEMP[1].zzzz, TEMP[0].yyyy\n"
+      "  9: ADD_SAT OUT[0], TEMP[1], TEMP[0].xxxx\n"
+      " 10: END\n"
+   },
+   {
+      "integer", FALSE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL TEMP[0..2]\n"
+      "IMM[0] UINT32 {3, 31, 4294967295, 7}\n"
+      "  0: F2U TEMP[0], IN[0]\n"
+      "  1: F2I TEMP[1], IN[1]\n"
+      "  2: UDIV TEMP[2].x, TEMP[0].xxxx, TEMP[1].yyyy\n"
+      "  3: UMOD TEMP[2].y, TEMP[0].zzzz, TEMP[1].xxxx\n"
+      "  4: IDIV TEMP[2].z, TEMP[1].zzzz, TEMP[0].wwww\n"
+      "  5: SHL TEMP[2].w, TEMP[0].yyyy, TEMP[1].wwww\n"
+      "  6: USHR TEMP[0].x, IMM[0].zzzz, TEMP[0].xxxx\n"
+      "  7: ISHR TEMP[0].y, -TEMP[1].xxxx, IMM[0].xxxx\n"
+      "  8: IMUL_HI TEMP[0].z, TEMP[2].wwww, IMM[0].zzzz\n"
+      "  9: UMUL_HI TEMP[0].w, TEMP[2].wwww, IMM[0].zzzz\n"
+      " 10: UADD TEMP[2].x, TEMP[2].xxxx, TEMP[0].xxxx\n"
+      " 11: XOR TEMP[2].y, TEMP[2].yyyy, TEMP[0].yyyy\n"
+      " 12: IMIN TEMP[2].z, TEMP[2].zzzz, TEMP[0].zzzz\n"
+      " 13: UMAX TEMP[2].w, TEMP[2].wwww, TEMP[0].wwww\n"
+      " 14: INEG TEMP[1].x, TEMP[1].xxxx\n"
+      " 15: UMIN TEMP[1].y, TEMP[0].xxxx, TEMP[1].yyyy\n"
+      " 16: UMAD TEMP[1].z, TEMP[0].xxxx, TEMP[1].zzzz, IMM[0].zzzz\n"
+      " 17: AND TEMP[1].w, TEMP[0].zzzz, IMM[0].wwww\n"
+      " 18: UADD TEMP[2], TEMP[2], TEMP[1]\n"
+      " 19: MOV OUT[0], TEMP[2]\n"
+      " 20: END\n"
+   },
+   {
+      "compare", FALSE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL TEMP[0..1]\n"
+      "IMM[0] UINT32 {1, 2, 0, 0}\n"
+      "  0: FSLT TEMP[0].x, IN[0].xxxx, IN[1].xxxx\n"
+      "  1: FSEQ TEMP[0].y, IN[0].yyyy, IN[0].yyyy\n"
+      "  2: F2I TEMP[1], IN[1]\n"
+      "  3: ISGE TEMP[0].z, TEMP[1].zzzz, TEMP[1].wwww\n"
+      "  4: USNE TEMP[0].w, TEMP[1].xxxx, TEMP[1].yyyy\n"
+      "  5: UCMP TEMP[1].x, TEMP[0].xxxx, IMM[0].xxxx, IMM[0].yyyy\n"
+      "  6: AND TEMP[1].y, TEMP[0].yyyy, TEMP[0].zzzz\n"
+      "  7: OR TEMP[1].z, TEMP[0].zzzz, TEMP[0].wwww\n"
+      "  8: NOT TEMP[1].w, TEMP[0].xxxx\n"
+      "  9: MOV OUT[0], TEMP[1]\n"
+      " 10: END\n"
+   },
+   {
+      /*
+       * Divergent ifs and loops, which go through registers.  The ifs
+       * hold loops, so that NIR doesn't turn them into selects.
+       */
+      "control_flow", TRUE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL TEMP[0..3]\n"
+      "IMM[0] UINT32 {0, 1, 0, 0}\n"
+      "IMM[1] FLT32 {    0.0000,     1.0000,     4.0000,     0.0000}\n"
+      "  0: F2U TEMP[0].xy, IN[0].xyyy\n"
+      "  1: MOV TEMP[1], IMM[1].xxxx\n"
+      "  2: MOV TEMP[2].x, IMM[0].xxxx\n"
+      "  3: BGNLOOP\n"
+      "  4:   USGE TEMP[3].x, TEMP[2].xxxx, TEMP[0].xxxx\n"
+      "  5:   UIF TEMP[3].xxxx\n"
+      "  6:     BRK\n"
+      "  7:   ENDIF\n"
+      "  8:   UADD TEMP[2].x, TEMP[2].xxxx, IMM[0].yyyy\n"
+      "  9:   ADD TEMP[1].x, TEMP[1].xxxx, IN[1].xxxx\n"
+      " 10:   AND TEMP[3].x, TEMP[2].xxxx, IMM[0].yyyy\n"
+      " 11:   UIF TEMP[3].xxxx\n"
+      " 12:     CONT\n"
+      " 13:   ENDIF\n"
+      " 14:   MOV TEMP[2].y, IMM[0].xxxx\n"
+      " 15:   BGNLOOP\n"
+      " 16:     USGE TEMP[3].y, TEMP[2].yyyy, TEMP[0].yyyy\n"
+      " 17:     UIF TEMP[3].yyyy\n"
+      " 18:       BRK\n"
+      " 19:     ENDIF\n"
+      " 20:     UADD TEMP[2].y, TEMP[2].yyyy, IMM[0].yyyy\n"
+      " 21:     ADD TEMP[1].y, TEMP[1].yyyy, IN[1].yyyy\n"
+      " 22:   ENDLOOP\n"
+      " 23: ENDLOOP\n"
+      " 24: FSLT TEMP[3].x, IN[0].zzzz, IMM[1].zzzz\n"
+      " 25: UIF TEMP[3].xxxx\n"
+      " 26:   MOV TEMP[1].z, IN[1].zzzz\n"
+      " 27:   BGNLOOP\n"
+      " 28:     FSGE TEMP[3].z, TEMP[1].zzzz, IMM[1].zzzz\n"
+      " 29:     UIF TEMP[3].zzzz\n"
+      " 30:       BRK\n"
+      " 31:     ENDIF\n"
+      " 32:     ADD TEMP[1].z, TEMP[1].zzzz, IMM[1].yyyy\n"
+      " 33:   ENDLOOP\n"
+      " 34: ELSE\n"
+      " 35:   MOV TEMP[1].z, -IN[1].zzzz\n"
+      " 36: ENDIF\n"
+      " 37: U2F TEMP[1].w, TEMP[2].xxxx\n"
+      " 38: MOV OUT[0], TEMP[1]\n"
+      " 39: END\n"
+   },
+   {
+      /* Indirect constant fetches, out of bounds ones returning 0. */
+      "indirect_const", TRUE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL CONST[0..3]\n"
+      "DCL TEMP[0]\n"
+      "DCL ADDR[0]\n"
+      "  0: F2U TEMP[0].x, IN[0].xxxx\n"
+      "  1: UARL ADDR[0].x, TEMP[0].xxxx\n"
+      "  2: MOV TEMP[0], CONST[ADDR[0].x]\n"
+      "  3: ADD OUT[0], TEMP[0], CONST[ADDR[0].x+1].wzyx\n"
+      "  4: END\n"
+   },
+   {
+      "bits", FALSE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL TEMP[0..2]\n"
+      "IMM[0] FLT32 { 1000.0000,     4.0000,     0.0000,     0.0000}\n"
+      "  0: MUL TEMP[0], IN[0], IMM[0].xxxx\n"
+      "  1: F2U TEMP[0], TEMP[0]\n"
+      "  2: ADD TEMP[1], IN[1], -IMM[0].yyyy\n"
+      "  3: MUL TEMP[1], TEMP[1], IMM[0].xxxx\n"
+      "  4: F2I TEMP[1], TEMP[1]\n"
+      "  5: IMSB TEMP[2].x, TEMP[1].xxxx\n"
+      "  6: UMSB TEMP[2].y, TEMP[0].yyyy\n"
+      "  7: LSB TEMP[2].z, TEMP[0].zzzz\n"
+      "  8: POPC TEMP[2].w, TEMP[1].wwww\n"
+      "  9: MOV OUT[0], TEMP[2]\n"
+      " 10: END\n",
+      bits_ref
+   },
+   {
+      "64bit", FALSE, NULL, ref_64bit, build_64bit
+   },
+   {
+      "16bit", FALSE, NULL, ref_16bit, build_16bit
+   },
+   {
+      "discard", TRUE,
+      "FRAG\n"
+      "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+      "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+      "DCL OUT[0], COLOR\n"
+      "DCL TEMP[0]\n"
+      "IMM[0] FLT32 {    2.0000,     0.0000,     0.0000,     0.0000}\n"
+      "  0: ADD TEMP[0], IN[0], -IMM[0].xxxx\n"
+      "  1: FSLT TEMP[0].x, IN[1].xxxx, IMM[0].xxxx\n"
+      "  2: UIF TEMP[0].xxxx\n"
+      "  3:   KILL_IF TEMP[0].yzww\n"
+      "  4: ENDIF\n"
+      "  5: MOV OUT[0], IN[1]\n"
+      "  6: END\n"
+   },
+};
+
+
+/*
+ * Build a function running the shader, through NIR if nir is not NULL,
+ * else through the TGSI translator.
+ */
+static LLVMValueRef
+add_nir_test(struct gallivm_state *gallivm, struct lp_type type,
+             const char *name, const struct tgsi_token *tokens,
+             const struct tgsi_shader_info *info, nir_shader *nir)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef int_vec_type = lp_build_int_vec_type(gallivm, type);
+   LLVMTypeRef float_ptr_type =
+      LLVMPointerType(LLVMFloatTypeInContext(context), 0);
+   LLVMTypeRef args[5];
+   LLVMValueRef func, out_ptr, in_ptr, mask_ptr;
+   LLVMValueRef inputs[PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS];
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_build_tgsi_params params;
+   struct lp_build_mask_context mask;
+   unsigned i, c;
+
+   args[0] = LLVMPointerType(vec_type, 0);
+   args[1] = LLVMPointerType(vec_type, 0);
+   args[2] = LLVMPointerType(LLVMArrayType(float_ptr_type,
+                                           LP_MAX_TGSI_CONST_BUFFERS), 0);
+   args[3] = LLVMPointerType(LLVMArrayType(LLVMInt32TypeInContext(context),
+                                           LP_MAX_TGSI_CONST_BUFFERS), 0);
+   args[4] = LLVMPointerType(int_vec_type, 0);
+
+   func = LLVMAddFunction(gallivm->module, name,
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, ARRAY_SIZE(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   LLVMPositionBuilderAtEnd(builder,
+                            LLVMAppendBasicBlockInContext(context, func,
+                                                          "entry"));
+
+   out_ptr = LLVMGetParam(func, 0);
+   in_ptr = LLVMGetParam(func, 1);
+   mask_ptr = LLVMGetParam(func, 4);
+
+   for (i = 0; i < info->num_inputs; i++) {
+      for (c = 0; c < TGSI_NUM_CHANNELS; c++) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, i * 4 + c);
+
+         inputs[i][c] = LLVMBuildLoad(builder,
+                                      LLVMBuildGEP(builder, in_ptr,
+                                                   &index, 1, ""), "");
+      }
+   }
+
+   memset(outputs, 0, sizeof outputs);
+   memset(&system_values, 0, sizeof system_values);
+   memset(&params, 0, sizeof params);
+
+   lp_build_mask_begin(&mask, gallivm, type,
+                       LLVMBuildLoad(builder, mask_ptr, ""));
+
+   params.type = type;
+   params.mask = &mask;
+   params.consts_ptr = LLVMGetParam(func, 2);
+   params.const_sizes_ptr = LLVMGetParam(func, 3);
+   params.system_values = &system_values;
+   params.inputs = (const LLVMValueRef (*)[TGSI_NUM_CHANNELS]) inputs;
+   params.info = info;
+
+   if (nir)
+      lp_build_nir_soa(gallivm, nir, &params, outputs);
+   else
+      lp_build_tgsi_soa(gallivm, tokens, &params, outputs);
+
+   for (i = 0; i < info->num_outputs; i++) {
+      for (c = 0; c < TGSI_NUM_CHANNELS; c++) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, i * 4 + c);
+         LLVMValueRef val = outputs[i][c] ?
+            LLVMBuildLoad(builder, outputs[i][c], "") : LLVMConstNull(vec_type);
+
+         LLVMBuildStore(builder, val,
+                        LLVMBuildGEP(builder, out_ptr, &index, 1, ""));
+      }
+   }
+
+   LLVMBuildStore(builder, lp_build_mask_end(&mask), mask_ptr);
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+static float
+random_input(void)
+{
+   /* Non-negative, so that the conversions to unsigned are defined. */
+   return (rand() % 64) / 8.0f;
+}
+
+
+static boolean
+compare_results(const struct nir_test_shader *shader, unsigned length,
+                const float *ref, const float *res,
+                const int32_t *ref_mask, const int32_t *res_mask,
+                unsigned num_values)
+{
+   unsigned i, j;
+
+   for (j = 0; j < length; j++) {
+      if (ref_mask[j] != res_mask[j])
+         return FALSE;
+
+      /* The outputs of killed fragments don't matter. */
+      if (!ref_mask[j])
+         continue;
+
+      for (i = 0; i < num_values; i++) {
+         float a = ref[i * length + j];
+         float b = res[i * length + j];
+
+         if (!memcmp(&a, &b, sizeof a))
+            continue;
+
+         if (!shader->float_outputs ||
+             fabsf(a - b) > 1e-5f * MAX2(1.0f, fabsf(a)))
+            return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+static void
+dump_results(const char *what, unsigned length, const float *values,
+             const int32_t *mask, unsigned num_values)
+{
+   unsigned i, j;
+
+   printf("  %s:\n", what);
+   for (j = 0; j < length; j++) {
+      printf("    %s", mask[j] ? "   " : "(k)");
+      for (i = 0; i < num_values; i++) {
+         float val = values[i * length + j];
+         uint32_t bits;
+
+         memcpy(&bits, &val, sizeof bits);
+         printf(" %g (0x%08x)", val, bits);
+      }
+      printf("\n");
+   }
+}
+
+
+static void
+run_reference(nir_test_ref_t reference, unsigned length, const float *in,
+              const float consts[NUM_CONSTS][4], unsigned num_outputs,
+              float *ref)
+{
+   unsigned i, j, c;
+
+   for (j = 0; j < length; j++) {
+      float lane_in[NUM_INPUTS][4];
+      uint32_t lane_out[NUM_OUTPUTS][4];
+
+      for (i = 0; i < NUM_INPUTS; i++) {
+         for (c = 0; c < 4; c++)
+            lane_in[i][c] = in[(i * 4 + c) * length + j];
+      }
+
+      memset(lane_out, 0, sizeof lane_out);
+      reference(lane_out, lane_in, consts);
+
+      for (i = 0; i < num_outputs; i++) {
+         for (c = 0; c < 4; c++)
+            memcpy(&ref[(i * 4 + c) * length + j], &lane_out[i][c],
+                   sizeof lane_out[i][c]);
+      }
+   }
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_shader(unsigned verbose, FILE *fp, struct pipe_screen *screen,
+            const struct nir_test_shader *shader, unsigned n)
+{
+   struct lp_type type = lp_type_float_vec(32, lp_native_vector_width);
+   const unsigned length = type.length;
+   const unsigned num_in = NUM_INPUTS * 4;
+   unsigned num_out;
+   struct tgsi_token tokens[1024];
+   struct tgsi_shader_info info;
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   nir_shader *nir;
+   LLVMValueRef tgsi_func = NULL, nir_func;
+   nir_test_func_t run_tgsi = NULL, run_nir;
+   float *in, *ref, *res;
+   int32_t *ref_mask, *res_mask;
+   float consts[NUM_CONSTS][4];
+   const float *const_buffers[LP_MAX_TGSI_CONST_BUFFERS] = { consts[0] };
+   int num_consts[LP_MAX_TGSI_CONST_BUFFERS] = { NUM_CONSTS };
+   boolean success = TRUE;
+   unsigned i, j;
+
+   if (shader->build) {
+      nir_builder b;
+
+      nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT,
+                                     screen->get_compiler_options(screen,
+                                                                  PIPE_SHADER_IR_NIR,
+                                                                  PIPE_SHADER_FRAGMENT));
+      shader->build(&b);
+      nir = b.shader;
+
+      /* Only the counts of the TGSI info are read by the translator. */
+      memset(&info, 0, sizeof info);
+      info.num_inputs = nir->num_inputs;
+      info.num_outputs = nir->num_outputs;
+   } else {
+      if (!tgsi_text_translate(shader->text, tokens, ARRAY_SIZE(tokens))) {
+         printf("nir: %s: can't parse the shader: FAIL\n", shader->name);
+         return FALSE;
+      }
+      tgsi_scan_shader(tokens, &info);
+
+      nir = tgsi_to_nir(tokens, screen);
+   }
+   lp_build_nir_prepasses(nir);
+   num_out = info.num_outputs * 4;
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_module", context, NULL);
+
+   if (!shader->reference)
+      tgsi_func = add_nir_test(gallivm, type, "test_tgsi", tokens, &info,
+                               NULL);
+   nir_func = add_nir_test(gallivm, type, "test_nir", tokens, &info, nir);
+
+   gallivm_compile_module(gallivm);
+   if (tgsi_func)
+      run_tgsi = (nir_test_func_t) gallivm_jit_function(gallivm, tgsi_func);
+   run_nir = (nir_test_func_t) gallivm_jit_function(gallivm, nir_func);
+   gallivm_free_ir(gallivm);
+
+   in = align_malloc(num_in * length * sizeof *in, LP_MIN_VECTOR_ALIGN);
+   ref = align_malloc(num_out * length * sizeof *ref, LP_MIN_VECTOR_ALIGN);
+   res = align_malloc(num_out * length * sizeof *res, LP_MIN_VECTOR_ALIGN);
+   ref_mask = align_malloc(length * sizeof *ref_mask, LP_MIN_VECTOR_ALIGN);
+   res_mask = align_malloc(length * sizeof *res_mask, LP_MIN_VECTOR_ALIGN);
+
+   for (i = 0; i < n && success; i++) {
+      for (j = 0; j < num_in * length; j++)
+         in[j] = random_input();
+      for (j = 0; j < NUM_CONSTS * 4; j++)
+         consts[j / 4][j % 4] = random_input() - 4.0f;
+
+      /* The shaders must only write to the outputs and the mask. */
+      memset(ref, 0, num_out * length * sizeof *ref);
+      memset(res, 0, num_out * length * sizeof *res);
+      memset(ref_mask, 0xff, length * sizeof *ref_mask);
+      memset(res_mask, 0xff, length * sizeof *res_mask);
+
+      if (run_tgsi)
+         run_tgsi(ref, in, const_buffers, num_consts, ref_mask);
+      else
+         run_reference(shader->reference, length, in,
+                       (const float (*)[4]) consts, info.num_outputs, ref);
+      run_nir(res, in, const_buffers, num_consts, res_mask);
+
+      success = compare_results(shader, length, ref, res, ref_mask, res_mask,
+                                num_out);
+   }
+
+   if (!success) {
+      dump_results("inputs", length, in, res_mask, num_in);
+      dump_results(run_tgsi ? "TGSI" : "reference", length, ref, ref_mask,
+                   num_out);
+      dump_results("NIR", length, res, res_mask, num_out);
+   }
+
+   if (verbose || !success)
+      printf("nir: %s: %s\n", shader->name, success ? "PASS" : "FAIL");
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\n", success ? "pass" : "fail", shader->name);
+      fflush(fp);
+   }
+
+   align_free(in);
+   align_free(ref);
+   align_free(res);
+   align_free(ref_mask);
+   align_free(res_mask);
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+   ralloc_free(nir);
+
+   return success;
+}
+
+
+static boolean
+test_shaders(unsigned verbose, FILE *fp, unsigned n)
+{
+   struct sw_winsys winsys;
+   struct pipe_screen *screen;
+   boolean success = TRUE;
+   unsigned i;
+
+   /* The screen gives tgsi_to_nir the options and caps of llvmpipe. */
+   memset(&winsys, 0, sizeof winsys);
+   screen = llvmpipe_create_screen(&winsys);
+   if (!screen) {
+      printf("nir: can't create the screen: FAIL\n");
+      return FALSE;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(shaders); i++) {
+      if (!test_shader(verbose, fp, screen, &shaders[i], n))
+         success = FALSE;
+   }
+
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_shaders(verbose, fp, 64);
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_shaders(verbose, fp, MAX2(n / ARRAY_SIZE(shaders), 1));
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_shaders(verbose, fp, 1);
+}
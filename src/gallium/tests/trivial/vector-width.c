@@ -0,0 +1,527 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Compares llvmpipe fill rate and texturing rate across SIMD vector widths,
+ * e.g. AVX2 (256) against AVX-512 (512).  Each width is run in a child
+ * process with LP_NATIVE_VECTOR_WIDTH set, since gallivm reads it once per
+ * process, and renders two workloads:
+ *
+ *  - fill: layers of alpha blended, screen-covering, color interpolated
+ *    triangles;
+ *  - texture: the same layers with a bilinearly filtered texture.
+ *
+ * The rasterizer runs on one thread unless told otherwise, so the numbers
+ * are per core.  The default widths are 128, 256 and, if the CPU has
+ * AVX-512, 512.  Widths llvmpipe falls back from, e.g. 512 on CPUs gallivm
+ * doesn't use AVX-512 on, are reported as not available.
+ *
+ * Usage: vector-width [-t threads] [-f frames] [width...]
+ */
+
+#define WIDTH 1024
+#define HEIGHT 1024
+#define LAYERS 8
+#define TEX_SIZE 256
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* constant state object helper */
+#include "cso_cache/cso_context.h"
+
+/* u_sampler_view_default_template */
+#include "util/u_sampler.h"
+/* util_draw_vertex_buffer helper */
+#include "util/u_draw_quad.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* util_make_[fragment|vertex]_passthrough_shader */
+#include "util/u_simple_shaders.h"
+/* util_cpu_detect */
+#include "util/u_cpu_detect.h"
+/* os_time_get_nano */
+#include "util/os_time.h"
+/* to get a software pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+enum workload
+{
+	WORKLOAD_FILL,
+	WORKLOAD_TEXTURE,
+	NUM_WORKLOADS
+};
+
+static const char *workload_names[NUM_WORKLOADS] = { "fill", "texture" };
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_sampler_state sampler;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct pipe_vertex_element velem[2];
+
+	void *vs_color, *vs_tex;
+	void *fs_color, *fs_tex;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+	struct pipe_resource *tex;
+	struct pipe_sampler_view *view;
+};
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	float vertices[LAYERS * 6][2][4];
+	int ret;
+	unsigned i;
+
+	/* llvmpipe, unless GALLIUM_DRIVER says otherwise */
+	ret = pipe_loader_sw_probe_null(&p->dev);
+	assert(ret);
+	(void)ret;
+
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe, 0);
+
+	p->clear_color.f[0] = 0.3;
+	p->clear_color.f[1] = 0.1;
+	p->clear_color.f[2] = 0.3;
+	p->clear_color.f[3] = 1.0;
+
+	/* two triangles covering the whole target per layer; the second
+	 * attribute is a color for fill and texture coordinates for texture,
+	 * which repeat the texture a few times across the target */
+	for (i = 0; i < LAYERS; i++) {
+		static const float pos[6][2] = {
+			{ -1.0f, -1.0f }, { 1.0f, -1.0f }, { -1.0f, 1.0f },
+			{ -1.0f, 1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }
+		};
+		unsigned v;
+
+		for (v = 0; v < 6; v++) {
+			float *vert = vertices[i * 6 + v][0];
+			float *attr = vertices[i * 6 + v][1];
+
+			vert[0] = pos[v][0];
+			vert[1] = pos[v][1];
+			vert[2] = 0.0f;
+			vert[3] = 1.0f;
+
+			attr[0] = (pos[v][0] * 0.5f + 0.5f) * (1.5f + i * 0.25f);
+			attr[1] = (pos[v][1] * 0.5f + 0.5f) * (1.5f + i * 0.25f);
+			attr[2] = (float)i / LAYERS;
+			attr[3] = 0.5f;
+		}
+	}
+
+	p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+				     PIPE_USAGE_DEFAULT, sizeof(vertices));
+	pipe_buffer_write(p->pipe, p->vbuf, 0, sizeof(vertices), vertices);
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* sampler texture, a checkerboard of gradients */
+	{
+		uint32_t *ptr;
+		struct pipe_transfer *t;
+		struct pipe_resource t_tmplt;
+		struct pipe_sampler_view v_tmplt;
+		struct pipe_box box;
+		unsigned x, y;
+
+		memset(&t_tmplt, 0, sizeof(t_tmplt));
+		t_tmplt.target = PIPE_TEXTURE_2D;
+		t_tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+		t_tmplt.width0 = TEX_SIZE;
+		t_tmplt.height0 = TEX_SIZE;
+		t_tmplt.depth0 = 1;
+		t_tmplt.array_size = 1;
+		t_tmplt.last_level = 0;
+		t_tmplt.bind = PIPE_BIND_SAMPLER_VIEW;
+
+		p->tex = p->screen->resource_create(p->screen, &t_tmplt);
+
+		u_box_2d(0, 0, TEX_SIZE, TEX_SIZE, &box);
+
+		ptr = p->pipe->transfer_map(p->pipe, p->tex, 0, PIPE_TRANSFER_WRITE, &box, &t);
+		for (y = 0; y < TEX_SIZE; y++) {
+			uint32_t *row = (uint32_t *)((uint8_t *)ptr + y * t->stride);
+
+			for (x = 0; x < TEX_SIZE; x++)
+				row[x] = 0xff000000 | (x << 16) | (y << 8) |
+				         (((x ^ y) & 32) ? 0xff : 0);
+		}
+		p->pipe->transfer_unmap(p->pipe, t);
+
+		u_sampler_view_default_template(&v_tmplt, p->tex, p->tex->format);
+
+		p->view = p->pipe->create_sampler_view(p->pipe, p->tex, &v_tmplt);
+	}
+
+	/* alpha blending, so every layer has to be shaded */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].blend_enable = 1;
+	p->blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+	p->blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+	p->blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+	p->blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+	p->blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+	p->blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ZERO;
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip_near = 1;
+	p->rasterizer.depth_clip_far = 1;
+
+	memset(&p->sampler, 0, sizeof(p->sampler));
+	p->sampler.wrap_s = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.wrap_t = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.wrap_r = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+	p->sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+	p->sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+	p->sampler.normalized_coords = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	p->viewport.scale[0] = WIDTH / 2.0f;
+	p->viewport.scale[1] = HEIGHT / 2.0f;
+	p->viewport.scale[2] = 0.5f;
+	p->viewport.translate[0] = WIDTH / 2.0f;
+	p->viewport.translate[1] = HEIGHT / 2.0f;
+	p->viewport.translate[2] = 0.5f;
+
+	memset(p->velem, 0, sizeof(p->velem));
+	p->velem[0].src_offset = 0 * 4 * sizeof(float);
+	p->velem[0].vertex_buffer_index = 0;
+	p->velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	p->velem[1].src_offset = 1 * 4 * sizeof(float);
+	p->velem[1].vertex_buffer_index = 0;
+	p->velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	{
+		const enum tgsi_semantic color_names[] =
+			{ TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR };
+		const enum tgsi_semantic tex_names[] =
+			{ TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_GENERIC };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs_color = util_make_vertex_passthrough_shader(p->pipe, 2, color_names, semantic_indexes, FALSE);
+		p->vs_tex = util_make_vertex_passthrough_shader(p->pipe, 2, tex_names, semantic_indexes, FALSE);
+	}
+
+	p->fs_color = util_make_fragment_passthrough_shader(p->pipe,
+		    TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, TRUE);
+	p->fs_tex = util_make_fragment_tex_shader(p->pipe, TGSI_TEXTURE_2D,
+	                                          TGSI_INTERPOLATE_LINEAR,
+	                                          TGSI_RETURN_TYPE_FLOAT,
+	                                          TGSI_RETURN_TYPE_FLOAT, false,
+	                                          false);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs_color);
+	p->pipe->delete_vs_state(p->pipe, p->vs_tex);
+	p->pipe->delete_fs_state(p->pipe, p->fs_color);
+	p->pipe->delete_fs_state(p->pipe, p->fs_tex);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_sampler_view_reference(&p->view, NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->tex, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw_frame(struct program *p, enum workload w)
+{
+	const struct pipe_sampler_state *samplers[] = {&p->sampler};
+
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, &p->clear_color, 0, 0);
+
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	if (w == WORKLOAD_TEXTURE) {
+		cso_set_samplers(p->cso, PIPE_SHADER_FRAGMENT, 1, samplers);
+		cso_set_sampler_views(p->cso, PIPE_SHADER_FRAGMENT, 1, &p->view);
+		cso_set_fragment_shader_handle(p->cso, p->fs_tex);
+		cso_set_vertex_shader_handle(p->cso, p->vs_tex);
+	} else {
+		cso_set_fragment_shader_handle(p->cso, p->fs_color);
+		cso_set_vertex_shader_handle(p->cso, p->vs_color);
+	}
+
+	cso_set_vertex_elements(p->cso, 2, p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+	                        p->vbuf, 0, 0,
+	                        PIPE_PRIM_TRIANGLES,
+	                        LAYERS * 6, /* verts */
+	                        2);         /* attribs/vert */
+}
+
+static void finish(struct program *p)
+{
+	struct pipe_fence_handle *fence = NULL;
+
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+/* Fills mpix with the megapixels per second of each workload.  Returns
+ * false if the driver doesn't run at the given vector width, e.g. because
+ * gallivm doesn't use AVX-512 on the CPU.
+ */
+static bool run(unsigned width, unsigned frames, double mpix[NUM_WORKLOADS])
+{
+	struct program *p = CALLOC_STRUCT(program);
+	char bits[32];
+	unsigned w, i;
+
+	init_prog(p);
+
+	/* llvmpipe names the vector width it settled on */
+	snprintf(bits, sizeof(bits), ", %u bits)", width);
+	if (!strstr(p->screen->get_name(p->screen), bits)) {
+		close_prog(p);
+		return false;
+	}
+
+	for (w = 0; w < NUM_WORKLOADS; w++) {
+		int64_t start, end;
+
+		/* warm up: compile shaders, fault in the target */
+		draw_frame(p, w);
+		finish(p);
+
+		start = os_time_get_nano();
+		for (i = 0; i < frames; i++) {
+			draw_frame(p, w);
+			p->pipe->flush(p->pipe, NULL, 0);
+		}
+		finish(p);
+		end = os_time_get_nano();
+
+		mpix[w] = (double)frames * WIDTH * HEIGHT * LAYERS /
+		          ((end - start) / 1e3);
+	}
+
+	close_prog(p);
+	return true;
+}
+
+enum run_result
+{
+	RUN_OK,
+	RUN_FAILED,
+	RUN_UNAVAILABLE,
+};
+
+/* Runs the workloads in a child process with the given vector width. */
+static enum run_result run_width(unsigned width, unsigned frames,
+                                 double mpix[NUM_WORKLOADS])
+{
+	int fds[2], status;
+	pid_t pid;
+	bool ok;
+
+	if (pipe(fds))
+		return RUN_FAILED;
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return RUN_FAILED;
+	}
+
+	if (pid == 0) {
+		char value[16];
+
+		/* read by gallivm when the screen is created */
+		snprintf(value, sizeof(value), "%u", width);
+		setenv("LP_NATIVE_VECTOR_WIDTH", value, 1);
+
+		close(fds[0]);
+		if (!run(width, frames, mpix))
+			_exit(RUN_UNAVAILABLE);
+		ok = write(fds[1], mpix, NUM_WORKLOADS * sizeof(double)) ==
+		     NUM_WORKLOADS * sizeof(double);
+		close(fds[1]);
+		_exit(ok ? RUN_OK : RUN_FAILED);
+	}
+
+	close(fds[1]);
+	ok = read(fds[0], mpix, NUM_WORKLOADS * sizeof(double)) ==
+	     NUM_WORKLOADS * sizeof(double);
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return RUN_FAILED;
+	if (WEXITSTATUS(status) != RUN_OK)
+		return WEXITSTATUS(status) == RUN_UNAVAILABLE ? RUN_UNAVAILABLE
+		                                             : RUN_FAILED;
+
+	return ok ? RUN_OK : RUN_FAILED;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned widths[8], num_widths = 0;
+	unsigned frames = 20;
+	const char *threads = "1";
+	double base[NUM_WORKLOADS] = {0};
+	unsigned i, w;
+	int arg;
+
+	for (arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-t") && arg + 1 < argc)
+			threads = argv[++arg];
+		else if (!strcmp(argv[arg], "-f") && arg + 1 < argc) {
+			frames = atoi(argv[++arg]);
+			frames = MAX2(frames, 1);
+		}
+		else if (atoi(argv[arg]) > 0 && num_widths < ARRAY_SIZE(widths))
+			widths[num_widths++] = atoi(argv[arg]);
+		else {
+			fprintf(stderr, "usage: %s [-t threads] [-f frames] "
+			        "[width...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!num_widths) {
+		util_cpu_detect();
+
+		widths[num_widths++] = 128;
+		widths[num_widths++] = 256;
+		if (util_cpu_caps.has_avx512f)
+			widths[num_widths++] = 512;
+	}
+
+	/* read by llvmpipe when the screen is created */
+	setenv("LP_NUM_THREADS", threads, 1);
+
+	printf("%6s", "width");
+	for (w = 0; w < NUM_WORKLOADS; w++)
+		printf(" %10s Mpix/s %7s", workload_names[w], "speedup");
+	printf("\n");
+
+	for (i = 0; i < num_widths; i++) {
+		double mpix[NUM_WORKLOADS];
+
+		switch (run_width(widths[i], frames, mpix)) {
+		case RUN_OK:
+			break;
+		case RUN_UNAVAILABLE:
+			printf("%6u not available\n", widths[i]);
+			continue;
+		default:
+			fprintf(stderr, "width %u failed\n", widths[i]);
+			return 1;
+		}
+
+		printf("%6u", widths[i]);
+		for (w = 0; w < NUM_WORKLOADS; w++) {
+			/* speedups are relative to the first width that ran */
+			if (!base[w])
+				base[w] = mpix[w];
+			printf(" %17.1f %6.2fx", mpix[w], mpix[w] / base[w]);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
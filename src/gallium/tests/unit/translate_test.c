@@ -29,6 +29,7 @@
 #include "util/u_format.h"
 #include "util/u_half.h"
 #include "util/u_cpu_detect.h"
+#include "util/os_time.h"
 #include "rtasm/rtasm_cpu.h"
 
 /* don't use this for serious use */
@@ -46,6 +47,129 @@ static double rand_double()
    return v;
 }
 
+/* Vertex layouts timed by the bench mode: interleaved in one input buffer,
+ * packed in the output vertex.
+ */
+static const struct {
+   const char *name;
+   unsigned nr_elements;
+   enum pipe_format input[3];
+   enum pipe_format output[3];
+} bench_layouts[] = {
+   { "f3 -> f4", 1,
+     { PIPE_FORMAT_R32G32B32_FLOAT },
+     { PIPE_FORMAT_R32G32B32A32_FLOAT } },
+   { "f4 -> f4", 1,
+     { PIPE_FORMAT_R32G32B32A32_FLOAT },
+     { PIPE_FORMAT_R32G32B32A32_FLOAT } },
+   { "unorm8x4 -> f4", 1,
+     { PIPE_FORMAT_R8G8B8A8_UNORM },
+     { PIPE_FORMAT_R32G32B32A32_FLOAT } },
+   { "snorm16x4 -> f4", 1,
+     { PIPE_FORMAT_R16G16B16A16_SNORM },
+     { PIPE_FORMAT_R32G32B32A32_FLOAT } },
+   { "half2 -> f2", 1,
+     { PIPE_FORMAT_R16G16_FLOAT },
+     { PIPE_FORMAT_R32G32_FLOAT } },
+   { "f4 -> unorm8x4", 1,
+     { PIPE_FORMAT_R32G32B32A32_FLOAT },
+     { PIPE_FORMAT_R8G8B8A8_UNORM } },
+   { "f3+snorm16x4+unorm8x4 -> 3 x f4", 3,
+     { PIPE_FORMAT_R32G32B32_FLOAT, PIPE_FORMAT_R16G16B16A16_SNORM,
+       PIPE_FORMAT_R8G8B8A8_UNORM },
+     { PIPE_FORMAT_R32G32B32A32_FLOAT, PIPE_FORMAT_R32G32B32A32_FLOAT,
+       PIPE_FORMAT_R32G32B32A32_FLOAT } },
+};
+
+/* Returns millions of vertices translated per second. */
+static double
+bench_run(struct translate *translate, const void *input,
+          unsigned input_stride, unsigned count, void *output)
+{
+   const unsigned iterations = 200;
+   int64_t start, end;
+   unsigned i;
+
+   translate->set_buffer(translate, 0, input, input_stride, count - 1);
+
+   /* warm up the caches */
+   translate->run(translate, 0, count, 0, 0, output);
+
+   start = os_time_get_nano();
+   for (i = 0; i < iterations; i++)
+      translate->run(translate, 0, count, 0, 0, output);
+   end = os_time_get_nano();
+
+   return (double)count * iterations / ((end - start) / 1e3);
+}
+
+/* Times translate_generic and the given implementation on the same vertex
+ * layouts.
+ */
+static int
+bench(struct translate *(*create_fn)(const struct translate_key *key),
+      const char *name)
+{
+   const unsigned count = 4096;
+   unsigned char *input = align_malloc(count * 64, 64);
+   unsigned char *output = align_malloc(count * 64, 64);
+   unsigned i, j;
+
+   /* in range for every input format, including half floats */
+   for (i = 0; i < count * 64; ++i)
+      input[i] = rand() & 0x3f;
+
+   printf("millions of vertices per second, %u vertices per run\n", count);
+   printf("%-34s %14s %14s %8s\n", "layout", "generic", name, "speedup");
+
+   for (i = 0; i < ARRAY_SIZE(bench_layouts); ++i)
+   {
+      struct translate_key key;
+      struct translate *generic, *translate;
+      unsigned input_stride = 0;
+      double generic_rate, rate;
+
+      memset(&key, 0, sizeof key);
+      key.nr_elements = bench_layouts[i].nr_elements;
+      for (j = 0; j < key.nr_elements; ++j)
+      {
+         struct translate_element *element = &key.element[j];
+
+         element->type = TRANSLATE_ELEMENT_NORMAL;
+         element->input_format = bench_layouts[i].input[j];
+         element->output_format = bench_layouts[i].output[j];
+         element->input_buffer = 0;
+         element->input_offset = input_stride;
+         element->output_offset = key.output_stride;
+         input_stride += util_format_get_blocksize(element->input_format);
+         key.output_stride += util_format_get_blocksize(element->output_format);
+      }
+
+      generic = translate_generic_create(&key);
+      translate = create_fn(&key);
+      if (!generic)
+         continue;
+
+      generic_rate = bench_run(generic, input, input_stride, count, output);
+      if (translate)
+      {
+         rate = bench_run(translate, input, input_stride, count, output);
+         printf("%-34s %14.1f %14.1f %7.2fx\n", bench_layouts[i].name,
+                generic_rate, rate, rate / generic_rate);
+         translate->release(translate);
+      }
+      else
+         printf("%-34s %14.1f %14s\n", bench_layouts[i].name,
+                generic_rate, "n/a");
+
+      generic->release(generic);
+   }
+
+   align_free(input);
+   align_free(output);
+   return 0;
+}
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
@@ -65,11 +189,19 @@ int main(int argc, char** argv)
    unsigned passed = 0;
    unsigned total = 0;
    const float error = 0.03125;
+   boolean do_bench = FALSE;
 
    create_fn = 0;
 
    util_cpu_detect();
 
+   if (argc > 1 && !strcmp(argv[1], "bench"))
+   {
+      do_bench = TRUE;
+      argv++;
+      argc--;
+   }
+
    if (argc <= 1 ||
        !strcmp(argv[1], "default") )
       create_fn = translate_create;
@@ -77,6 +209,8 @@ int main(int argc, char** argv)
       create_fn = translate_generic_create;
    else if (!strcmp(argv[1], "x86"))
       create_fn = translate_sse2_create;
+   else if (!strcmp(argv[1], "neon"))
+      create_fn = translate_neon_create;
    else if (!strcmp(argv[1], "nosse"))
    {
       util_cpu_caps.has_sse = 0;
@@ -130,10 +264,13 @@ int main(int argc, char** argv)
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [default|generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [bench] [default|generic|x86|neon|nosse|sse|sse2|sse3|sse4.1]\n");
       return 2;
    }
 
+   if (do_bench)
+      return bench(create_fn, argc > 1 ? argv[1] : "default");
+
    for (i = 1; i < ARRAY_SIZE(buffer); ++i)
       buffer[i] = align_malloc(buffer_size, 4096);
 
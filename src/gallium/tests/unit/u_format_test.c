@@ -28,6 +28,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <float.h>
 
 #include "util/u_half.h"
@@ -709,6 +710,101 @@ test_format_norm_flags(const struct util_format_description *format_desc)
    return success;
 }
 
+/* The pack and unpack functions convert the leading pixels of a row with
+ * SIMD code when they can, so check that whole rows give the same results
+ * as converting each pixel alone.
+ */
+static boolean
+test_format_rows(const struct util_format_description *format_desc)
+{
+   const unsigned width = 37;
+   const unsigned size = format_desc->block.bits / 8;
+   uint8_t packed[37 * UTIL_FORMAT_MAX_PACKED_BYTES];
+   uint8_t row[37 * UTIL_FORMAT_MAX_PACKED_BYTES];
+   uint8_t pixel[37 * UTIL_FORMAT_MAX_PACKED_BYTES];
+   float float_row[37][4], float_pixel[37][4];
+   uint8_t unorm_row[37][4], unorm_pixel[37][4];
+   unsigned seed = format_desc->format;
+   unsigned i, x;
+   boolean success = TRUE;
+
+   if (format_desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       format_desc->block.width != 1 || format_desc->block.height != 1 ||
+       format_desc->block.bits % 8)
+      return TRUE;
+
+   for (i = 0; i < width * size; i++) {
+      seed = seed * 1103515245 + 12345;
+      packed[i] = seed >> 16;
+   }
+
+   if (format_desc->unpack_rgba_8unorm) {
+      format_desc->unpack_rgba_8unorm(&unorm_pixel[0][0], 0,
+                                      packed, 0, width, 1);
+      memcpy(unorm_row, unorm_pixel, sizeof unorm_row);
+      for (x = 0; x < width; x++)
+         format_desc->unpack_rgba_8unorm(unorm_pixel[x], 0,
+                                         packed + x * size, 0, 1, 1);
+      if (memcmp(unorm_row, unorm_pixel, sizeof unorm_row)) {
+         printf("FAILED: unpack_rgba_8unorm rows differ from pixels\n");
+         success = FALSE;
+      }
+   }
+
+   if (format_desc->unpack_rgba_float) {
+      format_desc->unpack_rgba_float(&float_pixel[0][0], 0,
+                                     packed, 0, width, 1);
+      memcpy(float_row, float_pixel, sizeof float_row);
+      for (x = 0; x < width; x++)
+         format_desc->unpack_rgba_float(float_pixel[x], 0,
+                                        packed + x * size, 0, 1, 1);
+      if (memcmp(float_row, float_pixel, sizeof float_row)) {
+         printf("FAILED: unpack_rgba_float rows differ from pixels\n");
+         success = FALSE;
+      }
+   }
+
+   for (x = 0; x < width; x++) {
+      for (i = 0; i < 4; i++) {
+         seed = seed * 1103515245 + 12345;
+         unorm_row[x][i] = seed >> 16;
+         float_row[x][i] = (float)((seed >> 8) & 0xffff) / 32768.0f - 0.5f;
+      }
+   }
+   float_row[3][0] = -FLT_MAX;
+   float_row[3][1] = FLT_MAX;
+   float_row[5][2] = 1.0f;
+   float_row[5][3] = 0.0f;
+
+   if (format_desc->pack_rgba_8unorm) {
+      memset(row, 0, sizeof row);
+      memset(pixel, 0, sizeof pixel);
+      format_desc->pack_rgba_8unorm(row, 0, &unorm_row[0][0], 0, width, 1);
+      for (x = 0; x < width; x++)
+         format_desc->pack_rgba_8unorm(pixel + x * size, 0,
+                                       unorm_row[x], 0, 1, 1);
+      if (memcmp(row, pixel, width * size)) {
+         printf("FAILED: pack_rgba_8unorm rows differ from pixels\n");
+         success = FALSE;
+      }
+   }
+
+   if (format_desc->pack_rgba_float) {
+      memset(row, 0, sizeof row);
+      memset(pixel, 0, sizeof pixel);
+      format_desc->pack_rgba_float(row, 0, &float_row[0][0], 0, width, 1);
+      for (x = 0; x < width; x++)
+         format_desc->pack_rgba_float(pixel + x * size, 0,
+                                      float_row[x], 0, 1, 1);
+      if (memcmp(row, pixel, width * size)) {
+         printf("FAILED: pack_rgba_float rows differ from pixels\n");
+         success = FALSE;
+      }
+   }
+
+   return success;
+}
+
 typedef boolean
 (*test_func_t)(const struct util_format_description *format_desc,
                const struct util_format_test_case *test);
@@ -800,6 +896,7 @@ test_all(void)
       TEST_ONE_FUNC(pack_s_8uint);
 
       TEST_FORMAT_METADATA(norm_flags);
+      TEST_FORMAT_METADATA(rows);
 
 #     undef TEST_ONE_FUNC
 #     undef TEST_ONE_FORMAT
@@ -287,7 +287,7 @@ class PrintCode(gl_XML.gl_print_base):
             out('switch (cmd_base->cmd_id) {')
             for func in api.functionIterateAll():
                 flavor = func.marshal_flavor()
-                if flavor in ('skip', 'sync'):
+                if flavor in ('skip', 'sync', 'custom_sync'):
                     continue
                 out('case DISPATCH_CMD_{0}:'.format(func.name))
                 with indent():
@@ -332,7 +332,7 @@ class PrintCode(gl_XML.gl_print_base):
         async_funcs = []
         for func in api.functionIterateAll():
             flavor = func.marshal_flavor()
-            if flavor in ('skip', 'custom'):
+            if flavor in ('skip', 'custom', 'custom_sync'):
                 continue
             elif flavor == 'async':
                 self.print_async_body(func)
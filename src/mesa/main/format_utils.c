@@ -27,6 +27,7 @@
 #include "glformats.h"
 #include "format_pack.h"
 #include "format_unpack.h"
+#include "util/format_simd.h"
 
 const mesa_array_format RGBA32_FLOAT =
    MESA_ARRAY_FORMAT(4, 1, 1, 1, 4, 0, 1, 2, 3);
@@ -56,6 +57,51 @@ invert_swizzle(uint8_t dst[4], const uint8_t src[4])
             dst[i] = j;
 }
 
+/**
+ * Computes the swizzle that util/format_simd.h needs to unpack a row of
+ * \p format to RGBA, or to pack RGBA to it if \p pack is set, when its pixels
+ * are arrays of linear 8-bit unorm channels.
+ *
+ * \return the number of channels of the format, or 0 if the SIMD paths
+ *         don't handle it.
+ */
+static int
+get_unorm8_simd_swizzle(mesa_format format, mesa_array_format array_format,
+                        bool pack, uint8_t swizzle[4])
+{
+   uint8_t format2rgba[4];
+   int i, num_channels;
+
+   if (!array_format ||
+       _mesa_array_format_get_datatype(array_format) !=
+       MESA_ARRAY_FORMAT_TYPE_UBYTE ||
+       !_mesa_array_format_is_normalized(array_format) ||
+       _mesa_is_format_srgb(format))
+      return 0;
+
+   num_channels = _mesa_array_format_get_num_channels(array_format);
+   _mesa_array_format_get_swizzle(array_format, format2rgba);
+
+   if (!pack) {
+      memcpy(swizzle, format2rgba, 4);
+      return num_channels;
+   }
+
+   /* The pack functions write zeros to the padding channels of packed
+    * formats, like MESA_FORMAT_R8G8B8X8_UNORM.
+    */
+   invert_swizzle(swizzle, format2rgba);
+   for (i = 0; i < num_channels; i++) {
+      if (swizzle[i] == MESA_FORMAT_SWIZZLE_NONE) {
+         if (_mesa_get_format_layout(format) != MESA_FORMAT_LAYOUT_PACKED)
+            return 0;
+         swizzle[i] = MESA_FORMAT_SWIZZLE_ZERO;
+      }
+   }
+
+   return num_channels;
+}
+
 /* Takes a src to RGBA swizzle and applies a rebase swizzle to it. This
  * is used when we need to rebase a format to match a different
  * base internal format.
@@ -190,6 +236,9 @@ convert_ubyte_rgba_to_bgra(size_t width, size_t height,
                            const uint8_t *src, size_t src_stride,
                            uint8_t *dst, size_t dst_stride)
 {
+   /* The words below hold the pixels in this order on little-endian only. */
+   static const uint8_t rgba2bgra[4] = { 2, 1, 0, 3 };
+   const bool simd = _mesa_little_endian();
    int row;
 
    if (sizeof(void *) == 8 &&
@@ -203,8 +252,13 @@ convert_ubyte_rgba_to_bgra(size_t width, size_t height,
       for (row = 0; row < height; row++) {
          const GLuint64 *s = (const GLuint64 *) src;
          GLuint64 *d = (GLuint64 *) dst;
-         int i;
-         for (i = 0; i < width/2; i++) {
+         int i = 0;
+
+         /* The SIMD path converts an even number of pixels. */
+         if (simd)
+            i = util_format_simd_swizzle_ubyte(dst, 4, src, 4, rgba2bgra,
+                                               0xff, width) / 2;
+         for (; i < width/2; i++) {
             d[i] = ( (s[i] & 0xff00ff00ff00ff00) |
                     ((s[i] &       0xff000000ff) << 16) |
                     ((s[i] &   0xff000000ff0000) >> 16));
@@ -224,8 +278,12 @@ convert_ubyte_rgba_to_bgra(size_t width, size_t height,
       for (row = 0; row < height; row++) {
          const GLuint *s = (const GLuint *) src;
          GLuint *d = (GLuint *) dst;
-         int i;
-         for (i = 0; i < width; i++) {
+         int i = 0;
+
+         if (simd)
+            i = util_format_simd_swizzle_ubyte(dst, 4, src, 4, rgba2bgra,
+                                               0xff, width);
+         for (; i < width; i++) {
             d[i] = ( (s[i] & 0xff00ff00) |
                     ((s[i] &       0xff) << 16) |
                     ((s[i] &   0xff0000) >> 16));
@@ -281,8 +339,10 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
    uint8_t (*tmp_ubyte)[4];
    float (*tmp_float)[4];
    uint32_t (*tmp_uint)[4];
+   uint8_t simd_swizzle[4];
+   int simd_channels;
    int bits;
-   size_t row;
+   size_t row, done;
 
    if (_mesa_format_is_mesa_array_format(src_format)) {
       src_format_is_mesa_array_format = true;
@@ -329,10 +389,23 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
 
       /* Handle the cases where we can directly unpack */
       if (!src_format_is_mesa_array_format) {
+         /* Rows of 8-bit unorm formats start with the SIMD paths, and leave
+          * the remaining pixels to the unpack functions.
+          */
+         simd_channels = get_unorm8_simd_swizzle(src_format, src_array_format,
+                                                 false, simd_swizzle);
+
          if (dst_array_format == RGBA32_FLOAT) {
             for (row = 0; row < height; ++row) {
-               _mesa_unpack_rgba_row(src_format, width,
-                                     src, (float (*)[4])dst);
+               done = 0;
+               if (simd_channels) {
+                  done = util_format_simd_unorm8_to_float((float *)dst, 4,
+                                                          src, simd_channels,
+                                                          simd_swizzle, width);
+               }
+               _mesa_unpack_rgba_row(src_format, width - done,
+                                     src + done * simd_channels,
+                                     (float (*)[4])dst + done);
                src += src_stride;
                dst += dst_stride;
             }
@@ -340,8 +413,16 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
          } else if (dst_array_format == RGBA8_UBYTE) {
             assert(!_mesa_is_format_integer_color(src_format));
             for (row = 0; row < height; ++row) {
-               _mesa_unpack_ubyte_rgba_row(src_format, width,
-                                           src, (uint8_t (*)[4])dst);
+               done = 0;
+               if (simd_channels) {
+                  done = util_format_simd_swizzle_ubyte(dst, 4,
+                                                        src, simd_channels,
+                                                        simd_swizzle, 0xff,
+                                                        width);
+               }
+               _mesa_unpack_ubyte_rgba_row(src_format, width - done,
+                                           src + done * simd_channels,
+                                           (uint8_t (*)[4])dst + done);
                src += src_stride;
                dst += dst_stride;
             }
@@ -361,10 +442,20 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
 
       /* Handle the cases where we can directly pack */
       if (!dst_format_is_mesa_array_format) {
+         simd_channels = get_unorm8_simd_swizzle(dst_format, dst_array_format,
+                                                 true, simd_swizzle);
+
          if (src_array_format == RGBA32_FLOAT) {
             for (row = 0; row < height; ++row) {
-               _mesa_pack_float_rgba_row(dst_format, width,
-                                         (const float (*)[4])src, dst);
+               done = 0;
+               if (simd_channels) {
+                  done = util_format_simd_float_to_unorm8(dst, simd_channels,
+                                                          (const float *)src, 4,
+                                                          simd_swizzle, width);
+               }
+               _mesa_pack_float_rgba_row(dst_format, width - done,
+                                         (const float (*)[4])src + done,
+                                         dst + done * simd_channels);
                src += src_stride;
                dst += dst_stride;
             }
@@ -378,8 +469,16 @@ _mesa_format_convert(void *void_dst, uint32_t dst_format, size_t dst_stride,
             }
             else {
                for (row = 0; row < height; ++row) {
-                  _mesa_pack_ubyte_rgba_row(dst_format, width,
-                                            (const uint8_t (*)[4])src, dst);
+                  done = 0;
+                  if (simd_channels) {
+                     done = util_format_simd_swizzle_ubyte(dst, simd_channels,
+                                                           src, 4,
+                                                           simd_swizzle, 0xff,
+                                                           width);
+                  }
+                  _mesa_pack_ubyte_rgba_row(dst_format, width - done,
+                                            (const uint8_t (*)[4])src + done,
+                                            dst + done * simd_channels);
                   src += src_stride;
                   dst += dst_stride;
                }
@@ -792,6 +891,65 @@ swizzle_convert_try_memcpy(void *dst,
    return true;
 }
 
+/**
+ * Converts the leading pixels with the SIMD paths of util/format_simd.h
+ *
+ * They handle the conversions between 8-bit channels, between floats and
+ * 8-bit unorm channels, and between half floats and floats without swizzle.
+ *
+ * \return  the number of pixels converted
+ */
+static int
+swizzle_convert_try_simd(void *dst,
+                         enum mesa_array_format_datatype dst_type,
+                         int num_dst_channels,
+                         const void *src,
+                         enum mesa_array_format_datatype src_type,
+                         int num_src_channels,
+                         const uint8_t swizzle[4], bool normalized, int count)
+{
+   int i;
+
+   if (dst_type == MESA_ARRAY_FORMAT_TYPE_UBYTE &&
+       src_type == MESA_ARRAY_FORMAT_TYPE_UBYTE)
+      return util_format_simd_swizzle_ubyte(dst, num_dst_channels,
+                                            src, num_src_channels, swizzle,
+                                            normalized ? UINT8_MAX : 1, count);
+
+   if (normalized && dst_type == MESA_ARRAY_FORMAT_TYPE_UBYTE &&
+       src_type == MESA_ARRAY_FORMAT_TYPE_FLOAT)
+      return util_format_simd_float_to_unorm8(dst, num_dst_channels,
+                                              src, num_src_channels,
+                                              swizzle, count);
+
+   if (normalized && dst_type == MESA_ARRAY_FORMAT_TYPE_FLOAT &&
+       src_type == MESA_ARRAY_FORMAT_TYPE_UBYTE)
+      return util_format_simd_unorm8_to_float(dst, num_dst_channels,
+                                              src, num_src_channels,
+                                              swizzle, count);
+
+   /* Half floats are converted as a flat array of channels. */
+   if (num_src_channels != num_dst_channels)
+      return 0;
+   for (i = 0; i < num_dst_channels; ++i)
+      if (swizzle[i] != i)
+         return 0;
+
+   if (dst_type == MESA_ARRAY_FORMAT_TYPE_FLOAT &&
+       src_type == MESA_ARRAY_FORMAT_TYPE_HALF)
+      return util_format_simd_half_to_float(dst, src,
+                                            count * num_src_channels) /
+             num_src_channels;
+
+   if (dst_type == MESA_ARRAY_FORMAT_TYPE_HALF &&
+       src_type == MESA_ARRAY_FORMAT_TYPE_FLOAT)
+      return util_format_simd_float_to_half(dst, src,
+                                            count * num_src_channels) /
+             num_src_channels;
+
+   return 0;
+}
+
 /**
  * Represents a single instance of the standard swizzle-and-convert loop
  *
@@ -1506,11 +1664,26 @@ _mesa_swizzle_and_convert(void *void_dst, enum mesa_array_format_datatype dst_ty
                           const void *void_src, enum mesa_array_format_datatype src_type, int num_src_channels,
                           const uint8_t swizzle[4], bool normalized, int count)
 {
+   int done;
+
    if (swizzle_convert_try_memcpy(void_dst, dst_type, num_dst_channels,
                                   void_src, src_type, num_src_channels,
                                   swizzle, normalized, count))
       return;
 
+   done = swizzle_convert_try_simd(void_dst, dst_type, num_dst_channels,
+                                   void_src, src_type, num_src_channels,
+                                   swizzle, normalized, count);
+   if (done == count)
+      return;
+   if (done) {
+      void_dst = (uint8_t *) void_dst + done * num_dst_channels *
+                 _mesa_array_format_datatype_get_size(dst_type);
+      void_src = (const uint8_t *) void_src + done * num_src_channels *
+                 _mesa_array_format_datatype_get_size(src_type);
+      count -= done;
+   }
+
    switch (dst_type) {
    case MESA_ARRAY_FORMAT_TYPE_FLOAT:
       convert_float(void_dst, num_dst_channels, void_src, src_type,
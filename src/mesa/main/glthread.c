@@ -36,6 +36,7 @@
 #include "main/glthread.h"
 #include "main/marshal.h"
 #include "main/marshal_generated.h"
+#include "util/hash_table.h"
 #include "util/u_atomic.h"
 #include "util/u_thread.h"
 
@@ -56,6 +57,12 @@ glthread_unmarshal_batch(void *job, int thread_index)
    batch->used = 0;
 }
 
+static void
+glthread_free_vao(struct hash_entry *entry)
+{
+   free(entry->data);
+}
+
 static void
 glthread_thread_initialization(void *job, int thread_index)
 {
@@ -79,8 +86,16 @@ _mesa_glthread_init(struct gl_context *ctx)
       return;
    }
 
+   glthread->vaos = _mesa_hash_table_u64_create(NULL);
+   if (!glthread->vaos) {
+      util_queue_destroy(&glthread->queue);
+      free(glthread);
+      return;
+   }
+
    ctx->MarshalExec = _mesa_create_marshal_table(ctx);
    if (!ctx->MarshalExec) {
+      _mesa_hash_table_u64_destroy(glthread->vaos, NULL);
       util_queue_destroy(&glthread->queue);
       free(glthread);
       return;
@@ -91,6 +106,9 @@ _mesa_glthread_init(struct gl_context *ctx)
       util_queue_fence_init(&glthread->batches[i].fence);
    }
 
+   glthread->batch_size = MARSHAL_MIN_BATCH_SIZE;
+   glthread->current_vao = &glthread->default_vao;
+
    glthread->stats.queue = &glthread->queue;
    ctx->CurrentClientDispatch = ctx->MarshalExec;
    ctx->GLThread = glthread;
@@ -118,6 +136,7 @@ _mesa_glthread_destroy(struct gl_context *ctx)
    for (unsigned i = 0; i < MARSHAL_MAX_BATCHES; i++)
       util_queue_fence_destroy(&glthread->batches[i].fence);
 
+   _mesa_hash_table_u64_destroy(glthread->vaos, glthread_free_vao);
    free(glthread);
    ctx->GLThread = NULL;
 
@@ -166,6 +185,17 @@ _mesa_glthread_flush_batch(struct gl_context *ctx)
 
    p_atomic_add(&glthread->stats.num_offloaded_items, next->used);
 
+   /* Grow the batches while the worker thread is busy, which amortizes the
+    * cost of the queue, and shrink them back when it has been waiting for
+    * us, so that it gets work sooner.
+    */
+   if (util_queue_fence_is_signalled(&glthread->batches[glthread->last].fence))
+      glthread->batch_size = MAX2(glthread->batch_size / 2,
+                                  MARSHAL_MIN_BATCH_SIZE);
+   else
+      glthread->batch_size = MIN2(glthread->batch_size * 2,
+                                  MARSHAL_MAX_CMD_SIZE);
+
    util_queue_add_job(&glthread->queue, next, &next->fence,
                       glthread_unmarshal_batch, NULL);
    glthread->last = glthread->next;
@@ -221,3 +251,35 @@ _mesa_glthread_finish(struct gl_context *ctx)
    if (synced)
       p_atomic_inc(&glthread->stats.num_syncs);
 }
+
+/**
+ * Copies data too large for a batch, for the worker thread to use and
+ * release with _mesa_glthread_release_upload.
+ *
+ * Returns NULL if the call must be executed synchronously instead.
+ */
+void *
+_mesa_glthread_upload(struct gl_context *ctx, const void *data, size_t size)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (size > MARSHAL_MAX_UPLOAD_SIZE ||
+       p_atomic_read(&glthread->upload_size) + size > MARSHAL_MAX_UPLOAD_SIZE)
+      return NULL;
+
+   void *upload = malloc(size);
+   if (!upload)
+      return NULL;
+
+   memcpy(upload, data, size);
+   p_atomic_add(&glthread->upload_size, size);
+   return upload;
+}
+
+void
+_mesa_glthread_release_upload(struct gl_context *ctx, void *upload,
+                              size_t size)
+{
+   free(upload);
+   p_atomic_add(&ctx->GLThread->upload_size, -(int)size);
+}
@@ -24,7 +24,14 @@
 #ifndef _GLTHREAD_H
 #define _GLTHREAD_H
 
-/* The size of one batch and the maximum size of one call.
+/* The size of the batch buffers and the maximum size of one call.
+ *
+ * Batches are submitted well before they are full: see
+ * MARSHAL_MIN_BATCH_SIZE.
+ */
+#define MARSHAL_MAX_CMD_SIZE (64 * 1024)
+
+/* The initial and minimum size at which a batch is submitted.
  *
  * This should be as low as possible, so that:
  * - multiple synchronizations within a frame don't slow us down much
@@ -32,8 +39,12 @@
  * - the memory footprint of the queue is low, and with that comes a lower
  *   chance of experiencing CPU cache thrashing
  * but it should be high enough so that u_queue overhead remains negligible.
+ *
+ * The size is doubled, up to MARSHAL_MAX_CMD_SIZE, each time a batch is
+ * submitted while the worker thread is still busy with the previous one,
+ * and halved back when the worker thread has been waiting for it.
  */
-#define MARSHAL_MAX_CMD_SIZE (8 * 1024)
+#define MARSHAL_MIN_BATCH_SIZE (8 * 1024)
 
 /* The number of batch slots in memory.
  *
@@ -43,12 +54,20 @@
  */
 #define MARSHAL_MAX_BATCHES 8
 
+/* The maximum amount of data passed to the worker thread outside of the
+ * batches, see _mesa_glthread_upload. Calls are executed synchronously
+ * beyond that.
+ */
+#define MARSHAL_MAX_UPLOAD_SIZE (64 * 1024 * 1024)
+
 #include <inttypes.h>
 #include <stdbool.h>
 #include "util/u_queue.h"
+#include "main/glheader.h"
 
 enum marshal_dispatch_cmd_id;
 struct gl_context;
+struct hash_table_u64;
 
 /** A single batch of commands queued up for execution. */
 struct glthread_batch
@@ -66,6 +85,15 @@ struct glthread_batch
    uint8_t buffer[MARSHAL_MAX_CMD_SIZE];
 };
 
+/** The state of a vertex array object tracked on the main thread side. */
+struct glthread_vao
+{
+   GLuint name;
+
+   /** The element array (index buffer) binding. */
+   GLuint element_buffer;
+};
+
 struct glthread_state
 {
    /** Multithreaded queue. */
@@ -83,17 +111,25 @@ struct glthread_state
    /** Index of the batch being filled and about to be submitted. */
    unsigned next;
 
+   /** Size at which the batch being filled is submitted. */
+   unsigned batch_size;
+
+   /** Amount of data uploaded and not yet consumed by the worker thread. */
+   unsigned upload_size;
+
    /**
-    * Tracks on the main thread side whether the current vertex array binding
-    * is in a VBO.
+    * Tracks on the main thread side the current vertex array buffer binding,
+    * to know whether vertex arrays are in a VBO.
     */
-   bool vertex_array_is_vbo;
+   GLuint array_buffer;
 
    /**
-    * Tracks on the main thread side whether the current element array (index
-    * buffer) binding is in a VBO.
+    * Tracks on the main thread side the vertex array objects and the current
+    * one, or NULL if it is unknown.
     */
-   bool element_array_is_vbo;
+   struct hash_table_u64 *vaos;
+   struct glthread_vao default_vao;
+   struct glthread_vao *current_vao;
 };
 
 void _mesa_glthread_init(struct gl_context *ctx);
@@ -103,4 +139,9 @@ void _mesa_glthread_restore_dispatch(struct gl_context *ctx, const char *func);
 void _mesa_glthread_flush_batch(struct gl_context *ctx);
 void _mesa_glthread_finish(struct gl_context *ctx);
 
+void *_mesa_glthread_upload(struct gl_context *ctx, const void *data,
+                            size_t size);
+void _mesa_glthread_release_upload(struct gl_context *ctx, void *upload,
+                                   size_t size);
+
 #endif /* _GLTHREAD_H*/
@@ -38,6 +38,24 @@
 #include "glheader.h"
 #include "hash.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
+
+
+/**
+ * Array of the objects whose names are below its size.
+ *
+ * Readers load the array and its slots with acquire semantics and never
+ * lock; writers hold the table mutex and publish with release stores.  The
+ * array is never resized in place: growing it publishes a new copy, and the
+ * old one is kept until the table is deleted since a reader may still be
+ * looking at it.  With the size doubling each time, the retired arrays add
+ * up to less than the current one.
+ */
+struct hash_direct_array {
+   struct hash_direct_array *retired;    /**< previous, smaller array */
+   GLuint size;
+   void *slots[];
+};
 
 
 /**
@@ -88,12 +106,19 @@ _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 {
    assert(table);
 
-   if (_mesa_hash_table_next_entry(table->ht, NULL) != NULL) {
+   if (_mesa_hash_table_next_entry(table->ht, NULL) != NULL ||
+       table->direct_count) {
       _mesa_problem(NULL, "In _mesa_DeleteHashTable, found non-freed data");
    }
 
    _mesa_hash_table_destroy(table->ht, NULL);
 
+   while (table->direct) {
+      struct hash_direct_array *retired = table->direct->retired;
+      free(table->direct);
+      table->direct = retired;
+   }
+
    mtx_destroy(&table->Mutex);
    free(table);
 }
@@ -112,8 +137,8 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
    assert(table);
    assert(key);
 
-   if (key == DELETED_KEY_VALUE)
-      return table->deleted_key_data;
+   if (table->direct && key < table->direct->size)
+      return table->direct->slots[key];
 
    entry = _mesa_hash_table_search_pre_hashed(table->ht,
                                               uint_hash(key),
@@ -136,7 +161,15 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
 void *
 _mesa_HashLookup(struct _mesa_HashTable *table, GLuint key)
 {
+   const struct hash_direct_array *direct = p_atomic_read(&table->direct);
    void *res;
+
+   /* Small names don't need the mutex.  Others are looked up again once it
+    * is held, in case a writer moved them to a larger array meanwhile.
+    */
+   if (direct && key < direct->size)
+      return p_atomic_read(&direct->slots[key]);
+
    _mesa_HashLockMutex(table);
    res = _mesa_HashLookup_unlocked(table, key);
    _mesa_HashUnlockMutex(table);
@@ -162,6 +195,68 @@ _mesa_HashLookupLocked(struct _mesa_HashTable *table, GLuint key)
 }
 
 
+/**
+ * Replace the direct array with one twice as large, or with the initial
+ * one, and move the objects it now covers out of the hash table.
+ *
+ * \return false if out of memory, the array is then left untouched.
+ */
+static bool
+grow_direct_array(struct _mesa_HashTable *table)
+{
+   struct hash_direct_array *old = table->direct;
+   GLuint size = old ? old->size * 2 : HASH_DIRECT_MIN_SIZE;
+   struct hash_direct_array *direct =
+      malloc(sizeof(*direct) + size * sizeof(direct->slots[0]));
+
+   if (!direct)
+      return false;
+
+   direct->retired = old;
+   direct->size = size;
+   if (old) {
+      memcpy(direct->slots, old->slots, old->size * sizeof(old->slots[0]));
+      memset(direct->slots + old->size, 0,
+             (size - old->size) * sizeof(direct->slots[0]));
+   } else {
+      memset(direct->slots, 0, size * sizeof(direct->slots[0]));
+   }
+
+   hash_table_foreach(table->ht, entry) {
+      GLuint key = (uintptr_t)entry->key;
+
+      if (key < size) {
+         direct->slots[key] = entry->data;
+         table->direct_count++;
+         _mesa_hash_table_remove(table->ht, entry);
+      }
+   }
+
+   p_atomic_set(&table->direct, direct);
+   return true;
+}
+
+
+/**
+ * Whether a new object named \p key should grow the direct array.
+ *
+ * Growing is limited to arrays that are at least half full, so that a few
+ * large names picked by the application don't allocate large arrays.
+ */
+static inline bool
+direct_array_should_grow(const struct _mesa_HashTable *table, GLuint key)
+{
+   const struct hash_direct_array *direct = table->direct;
+
+   if (!direct)
+      return key < HASH_DIRECT_MIN_SIZE;
+
+   return key >= direct->size && key < direct->size * 2 &&
+          direct->size < HASH_DIRECT_MAX_SIZE &&
+          table->direct_count >= direct->size / 2;
+}
+
+
 static inline void
 _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
 {
@@ -174,8 +269,19 @@ _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
    if (key > table->MaxKey)
       table->MaxKey = key;
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = data;
+   if (direct_array_should_grow(table, key) && !grow_direct_array(table)) {
+      _mesa_error_no_memory(__func__);
+      /* The hash table can't hold the name it uses as its deleted key. */
+      if (key == DELETED_KEY_VALUE && !table->direct)
+         return;
+   }
+
+   if (table->direct && key < table->direct->size) {
+      void **slot = &table->direct->slots[key];
+
+      if (!*slot)
+         table->direct_count++;
+      p_atomic_set(slot, data);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht, hash, uint_key(key));
       if (entry) {
@@ -244,8 +350,12 @@ _mesa_HashRemove_unlocked(struct _mesa_HashTable *table, GLuint key)
     */
    assert(!table->InDeleteAll);
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = NULL;
+   if (table->direct && key < table->direct->size) {
+      void **slot = &table->direct->slots[key];
+
+      if (*slot)
+         table->direct_count--;
+      p_atomic_set(slot, NULL);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht,
                                                  uint_hash(key),
@@ -286,14 +396,21 @@ _mesa_HashDeleteAll(struct _mesa_HashTable *table,
    assert(callback);
    _mesa_HashLockMutex(table);
    table->InDeleteAll = GL_TRUE;
+   if (table->direct) {
+      for (GLuint key = 1; key < table->direct->size; key++) {
+         void *data = table->direct->slots[key];
+
+         if (data) {
+            callback(key, data, userData);
+            p_atomic_set(&table->direct->slots[key], NULL);
+         }
+      }
+      table->direct_count = 0;
+   }
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
       _mesa_hash_table_remove(table->ht, entry);
    }
-   if (table->deleted_key_data) {
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
-      table->deleted_key_data = NULL;
-   }
    table->InDeleteAll = GL_FALSE;
    _mesa_HashUnlockMutex(table);
 }
@@ -314,11 +431,16 @@ hash_walk_unlocked(const struct _mesa_HashTable *table,
    assert(table);
    assert(callback);
 
+   /* The callback may insert objects, so reload the array at each step. */
+   for (GLuint key = 1; table->direct && key < table->direct->size; key++) {
+      void *data = table->direct->slots[key];
+
+      if (data)
+         callback(key, data, userData);
+   }
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
    }
-   if (table->deleted_key_data)
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
 }
 
 
@@ -357,8 +479,6 @@ debug_print_entry(GLuint key, void *data, void *userData)
 void
 _mesa_HashPrint(const struct _mesa_HashTable *table)
 {
-   if (table->deleted_key_data)
-      debug_print_entry(DELETED_KEY_VALUE, table->deleted_key_data, NULL);
    _mesa_HashWalk(table, debug_print_entry, NULL);
 }
 
@@ -415,12 +535,5 @@ _mesa_HashFindFreeKeyBlock(struct _mesa_HashTable *table, GLuint numKeys)
 GLuint
 _mesa_HashNumEntries(const struct _mesa_HashTable *table)
 {
-   GLuint count = 0;
-
-   if (table->deleted_key_data)
-      count++;
-
-   count += _mesa_hash_table_num_entries(table->ht);
-
-   return count;
+   return table->direct_count + _mesa_hash_table_num_entries(table->ht);
 }
@@ -37,18 +37,29 @@
 #include "c11/threads.h"
 
 /**
- * Magic GLuint object name that gets stored outside of the struct hash_table.
+ * Magic GLuint object name the hash table uses as its deleted key.
  *
  * The hash table needs a particular pointer to be the marker for a key that
  * was deleted from the table, along with NULL for the "never allocated in the
  * table" marker.  Legacy GL allows any GLuint to be used as a GL object name,
- * and we use a 1:1 mapping from GLuints to key pointers, so we need to be
- * able to track a GLuint that happens to match the deleted key outside of
- * struct hash_table.  We tell the hash table to use "1" as the deleted key
- * value, so that we test the deleted-key-in-the-table path as best we can.
+ * and we use a 1:1 mapping from GLuints to key pointers, so the marker has to
+ * be a name that never reaches struct hash_table.  Names below
+ * HASH_DIRECT_MIN_SIZE always live in the direct array, so "1" is safe.
  */
 #define DELETED_KEY_VALUE 1
 
+/** @{
+ * Bounds of the array of objects indexed directly by their names.
+ *
+ * glGen*() hands out small contiguous names, so most objects are stored in
+ * an array indexed by name that readers access without taking the mutex.
+ * The array starts with HASH_DIRECT_MIN_SIZE slots and doubles as long as
+ * it stays at least half full; names beyond it go to the struct hash_table.
+ */
+#define HASH_DIRECT_MIN_SIZE 64
+#define HASH_DIRECT_MAX_SIZE (1 << 20)
+/** @} */
+
 /** @{
  * Mapping from our use of GLuint as both the key and the hash value to the
  * hash_table.h API
@@ -98,11 +109,12 @@ uint_key(GLuint id)
  */
 struct _mesa_HashTable {
    struct hash_table *ht;
+   /** Objects named below its size, read without locking (may be NULL). */
+   struct hash_direct_array *direct;
+   GLuint direct_count;                  /**< objects in the direct array */
    GLuint MaxKey;                        /**< highest key inserted so far */
    mtx_t Mutex;                          /**< mutual exclusion lock */
    GLboolean InDeleteAll;                /**< Debug check */
-   /** Value that would be in the table for DELETED_KEY_VALUE. */
-   void *deleted_key_data;
 };
 
 extern struct _mesa_HashTable *_mesa_NewHashTable(void);
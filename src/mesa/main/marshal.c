@@ -32,6 +32,7 @@
 #include "marshal.h"
 #include "dispatch.h"
 #include "marshal_generated.h"
+#include "util/hash_table.h"
 
 struct marshal_cmd_Flush
 {
@@ -234,14 +235,14 @@ track_vbo_binding(struct gl_context *ctx, GLenum target, GLuint buffer)
 
    switch (target) {
    case GL_ARRAY_BUFFER:
-      glthread->vertex_array_is_vbo = (buffer != 0);
+      glthread->array_buffer = buffer;
       break;
    case GL_ELEMENT_ARRAY_BUFFER:
       /* The current element array buffer binding is actually tracked in the
-       * vertex array object instead of the context, so this would need to
-       * change on vertex array object updates.
+       * vertex array object instead of the context.
        */
-      glthread->element_array_is_vbo = (buffer != 0);
+      if (glthread->current_vao)
+         glthread->current_vao->element_buffer = buffer;
       break;
    }
 }
@@ -288,6 +289,72 @@ _mesa_marshal_BindBuffer(GLenum target, GLuint buffer)
    }
 }
 
+/* DeleteBuffers: marshalled asynchronously */
+struct marshal_cmd_DeleteBuffers
+{
+   struct marshal_cmd_base cmd_base;
+   GLsizei n;
+   /* Next n * sizeof(GLuint) bytes are GLuint buffer[n] */
+};
+
+void
+_mesa_unmarshal_DeleteBuffers(struct gl_context *ctx,
+                              const struct marshal_cmd_DeleteBuffers *cmd)
+{
+   const GLsizei n = cmd->n;
+   const GLuint *buffer = (const GLuint *) (cmd + 1);
+
+   CALL_DeleteBuffers(ctx->CurrentServerDispatch, (n, buffer));
+}
+
+/**
+ * Deleting a buffer unbinds it from the context and from the current
+ * vertex array object.
+ */
+static void
+track_buffer_deletion(struct gl_context *ctx, GLsizei n, const GLuint *buffer)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (n < 0 || !buffer)
+      return;
+
+   for (GLsizei i = 0; i < n; i++) {
+      if (!buffer[i])
+         continue;
+
+      if (glthread->array_buffer == buffer[i])
+         glthread->array_buffer = 0;
+      if (glthread->current_vao &&
+          glthread->current_vao->element_buffer == buffer[i])
+         glthread->current_vao->element_buffer = 0;
+   }
+}
+
+void GLAPIENTRY
+_mesa_marshal_DeleteBuffers(GLsizei n, const GLuint *buffer)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   size_t cmd_size = sizeof(struct marshal_cmd_DeleteBuffers) +
+                     (n > 0 ? n * sizeof(GLuint) : 0);
+   debug_print_marshal("DeleteBuffers");
+
+   track_buffer_deletion(ctx, n, buffer);
+
+   if (n >= 0 && cmd_size <= MARSHAL_MAX_CMD_SIZE) {
+      struct marshal_cmd_DeleteBuffers *cmd =
+         _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_DeleteBuffers,
+                                         cmd_size);
+      cmd->n = n;
+      if (n)
+         memcpy(cmd + 1, buffer, n * sizeof(GLuint));
+      _mesa_post_marshal_hook(ctx);
+   } else {
+      _mesa_glthread_finish(ctx);
+      CALL_DeleteBuffers(ctx->CurrentServerDispatch, (n, buffer));
+   }
+}
+
 /* BufferData: marshalled asynchronously */
 struct marshal_cmd_BufferData
 {
@@ -296,6 +363,7 @@ struct marshal_cmd_BufferData
    GLsizeiptr size;
    GLenum usage;
    bool data_null; /* If set, no data follows for "data" */
+   void *upload; /* If set, no data follows, it is there instead */
    /* Next size bytes are GLubyte data[size] */
 };
 
@@ -310,10 +378,15 @@ _mesa_unmarshal_BufferData(struct gl_context *ctx,
 
    if (cmd->data_null)
       data = NULL;
+   else if (cmd->upload)
+      data = cmd->upload;
    else
       data = (const void *) (cmd + 1);
 
    CALL_BufferData(ctx->CurrentServerDispatch, (target, size, data, usage));
+
+   if (cmd->upload)
+      _mesa_glthread_release_upload(ctx, cmd->upload, size);
 }
 
 void GLAPIENTRY
@@ -331,6 +404,14 @@ _mesa_marshal_BufferData(GLenum target, GLsizeiptr size, const GLvoid * data,
       return;
    }
 
+   void *upload = NULL;
+   if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD && data &&
+       cmd_size > MARSHAL_MAX_CMD_SIZE) {
+      upload = _mesa_glthread_upload(ctx, data, size);
+      if (upload)
+         cmd_size = sizeof(struct marshal_cmd_BufferData);
+   }
+
    if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD &&
        cmd_size <= MARSHAL_MAX_CMD_SIZE) {
       struct marshal_cmd_BufferData *cmd =
@@ -341,7 +422,8 @@ _mesa_marshal_BufferData(GLenum target, GLsizeiptr size, const GLvoid * data,
       cmd->size = size;
       cmd->usage = usage;
       cmd->data_null = !data;
-      if (data) {
+      cmd->upload = upload;
+      if (data && !upload) {
          char *variable_data = (char *) (cmd + 1);
          memcpy(variable_data, data, size);
       }
@@ -360,6 +442,7 @@ struct marshal_cmd_BufferSubData
    GLenum target;
    GLintptr offset;
    GLsizeiptr size;
+   void *upload; /* If set, no data follows, it is there instead */
    /* Next size bytes are GLubyte data[size] */
 };
 
@@ -370,10 +453,13 @@ _mesa_unmarshal_BufferSubData(struct gl_context *ctx,
    const GLenum target = cmd->target;
    const GLintptr offset = cmd->offset;
    const GLsizeiptr size = cmd->size;
-   const void *data = (const void *) (cmd + 1);
+   const void *data = cmd->upload ? cmd->upload : (const void *) (cmd + 1);
 
    CALL_BufferSubData(ctx->CurrentServerDispatch,
                       (target, offset, size, data));
+
+   if (cmd->upload)
+      _mesa_glthread_release_upload(ctx, cmd->upload, size);
 }
 
 void GLAPIENTRY
@@ -390,6 +476,14 @@ _mesa_marshal_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
       return;
    }
 
+   void *upload = NULL;
+   if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD &&
+       cmd_size > MARSHAL_MAX_CMD_SIZE) {
+      upload = _mesa_glthread_upload(ctx, data, size);
+      if (upload)
+         cmd_size = sizeof(struct marshal_cmd_BufferSubData);
+   }
+
    if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD &&
        cmd_size <= MARSHAL_MAX_CMD_SIZE) {
       struct marshal_cmd_BufferSubData *cmd =
@@ -398,8 +492,11 @@ _mesa_marshal_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
       cmd->target = target;
       cmd->offset = offset;
       cmd->size = size;
-      char *variable_data = (char *) (cmd + 1);
-      memcpy(variable_data, data, size);
+      cmd->upload = upload;
+      if (!upload) {
+         char *variable_data = (char *) (cmd + 1);
+         memcpy(variable_data, data, size);
+      }
       _mesa_post_marshal_hook(ctx);
    } else {
       _mesa_glthread_finish(ctx);
@@ -416,6 +513,7 @@ struct marshal_cmd_NamedBufferData
    GLsizei size;
    GLenum usage;
    bool data_null; /* If set, no data follows for "data" */
+   void *upload; /* If set, no data follows, it is there instead */
    /* Next size bytes are GLubyte data[size] */
 };
 
@@ -430,11 +528,16 @@ _mesa_unmarshal_NamedBufferData(struct gl_context *ctx,
 
    if (cmd->data_null)
       data = NULL;
+   else if (cmd->upload)
+      data = cmd->upload;
    else
       data = (const void *) (cmd + 1);
 
    CALL_NamedBufferData(ctx->CurrentServerDispatch,
                         (name, size, data, usage));
+
+   if (cmd->upload)
+      _mesa_glthread_release_upload(ctx, cmd->upload, size);
 }
 
 void GLAPIENTRY
@@ -451,6 +554,13 @@ _mesa_marshal_NamedBufferData(GLuint buffer, GLsizeiptr size,
       return;
    }
 
+   void *upload = NULL;
+   if (buffer > 0 && data && cmd_size > MARSHAL_MAX_CMD_SIZE) {
+      upload = _mesa_glthread_upload(ctx, data, size);
+      if (upload)
+         cmd_size = sizeof(struct marshal_cmd_NamedBufferData);
+   }
+
    if (buffer > 0 && cmd_size <= MARSHAL_MAX_CMD_SIZE) {
       struct marshal_cmd_NamedBufferData *cmd =
          _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_NamedBufferData,
@@ -459,7 +569,8 @@ _mesa_marshal_NamedBufferData(GLuint buffer, GLsizeiptr size,
       cmd->size = size;
       cmd->usage = usage;
       cmd->data_null = !data;
-      if (data) {
+      cmd->upload = upload;
+      if (data && !upload) {
          char *variable_data = (char *) (cmd + 1);
          memcpy(variable_data, data, size);
       }
@@ -478,6 +589,7 @@ struct marshal_cmd_NamedBufferSubData
    GLuint name;
    GLintptr offset;
    GLsizei size;
+   void *upload; /* If set, no data follows, it is there instead */
    /* Next size bytes are GLubyte data[size] */
 };
 
@@ -488,10 +600,13 @@ _mesa_unmarshal_NamedBufferSubData(struct gl_context *ctx,
    const GLuint name = cmd->name;
    const GLintptr offset = cmd->offset;
    const GLsizei size = cmd->size;
-   const void *data = (const void *) (cmd + 1);
+   const void *data = cmd->upload ? cmd->upload : (const void *) (cmd + 1);
 
    CALL_NamedBufferSubData(ctx->CurrentServerDispatch,
                            (name, offset, size, data));
+
+   if (cmd->upload)
+      _mesa_glthread_release_upload(ctx, cmd->upload, size);
 }
 
 void GLAPIENTRY
@@ -508,6 +623,13 @@ _mesa_marshal_NamedBufferSubData(GLuint buffer, GLintptr offset,
       return;
    }
 
+   void *upload = NULL;
+   if (buffer > 0 && cmd_size > MARSHAL_MAX_CMD_SIZE) {
+      upload = _mesa_glthread_upload(ctx, data, size);
+      if (upload)
+         cmd_size = sizeof(struct marshal_cmd_NamedBufferSubData);
+   }
+
    if (buffer > 0 && cmd_size <= MARSHAL_MAX_CMD_SIZE) {
       struct marshal_cmd_NamedBufferSubData *cmd =
          _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_NamedBufferSubData,
@@ -515,8 +637,11 @@ _mesa_marshal_NamedBufferSubData(GLuint buffer, GLintptr offset,
       cmd->name = buffer;
       cmd->offset = offset;
       cmd->size = size;
-      char *variable_data = (char *) (cmd + 1);
-      memcpy(variable_data, data, size);
+      cmd->upload = upload;
+      if (!upload) {
+         char *variable_data = (char *) (cmd + 1);
+         memcpy(variable_data, data, size);
+      }
       _mesa_post_marshal_hook(ctx);
    } else {
       _mesa_glthread_finish(ctx);
@@ -747,3 +872,251 @@ _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
                          (buffer, drawbuffer, depth, stencil));
    }
 }
+
+
+/** Tracks the vertex array objects, so that their index buffer bindings are
+ * known on the main thread side.
+ *
+ * Vertex array objects are not shared between contexts and their names must
+ * come from glGenVertexArrays() or glCreateVertexArrays(), so we know all of
+ * them.  As with buffer bindings, calls that generate an error are assumed
+ * not to happen.  The binding of a name we don't know leaves the current
+ * vertex array unknown, and the queries about it are synchronous.
+ */
+static void
+track_vao_creation(struct gl_context *ctx, GLsizei n, const GLuint *arrays)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (n < 0 || !arrays)
+      return;
+
+   for (GLsizei i = 0; i < n; i++) {
+      struct glthread_vao *vao;
+
+      if (!arrays[i] || _mesa_hash_table_u64_search(glthread->vaos, arrays[i]))
+         continue;
+
+      vao = calloc(1, sizeof(*vao));
+      if (!vao)
+         continue;
+
+      vao->name = arrays[i];
+      _mesa_hash_table_u64_insert(glthread->vaos, arrays[i], vao);
+   }
+}
+
+static void
+track_vao_deletion(struct gl_context *ctx, GLsizei n, const GLuint *arrays)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (n < 0 || !arrays)
+      return;
+
+   for (GLsizei i = 0; i < n; i++) {
+      struct glthread_vao *vao;
+
+      if (!arrays[i])
+         continue;
+
+      vao = _mesa_hash_table_u64_search(glthread->vaos, arrays[i]);
+      if (!vao)
+         continue;
+
+      /* Deleting the bound vertex array binds the default one. */
+      if (glthread->current_vao == vao)
+         glthread->current_vao = &glthread->default_vao;
+
+      _mesa_hash_table_u64_remove(glthread->vaos, arrays[i]);
+      free(vao);
+   }
+}
+
+static struct glthread_vao *
+lookup_vao(struct gl_context *ctx, GLuint array)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (!array)
+      return &glthread->default_vao;
+
+   return _mesa_hash_table_u64_search(glthread->vaos, array);
+}
+
+/* GenVertexArrays: marshalled synchronously */
+void GLAPIENTRY
+_mesa_marshal_GenVertexArrays(GLsizei n, GLuint *arrays)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   _mesa_glthread_finish(ctx);
+   debug_print_sync("GenVertexArrays");
+   CALL_GenVertexArrays(ctx->CurrentServerDispatch, (n, arrays));
+   track_vao_creation(ctx, n, arrays);
+}
+
+/* CreateVertexArrays: marshalled synchronously */
+void GLAPIENTRY
+_mesa_marshal_CreateVertexArrays(GLsizei n, GLuint *arrays)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   _mesa_glthread_finish(ctx);
+   debug_print_sync("CreateVertexArrays");
+   CALL_CreateVertexArrays(ctx->CurrentServerDispatch, (n, arrays));
+   track_vao_creation(ctx, n, arrays);
+}
+
+/* BindVertexArray: marshalled asynchronously */
+struct marshal_cmd_BindVertexArray
+{
+   struct marshal_cmd_base cmd_base;
+   GLuint array;
+};
+
+void
+_mesa_unmarshal_BindVertexArray(struct gl_context *ctx,
+                                const struct marshal_cmd_BindVertexArray *cmd)
+{
+   const GLuint array = cmd->array;
+   CALL_BindVertexArray(ctx->CurrentServerDispatch, (array));
+}
+
+void GLAPIENTRY
+_mesa_marshal_BindVertexArray(GLuint array)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_BindVertexArray *cmd;
+   debug_print_marshal("BindVertexArray");
+
+   if (_mesa_glthread_is_compat_bind_vertex_array(ctx)) {
+      _mesa_glthread_finish(ctx);
+      _mesa_glthread_restore_dispatch(ctx, __func__);
+      debug_print_sync_fallback("BindVertexArray");
+      CALL_BindVertexArray(ctx->CurrentServerDispatch, (array));
+      return;
+   }
+
+   ctx->GLThread->current_vao = lookup_vao(ctx, array);
+
+   cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_BindVertexArray,
+                                         sizeof(*cmd));
+   cmd->array = array;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/* DeleteVertexArrays: marshalled asynchronously */
+struct marshal_cmd_DeleteVertexArrays
+{
+   struct marshal_cmd_base cmd_base;
+   GLsizei n;
+   /* Next n * sizeof(GLuint) bytes are GLuint arrays[n] */
+};
+
+void
+_mesa_unmarshal_DeleteVertexArrays(struct gl_context *ctx,
+                                   const struct marshal_cmd_DeleteVertexArrays *cmd)
+{
+   const GLsizei n = cmd->n;
+   const GLuint *arrays = (const GLuint *) (cmd + 1);
+
+   CALL_DeleteVertexArrays(ctx->CurrentServerDispatch, (n, arrays));
+}
+
+void GLAPIENTRY
+_mesa_marshal_DeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   size_t cmd_size = sizeof(struct marshal_cmd_DeleteVertexArrays) +
+                     (n > 0 ? n * sizeof(GLuint) : 0);
+   debug_print_marshal("DeleteVertexArrays");
+
+   track_vao_deletion(ctx, n, arrays);
+
+   if (n >= 0 && cmd_size <= MARSHAL_MAX_CMD_SIZE) {
+      struct marshal_cmd_DeleteVertexArrays *cmd =
+         _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_DeleteVertexArrays,
+                                         cmd_size);
+      cmd->n = n;
+      if (n)
+         memcpy(cmd + 1, arrays, n * sizeof(GLuint));
+      _mesa_post_marshal_hook(ctx);
+   } else {
+      _mesa_glthread_finish(ctx);
+      CALL_DeleteVertexArrays(ctx->CurrentServerDispatch, (n, arrays));
+   }
+}
+
+/* VertexArrayElementBuffer: marshalled asynchronously */
+struct marshal_cmd_VertexArrayElementBuffer
+{
+   struct marshal_cmd_base cmd_base;
+   GLuint vaobj;
+   GLuint buffer;
+};
+
+void
+_mesa_unmarshal_VertexArrayElementBuffer(struct gl_context *ctx,
+                                         const struct marshal_cmd_VertexArrayElementBuffer *cmd)
+{
+   const GLuint vaobj = cmd->vaobj;
+   const GLuint buffer = cmd->buffer;
+   CALL_VertexArrayElementBuffer(ctx->CurrentServerDispatch, (vaobj, buffer));
+}
+
+void GLAPIENTRY
+_mesa_marshal_VertexArrayElementBuffer(GLuint vaobj, GLuint buffer)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_VertexArrayElementBuffer *cmd;
+   struct glthread_vao *vao;
+   debug_print_marshal("VertexArrayElementBuffer");
+
+   /* Zero is not a vertex array object here, it is an error. */
+   vao = vaobj ? lookup_vao(ctx, vaobj) : NULL;
+   if (vao)
+      vao->element_buffer = buffer;
+
+   cmd = _mesa_glthread_allocate_command(ctx,
+                                         DISPATCH_CMD_VertexArrayElementBuffer,
+                                         sizeof(*cmd));
+   cmd->vaobj = vaobj;
+   cmd->buffer = buffer;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/* GetIntegerv: marshalled synchronously, unless we track the state */
+void GLAPIENTRY
+_mesa_marshal_GetIntegerv(GLenum pname, GLint *params)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct glthread_state *glthread = ctx->GLThread;
+
+   /* Return the bindings tracked on this side without waiting for the
+    * worker thread.  This is not done in compat contexts, where the query
+    * could be an error between glBegin() and glEnd().
+    */
+   if (ctx->API == API_OPENGL_CORE || ctx->API == API_OPENGLES2) {
+      switch (pname) {
+      case GL_ARRAY_BUFFER_BINDING:
+         *params = glthread->array_buffer;
+         return;
+      case GL_ELEMENT_ARRAY_BUFFER_BINDING:
+         if (glthread->current_vao) {
+            *params = glthread->current_vao->element_buffer;
+            return;
+         }
+         break;
+      case GL_VERTEX_ARRAY_BINDING:
+         if (glthread->current_vao &&
+             (ctx->API == API_OPENGL_CORE || _mesa_is_gles3(ctx))) {
+            *params = glthread->current_vao->name;
+            return;
+         }
+         break;
+      }
+   }
+
+   _mesa_glthread_finish(ctx);
+   debug_print_sync("GetIntegerv");
+   CALL_GetIntegerv(ctx->CurrentServerDispatch, (pname, params));
+}
@@ -57,7 +57,7 @@ _mesa_glthread_allocate_command(struct gl_context *ctx,
    struct marshal_cmd_base *cmd_base;
    const size_t aligned_size = ALIGN(size, 8);
 
-   if (unlikely(next->used + size > MARSHAL_MAX_CMD_SIZE)) {
+   if (unlikely(next->used + size > glthread->batch_size)) {
       _mesa_glthread_flush_batch(ctx);
       next = &glthread->batches[glthread->next];
    }
@@ -79,7 +79,7 @@ _mesa_glthread_is_non_vbo_vertex_attrib_pointer(const struct gl_context *ctx)
 {
    struct glthread_state *glthread = ctx->GLThread;
 
-   return ctx->API != API_OPENGL_CORE && !glthread->vertex_array_is_vbo;
+   return ctx->API != API_OPENGL_CORE && !glthread->array_buffer;
 }
 
 /**
@@ -91,7 +91,8 @@ _mesa_glthread_is_non_vbo_draw_elements(const struct gl_context *ctx)
 {
    struct glthread_state *glthread = ctx->GLThread;
 
-   return ctx->API != API_OPENGL_CORE && !glthread->element_array_is_vbo;
+   return ctx->API != API_OPENGL_CORE &&
+          (!glthread->current_vao || !glthread->current_vao->element_buffer);
 }
 
 #define DEBUG_MARSHAL_PRINT_CALLS 0
@@ -152,19 +153,15 @@ _mesa_post_marshal_hook(struct gl_context *ctx)
 
 
 /**
- * Checks whether we're on a compat context for code-generated
- * glBindVertexArray().
+ * Checks whether we're on a compat context for glBindVertexArray().
  *
  * In order to decide whether a draw call uses only VBOs for vertex and index
  * buffers, we track the current vertex and index buffer bindings by
- * glBindBuffer().  However, the index buffer binding is stored in the vertex
- * array as opposed to the context.  If we were to accurately track whether
- * the index buffer was a user pointer ot not, we'd have to track it per
- * vertex array, which would mean synchronizing with the client thread and
- * looking into the hash table to find the actual vertex array object.  That's
- * more tracking than we'd like to do in the main thread, if possible.
+ * glBindBuffer().  The index buffer binding is tracked per vertex array,
+ * but whether each vertex attribute is a user pointer or not is only
+ * checked when it is set, which switching vertex arrays would bypass.
  *
- * Instead, just punt for now and disable threading on apps using vertex
+ * So just punt for now and disable threading on apps using vertex
  * arrays and compat contexts.  Apps using vertex arrays can probably use a
  * core context.
  */
@@ -183,6 +180,10 @@ struct marshal_cmd_BufferSubData;
 struct marshal_cmd_NamedBufferData;
 struct marshal_cmd_NamedBufferSubData;
 struct marshal_cmd_ClearBuffer;
+struct marshal_cmd_DeleteBuffers;
+struct marshal_cmd_BindVertexArray;
+struct marshal_cmd_DeleteVertexArrays;
+struct marshal_cmd_VertexArrayElementBuffer;
 #define marshal_cmd_ClearBufferfv   marshal_cmd_ClearBuffer
 #define marshal_cmd_ClearBufferiv   marshal_cmd_ClearBuffer
 #define marshal_cmd_ClearBufferuiv  marshal_cmd_ClearBuffer
@@ -281,4 +282,41 @@ void GLAPIENTRY
 _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
                             const GLfloat depth, const GLint stencil);
 
+void GLAPIENTRY
+_mesa_marshal_DeleteBuffers(GLsizei n, const GLuint *buffer);
+
+void
+_mesa_unmarshal_DeleteBuffers(struct gl_context *ctx,
+                              const struct marshal_cmd_DeleteBuffers *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_GenVertexArrays(GLsizei n, GLuint *arrays);
+
+void GLAPIENTRY
+_mesa_marshal_CreateVertexArrays(GLsizei n, GLuint *arrays);
+
+void GLAPIENTRY
+_mesa_marshal_BindVertexArray(GLuint array);
+
+void
+_mesa_unmarshal_BindVertexArray(struct gl_context *ctx,
+                                const struct marshal_cmd_BindVertexArray *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_DeleteVertexArrays(GLsizei n, const GLuint *arrays);
+
+void
+_mesa_unmarshal_DeleteVertexArrays(struct gl_context *ctx,
+                                   const struct marshal_cmd_DeleteVertexArrays *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_VertexArrayElementBuffer(GLuint vaobj, GLuint buffer);
+
+void
+_mesa_unmarshal_VertexArrayElementBuffer(struct gl_context *ctx,
+                                         const struct marshal_cmd_VertexArrayElementBuffer *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_GetIntegerv(GLenum pname, GLint *params);
+
 #endif /* MARSHAL_H */
@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Binds shared objects from several threads at once: each thread looks up
+ * random names in one _mesa_HashTable and takes and drops a reference on
+ * the object found, as glBind*() does.  Lookups go either through
+ * _mesa_HashLookup() or through the mutex and _mesa_HashLookupLocked(),
+ * which is what every lookup cost before small names became lock-free.
+ * With -w, another thread keeps generating and deleting objects meanwhile.
+ *
+ * Usage: hash_bench [-t max threads] [-n objects] [-i lookups] [-w]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c11/threads.h"
+#include "main/errors.h"
+#include "main/hash.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+
+struct object {
+   GLuint Name;
+   int RefCount;
+};
+
+struct bench {
+   struct _mesa_HashTable *table;
+   unsigned num_objects;
+   unsigned iterations;
+   bool locked;
+   bool stop;
+};
+
+struct worker {
+   struct bench *bench;
+   unsigned seed;
+   unsigned errors;
+};
+
+/* hash.c reports problems through these */
+void
+_mesa_problem(const struct gl_context *ctx, const char *fmtString, ...)
+{
+   va_list args;
+
+   va_start(args, fmtString);
+   vfprintf(stderr, fmtString, args);
+   va_end(args);
+   fputc('\n', stderr);
+}
+
+void
+_mesa_error_no_memory(const char *caller)
+{
+   fprintf(stderr, "%s: out of memory\n", caller);
+}
+
+void
+_mesa_debug(const struct gl_context *ctx, const char *fmtString, ...)
+{
+}
+
+static int
+bind_objects(void *data)
+{
+   struct worker *w = data;
+   struct bench *b = w->bench;
+
+   for (unsigned i = 0; i < b->iterations; i++) {
+      struct object *obj;
+      GLuint name;
+
+      w->seed = w->seed * 1103515245 + 12345;
+      name = 1 + (w->seed >> 8) % b->num_objects;
+
+      if (b->locked) {
+         _mesa_HashLockMutex(b->table);
+         obj = _mesa_HashLookupLocked(b->table, name);
+         _mesa_HashUnlockMutex(b->table);
+      } else {
+         obj = _mesa_HashLookup(b->table, name);
+      }
+
+      if (!obj || obj->Name != name) {
+         w->errors++;
+         continue;
+      }
+      p_atomic_inc(&obj->RefCount);
+      p_atomic_dec(&obj->RefCount);
+   }
+   return 0;
+}
+
+static int
+gen_and_delete_objects(void *data)
+{
+   struct bench *b = data;
+   struct object objs[16];
+
+   while (!p_atomic_read(&b->stop)) {
+      GLuint first;
+
+      _mesa_HashLockMutex(b->table);
+      first = _mesa_HashFindFreeKeyBlock(b->table, ARRAY_SIZE(objs));
+      for (unsigned i = 0; i < ARRAY_SIZE(objs); i++) {
+         objs[i].Name = first + i;
+         objs[i].RefCount = 1;
+         _mesa_HashInsertLocked(b->table, first + i, &objs[i]);
+      }
+      _mesa_HashUnlockMutex(b->table);
+
+      for (unsigned i = 0; i < ARRAY_SIZE(objs); i++)
+         _mesa_HashRemove(b->table, first + i);
+   }
+   return 0;
+}
+
+static double
+run(struct bench *b, unsigned num_threads, bool writer, unsigned *errors)
+{
+   struct worker *workers = calloc(num_threads, sizeof(*workers));
+   thrd_t *threads = calloc(num_threads, sizeof(*threads));
+   thrd_t writer_thread;
+   int64_t start, end;
+
+   b->stop = false;
+   if (writer)
+      thrd_create(&writer_thread, gen_and_delete_objects, b);
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_threads; i++) {
+      workers[i].bench = b;
+      workers[i].seed = i + 1;
+      thrd_create(&threads[i], bind_objects, &workers[i]);
+   }
+   for (unsigned i = 0; i < num_threads; i++) {
+      thrd_join(threads[i], NULL);
+      *errors += workers[i].errors;
+   }
+   end = os_time_get_nano();
+
+   if (writer) {
+      p_atomic_set(&b->stop, true);
+      thrd_join(writer_thread, NULL);
+   }
+
+   free(threads);
+   free(workers);
+
+   /* millions of lookups per second, all threads together */
+   return (double) num_threads * b->iterations / ((end - start) / 1e3);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_threads = 8, errors = 0;
+   bool writer = false;
+   struct bench b = { .num_objects = 1000, .iterations = 2000000 };
+   struct object *objs;
+
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc)
+         max_threads = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+         b.num_objects = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+         b.iterations = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-w"))
+         writer = true;
+      else {
+         fprintf(stderr, "usage: %s [-t max threads] [-n objects] "
+                 "[-i lookups] [-w]\n", argv[0]);
+         return 1;
+      }
+   }
+   max_threads = MAX2(max_threads, 1);
+   b.num_objects = MAX2(b.num_objects, 1);
+   b.iterations = MAX2(b.iterations, 1);
+
+   b.table = _mesa_NewHashTable();
+   objs = calloc(b.num_objects, sizeof(*objs));
+   for (unsigned i = 0; i < b.num_objects; i++) {
+      objs[i].Name = i + 1;
+      objs[i].RefCount = 1;
+      _mesa_HashInsert(b.table, i + 1, &objs[i]);
+   }
+
+   printf("%8s %16s %16s\n", "threads", "locked Mlookup/s", "Mlookup/s");
+   for (unsigned n = 1; n <= max_threads; n *= 2) {
+      double locked, unlocked;
+
+      b.locked = true;
+      locked = run(&b, n, writer, &errors);
+      b.locked = false;
+      unlocked = run(&b, n, writer, &errors);
+
+      printf("%8u %16.1f %16.1f\n", n, locked, unlocked);
+   }
+
+   for (unsigned i = 0; i < b.num_objects; i++)
+      _mesa_HashRemove(b.table, i + 1);
+   _mesa_DeleteHashTable(b.table);
+   free(objs);
+
+   if (errors)
+      fprintf(stderr, "%u lookups returned the wrong object\n", errors);
+   return errors != 0;
+}
@@ -32,6 +32,7 @@
 #include <gtest/gtest.h>
 
 #include "main/formats.h"
+#include "main/format_utils.h"
 #include "main/glformats.h"
 
 /**
@@ -137,3 +138,142 @@ TEST(MesaFormatsTest, FormatSanity)
 
    }
 }
+
+/**
+ * Check that _mesa_format_convert() converts rows of pixels, which go
+ * through the SIMD paths where there are some, like single pixels.
+ */
+TEST(MesaFormatsTest, FormatConvertRows)
+{
+   const unsigned width = 37;
+   uint8_t rgba8[width * 4], ubyte_row[width * 4], ubyte_pixels[width * 4];
+   float rgba32f[width * 4], float_row[width * 4], float_pixels[width * 4];
+   uint8_t src[width * 16], row[width * 16], pixels[width * 16];
+   unsigned seed = 1;
+
+   for (unsigned i = 0; i < width * 4; i++) {
+      seed = seed * 1103515245 + 12345;
+      rgba8[i] = seed >> 16;
+      rgba32f[i] = (seed >> 8) % 1200 / 960.0f - 0.1f;
+   }
+
+   for (int fi = MESA_FORMAT_NONE + 1; fi < MESA_FORMAT_COUNT; ++fi) {
+      mesa_format f = (mesa_format) fi;
+      SCOPED_TRACE(_mesa_get_format_name(f));
+      const unsigned bytes = _mesa_get_format_bytes(f);
+      const enum mesa_format_layout layout = _mesa_get_format_layout(f);
+
+      if (!_mesa_is_format_color_format(f) ||
+          _mesa_is_format_integer_color(f) ||
+          (layout != MESA_FORMAT_LAYOUT_ARRAY &&
+           layout != MESA_FORMAT_LAYOUT_PACKED))
+         continue;
+
+      for (unsigned i = 0; i < width * bytes; i++) {
+         seed = seed * 1103515245 + 12345;
+         src[i] = seed >> 16;
+      }
+
+      /* Unpack */
+      _mesa_format_convert(float_row, RGBA32_FLOAT, width * 16,
+                           src, f, width * bytes, width, 1, NULL);
+      _mesa_format_convert(ubyte_row, RGBA8_UBYTE, width * 4,
+                           src, f, width * bytes, width, 1, NULL);
+      for (unsigned x = 0; x < width; x++) {
+         _mesa_format_convert(&float_pixels[x * 4], RGBA32_FLOAT, 16,
+                              &src[x * bytes], f, bytes, 1, 1, NULL);
+         _mesa_format_convert(&ubyte_pixels[x * 4], RGBA8_UBYTE, 4,
+                              &src[x * bytes], f, bytes, 1, 1, NULL);
+      }
+      EXPECT_EQ(memcmp(float_row, float_pixels, sizeof(float_row)), 0);
+      EXPECT_EQ(memcmp(ubyte_row, ubyte_pixels, sizeof(ubyte_row)), 0);
+
+      /* Pack */
+      memset(row, 0, sizeof(row));
+      memset(pixels, 0, sizeof(pixels));
+      _mesa_format_convert(row, f, width * bytes,
+                           rgba32f, RGBA32_FLOAT, width * 16, width, 1, NULL);
+      for (unsigned x = 0; x < width; x++) {
+         _mesa_format_convert(&pixels[x * bytes], f, bytes,
+                              &rgba32f[x * 4], RGBA32_FLOAT, 16, 1, 1, NULL);
+      }
+      EXPECT_EQ(memcmp(row, pixels, width * bytes), 0);
+
+      memset(row, 0, sizeof(row));
+      memset(pixels, 0, sizeof(pixels));
+      _mesa_format_convert(row, f, width * bytes,
+                           rgba8, RGBA8_UBYTE, width * 4, width, 1, NULL);
+      for (unsigned x = 0; x < width; x++) {
+         _mesa_format_convert(&pixels[x * bytes], f, bytes,
+                              &rgba8[x * 4], RGBA8_UBYTE, 4, 1, 1, NULL);
+      }
+      EXPECT_EQ(memcmp(row, pixels, width * bytes), 0);
+   }
+}
+
+/**
+ * Same for the conversions between array formats, done by
+ * _mesa_swizzle_and_convert().
+ */
+TEST(MesaFormatsTest, ArrayFormatConvertRows)
+{
+   const mesa_array_format RGBA16_FLOAT =
+      MESA_ARRAY_FORMAT(2, 1, 1, 1, 4, 0, 1, 2, 3);
+   const mesa_array_format BGR8_UBYTE =
+      MESA_ARRAY_FORMAT(1, 0, 0, 1, 3, 2, 1, 0, 5);
+   const mesa_array_format LA8_UBYTE =
+      MESA_ARRAY_FORMAT(1, 0, 0, 1, 2, 0, 0, 0, 1);
+   const struct {
+      mesa_array_format src, dst;
+   } conversions[] = {
+      { RGBA32_FLOAT, RGBA16_FLOAT },
+      { RGBA16_FLOAT, RGBA32_FLOAT },
+      { RGBA32_FLOAT, RGBA8_UBYTE },
+      { RGBA8_UBYTE, RGBA32_FLOAT },
+      { BGR8_UBYTE, RGBA8_UBYTE },
+      { RGBA8_UBYTE, BGR8_UBYTE },
+      { LA8_UBYTE, RGBA32_FLOAT },
+      { RGBA32_FLOAT, LA8_UBYTE },
+   };
+   const unsigned width = 37;
+   uint8_t src[width * 16], row[width * 16], pixels[width * 16];
+   unsigned seed = 1;
+
+   for (unsigned c = 0; c < ARRAY_SIZE(conversions); c++) {
+      const mesa_array_format src_format = conversions[c].src;
+      const mesa_array_format dst_format = conversions[c].dst;
+      const unsigned src_bytes =
+         _mesa_array_format_get_num_channels(src_format) *
+         _mesa_array_format_datatype_get_size(
+            _mesa_array_format_get_datatype(src_format));
+      const unsigned dst_bytes =
+         _mesa_array_format_get_num_channels(dst_format) *
+         _mesa_array_format_datatype_get_size(
+            _mesa_array_format_get_datatype(dst_format));
+      SCOPED_TRACE(c);
+
+      for (unsigned i = 0; i < width * src_bytes; i++) {
+         seed = seed * 1103515245 + 12345;
+         src[i] = seed >> 16;
+      }
+      /* Keep the floats in a range that exercises the rounding. */
+      if (src_format == RGBA32_FLOAT) {
+         float *f = (float *) src;
+
+         for (unsigned i = 0; i < width * 4; i++)
+            f[i] = (float) ((seed + i * 7919) % 1200) / 960.0f - 0.1f;
+      }
+
+      memset(row, 0, sizeof(row));
+      memset(pixels, 0, sizeof(pixels));
+      _mesa_format_convert(row, dst_format, width * dst_bytes,
+                           src, src_format, width * src_bytes,
+                           width, 1, NULL);
+      for (unsigned x = 0; x < width; x++) {
+         _mesa_format_convert(&pixels[x * dst_bytes], dst_format, dst_bytes,
+                              &src[x * src_bytes], src_format, src_bytes,
+                              1, 1, NULL);
+      }
+      EXPECT_EQ(memcmp(row, pixels, width * dst_bytes), 0);
+   }
+}
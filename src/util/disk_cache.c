@@ -40,9 +40,15 @@
 #include <inttypes.h>
 #include "zlib.h"
 
+#ifdef HAVE_ZSTD
+#include "zstd.h"
+#endif
+
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/disk_cache_db.h"
 #include "util/rand_xor.h"
+#include "util/simple_mtx.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
 #include "util/mesa-sha1.h"
@@ -73,7 +79,11 @@
  * - There is no strict requirement that cache versions be backwards
  *   compatible but effort should be taken to limit disruption where possible.
  */
-#define CACHE_VERSION 1
+#define CACHE_VERSION 2
+
+/* Puts are written in batches of up to this many items or bytes. */
+#define CACHE_BATCH_MAX_JOBS 64
+#define CACHE_BATCH_MAX_SIZE (4 * 1024 * 1024)
 
 struct disk_cache {
    /* The path to the cache directory. */
@@ -99,6 +109,15 @@ struct disk_cache {
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
+   /* Single file store holding the cache entries, NULL if they are kept
+    * in a file each.
+    */
+   struct disk_cache_db *db;
+
+   /* Batch of puts still taking new ones, if any. */
+   simple_mtx_t batch_mutex;
+   struct disk_cache_put_batch *batch;
+
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
@@ -108,8 +127,6 @@ struct disk_cache {
 };
 
 struct disk_cache_put_job {
-   struct util_queue_fence fence;
-
    struct disk_cache *cache;
 
    cache_key key;
@@ -123,6 +140,20 @@ struct disk_cache_put_job {
    struct cache_item_metadata cache_item_metadata;
 };
 
+/* Puts written together by a single job of the cache queue. */
+struct disk_cache_put_batch {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   unsigned num_jobs;
+
+   /* Total size of the data of the puts. */
+   size_t size;
+
+   struct disk_cache_put_job *jobs[CACHE_BATCH_MAX_JOBS];
+};
+
 /* Create a directory named 'path' if it does not already exist.
  *
  * Returns: 0 if path already exists as a directory or if created.
@@ -369,6 +400,12 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
 
    cache->max_size = max_size;
 
+   /* Fall back to a file per entry if the single file store can't be
+    * opened.
+    */
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false))
+      cache->db = disk_cache_db_open(cache->path, max_size);
+
    /* 1 thread was chosen because we don't really care about getting things
     * to disk quickly just that it's not blocking other tasks.
     *
@@ -380,6 +417,8 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                    UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY |
                    UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY);
 
+   simple_mtx_init(&cache->batch_mutex, mtx_plain);
+
    cache->path_init_failed = false;
 
  path_fail:
@@ -437,6 +476,8 @@ disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache && !cache->path_init_failed) {
       util_queue_destroy(&cache->cache_queue);
+      simple_mtx_destroy(&cache->batch_mutex);
+      disk_cache_db_close(cache->db);
       munmap(cache->index_mmap, cache->index_mmap_size);
    }
 
@@ -672,6 +713,11 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   if (cache->db) {
+      disk_cache_db_remove(cache->db, key);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -719,80 +765,92 @@ write_all(int fd, const void *buf, size_t count)
    return done;
 }
 
-/* From the zlib docs:
- *    "If the memory is available, buffers sizes on the order of 128K or 256K
- *    bytes should be used."
- */
-#define BUFSIZE 256 * 1024
+/* Codecs of the cache entries, recorded in each entry. */
+enum cache_entry_codec {
+   CACHE_CODEC_NONE,
+   CACHE_CODEC_ZLIB,
+   CACHE_CODEC_ZSTD,
+};
 
-/**
- * Compresses cache entry in memory and writes it to disk. Returns the size
- * of the data written to disk.
+/* Entries smaller than this are stored uncompressed, compressing them
+ * saves a few bytes at best.
  */
-static size_t
-deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
-                          const char *filename)
-{
-   unsigned char *out;
+#define CACHE_COMPRESS_MIN_SIZE 256
 
-   /* allocate deflate state */
-   z_stream strm;
-   strm.zalloc = Z_NULL;
-   strm.zfree = Z_NULL;
-   strm.opaque = Z_NULL;
-   strm.next_in = (uint8_t *) in_data;
-   strm.avail_in = in_data_size;
-
-   int ret = deflateInit(&strm, Z_BEST_COMPRESSION);
-   if (ret != Z_OK)
-       return 0;
-
-   /* compress until end of in_data */
-   size_t compressed_size = 0;
-   int flush;
-
-   out = malloc(BUFSIZE * sizeof(unsigned char));
-   if (out == NULL)
-      return 0;
-
-   do {
-      int remaining = in_data_size - BUFSIZE;
-      flush = remaining > 0 ? Z_NO_FLUSH : Z_FINISH;
-      in_data_size -= BUFSIZE;
-
-      /* Run deflate() on input until the output buffer is not full (which
-       * means there is no more data to deflate).
-       */
-      do {
-         strm.avail_out = BUFSIZE;
-         strm.next_out = out;
-
-         ret = deflate(&strm, flush);    /* no bad return value */
-         assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
-
-         size_t have = BUFSIZE - strm.avail_out;
-         compressed_size += have;
+/* Entries from this size on are deflated with zlib's fastest level, the
+ * best level is what makes them slow to write.
+ */
+#define CACHE_ZLIB_FAST_MIN_SIZE (64 * 1024)
 
-         ssize_t written = write_all(dest, out, have);
-         if (written == -1) {
-            (void)deflateEnd(&strm);
-            free(out);
-            return 0;
-         }
-      } while (strm.avail_out == 0);
+/* The fastest zstd level compresses cache entries about as well as zlib's
+ * best level.
+ */
+#define CACHE_ZSTD_LEVEL 1
 
-      /* all input should be used */
-      assert(strm.avail_in == 0);
+static enum cache_entry_codec
+choose_codec(size_t size)
+{
+   if (size < CACHE_COMPRESS_MIN_SIZE)
+      return CACHE_CODEC_NONE;
 
-   } while (flush != Z_FINISH);
+#ifdef HAVE_ZSTD
+   return CACHE_CODEC_ZSTD;
+#else
+   return CACHE_CODEC_ZLIB;
+#endif
+}
 
-   /* stream should be complete */
-   assert(ret == Z_STREAM_END);
+/**
+ * Returns the maximum size of in_data_size bytes compressed with codec.
+ */
+static size_t
+compress_bound(enum cache_entry_codec codec, size_t in_data_size)
+{
+   switch (codec) {
+   case CACHE_CODEC_ZLIB:
+      return compressBound(in_data_size);
+#ifdef HAVE_ZSTD
+   case CACHE_CODEC_ZSTD:
+      return ZSTD_compressBound(in_data_size);
+#endif
+   default:
+      return in_data_size;
+   }
+}
 
-   /* clean up and return */
-   (void)deflateEnd(&strm);
-   free(out);
-   return compressed_size;
+/**
+ * Compresses cache data in memory. Returns the compressed size, or 0 on
+ * failure.
+ */
+static size_t
+compress_cache_data(enum cache_entry_codec codec,
+                    const void *in_data, size_t in_data_size,
+                    uint8_t *out_data, size_t out_data_size)
+{
+   switch (codec) {
+   case CACHE_CODEC_NONE:
+      memcpy(out_data, in_data, in_data_size);
+      return in_data_size;
+   case CACHE_CODEC_ZLIB: {
+      uLongf compressed_size = out_data_size;
+      int level = in_data_size >= CACHE_ZLIB_FAST_MIN_SIZE ?
+                  Z_BEST_SPEED : Z_BEST_COMPRESSION;
+
+      if (compress2(out_data, &compressed_size, in_data, in_data_size,
+                    level) != Z_OK)
+         return 0;
+      return compressed_size;
+   }
+#ifdef HAVE_ZSTD
+   case CACHE_CODEC_ZSTD: {
+      size_t ret = ZSTD_compress(out_data, out_data_size, in_data,
+                                 in_data_size, CACHE_ZSTD_LEVEL);
+      return ZSTD_isError(ret) ? 0 : ret;
+   }
+#endif
+   default:
+      return 0;
+   }
 }
 
 static struct disk_cache_put_job *
@@ -854,17 +912,86 @@ destroy_put_job(void *job, int thread_index)
 struct cache_entry_file_data {
    uint32_t crc32;
    uint32_t uncompressed_size;
+   uint32_t codec;
 };
 
-static void
-cache_put(void *job, int thread_index)
+/**
+ * Builds the cache entry of a put in memory: the driver keys, the cache
+ * item metadata, the CRC, and the data, compressed with a codec chosen by
+ * its size.  Returns the entry, to be freed by the caller, or NULL.
+ */
+static uint8_t *
+create_cache_entry(struct disk_cache_put_job *dc_job, size_t *entry_size)
 {
-   assert(job);
+   struct disk_cache *cache = dc_job->cache;
+   struct cache_item_metadata *md = &dc_job->cache_item_metadata;
+   struct cache_entry_file_data cf_data;
+   uint8_t *entry, *p;
+
+   size_t md_size = sizeof(uint32_t);
+   if (md->type == CACHE_ITEM_TYPE_GLSL)
+      md_size += sizeof(uint32_t) + md->num_keys * sizeof(cache_key);
+
+   size_t header_size =
+      cache->driver_keys_blob_size + md_size + sizeof(cf_data);
+   enum cache_entry_codec codec = choose_codec(dc_job->size);
+   size_t max_compressed_size = compress_bound(codec, dc_job->size);
 
+   entry = malloc(header_size + max_compressed_size);
+   if (!entry)
+      return NULL;
+
+   /* Write the driver_keys_blob, this can be used find information about the
+    * mesa version that produced the entry or deal with hash collisions,
+    * should that ever become a real problem.
+    */
+   p = entry;
+   memcpy(p, cache->driver_keys_blob, cache->driver_keys_blob_size);
+   p += cache->driver_keys_blob_size;
+
+   /* Write the cache item metadata. This data can be used to deal with
+    * hash collisions, as well as providing useful information to 3rd party
+    * tools reading the cache files.
+    */
+   memcpy(p, &md->type, sizeof(uint32_t));
+   p += sizeof(uint32_t);
+   if (md->type == CACHE_ITEM_TYPE_GLSL) {
+      memcpy(p, &md->num_keys, sizeof(uint32_t));
+      p += sizeof(uint32_t);
+      memcpy(p, md->keys, md->num_keys * sizeof(cache_key));
+      p += md->num_keys * sizeof(cache_key);
+   }
+
+   /* Create CRC of the data. We will read this when restoring the cache and
+    * use it to check for corruption.
+    */
+   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+   cf_data.uncompressed_size = dc_job->size;
+   cf_data.codec = codec;
+   memcpy(p, &cf_data, sizeof(cf_data));
+   p += sizeof(cf_data);
+
+   size_t compressed_size =
+      compress_cache_data(codec, dc_job->data, dc_job->size,
+                          p, max_compressed_size);
+   if (compressed_size == 0) {
+      free(entry);
+      return NULL;
+   }
+
+   *entry_size = header_size + compressed_size;
+
+   return entry;
+}
+
+static void
+cache_put(struct disk_cache_put_job *dc_job)
+{
    int fd = -1, fd_final = -1, err, ret;
    unsigned i = 0;
    char *filename = NULL, *filename_tmp = NULL;
-   struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
+   uint8_t *entry = NULL;
+   size_t entry_size;
 
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
@@ -933,67 +1060,18 @@ cache_put(void *job, int thread_index)
     * not in the cache, and is also not being written out to the cache
     * by some other process.
     */
-
-   /* Write the driver_keys_blob, this can be used find information about the
-    * mesa version that produced the entry or deal with hash collisions,
-    * should that ever become a real problem.
-    */
-   ret = write_all(fd, dc_job->cache->driver_keys_blob,
-                   dc_job->cache->driver_keys_blob_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Write the cache item metadata. This data can be used to deal with
-    * hash collisions, as well as providing useful information to 3rd party
-    * tools reading the cache files.
-    */
-   ret = write_all(fd, &dc_job->cache_item_metadata.type,
-                   sizeof(uint32_t));
-   if (ret == -1) {
+   entry = create_cache_entry(dc_job, &entry_size);
+   if (!entry) {
       unlink(filename_tmp);
       goto done;
    }
 
-   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
-      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
-                      sizeof(uint32_t));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-
-      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
-                      dc_job->cache_item_metadata.num_keys *
-                      sizeof(cache_key));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-   }
-
-   /* Create CRC of the data. We will read this when restoring the cache and
-    * use it to check for corruption.
-    */
-   struct cache_entry_file_data cf_data;
-   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
-   cf_data.uncompressed_size = dc_job->size;
-
-   size_t cf_data_size = sizeof(cf_data);
-   ret = write_all(fd, &cf_data, cf_data_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Now, finally, write out the contents to the temporary file, then
-    * rename them atomically to the destination filename, and also
+   /* Now, finally, write out the entry to the temporary file, then
+    * rename it atomically to the destination filename, and also
     * perform an atomic increment of the total cache size.
     */
-   size_t file_size = deflate_and_write_to_disk(dc_job->data, dc_job->size,
-                                                fd, filename_tmp);
-   if (file_size == 0) {
+   ret = write_all(fd, entry, entry_size);
+   if (ret == -1) {
       unlink(filename_tmp);
       goto done;
    }
@@ -1020,15 +1098,82 @@ cache_put(void *job, int thread_index)
     */
    if (fd != -1)
       close(fd);
+   free(entry);
    free(filename_tmp);
    free(filename);
 }
 
+/**
+ * Adds the entries of a batch to the single file store, with a single
+ * write.
+ */
+static void
+cache_put_db(struct disk_cache_put_batch *batch)
+{
+   struct disk_cache_db_item items[CACHE_BATCH_MAX_JOBS];
+   unsigned num_items = 0;
+
+   for (unsigned i = 0; i < batch->num_jobs; i++) {
+      struct disk_cache_db_item *item = &items[num_items];
+      size_t entry_size;
+
+      item->data = create_cache_entry(batch->jobs[i], &entry_size);
+      if (!item->data)
+         continue;
+
+      item->key = batch->jobs[i]->key;
+      item->size = entry_size;
+      num_items++;
+   }
+
+   if (num_items)
+      disk_cache_db_put(batch->cache->db, items, num_items);
+
+   for (unsigned i = 0; i < num_items; i++)
+      free((void *) items[i].data);
+}
+
+static void
+cache_put_batch(void *job, int thread_index)
+{
+   assert(job);
+
+   struct disk_cache_put_batch *batch = (struct disk_cache_put_batch *) job;
+   struct disk_cache *cache = batch->cache;
+
+   /* From now on, puts go to a new batch. */
+   simple_mtx_lock(&cache->batch_mutex);
+   if (cache->batch == batch)
+      cache->batch = NULL;
+   simple_mtx_unlock(&cache->batch_mutex);
+
+   if (cache->db) {
+      cache_put_db(batch);
+      return;
+   }
+
+   for (unsigned i = 0; i < batch->num_jobs; i++)
+      cache_put(batch->jobs[i]);
+}
+
+static void
+destroy_put_batch(void *job, int thread_index)
+{
+   struct disk_cache_put_batch *batch = (struct disk_cache_put_batch *) job;
+
+   for (unsigned i = 0; i < batch->num_jobs; i++)
+      destroy_put_job(batch->jobs[i], thread_index);
+
+   free(batch);
+}
+
 void
 disk_cache_put(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
                struct cache_item_metadata *cache_item_metadata)
 {
+   struct disk_cache_put_batch *batch;
+
    if (cache->blob_put_cb) {
       cache->blob_put_cb(key, CACHE_KEY_SIZE, data, size);
       return;
@@ -1040,11 +1185,47 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata);
 
-   if (dc_job) {
-      util_queue_fence_init(&dc_job->fence);
-      util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
-                         cache_put, destroy_put_job);
+   if (!dc_job)
+      return;
+
+   /* Join the batch waiting in the queue, if it has room left, so that a
+    * burst of puts is written in one go.
+    */
+   simple_mtx_lock(&cache->batch_mutex);
+
+   batch = cache->batch;
+   if (!batch || batch->num_jobs == CACHE_BATCH_MAX_JOBS ||
+       (batch->num_jobs && batch->size + size > CACHE_BATCH_MAX_SIZE)) {
+      batch = calloc(1, sizeof(*batch));
+      if (!batch) {
+         simple_mtx_unlock(&cache->batch_mutex);
+         destroy_put_job(dc_job, 0);
+         return;
+      }
+
+      batch->cache = cache;
+      cache->batch = batch;
+
+      /* The batch can't start before the lock is released. */
+      util_queue_fence_init(&batch->fence);
+      util_queue_add_job(&cache->cache_queue, batch, &batch->fence,
+                         cache_put_batch, destroy_put_batch);
    }
+
+   batch->jobs[batch->num_jobs++] = dc_job;
+   batch->size += size;
+
+   simple_mtx_unlock(&cache->batch_mutex);
+}
+
+void
+disk_cache_wait_for_idle(struct disk_cache *cache)
+{
+   /* The batch still taking puts is already queued, so this writes it too:
+    * puts made once it has started go to a new batch.
+    */
+   if (!cache->path_init_failed)
+      util_queue_finish(&cache->cache_queue);
 }
 
 /**
@@ -1086,6 +1267,114 @@ inflate_cache_data(uint8_t *in_data, size_t in_data_size,
    return true;
 }
 
+/**
+ * Decompresses cache data compressed with codec, returns true if
+ * successful.
+ */
+static bool
+decompress_cache_data(enum cache_entry_codec codec,
+                      const uint8_t *in_data, size_t in_data_size,
+                      uint8_t *out_data, size_t out_data_size)
+{
+   switch (codec) {
+   case CACHE_CODEC_NONE:
+      if (in_data_size != out_data_size)
+         return false;
+      memcpy(out_data, in_data, in_data_size);
+      return true;
+   case CACHE_CODEC_ZLIB:
+      return inflate_cache_data((uint8_t *) in_data, in_data_size,
+                                out_data, out_data_size);
+#ifdef HAVE_ZSTD
+   case CACHE_CODEC_ZSTD: {
+      size_t ret = ZSTD_decompress(out_data, out_data_size,
+                                   in_data, in_data_size);
+      return !ZSTD_isError(ret) && ret == out_data_size;
+   }
+#endif
+   default:
+      /* Written by a build with a codec this one lacks. */
+      return false;
+   }
+}
+
+/**
+ * Checks and decompresses a cache entry, as read from a cache file or from
+ * the single file store.  Returns the uncompressed data, or NULL.
+ */
+static void *
+parse_cache_entry(struct disk_cache *cache, const uint8_t *entry,
+                  size_t entry_size, size_t *size)
+{
+   size_t ck_size = cache->driver_keys_blob_size;
+   size_t offset = 0;
+   uint8_t *uncompressed_data;
+
+   if (entry_size < ck_size + sizeof(uint32_t))
+      return NULL;
+
+   /* Check for extremely unlikely hash collisions */
+   if (memcmp(cache->driver_keys_blob, entry, ck_size) != 0) {
+      assert(!"Mesa cache keys mismatch!");
+      return NULL;
+   }
+   offset += ck_size;
+
+   uint32_t md_type;
+   memcpy(&md_type, entry + offset, sizeof(uint32_t));
+   offset += sizeof(uint32_t);
+
+   if (md_type == CACHE_ITEM_TYPE_GLSL) {
+      uint32_t num_keys;
+      if (entry_size - offset < sizeof(uint32_t))
+         return NULL;
+      memcpy(&num_keys, entry + offset, sizeof(uint32_t));
+      offset += sizeof(uint32_t);
+
+      /* The cache item metadata is currently just used for distributing
+       * precompiled shaders, they are not used by Mesa so just skip them for
+       * now.
+       * TODO: pass the metadata back to the caller and do some basic
+       * validation.
+       */
+      if ((entry_size - offset) / sizeof(cache_key) < num_keys)
+         return NULL;
+      offset += num_keys * sizeof(cache_key);
+   }
+
+   /* Load the CRC that was created when the file was written. */
+   struct cache_entry_file_data cf_data;
+   if (entry_size - offset < sizeof(cf_data))
+      return NULL;
+   memcpy(&cf_data, entry + offset, sizeof(cf_data));
+   offset += sizeof(cf_data);
+
+   /* Uncompress the cache data */
+   uncompressed_data = malloc(cf_data.uncompressed_size);
+   if (!uncompressed_data)
+      return NULL;
+
+   if (!decompress_cache_data(cf_data.codec, entry + offset,
+                              entry_size - offset, uncompressed_data,
+                              cf_data.uncompressed_size))
+      goto fail;
+
+   /* Check the data for corruption */
+   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
+                                        cf_data.uncompressed_size))
+      goto fail;
+
+   if (size)
+      *size = cf_data.uncompressed_size;
+
+   return uncompressed_data;
+
+ fail:
+   free(uncompressed_data);
+
+   return NULL;
+}
+
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
 {
@@ -1093,8 +1382,7 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    struct stat sb;
    char *filename = NULL;
    uint8_t *data = NULL;
-   uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
+   void *uncompressed_data = NULL;
 
    if (size)
       *size = 0;
@@ -1121,6 +1409,22 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
+   if (cache->db) {
+      struct disk_cache_db_map *map;
+      const void *entry;
+      size_t entry_size;
+
+      /* The entry is read in place from the mapping of the store. */
+      entry = disk_cache_db_get(cache->db, key, &entry_size, &map);
+      if (!entry)
+         return NULL;
+
+      uncompressed_data = parse_cache_entry(cache, entry, entry_size, size);
+      disk_cache_db_release(cache->db, map);
+
+      return uncompressed_data;
+   }
+
    filename = get_cache_file(cache, key);
    if (filename == NULL)
       goto fail;
@@ -1136,97 +1440,21 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    if (data == NULL)
       goto fail;
 
-   size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
-
-   if (sb.st_size < ck_size)
-      goto fail;
-
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
-      goto fail;
-
-   /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
-      assert(!"Mesa cache keys mismatch!");
-      goto fail;
-   }
-
-   size_t cache_item_md_size = sizeof(uint32_t);
-   uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
-      goto fail;
-
-   if (md_type == CACHE_ITEM_TYPE_GLSL) {
-      uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
-         goto fail;
-
-      /* The cache item metadata is currently just used for distributing
-       * precompiled shaders, they are not used by Mesa so just skip them for
-       * now.
-       * TODO: pass the metadata back to the caller and do some basic
-       * validation.
-       */
-      cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
-   }
-
-   /* Load the CRC that was created when the file was written. */
-   struct cache_entry_file_data cf_data;
-   size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
+   ret = read_all(fd, data, sb.st_size);
    if (ret == -1)
       goto fail;
 
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
-   if (ret == -1)
-      goto fail;
-
-   /* Uncompress the cache data */
-   uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
-      goto fail;
-
-   /* Check the data for corruption */
-   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
-                                        cf_data.uncompressed_size))
-      goto fail;
-
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
-
-   if (size)
-      *size = cf_data.uncompressed_size;
-
-   return uncompressed_data;
+   uncompressed_data = parse_cache_entry(cache, data, sb.st_size, size);
 
  fail:
    if (data)
       free(data);
-   if (uncompressed_data)
-      free(uncompressed_data);
    if (filename)
       free(filename);
-   if (file_header)
-      free(file_header);
    if (fd != -1)
       close(fd);
 
-   return NULL;
+   return uncompressed_data;
 }
 
 void
@@ -194,6 +194,15 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
                struct cache_item_metadata *cache_item_metadata);
 
+/**
+ * Wait until the batches of items given to disk_cache_put() are written.
+ *
+ * disk_cache_destroy() drops the items not written yet, this lets the
+ * caller decide whether they are worth the wait.
+ */
+void
+disk_cache_wait_for_idle(struct disk_cache *cache);
+
 /**
  * Retrieve an item previously stored in the cache with the name <key>.
  *
@@ -268,6 +277,11 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    return;
 }
 
+static inline void
+disk_cache_wait_for_idle(struct disk_cache *cache) {
+   return;
+}
+
 static inline void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
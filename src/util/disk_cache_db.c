@@ -0,0 +1,852 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "util/disk_cache.h"
+#include "util/disk_cache_db.h"
+#include "util/ralloc.h"
+#include "util/simple_mtx.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+
+#define DB_MAGIC 0x4244434d /* "MCDB" */
+
+/* Bump this whenever the layout of the index or of the pack changes. */
+#define DB_VERSION 1
+
+/* Number of slots of the hash table in the index, a power of two. */
+#define DB_INDEX_SLOTS (1 << 16)
+
+/* The pack is rewritten once this many slots are in use, so that probe
+ * sequences stay short.
+ */
+#define DB_INDEX_MAX_USED (DB_INDEX_SLOTS / 4 * 3)
+
+/* Mappings of the pack are rounded up to this size, so that a mapping keeps
+ * covering the pack through a number of appends.
+ */
+#define DB_MAP_ALIGN (4 * 1024 * 1024)
+
+struct db_index_header {
+   uint32_t magic;
+   uint32_t version;
+
+   /* Bumped twice by each rewrite of the pack: it is odd while the index
+    * and the pack are being rewritten.
+    */
+   uint64_t generation;
+
+   /* End of the valid data in the pack. */
+   uint64_t pack_size;
+
+   /* Size of the entries still referenced by the index. */
+   uint64_t live_size;
+
+   /* Clock of the last_access stamps, ticking on each lookup. */
+   uint64_t access_clock;
+
+   /* Slots that are not empty, including those of removed entries. */
+   uint32_t num_used;
+   uint32_t pad;
+};
+
+struct db_index_slot {
+   uint8_t key[CACHE_KEY_SIZE];
+
+   /* Size of the entry data, 0 if the entry was removed. */
+   uint32_t size;
+
+   /* Offset of the entry in the pack, 0 if the slot is empty. */
+   uint64_t offset;
+
+   uint64_t last_access;
+};
+
+struct db_pack_header {
+   uint32_t magic;
+   uint32_t version;
+   uint64_t generation;
+};
+
+/* Each entry of the pack, aligned to 8 bytes, is this header followed by
+ * the entry data.
+ */
+struct db_pack_entry {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t size;
+};
+
+struct disk_cache_db_map {
+   /* Protected by disk_cache_db::map_mutex. */
+   unsigned refcount;
+
+   uint64_t generation;
+   uint8_t *ptr;
+   size_t size;
+};
+
+struct disk_cache_db {
+   char *index_path;
+   char *pack_path;
+   char *pack_tmp_path;
+
+   uint64_t max_size;
+
+   int index_fd;
+   size_t index_size;
+   struct db_index_header *header;
+   struct db_index_slot *slots;
+
+   /* Serializes the writers of this process, those of other processes are
+    * kept out by the lock on the index file.
+    */
+   simple_mtx_t write_mutex;
+
+   /* Pack file written by this process, and its generation. */
+   int pack_fd;
+   uint64_t pack_generation;
+
+   /* Latest mapping of the pack for lookups. */
+   simple_mtx_t map_mutex;
+   struct disk_cache_db_map *map;
+};
+
+static inline uint64_t
+entry_size(uint32_t size)
+{
+   return align64(sizeof(struct db_pack_entry) + size, 8);
+}
+
+static bool
+lock_index(struct disk_cache_db *db)
+{
+   int err;
+
+   simple_mtx_lock(&db->write_mutex);
+
+#ifdef HAVE_FLOCK
+   do {
+      err = flock(db->index_fd, LOCK_EX);
+   } while (err == -1 && errno == EINTR);
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_WRLCK,
+      .l_whence = SEEK_SET
+   };
+   do {
+      err = fcntl(db->index_fd, F_SETLKW, &lock);
+   } while (err == -1 && errno == EINTR);
+#endif
+
+   if (err == -1) {
+      simple_mtx_unlock(&db->write_mutex);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+unlock_index(struct disk_cache_db *db)
+{
+#ifdef HAVE_FLOCK
+   flock(db->index_fd, LOCK_UN);
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_UNLCK,
+      .l_whence = SEEK_SET
+   };
+   fcntl(db->index_fd, F_SETLK, &lock);
+#endif
+
+   simple_mtx_unlock(&db->write_mutex);
+}
+
+static bool
+pwrite_all(int fd, const void *buf, size_t count, uint64_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return false;
+   }
+
+   return true;
+}
+
+/* Write an entry of the pack at offset, padding included. */
+static bool
+write_entry(int fd, uint64_t offset, const uint8_t *key, const void *data,
+            uint32_t size)
+{
+   static const uint8_t zero[8];
+   struct db_pack_entry entry;
+   size_t end = sizeof(entry) + size;
+
+   memcpy(entry.key, key, CACHE_KEY_SIZE);
+   entry.size = size;
+
+   return pwrite_all(fd, &entry, sizeof(entry), offset) &&
+          pwrite_all(fd, data, size, offset + sizeof(entry)) &&
+          pwrite_all(fd, zero, entry_size(size) - end, offset + end);
+}
+
+/* Find the slot of key.  For an insertion, an empty slot or one of a
+ * removed entry is returned if key is not in the index.
+ *
+ * Lookups run concurrently with the writers, so the returned slot may be
+ * torn or reused; the callers check the entry in the pack.
+ */
+static struct db_index_slot *
+find_slot(struct disk_cache_db *db, const uint8_t *key, bool insert)
+{
+   struct db_index_slot *free_slot = NULL;
+   uint32_t hash;
+
+   memcpy(&hash, key, sizeof(hash));
+
+   for (unsigned i = 0; i < DB_INDEX_SLOTS; i++) {
+      struct db_index_slot *slot =
+         &db->slots[(hash + i) & (DB_INDEX_SLOTS - 1)];
+
+      if (slot->offset == 0)
+         return insert ? (free_slot ? free_slot : slot) : NULL;
+
+      if (slot->size == 0) {
+         if (!free_slot)
+            free_slot = slot;
+         continue;
+      }
+
+      if (memcmp(slot->key, key, CACHE_KEY_SIZE) == 0)
+         return slot;
+   }
+
+   return insert ? free_slot : NULL;
+}
+
+static bool
+read_pack_header(int fd, uint64_t generation)
+{
+   struct db_pack_header pack_header;
+
+   if (pread(fd, &pack_header, sizeof(pack_header), 0) != sizeof(pack_header))
+      return false;
+
+   return pack_header.magic == DB_MAGIC &&
+          pack_header.version == DB_VERSION &&
+          pack_header.generation == generation;
+}
+
+/* Create an empty pack file of the given generation in place of the
+ * current one.  Readers still mapping the old file keep it alive.
+ */
+static int
+create_pack(struct disk_cache_db *db, uint64_t generation)
+{
+   struct db_pack_header pack_header = {
+      .magic = DB_MAGIC,
+      .version = DB_VERSION,
+      .generation = generation,
+   };
+   int fd;
+
+   fd = open(db->pack_tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd == -1)
+      return -1;
+
+   if (!pwrite_all(fd, &pack_header, sizeof(pack_header), 0)) {
+      close(fd);
+      unlink(db->pack_tmp_path);
+      return -1;
+   }
+
+   return fd;
+}
+
+/* Open the pack file of the current generation for writing, with the
+ * index locked.
+ */
+static bool
+open_pack(struct disk_cache_db *db)
+{
+   uint64_t generation = db->header->generation;
+
+   if (db->pack_fd != -1 && db->pack_generation == generation)
+      return true;
+
+   if (db->pack_fd != -1)
+      close(db->pack_fd);
+
+   db->pack_fd = open(db->pack_path, O_RDWR | O_CLOEXEC);
+   if (db->pack_fd == -1)
+      return false;
+
+   if (!read_pack_header(db->pack_fd, generation)) {
+      close(db->pack_fd);
+      db->pack_fd = -1;
+      return false;
+   }
+
+   db->pack_generation = generation;
+
+   return true;
+}
+
+/* Start over with an empty index and pack, with the index locked. */
+static bool
+reset_db(struct disk_cache_db *db)
+{
+   struct db_index_header *header = db->header;
+   uint64_t generation;
+   int fd;
+
+   /* Make sure that nobody takes the old pack for the new one. */
+   generation = header->magic == DB_MAGIC ?
+                align64(header->generation + 2, 2) : 2;
+
+   fd = create_pack(db, generation);
+   if (fd == -1)
+      return false;
+
+   p_atomic_set(&header->generation, generation - 1);
+
+   if (rename(db->pack_tmp_path, db->pack_path) == -1) {
+      close(fd);
+      unlink(db->pack_tmp_path);
+      return false;
+   }
+
+   memset(db->slots, 0, DB_INDEX_SLOTS * sizeof(*db->slots));
+   header->magic = DB_MAGIC;
+   header->version = DB_VERSION;
+   header->pack_size = sizeof(struct db_pack_header);
+   header->live_size = 0;
+   header->access_clock = 0;
+   header->num_used = 0;
+   p_atomic_inc(&header->generation);
+
+   if (db->pack_fd != -1)
+      close(db->pack_fd);
+   db->pack_fd = fd;
+   db->pack_generation = generation;
+
+   return true;
+}
+
+static int
+compare_last_access(const void *a, const void *b)
+{
+   const struct db_index_slot *slot_a = a;
+   const struct db_index_slot *slot_b = b;
+
+   /* Most recently used first */
+   if (slot_a->last_access != slot_b->last_access)
+      return slot_a->last_access > slot_b->last_access ? -1 : 1;
+   return 0;
+}
+
+/* Rewrite the pack with the most recently used entries only, leaving room
+ * for needed more bytes, with the index locked.
+ */
+static bool
+compact(struct disk_cache_db *db, uint64_t needed)
+{
+   struct db_index_header *header = db->header;
+   struct db_index_slot *live;
+   unsigned num_live = 0, num_kept = 0;
+   uint64_t target = db->max_size / 4 * 3;
+   uint64_t kept_size = 0, offset, generation;
+   uint8_t *old_pack;
+   int fd;
+
+   if (!open_pack(db))
+      return reset_db(db);
+
+   live = malloc(MAX2(header->num_used, 1) * sizeof(*live));
+   if (!live)
+      return false;
+
+   for (unsigned i = 0; i < DB_INDEX_SLOTS; i++) {
+      if (db->slots[i].offset && db->slots[i].size && num_live < header->num_used)
+         live[num_live++] = db->slots[i];
+   }
+
+   /* Keep the most recently used entries within 3/4 of the maximum size,
+    * so that the next rewrite does not come right away.
+    */
+   qsort(live, num_live, sizeof(*live), compare_last_access);
+   while (num_kept < num_live &&
+          kept_size + entry_size(live[num_kept].size) + needed <= target &&
+          num_kept < DB_INDEX_MAX_USED / 2) {
+      kept_size += entry_size(live[num_kept].size);
+      num_kept++;
+   }
+
+   old_pack = mmap(NULL, header->pack_size, PROT_READ, MAP_SHARED,
+                   db->pack_fd, 0);
+   if (old_pack == MAP_FAILED) {
+      free(live);
+      return false;
+   }
+
+   generation = header->generation + 2;
+   fd = create_pack(db, generation);
+   if (fd == -1) {
+      munmap(old_pack, header->pack_size);
+      free(live);
+      return false;
+   }
+
+   offset = sizeof(struct db_pack_header);
+   for (unsigned i = 0; i < num_kept; i++) {
+      const struct db_pack_entry *entry =
+         (const void *)(old_pack + live[i].offset);
+
+      if (live[i].offset + entry_size(live[i].size) > header->pack_size ||
+          memcmp(entry->key, live[i].key, CACHE_KEY_SIZE) != 0 ||
+          !write_entry(fd, offset, live[i].key, entry + 1, live[i].size)) {
+         live[i].size = 0;
+         continue;
+      }
+
+      live[i].offset = offset;
+      offset += entry_size(live[i].size);
+   }
+
+   munmap(old_pack, header->pack_size);
+
+   /* Lookups give up while the generation is odd. */
+   p_atomic_inc(&header->generation);
+
+   if (rename(db->pack_tmp_path, db->pack_path) == -1) {
+      p_atomic_dec(&header->generation);
+      close(fd);
+      unlink(db->pack_tmp_path);
+      free(live);
+      return false;
+   }
+
+   memset(db->slots, 0, DB_INDEX_SLOTS * sizeof(*db->slots));
+   header->num_used = 0;
+   for (unsigned i = 0; i < num_kept; i++) {
+      if (live[i].size == 0)
+         continue;
+
+      *find_slot(db, live[i].key, true) = live[i];
+      header->num_used++;
+   }
+   header->pack_size = offset;
+   header->live_size = offset - sizeof(struct db_pack_header);
+   p_atomic_inc(&header->generation);
+
+   close(db->pack_fd);
+   db->pack_fd = fd;
+   db->pack_generation = generation;
+
+   free(live);
+
+   return true;
+}
+
+struct disk_cache_db *
+disk_cache_db_open(const char *path, uint64_t max_size)
+{
+   struct disk_cache_db *db;
+   struct stat sb;
+   void *index_mmap;
+   bool reset;
+
+   db = rzalloc(NULL, struct disk_cache_db);
+   if (!db)
+      return NULL;
+
+   db->index_fd = -1;
+   db->pack_fd = -1;
+   db->max_size = max_size;
+   simple_mtx_init(&db->write_mutex, mtx_plain);
+   simple_mtx_init(&db->map_mutex, mtx_plain);
+
+   db->index_path = ralloc_asprintf(db, "%s/pack.idx", path);
+   db->pack_path = ralloc_asprintf(db, "%s/pack", path);
+   db->pack_tmp_path = ralloc_asprintf(db, "%s/pack.tmp", path);
+   if (!db->index_path || !db->pack_path || !db->pack_tmp_path)
+      goto fail;
+
+   db->index_fd = open(db->index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (db->index_fd == -1)
+      goto fail;
+
+   if (!lock_index(db))
+      goto fail;
+
+   if (fstat(db->index_fd, &sb) == -1)
+      goto fail_unlock;
+
+   /* Force the index file to be the expected size. */
+   db->index_size = sizeof(struct db_index_header) +
+                    DB_INDEX_SLOTS * sizeof(struct db_index_slot);
+   if (sb.st_size != db->index_size) {
+      if (ftruncate(db->index_fd, db->index_size) == -1)
+         goto fail_unlock;
+   }
+
+   /* Shared, so that the lookups of all processes see the entries and
+    * update the access stamps used for the eviction.
+    */
+   index_mmap = mmap(NULL, db->index_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, db->index_fd, 0);
+   if (index_mmap == MAP_FAILED)
+      goto fail_unlock;
+
+   db->header = index_mmap;
+   db->slots = (struct db_index_slot *)(db->header + 1);
+
+   /* An odd generation means a writer died while rewriting the pack. */
+   reset = db->header->magic != DB_MAGIC ||
+           db->header->version != DB_VERSION ||
+           (db->header->generation & 1) ||
+           !open_pack(db) ||
+           fstat(db->pack_fd, &sb) == -1 ||
+           sb.st_size < db->header->pack_size;
+
+   if (reset && !reset_db(db))
+      goto fail_unlock;
+
+   unlock_index(db);
+
+   return db;
+
+ fail_unlock:
+   unlock_index(db);
+ fail:
+   disk_cache_db_close(db);
+
+   return NULL;
+}
+
+static void
+unref_map(struct disk_cache_db_map *map)
+{
+   if (--map->refcount == 0) {
+      munmap(map->ptr, map->size);
+      free(map);
+   }
+}
+
+void
+disk_cache_db_close(struct disk_cache_db *db)
+{
+   if (!db)
+      return;
+
+   if (db->map)
+      unref_map(db->map);
+
+   if (db->header)
+      munmap(db->header, db->index_size);
+   if (db->pack_fd != -1)
+      close(db->pack_fd);
+   if (db->index_fd != -1)
+      close(db->index_fd);
+
+   simple_mtx_destroy(&db->map_mutex);
+   simple_mtx_destroy(&db->write_mutex);
+
+   ralloc_free(db);
+}
+
+bool
+disk_cache_db_put(struct disk_cache_db *db,
+                  const struct disk_cache_db_item *items, unsigned num_items)
+{
+   struct db_index_header *header = db->header;
+   uint64_t offset, needed = 0, *offsets;
+   unsigned num_new = 0;
+   uint8_t *buf = NULL;
+   bool ret = false;
+
+   for (unsigned i = 0; i < num_items; i++) {
+      if (items[i].size == 0 || items[i].size > UINT32_MAX)
+         return false;
+   }
+
+   /* Offset in the pack of each item, 0 for the items already there. */
+   offsets = calloc(num_items, sizeof(*offsets));
+   if (!offsets)
+      return false;
+
+   if (!lock_index(db)) {
+      free(offsets);
+      return false;
+   }
+
+   /* Another process may have written some of them already. */
+   for (unsigned i = 0; i < num_items; i++) {
+      if (!find_slot(db, items[i].key, false)) {
+         needed += entry_size(items[i].size);
+         num_new++;
+      }
+   }
+
+   if (num_new == 0) {
+      ret = true;
+      goto unlock;
+   }
+
+   if (header->pack_size + needed > db->max_size ||
+       header->num_used + num_new > DB_INDEX_MAX_USED) {
+      if (!compact(db, needed))
+         goto unlock;
+   }
+
+   if (!open_pack(db))
+      goto unlock;
+
+   /* Append the whole batch with a single write, padding included. */
+   buf = calloc(1, needed);
+   if (!buf)
+      goto unlock;
+
+   /* Anything after pack_size was left by a writer that failed, and is
+    * overwritten.
+    */
+   offset = header->pack_size;
+   for (unsigned i = 0; i < num_items; i++) {
+      struct db_pack_entry entry;
+      uint8_t *dst;
+
+      if (find_slot(db, items[i].key, false))
+         continue;
+
+      memcpy(entry.key, items[i].key, CACHE_KEY_SIZE);
+      entry.size = items[i].size;
+
+      dst = buf + (offset - header->pack_size);
+      memcpy(dst, &entry, sizeof(entry));
+      memcpy(dst + sizeof(entry), items[i].data, items[i].size);
+
+      offsets[i] = offset;
+      offset += entry_size(items[i].size);
+   }
+
+   if (!pwrite_all(db->pack_fd, buf, needed, header->pack_size))
+      goto unlock;
+
+   /* Make the data visible before the slots pointing at it. */
+   p_atomic_add(&header->pack_size, needed);
+   header->live_size += needed;
+
+   for (unsigned i = 0; i < num_items; i++) {
+      struct db_index_slot *slot;
+
+      /* The same key may come twice in a batch. */
+      if (offsets[i] == 0 || find_slot(db, items[i].key, false))
+         continue;
+
+      slot = find_slot(db, items[i].key, true);
+      if (slot->offset == 0)
+         header->num_used++;
+      memcpy(slot->key, items[i].key, CACHE_KEY_SIZE);
+      slot->last_access = p_atomic_inc_return(&header->access_clock);
+      slot->offset = offsets[i];
+      p_atomic_set(&slot->size, items[i].size);
+   }
+
+   ret = true;
+
+ unlock:
+   unlock_index(db);
+   free(buf);
+   free(offsets);
+
+   return ret;
+}
+
+/* Map the pack file of the given generation, up to at least size bytes. */
+static struct disk_cache_db_map *
+map_pack(struct disk_cache_db *db, uint64_t generation, uint64_t size)
+{
+   struct disk_cache_db_map *map;
+   int fd;
+
+   map = malloc(sizeof(*map));
+   if (!map)
+      return NULL;
+
+   fd = open(db->pack_path, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      goto fail;
+
+   /* The pack is only replaced while the generation is odd, so this is the
+    * pack of the generation if the latter did not change meanwhile.
+    */
+   if (!read_pack_header(fd, generation) ||
+       p_atomic_read(&db->header->generation) != generation)
+      goto fail_close;
+
+   map->size = align64(size, DB_MAP_ALIGN);
+   map->ptr = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0);
+   if (map->ptr == MAP_FAILED)
+      goto fail_close;
+
+   close(fd);
+
+   map->refcount = 1;
+   map->generation = generation;
+
+   return map;
+
+ fail_close:
+   close(fd);
+ fail:
+   free(map);
+
+   return NULL;
+}
+
+static struct disk_cache_db_map *
+get_map(struct disk_cache_db *db, uint64_t generation, uint64_t size)
+{
+   struct disk_cache_db_map *map;
+
+   simple_mtx_lock(&db->map_mutex);
+
+   map = db->map;
+   if (!map || map->generation != generation || map->size < size) {
+      map = map_pack(db, generation, size);
+      if (!map) {
+         simple_mtx_unlock(&db->map_mutex);
+         return NULL;
+      }
+
+      if (db->map)
+         unref_map(db->map);
+      db->map = map;
+   }
+
+   map->refcount++;
+
+   simple_mtx_unlock(&db->map_mutex);
+
+   return map;
+}
+
+const void *
+disk_cache_db_get(struct disk_cache_db *db, const uint8_t *key,
+                  size_t *size, struct disk_cache_db_map **map)
+{
+   struct db_index_header *header = db->header;
+   const struct db_pack_entry *entry;
+   struct db_index_slot *slot;
+   uint64_t generation, offset, pack_size;
+   uint32_t data_size;
+
+   /* No lock here: anything read from the index is checked against the
+    * generation, and the entry found against the key.
+    */
+   generation = p_atomic_read(&header->generation);
+   if (generation & 1)
+      return NULL;
+
+   slot = find_slot(db, key, false);
+   if (!slot)
+      return NULL;
+
+   data_size = p_atomic_read(&slot->size);
+   offset = p_atomic_read(&slot->offset);
+   pack_size = p_atomic_read(&header->pack_size);
+
+   if (p_atomic_read(&header->generation) != generation)
+      return NULL;
+
+   if (data_size == 0 || offset < sizeof(struct db_pack_header) ||
+       offset + sizeof(*entry) + data_size > pack_size)
+      return NULL;
+
+   *map = get_map(db, generation, pack_size);
+   if (!*map)
+      return NULL;
+
+   entry = (const void *)((*map)->ptr + offset);
+   if (memcmp(entry->key, key, CACHE_KEY_SIZE) != 0 ||
+       entry->size != data_size) {
+      disk_cache_db_release(db, *map);
+      return NULL;
+   }
+
+   /* Benign race: a stamp may be lost to a concurrent rewrite. */
+   slot->last_access = p_atomic_inc_return(&header->access_clock);
+
+   *size = data_size;
+
+   return entry + 1;
+}
+
+void
+disk_cache_db_release(struct disk_cache_db *db, struct disk_cache_db_map *map)
+{
+   simple_mtx_lock(&db->map_mutex);
+   unref_map(map);
+   simple_mtx_unlock(&db->map_mutex);
+}
+
+void
+disk_cache_db_remove(struct disk_cache_db *db, const uint8_t *key)
+{
+   struct db_index_slot *slot;
+
+   if (!lock_index(db))
+      return;
+
+   /* The space is reclaimed by the next rewrite of the pack. */
+   slot = find_slot(db, key, false);
+   if (slot) {
+      db->header->live_size -= entry_size(slot->size);
+      p_atomic_set(&slot->size, 0);
+   }
+
+   unlock_index(db);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
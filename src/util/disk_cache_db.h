@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DISK_CACHE_DB_H
+#define DISK_CACHE_DB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Single file store for the disk cache.
+ *
+ * All entries are appended to one pack file, which is memory-mapped for
+ * reading, and located through a hash table kept in a second, shared
+ * memory-mapped index file.  Lookups take no lock and do no syscall once
+ * the pack is mapped.  Writers, possibly in different processes, are
+ * serialized with a lock on the index file.
+ *
+ * When the pack grows over the maximum size, it is rewritten without the
+ * least recently used entries, as recorded in the index on each lookup.
+ */
+struct disk_cache_db;
+
+/* A reference to a mapping of the pack, which keeps the entries returned
+ * by disk_cache_db_get() valid until released.
+ */
+struct disk_cache_db_map;
+
+struct disk_cache_db_item {
+   const uint8_t *key;
+   const void *data;
+   size_t size;
+};
+
+struct disk_cache_db *
+disk_cache_db_open(const char *path, uint64_t max_size);
+
+void
+disk_cache_db_close(struct disk_cache_db *db);
+
+/* Add a batch of entries, with a single write to the pack. */
+bool
+disk_cache_db_put(struct disk_cache_db *db,
+                  const struct disk_cache_db_item *items, unsigned num_items);
+
+const void *
+disk_cache_db_get(struct disk_cache_db *db, const uint8_t *key,
+                  size_t *size, struct disk_cache_db_map **map);
+
+void
+disk_cache_db_release(struct disk_cache_db *db, struct disk_cache_db_map *map);
+
+void
+disk_cache_db_remove(struct disk_cache_db *db, const uint8_t *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_DB_H */
@@ -0,0 +1,511 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+
+#include "util/format_simd.h"
+#include "util/macros.h"
+#include "util/u_cpu_detect.h"
+
+#if defined(USE_SSE41)
+#include "util/format_simd_sse41.h"
+#elif defined(PIPE_ARCH_AARCH64)
+#include <arm_neon.h>
+#endif
+
+#if defined(PIPE_ARCH_AARCH64)
+
+/* NEON is always there on AArch64.  The kernels work on blocks of 16 pixels,
+ * which with 8-bit channels take as many 16-byte registers as there are
+ * channels.  A destination register is gathered from the source ones with a
+ * single tbl, whose out of range indices give 0 for swizzles to zero and
+ * one.
+ */
+
+static ALWAYS_INLINE uint8x16_t
+lookup_block(const uint8x16_t *t, unsigned n, uint8x16_t idx)
+{
+   switch (n) {
+   case 1:
+      return vqtbl1q_u8(t[0], idx);
+   case 2: {
+      const uint8x16x2_t t2 = { { t[0], t[1] } };
+      return vqtbl2q_u8(t2, idx);
+   }
+   case 3: {
+      const uint8x16x3_t t3 = { { t[0], t[1], t[2] } };
+      return vqtbl3q_u8(t3, idx);
+   }
+   default: {
+      const uint8x16x4_t t4 = { { t[0], t[1], t[2], t[3] } };
+      return vqtbl4q_u8(t4, idx);
+   }
+   }
+}
+
+/**
+ * Computes the tbl indices of each destination register of a block, and the
+ * bytes to OR into it for swizzles to one.  This runs for every row, so it
+ * counts pixels and channels instead of dividing.
+ */
+static void
+get_lookup(unsigned dst_channels, unsigned src_channels,
+           const uint8_t swizzle[4], uint8_t one,
+           uint8x16_t idx[4], uint8x16_t ones[4])
+{
+   unsigned pixel = 0, c = 0;
+
+   for (unsigned k = 0; k < dst_channels; k++) {
+      uint8_t s[16], o[16];
+
+      for (unsigned j = 0; j < 16; j++) {
+         const uint8_t swz = swizzle[c];
+
+         s[j] = swz < 4 ? pixel * src_channels + swz : 0xff;
+         o[j] = swz == 5 ? one : 0;
+
+         if (++c == dst_channels) {
+            c = 0;
+            pixel++;
+         }
+      }
+      idx[k] = vld1q_u8(s);
+      ones[k] = vld1q_u8(o);
+   }
+}
+
+/**
+ * Computes the bits to OR into each of the 4 * dst_channels float registers
+ * of a block for swizzles to one.
+ */
+static void
+get_float_lanes(unsigned dst_channels, const uint8_t swizzle[4],
+                uint32x4_t ones[16])
+{
+   unsigned c = 0;
+
+   for (unsigned m = 0; m < 4 * dst_channels; m++) {
+      uint32_t o[4];
+
+      for (unsigned j = 0; j < 4; j++) {
+         o[j] = swizzle[c] == 5 ? 0x3f800000 : 0;
+         if (++c == dst_channels)
+            c = 0;
+      }
+      ones[m] = vld1q_u32(o);
+   }
+}
+
+static ALWAYS_INLINE unsigned
+swizzle_ubyte_neon(uint8_t *dst, unsigned dst_channels,
+                   const uint8_t *src, unsigned src_channels,
+                   const uint8x16_t idx[4], const uint8x16_t ones[4],
+                   unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 16 <= count; i += 16) {
+      uint8x16_t v[4];
+
+      for (unsigned k = 0; k < src_channels; k++)
+         v[k] = vld1q_u8(src + 16 * k);
+      for (unsigned k = 0; k < dst_channels; k++) {
+         vst1q_u8(dst + 16 * k,
+                  vorrq_u8(lookup_block(v, src_channels, idx[k]), ones[k]));
+      }
+
+      src += 16 * src_channels;
+      dst += 16 * dst_channels;
+   }
+
+   return i;
+}
+
+static unsigned
+neon_swizzle_ubyte(uint8_t *dst, unsigned dst_channels,
+                   const uint8_t *src, unsigned src_channels,
+                   const uint8_t swizzle[4], uint8_t one, unsigned count)
+{
+   uint8x16_t idx[4], ones[4];
+
+   get_lookup(dst_channels, src_channels, swizzle, one, idx, ones);
+
+   switch (src_channels) {
+   case 1:
+      return swizzle_ubyte_neon(dst, dst_channels, src, 1, idx, ones, count);
+   case 2:
+      return swizzle_ubyte_neon(dst, dst_channels, src, 2, idx, ones, count);
+   case 3:
+      return swizzle_ubyte_neon(dst, dst_channels, src, 3, idx, ones, count);
+   default:
+      return swizzle_ubyte_neon(dst, dst_channels, src, 4, idx, ones, count);
+   }
+}
+
+/* Like _mesa_float_to_unorm(x, 8): fmaxnm turns NaN into 0, and fcvtnu
+ * rounds to nearest even.
+ */
+static ALWAYS_INLINE uint32x4_t
+float_to_unorm8_u32(const float *src)
+{
+   float32x4_t x = vld1q_f32(src);
+
+   x = vminq_f32(vmaxnmq_f32(x, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+   return vcvtnq_u32_f32(vmulq_n_f32(x, 255.0f));
+}
+
+static ALWAYS_INLINE unsigned
+float_to_unorm8_neon(uint8_t *dst, unsigned dst_channels,
+                     const float *src, unsigned src_channels,
+                     const uint8x16_t idx[4], const uint8x16_t ones[4],
+                     unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 16 <= count; i += 16) {
+      uint8x16_t v[4];
+
+      /* Convert the block to 8-bit channels in the source order. */
+      for (unsigned k = 0; k < src_channels; k++) {
+         const float *s = src + 16 * k;
+         uint16x8_t lo = vcombine_u16(vmovn_u32(float_to_unorm8_u32(s)),
+                                      vmovn_u32(float_to_unorm8_u32(s + 4)));
+         uint16x8_t hi = vcombine_u16(vmovn_u32(float_to_unorm8_u32(s + 8)),
+                                      vmovn_u32(float_to_unorm8_u32(s + 12)));
+
+         v[k] = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+      }
+      for (unsigned k = 0; k < dst_channels; k++) {
+         vst1q_u8(dst + 16 * k,
+                  vorrq_u8(lookup_block(v, src_channels, idx[k]), ones[k]));
+      }
+
+      src += 16 * src_channels;
+      dst += 16 * dst_channels;
+   }
+
+   return i;
+}
+
+static unsigned
+neon_float_to_unorm8(uint8_t *dst, unsigned dst_channels,
+                     const float *src, unsigned src_channels,
+                     const uint8_t swizzle[4], unsigned count)
+{
+   uint8x16_t idx[4], ones[4];
+
+   get_lookup(dst_channels, src_channels, swizzle, 0xff, idx, ones);
+
+   switch (src_channels) {
+   case 1:
+      return float_to_unorm8_neon(dst, dst_channels, src, 1, idx, ones, count);
+   case 2:
+      return float_to_unorm8_neon(dst, dst_channels, src, 2, idx, ones, count);
+   case 3:
+      return float_to_unorm8_neon(dst, dst_channels, src, 3, idx, ones, count);
+   default:
+      return float_to_unorm8_neon(dst, dst_channels, src, 4, idx, ones, count);
+   }
+}
+
+/* Converts 4 bytes like _mesa_unorm_to_float(x, 8), and ORs 1.0f into the
+ * channels swizzled to one, which are 0 in v.
+ */
+static ALWAYS_INLINE float32x4_t
+unorm8_to_float_f32(uint16x4_t v, uint32x4_t ones)
+{
+   float32x4_t x = vcvtq_f32_u32(vmovl_u16(v));
+
+   x = vmulq_n_f32(x, 1.0f / 255.0f);
+   return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(x), ones));
+}
+
+static ALWAYS_INLINE unsigned
+unorm8_to_float_neon(float *dst, unsigned dst_channels,
+                     const uint8_t *src, unsigned src_channels,
+                     const uint8x16_t idx[4], const uint32x4_t ones[16],
+                     unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 16 <= count; i += 16) {
+      uint8x16_t v[4];
+
+      for (unsigned k = 0; k < src_channels; k++)
+         v[k] = vld1q_u8(src + 16 * k);
+      for (unsigned k = 0; k < dst_channels; k++) {
+         uint8x16_t b = lookup_block(v, src_channels, idx[k]);
+         uint16x8_t lo = vmovl_u8(vget_low_u8(b));
+         uint16x8_t hi = vmovl_u8(vget_high_u8(b));
+         const uint16x4_t q[4] = {
+            vget_low_u16(lo), vget_high_u16(lo),
+            vget_low_u16(hi), vget_high_u16(hi),
+         };
+
+         /* Register 4k + j holds the floats 16k + 4j to 16k + 4j + 3. */
+         for (unsigned j = 0; j < 4; j++) {
+            vst1q_f32(dst + 16 * k + 4 * j,
+                      unorm8_to_float_f32(q[j], ones[4 * k + j]));
+         }
+      }
+
+      src += 16 * src_channels;
+      dst += 16 * dst_channels;
+   }
+
+   return i;
+}
+
+static unsigned
+neon_unorm8_to_float(float *dst, unsigned dst_channels,
+                     const uint8_t *src, unsigned src_channels,
+                     const uint8_t swizzle[4], unsigned count)
+{
+   uint8x16_t idx[4], unused[4];
+   uint32x4_t ones[16];
+
+   get_lookup(dst_channels, src_channels, swizzle, 0, idx, unused);
+   get_float_lanes(dst_channels, swizzle, ones);
+
+   switch (src_channels) {
+   case 1:
+      return unorm8_to_float_neon(dst, dst_channels, src, 1, idx, ones, count);
+   case 2:
+      return unorm8_to_float_neon(dst, dst_channels, src, 2, idx, ones, count);
+   case 3:
+      return unorm8_to_float_neon(dst, dst_channels, src, 3, idx, ones, count);
+   default:
+      return unorm8_to_float_neon(dst, dst_channels, src, 4, idx, ones, count);
+   }
+}
+
+/* The steps of util_half_to_float(), 4 values at a time.  fcvtl would quiet
+ * signaling NaNs, which the scalar code keeps.
+ */
+static ALWAYS_INLINE float32x4_t
+half_to_float_f32(uint16x4_t v)
+{
+   const float32x4_t magic = vreinterpretq_f32_u32(vdupq_n_u32(0xef << 23));
+   uint32x4_t h = vmovl_u16(v);
+   uint32x4_t sign = vshlq_n_u32(vandq_u32(h, vdupq_n_u32(0x8000)), 16);
+   float32x4_t f;
+   uint32x4_t u;
+
+   /* Exponent / Mantissa, adjusted */
+   u = vshlq_n_u32(vandq_u32(h, vdupq_n_u32(0x7fff)), 13);
+   f = vreinterpretq_f32_u32(u);
+   f = vmulq_f32(f, magic);
+
+   /* Inf / NaN */
+   u = vreinterpretq_u32_f32(f);
+   u = vorrq_u32(u, vandq_u32(vcgeq_f32(f, vdupq_n_f32(65536.0f)),
+                              vdupq_n_u32(0xff << 23)));
+
+   return vreinterpretq_f32_u32(vorrq_u32(u, sign));
+}
+
+static unsigned
+neon_half_to_float(float *dst, const uint16_t *src, unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      uint16x8_t h = vld1q_u16(&src[i]);
+
+      vst1q_f32(&dst[i], half_to_float_f32(vget_low_u16(h)));
+      vst1q_f32(&dst[i + 4], half_to_float_f32(vget_high_u16(h)));
+   }
+
+   return i;
+}
+
+/* Rounds like _mesa_float_to_half(); see float_to_half_epi32() in
+ * format_simd_sse41.c.  fcvtn would give a different NaN.
+ */
+static ALWAYS_INLINE uint16x4_t
+float_to_half_u16(const float *src)
+{
+   const float32x4_t denorm_magic = vdupq_n_f32(0.5f);
+   uint32x4_t u = vreinterpretq_u32_f32(vld1q_f32(src));
+   uint32x4_t sign = vandq_u32(u, vdupq_n_u32(0x80000000));
+   uint32x4_t abs = veorq_u32(u, sign);
+   uint32x4_t denorm, normal, infnan, odd, r;
+
+   denorm = vreinterpretq_u32_f32(vaddq_f32(vreinterpretq_f32_u32(abs),
+                                            denorm_magic));
+   denorm = vsubq_u32(denorm, vreinterpretq_u32_f32(denorm_magic));
+
+   odd = vandq_u32(vshrq_n_u32(abs, 13), vdupq_n_u32(1));
+   normal = vsubq_u32(abs, vdupq_n_u32((112 << 23) - 0xfff));
+   normal = vshrq_n_u32(vaddq_u32(normal, odd), 13);
+
+   infnan = vsubq_u32(vdupq_n_u32(0x7c00),
+                      vcgtq_u32(abs, vdupq_n_u32(0x7f800000)));
+
+   r = vbslq_u32(vcltq_u32(abs, vdupq_n_u32(113 << 23)), denorm, normal);
+   r = vbslq_u32(vcgtq_u32(abs, vdupq_n_u32((143 << 23) - 1)), infnan, r);
+
+   return vmovn_u32(vorrq_u32(r, vshrq_n_u32(sign, 16)));
+}
+
+static unsigned
+neon_float_to_half(uint16_t *dst, const float *src, unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      vst1q_u16(&dst[i], vcombine_u16(float_to_half_u16(&src[i]),
+                                      float_to_half_u16(&src[i + 4])));
+   }
+
+   return i;
+}
+
+#endif /* PIPE_ARCH_AARCH64 */
+
+/* Shorter rows are left to the scalar code: computing the shuffles of the
+ * kernels for each row costs more than they save on them.
+ */
+#define MIN_ROW_PIXELS 16
+
+static bool
+row_is_supported(unsigned dst_channels, unsigned src_channels,
+                 const uint8_t swizzle[4], unsigned count)
+{
+   if (count < MIN_ROW_PIXELS)
+      return false;
+
+   if (dst_channels < 1 || dst_channels > 4 ||
+       src_channels < 1 || src_channels > 4)
+      return false;
+
+   /* Swizzles to missing channels or to none leave undefined values in the
+    * scalar code; keep it that way.
+    */
+   for (unsigned i = 0; i < dst_channels; i++) {
+      if (swizzle[i] < 4 ? swizzle[i] >= src_channels : swizzle[i] > 5)
+         return false;
+   }
+
+   return true;
+}
+
+unsigned
+util_format_simd_swizzle_ubyte(uint8_t *dst, unsigned dst_channels,
+                               const uint8_t *src, unsigned src_channels,
+                               const uint8_t swizzle[4], uint8_t one,
+                               unsigned count)
+{
+   if (!row_is_supported(dst_channels, src_channels, swizzle, count))
+      return 0;
+
+#if defined(USE_SSE41)
+   util_cpu_detect();
+   if (util_cpu_caps.has_sse4_1) {
+      return util_format_sse41_swizzle_ubyte(dst, dst_channels,
+                                             src, src_channels,
+                                             swizzle, one, count);
+   }
+#elif defined(PIPE_ARCH_AARCH64)
+   return neon_swizzle_ubyte(dst, dst_channels, src, src_channels,
+                             swizzle, one, count);
+#endif
+
+   return 0;
+}
+
+unsigned
+util_format_simd_float_to_unorm8(uint8_t *dst, unsigned dst_channels,
+                                 const float *src, unsigned src_channels,
+                                 const uint8_t swizzle[4], unsigned count)
+{
+   if (!row_is_supported(dst_channels, src_channels, swizzle, count))
+      return 0;
+
+#if defined(USE_SSE41)
+   util_cpu_detect();
+   if (util_cpu_caps.has_sse4_1) {
+      return util_format_sse41_float_to_unorm8(dst, dst_channels,
+                                               src, src_channels,
+                                               swizzle, count);
+   }
+#elif defined(PIPE_ARCH_AARCH64)
+   return neon_float_to_unorm8(dst, dst_channels, src, src_channels,
+                               swizzle, count);
+#endif
+
+   return 0;
+}
+
+unsigned
+util_format_simd_unorm8_to_float(float *dst, unsigned dst_channels,
+                                 const uint8_t *src, unsigned src_channels,
+                                 const uint8_t swizzle[4], unsigned count)
+{
+   if (!row_is_supported(dst_channels, src_channels, swizzle, count))
+      return 0;
+
+#if defined(USE_SSE41)
+   util_cpu_detect();
+   if (util_cpu_caps.has_sse4_1) {
+      return util_format_sse41_unorm8_to_float(dst, dst_channels,
+                                               src, src_channels,
+                                               swizzle, count);
+   }
+#elif defined(PIPE_ARCH_AARCH64)
+   return neon_unorm8_to_float(dst, dst_channels, src, src_channels,
+                               swizzle, count);
+#endif
+
+   return 0;
+}
+
+unsigned
+util_format_simd_half_to_float(float *dst, const uint16_t *src,
+                               unsigned count)
+{
+#if defined(USE_SSE41)
+   util_cpu_detect();
+   if (util_cpu_caps.has_sse4_1)
+      return util_format_sse41_half_to_float(dst, src, count);
+#elif defined(PIPE_ARCH_AARCH64)
+   return neon_half_to_float(dst, src, count);
+#endif
+
+   return 0;
+}
+
+unsigned
+util_format_simd_float_to_half(uint16_t *dst, const float *src,
+                               unsigned count)
+{
+#if defined(USE_SSE41)
+   util_cpu_detect();
+   if (util_cpu_caps.has_sse4_1)
+      return util_format_sse41_float_to_half(dst, src, count);
+#elif defined(PIPE_ARCH_AARCH64)
+   return neon_float_to_half(dst, src, count);
+#endif
+
+   return 0;
+}
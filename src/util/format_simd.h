@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef FORMAT_SIMD_H
+#define FORMAT_SIMD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file format_simd.h
+ *
+ * SIMD versions of the most common conversions of rows of pixels done by
+ * _mesa_format_convert() and the u_format pack and unpack functions.
+ *
+ * Each function converts the leading pixels of a row with the vector
+ * instructions of the CPU, picked with util_cpu_detect(), and returns how
+ * many it converted; the caller converts the remaining ones with its scalar
+ * code.  This is zero when the CPU or the arguments are not supported, and
+ * for rows too short for the kernels to pay off.  The results are
+ * bit-identical to those of the scalar conversion each function names.
+ *
+ * Pixels are arrays of 1 to 4 channels.  Swizzles are encoded like
+ * MESA_FORMAT_SWIZZLE_* and PIPE_SWIZZLE_*: destination channel i takes
+ * source channel swizzle[i] if it is less than 4, zero if it is 4 and one if
+ * it is 5.
+ *
+ * The source and destination rows must not overlap, unless they start at the
+ * same address and their pixels have the same size.
+ *
+ * x86 CPUs without SSE4.1 keep the scalar code for every conversion: the
+ * kernels rely on pshufb, pmovzx and blendv.
+ */
+
+/**
+ * Swizzles 8-bit channels, writing \p one for swizzles to one.
+ */
+unsigned
+util_format_simd_swizzle_ubyte(uint8_t *dst, unsigned dst_channels,
+                               const uint8_t *src, unsigned src_channels,
+                               const uint8_t swizzle[4], uint8_t one,
+                               unsigned count);
+
+/**
+ * Converts floats to 8-bit unorm channels like _mesa_float_to_unorm(x, 8),
+ * which gives the same results as float_to_ubyte().
+ */
+unsigned
+util_format_simd_float_to_unorm8(uint8_t *dst, unsigned dst_channels,
+                                 const float *src, unsigned src_channels,
+                                 const uint8_t swizzle[4], unsigned count);
+
+/**
+ * Converts 8-bit unorm channels to floats like _mesa_unorm_to_float(x, 8)
+ * and ubyte_to_float().
+ */
+unsigned
+util_format_simd_unorm8_to_float(float *dst, unsigned dst_channels,
+                                 const uint8_t *src, unsigned src_channels,
+                                 const uint8_t swizzle[4], unsigned count);
+
+/**
+ * Converts \p count half floats like _mesa_half_to_float(), and returns how
+ * many were converted.
+ */
+unsigned
+util_format_simd_half_to_float(float *dst, const uint16_t *src,
+                               unsigned count);
+
+/**
+ * Converts \p count floats to half floats like _mesa_float_to_half(), and
+ * returns how many were converted.
+ */
+unsigned
+util_format_simd_float_to_half(uint16_t *dst, const float *src,
+                               unsigned count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FORMAT_SIMD_H */
@@ -0,0 +1,424 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* The kernels below work on blocks of 4 pixels, which take 4 to 16 bytes
+ * with 8-bit channels.  A block of bytes is loaded into one register, moved
+ * to its destination order with a single pshufb, and stored back without
+ * touching the bytes past the block, so a row is never read or written out
+ * of bounds.
+ */
+
+#include <smmintrin.h>
+#include <string.h>
+
+#include "util/format_simd_sse41.h"
+#include "util/macros.h"
+
+/* Calls CASE with each pair of destination and source channel counts, so
+ * that the kernels get specialized for them.
+ */
+#define CHANNEL_CASES(CASE) \
+   CASE(1, 1) CASE(1, 2) CASE(1, 3) CASE(1, 4) \
+   CASE(2, 1) CASE(2, 2) CASE(2, 3) CASE(2, 4) \
+   CASE(3, 1) CASE(3, 2) CASE(3, 3) CASE(3, 4) \
+   CASE(4, 1) CASE(4, 2) CASE(4, 3) CASE(4, 4)
+
+/* The pixel and the channel of each byte of a block of 4 pixels of 1 to 4
+ * channels.
+ */
+static const uint8_t block_pixel[4][16] = {
+   { 0, 1, 2, 3 },
+   { 0, 0, 1, 1, 2, 2, 3, 3 },
+   { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3 },
+   { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 },
+};
+
+static const uint8_t block_channel[4][16] = {
+   { 0, 0, 0, 0 },
+   { 0, 1, 0, 1, 0, 1, 0, 1 },
+   { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2 },
+   { 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3 },
+};
+
+/* Returns the swizzle of each byte of a block of 4 pixels of dst_channels. */
+static ALWAYS_INLINE __m128i
+get_block_swizzle(unsigned dst_channels, const uint8_t swizzle[4])
+{
+   const __m128i channel =
+      _mm_loadu_si128((const __m128i *) block_channel[dst_channels - 1]);
+   uint32_t w;
+
+   memcpy(&w, swizzle, 4);
+   return _mm_shuffle_epi8(_mm_cvtsi32_si128(w), channel);
+}
+
+/**
+ * Computes the pshufb mask moving the bytes of 4 pixels of src_channels to 4
+ * pixels of dst_channels, and the bytes to OR into the result for swizzles
+ * to one.  Swizzles to zero and one select no byte.
+ *
+ * This runs for every row, so it is computed with vector instructions:
+ * storing the bytes and loading them back would stall.
+ */
+static void
+get_shuffle(unsigned dst_channels, unsigned src_channels,
+            const uint8_t swizzle[4], uint8_t one,
+            __m128i *shuffle, __m128i *ones)
+{
+   const __m128i lane = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                      8, 9, 10, 11, 12, 13, 14, 15);
+   const __m128i in_block = _mm_cmpgt_epi8(_mm_set1_epi8(4 * dst_channels),
+                                           lane);
+   const __m128i swz = get_block_swizzle(dst_channels, swizzle);
+   __m128i pixel, index, from_src, to_one;
+
+   /* The pixels are at most 3 and the channels 4, so multiplying pairs of
+    * bytes as 16-bit values never carries from one byte to the other.
+    */
+   pixel = _mm_loadu_si128((const __m128i *) block_pixel[dst_channels - 1]);
+   index = _mm_add_epi8(_mm_mullo_epi16(pixel, _mm_set1_epi16(src_channels)),
+                        swz);
+
+   from_src = _mm_and_si128(_mm_cmplt_epi8(swz, _mm_set1_epi8(4)), in_block);
+   to_one = _mm_and_si128(_mm_cmpeq_epi8(swz, _mm_set1_epi8(5)), in_block);
+
+   *shuffle = _mm_blendv_epi8(_mm_set1_epi8(-128), index, from_src);
+   *ones = _mm_and_si128(to_one, _mm_set1_epi8(one));
+}
+
+/**
+ * Computes the bits to OR into the 4 float registers of a block for
+ * swizzles to one.
+ */
+static void
+get_float_lanes(unsigned dst_channels, const uint8_t swizzle[4],
+                __m128 ones[4])
+{
+   const __m128i swz = get_block_swizzle(dst_channels, swizzle);
+   const __m128i one = _mm_set1_epi32(0x3f800000);
+   __m128i to_one = _mm_cmpeq_epi8(swz, _mm_set1_epi8(5));
+
+   /* Register k holds the floats 4k to 4k + 3 of a block of 4 pixels. */
+   ones[0] = _mm_castsi128_ps(_mm_and_si128(_mm_cvtepi8_epi32(to_one), one));
+   to_one = _mm_srli_si128(to_one, 4);
+   ones[1] = _mm_castsi128_ps(_mm_and_si128(_mm_cvtepi8_epi32(to_one), one));
+   to_one = _mm_srli_si128(to_one, 4);
+   ones[2] = _mm_castsi128_ps(_mm_and_si128(_mm_cvtepi8_epi32(to_one), one));
+   to_one = _mm_srli_si128(to_one, 4);
+   ones[3] = _mm_castsi128_ps(_mm_and_si128(_mm_cvtepi8_epi32(to_one), one));
+}
+
+static ALWAYS_INLINE __m128i
+load_block(const uint8_t *src, unsigned size)
+{
+   uint32_t w;
+
+   switch (size) {
+   case 4:
+      memcpy(&w, src, 4);
+      return _mm_cvtsi32_si128(w);
+   case 8:
+      return _mm_loadl_epi64((const __m128i *) src);
+   case 12:
+      memcpy(&w, src + 8, 4);
+      return _mm_insert_epi32(_mm_loadl_epi64((const __m128i *) src), w, 2);
+   default:
+      return _mm_loadu_si128((const __m128i *) src);
+   }
+}
+
+static ALWAYS_INLINE void
+store_block(uint8_t *dst, unsigned size, __m128i v)
+{
+   uint32_t w;
+
+   switch (size) {
+   case 4:
+      w = _mm_cvtsi128_si32(v);
+      memcpy(dst, &w, 4);
+      break;
+   case 8:
+      _mm_storel_epi64((__m128i *) dst, v);
+      break;
+   case 12:
+      _mm_storel_epi64((__m128i *) dst, v);
+      w = _mm_extract_epi32(v, 2);
+      memcpy(dst + 8, &w, 4);
+      break;
+   default:
+      _mm_storeu_si128((__m128i *) dst, v);
+      break;
+   }
+}
+
+static ALWAYS_INLINE unsigned
+swizzle_ubyte(uint8_t *dst, unsigned dst_channels,
+              const uint8_t *src, unsigned src_channels,
+              __m128i shuffle, __m128i ones, unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128i v = load_block(src, 4 * src_channels);
+
+      v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), ones);
+      store_block(dst, 4 * dst_channels, v);
+
+      src += 4 * src_channels;
+      dst += 4 * dst_channels;
+   }
+
+   return i;
+}
+
+unsigned
+util_format_sse41_swizzle_ubyte(uint8_t *dst, unsigned dst_channels,
+                                const uint8_t *src, unsigned src_channels,
+                                const uint8_t swizzle[4], uint8_t one,
+                                unsigned count)
+{
+   __m128i shuffle, ones;
+
+   get_shuffle(dst_channels, src_channels, swizzle, one, &shuffle, &ones);
+
+#define CASE(d, s) \
+   case (d) * 8 + (s): \
+      return swizzle_ubyte(dst, d, src, s, shuffle, ones, count);
+
+   switch (dst_channels * 8 + src_channels) {
+   CHANNEL_CASES(CASE)
+   default:
+      return 0;
+   }
+
+#undef CASE
+}
+
+/* Like _mesa_float_to_unorm(x, 8): maxps returns its second operand when
+ * either one is NaN, so NaN becomes 0, and cvtps2dq rounds to nearest even.
+ */
+static ALWAYS_INLINE __m128i
+float_to_unorm8_epi32(const float *src)
+{
+   __m128 x = _mm_loadu_ps(src);
+
+   x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+   return _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(255.0f)));
+}
+
+static ALWAYS_INLINE unsigned
+float_to_unorm8(uint8_t *dst, unsigned dst_channels,
+                const float *src, unsigned src_channels,
+                __m128i shuffle, __m128i ones, unsigned count)
+{
+   const __m128i zero = _mm_setzero_si128();
+   unsigned i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128i a = float_to_unorm8_epi32(src);
+      __m128i b = src_channels > 1 ? float_to_unorm8_epi32(src + 4) : zero;
+      __m128i c = src_channels > 2 ? float_to_unorm8_epi32(src + 8) : zero;
+      __m128i d = src_channels > 3 ? float_to_unorm8_epi32(src + 12) : zero;
+      __m128i v = _mm_packus_epi16(_mm_packus_epi32(a, b),
+                                   _mm_packus_epi32(c, d));
+
+      v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), ones);
+      store_block(dst, 4 * dst_channels, v);
+
+      src += 4 * src_channels;
+      dst += 4 * dst_channels;
+   }
+
+   return i;
+}
+
+unsigned
+util_format_sse41_float_to_unorm8(uint8_t *dst, unsigned dst_channels,
+                                  const float *src, unsigned src_channels,
+                                  const uint8_t swizzle[4], unsigned count)
+{
+   __m128i shuffle, ones;
+
+   get_shuffle(dst_channels, src_channels, swizzle, 0xff, &shuffle, &ones);
+
+#define CASE(d, s) \
+   case (d) * 8 + (s): \
+      return float_to_unorm8(dst, d, src, s, shuffle, ones, count);
+
+   switch (dst_channels * 8 + src_channels) {
+   CHANNEL_CASES(CASE)
+   default:
+      return 0;
+   }
+
+#undef CASE
+}
+
+/* Converts the first 4 bytes of v like _mesa_unorm_to_float(x, 8), and ORs
+ * 1.0f into the channels swizzled to one, which are 0 in v.
+ */
+static ALWAYS_INLINE __m128
+unorm8_to_float_ps(__m128i v, __m128 ones)
+{
+   __m128 x = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+
+   return _mm_or_ps(_mm_mul_ps(x, _mm_set1_ps(1.0f / 255.0f)), ones);
+}
+
+static ALWAYS_INLINE unsigned
+unorm8_to_float(float *dst, unsigned dst_channels,
+                const uint8_t *src, unsigned src_channels,
+                __m128i shuffle, const __m128 ones[4], unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128i v = _mm_shuffle_epi8(load_block(src, 4 * src_channels), shuffle);
+
+      _mm_storeu_ps(dst, unorm8_to_float_ps(v, ones[0]));
+      if (dst_channels > 1)
+         _mm_storeu_ps(dst + 4, unorm8_to_float_ps(_mm_srli_si128(v, 4),
+                                                   ones[1]));
+      if (dst_channels > 2)
+         _mm_storeu_ps(dst + 8, unorm8_to_float_ps(_mm_srli_si128(v, 8),
+                                                   ones[2]));
+      if (dst_channels > 3)
+         _mm_storeu_ps(dst + 12, unorm8_to_float_ps(_mm_srli_si128(v, 12),
+                                                    ones[3]));
+
+      src += 4 * src_channels;
+      dst += 4 * dst_channels;
+   }
+
+   return i;
+}
+
+unsigned
+util_format_sse41_unorm8_to_float(float *dst, unsigned dst_channels,
+                                  const uint8_t *src, unsigned src_channels,
+                                  const uint8_t swizzle[4], unsigned count)
+{
+   __m128i shuffle, unused;
+   __m128 ones[4];
+
+   get_shuffle(dst_channels, src_channels, swizzle, 0, &shuffle, &unused);
+   get_float_lanes(dst_channels, swizzle, ones);
+
+#define CASE(d, s) \
+   case (d) * 8 + (s): \
+      return unorm8_to_float(dst, d, src, s, shuffle, ones, count);
+
+   switch (dst_channels * 8 + src_channels) {
+   CHANNEL_CASES(CASE)
+   default:
+      return 0;
+   }
+
+#undef CASE
+}
+
+/* The steps of util_half_to_float(), 4 values at a time. */
+unsigned
+util_format_sse41_half_to_float(float *dst, const uint16_t *src,
+                                unsigned count)
+{
+   const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(0xef << 23));
+   const __m128 infnan = _mm_set1_ps(65536.0f);
+   const __m128 exponent = _mm_castsi128_ps(_mm_set1_epi32(0xff << 23));
+   unsigned i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      __m128i h = _mm_loadl_epi64((const __m128i *) &src[i]);
+      __m128i sign, bits;
+      __m128 f;
+
+      h = _mm_cvtepu16_epi32(h);
+      sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+
+      /* Exponent / Mantissa, adjusted */
+      bits = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+      f = _mm_castsi128_ps(bits);
+      f = _mm_mul_ps(f, magic);
+
+      /* Inf / NaN */
+      f = _mm_or_ps(f, _mm_and_ps(_mm_cmpge_ps(f, infnan), exponent));
+
+      _mm_storeu_ps(&dst[i], _mm_or_ps(f, _mm_castsi128_ps(sign)));
+   }
+
+   return i;
+}
+
+/* Rounds like _mesa_float_to_half(), computing the result of each of its
+ * cases and picking the right one.
+ */
+static ALWAYS_INLINE __m128i
+float_to_half_epi32(const float *src)
+{
+   const __m128 denorm_magic = _mm_set1_ps(0.5f);
+   __m128i u = _mm_castps_si128(_mm_loadu_ps(src));
+   __m128i sign = _mm_and_si128(u, _mm_set1_epi32(0x80000000));
+   __m128i abs = _mm_xor_si128(u, sign);
+   __m128i denorm, normal, infnan, odd, r;
+
+   /* Below 2^-14: adding 0.5 leaves |x| * 2^24 rounded to nearest even in
+    * the low bits of the mantissa, which is a half denorm, or the smallest
+    * normal when it rounds up to 1024.  Float denorms become 0.
+    */
+   denorm = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(abs), denorm_magic));
+   denorm = _mm_sub_epi32(denorm, _mm_castps_si128(denorm_magic));
+
+   /* Rebias the exponent and round the mantissa to nearest even, carrying
+    * into the exponent up to infinity.
+    */
+   odd = _mm_and_si128(_mm_srli_epi32(abs, 13), _mm_set1_epi32(1));
+   normal = _mm_sub_epi32(abs, _mm_set1_epi32((112 << 23) - 0xfff));
+   normal = _mm_srli_epi32(_mm_add_epi32(normal, odd), 13);
+
+   /* At or above 65536: infinity, or 0x7c01 for NaN */
+   infnan = _mm_sub_epi32(_mm_set1_epi32(0x7c00),
+                          _mm_cmpgt_epi32(abs, _mm_set1_epi32(0x7f800000)));
+
+   r = _mm_blendv_epi8(normal, denorm,
+                       _mm_cmplt_epi32(abs, _mm_set1_epi32(113 << 23)));
+   r = _mm_blendv_epi8(r, infnan,
+                       _mm_cmpgt_epi32(abs, _mm_set1_epi32((143 << 23) - 1)));
+
+   return _mm_or_si128(r, _mm_srli_epi32(sign, 16));
+}
+
+unsigned
+util_format_sse41_float_to_half(uint16_t *dst, const float *src,
+                                unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      __m128i v = _mm_packus_epi32(float_to_half_epi32(&src[i]),
+                                   float_to_half_epi32(&src[i + 4]));
+
+      _mm_storeu_si128((__m128i *) &dst[i], v);
+   }
+
+   return i;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef FORMAT_SIMD_SSE41_H
+#define FORMAT_SIMD_SSE41_H
+
+#include <stdint.h>
+
+/* SSE4.1 implementations of the functions of format_simd.h, which call them
+ * after checking the CPU and the channel counts and swizzles.
+ */
+
+unsigned
+util_format_sse41_swizzle_ubyte(uint8_t *dst, unsigned dst_channels,
+                                const uint8_t *src, unsigned src_channels,
+                                const uint8_t swizzle[4], uint8_t one,
+                                unsigned count);
+
+unsigned
+util_format_sse41_float_to_unorm8(uint8_t *dst, unsigned dst_channels,
+                                  const float *src, unsigned src_channels,
+                                  const uint8_t swizzle[4], unsigned count);
+
+unsigned
+util_format_sse41_unorm8_to_float(float *dst, unsigned dst_channels,
+                                  const uint8_t *src, unsigned src_channels,
+                                  const uint8_t swizzle[4], unsigned count);
+
+unsigned
+util_format_sse41_half_to_float(float *dst, const uint16_t *src,
+                                unsigned count);
+
+unsigned
+util_format_sse41_float_to_half(uint16_t *dst, const float *src,
+                                unsigned count);
+
+#endif /* FORMAT_SIMD_SSE41_H */
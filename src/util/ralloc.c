@@ -76,12 +76,41 @@ struct
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+   /* The arena the block was carved out of, or NULL if it was malloc'ed */
+   struct ralloc_arena *arena;
 };
 
 typedef struct ralloc_header ralloc_header;
 
+/* An arena is the payload of a malloc'ed ralloc context: every descendant of
+ * the context is carved out of large chunks, which are released all at once
+ * when the context is freed.  Freeing a descendant only unlinks it.
+ *
+ * The descendants still have to be visited when the arena is freed if some
+ * of them have destructors, or if blocks malloc'ed elsewhere were stolen
+ * into the arena; both are counted.
+ */
+struct ralloc_arena {
+   void *chunks;        /* the chunks, each starting with the next one */
+   char *next;          /* the first free byte of the current chunk */
+   char *end;           /* the end of the current chunk */
+
+   unsigned num_destructors;
+   unsigned num_foreign;
+};
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+/* Each block of an arena is preceded by its capacity, for resize(). */
+#define ARENA_BLOCK_PREFIX ARENA_ALIGNMENT
+#define ARENA_BLOCK_CAPACITY(info) \
+   (*(size_t *) ((char *) (info) - ARENA_BLOCK_PREFIX))
+
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
+static void destroy_arena(void *ptr);
 
 static ralloc_header *
 get_header(const void *ptr)
@@ -94,10 +123,100 @@ get_header(const void *ptr)
 
 #define PTR_FROM_HEADER(info) (((char *) info) + sizeof(ralloc_header))
 
+/* Return the arena the children of a block are carved out of, if any. */
+static inline struct ralloc_arena *
+get_arena(const ralloc_header *info)
+{
+   if (info == NULL)
+      return NULL;
+   if (info->arena != NULL)
+      return info->arena;
+   if (info->destructor == destroy_arena)
+      return (struct ralloc_arena *) PTR_FROM_HEADER(info);
+   return NULL;
+}
+
+static ralloc_header *
+arena_alloc(struct ralloc_arena *arena, size_t size)
+{
+   size_t capacity = ALIGN_POT(size, ARENA_ALIGNMENT);
+   size_t full_size = ARENA_BLOCK_PREFIX + sizeof(ralloc_header) + capacity;
+   char *block;
+
+   if (unlikely(full_size > (size_t) (arena->end - arena->next))) {
+      size_t chunk_size = MAX2(full_size + ARENA_ALIGNMENT, ARENA_CHUNK_SIZE);
+      char *chunk = malloc(chunk_size);
+
+      if (unlikely(chunk == NULL))
+         return NULL;
+
+      *(void **) chunk = arena->chunks;
+      arena->chunks = chunk;
+      block = chunk + ARENA_ALIGNMENT;
+
+      /* Large blocks get a chunk of their own, the current one is kept. */
+      if (chunk_size == ARENA_CHUNK_SIZE) {
+         arena->next = block + full_size;
+         arena->end = chunk + chunk_size;
+      }
+   } else {
+      block = arena->next;
+      arena->next += full_size;
+   }
+
+   *(size_t *) block = capacity;
+   return (ralloc_header *) (block + ARENA_BLOCK_PREFIX);
+}
+
+static ralloc_header *
+arena_resize(ralloc_header *old, size_t size)
+{
+   struct ralloc_arena *arena = old->arena;
+   size_t capacity = ARENA_BLOCK_CAPACITY(old);
+   char *old_end = PTR_FROM_HEADER(old) + capacity;
+   ralloc_header *info;
+
+   if (size <= capacity)
+      return old;
+
+   /* Grow the last block of the current chunk in place. */
+   size = ALIGN_POT(size, ARENA_ALIGNMENT);
+   if (old_end == arena->next &&
+       size - capacity <= (size_t) (arena->end - arena->next)) {
+      arena->next += size - capacity;
+      ARENA_BLOCK_CAPACITY(old) = size;
+      return old;
+   }
+
+   info = arena_alloc(arena, size);
+   if (likely(info != NULL))
+      memcpy(info, old, sizeof(ralloc_header) + capacity);
+   return info;
+}
+
+static void
+destroy_arena(void *ptr)
+{
+   struct ralloc_arena *arena = ptr;
+
+   while (arena->chunks != NULL) {
+      void *chunk = arena->chunks;
+
+      arena->chunks = *(void **) chunk;
+      free(chunk);
+   }
+}
+
 static void
 add_child(ralloc_header *parent, ralloc_header *info)
 {
    if (parent != NULL) {
+      if (info->arena == NULL) {
+         struct ralloc_arena *arena = get_arena(parent);
+         if (arena != NULL)
+            arena->num_foreign++;
+      }
+
       info->parent = parent;
       info->next = parent->child;
       parent->child = info;
@@ -113,17 +232,51 @@ ralloc_context(const void *ctx)
    return ralloc_size(ctx, 0);
 }
 
+void *
+ralloc_arena_context(const void *ctx)
+{
+   ralloc_header *info = malloc(sizeof(ralloc_header) +
+                                sizeof(struct ralloc_arena));
+
+   if (unlikely(info == NULL))
+      return NULL;
+
+   info->parent = NULL;
+   info->child = NULL;
+   info->prev = NULL;
+   info->next = NULL;
+   info->destructor = destroy_arena;
+   info->arena = NULL;
+
+   memset(PTR_FROM_HEADER(info), 0, sizeof(struct ralloc_arena));
+
+   add_child(ctx != NULL ? get_header(ctx) : NULL, info);
+
+#ifndef NDEBUG
+   info->canary = CANARY;
+#endif
+
+   return PTR_FROM_HEADER(info);
+}
+
 void *
 ralloc_size(const void *ctx, size_t size)
 {
-   void *block = malloc(size + sizeof(ralloc_header));
    ralloc_header *info;
    ralloc_header *parent;
+   struct ralloc_arena *arena;
 
-   if (unlikely(block == NULL))
+   parent = ctx != NULL ? get_header(ctx) : NULL;
+   arena = get_arena(parent);
+
+   if (arena != NULL)
+      info = arena_alloc(arena, size);
+   else
+      info = malloc(size + sizeof(ralloc_header));
+
+   if (unlikely(info == NULL))
       return NULL;
 
-   info = (ralloc_header *) block;
    /* measurements have shown that calloc is slower (because of
     * the multiplication overflow checking?), so clear things
     * manually
@@ -133,8 +286,7 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
-
-   parent = ctx != NULL ? get_header(ctx) : NULL;
+   info->arena = arena;
 
    add_child(parent, info);
 
@@ -163,7 +315,10 @@ resize(void *ptr, size_t size)
    ralloc_header *child, *old, *info;
 
    old = get_header(ptr);
-   info = realloc(old, size + sizeof(ralloc_header));
+   if (old->arena != NULL)
+      info = arena_resize(old, size);
+   else
+      info = realloc(old, size + sizeof(ralloc_header));
 
    if (info == NULL)
       return NULL;
@@ -267,6 +422,12 @@ unlink_block(ralloc_header *info)
 {
    /* Unlink from parent & siblings */
    if (info->parent != NULL) {
+      if (info->arena == NULL) {
+         struct ralloc_arena *arena = get_arena(info->parent);
+         if (arena != NULL)
+            arena->num_foreign--;
+      }
+
       if (info->parent->child == info)
 	 info->parent->child = info->next;
 
@@ -284,35 +445,65 @@ unlink_block(ralloc_header *info)
 static void
 unsafe_free(ralloc_header *info)
 {
-   /* Recursively free any children...don't waste time unlinking them. */
-   ralloc_header *temp;
-   while (info->child != NULL) {
-      temp = info->child;
-      info->child = temp->next;
-      unsafe_free(temp);
+   struct ralloc_arena *arena = get_arena(info);
+
+   /* A block malloc'ed elsewhere and stolen into an arena which is being
+    * freed; it was not unlinked.
+    */
+   if (info->arena == NULL && info->parent != NULL) {
+      struct ralloc_arena *parent_arena = get_arena(info->parent);
+      if (parent_arena != NULL)
+         parent_arena->num_foreign--;
+   }
+
+   /* Recursively free any children...don't waste time unlinking them.  The
+    * children carved out of an arena need no visit unless some of them have
+    * destructors or malloc'ed children.
+    */
+   if (arena == NULL || arena->num_destructors || arena->num_foreign) {
+      ralloc_header *temp;
+      while (info->child != NULL) {
+         temp = info->child;
+         info->child = temp->next;
+         unsafe_free(temp);
+      }
    }
 
    /* Free the block itself.  Call the destructor first, if any. */
-   if (info->destructor != NULL)
+   if (info->destructor != NULL) {
+      if (info->arena != NULL)
+         info->arena->num_destructors--;
       info->destructor(PTR_FROM_HEADER(info));
+   }
 
-   free(info);
+   if (info->arena == NULL)
+      free(info);
 }
 
-void
+bool
 ralloc_steal(const void *new_ctx, void *ptr)
 {
    ralloc_header *info, *parent;
 
    if (unlikely(ptr == NULL))
-      return;
+      return true;
 
    info = get_header(ptr);
    parent = new_ctx ? get_header(new_ctx) : NULL;
 
+   /* Blocks cannot leave the arena they were carved out of: their memory
+    * goes away with the arena, whatever their new parent.  Leave the block
+    * where it is rather than let it dangle.
+    */
+   if (unlikely(info->arena != NULL && info->arena != get_arena(parent))) {
+      assert(!"ralloc_steal() of a block out of its arena");
+      return false;
+   }
+
    unlink_block(info);
 
    add_child(parent, info);
+   return true;
 }
 
 void
@@ -330,6 +521,19 @@ ralloc_adopt(const void *new_ctx, void *old_ctx)
    if (unlikely(old_info->child == NULL))
       return;
 
+   /* Moving children between arenas needs the bookkeeping of ralloc_steal,
+    * and the children carved out of an arena have to stay in it.
+    */
+   if (get_arena(old_info) != get_arena(new_info)) {
+      ralloc_header *next;
+      for (child = old_info->child; child != NULL; child = next) {
+         next = child->next;
+         if (child->arena == NULL || child->arena == get_arena(new_info))
+            ralloc_steal(new_ctx, PTR_FROM_HEADER(child));
+      }
+      return;
+   }
+
    /* Set all the children's parent to new_ctx; get a pointer to the last child. */
    for (child = old_info->child; child->next != NULL; child = child->next) {
       child->parent = new_info;
@@ -360,6 +564,11 @@ void
 ralloc_set_destructor(const void *ptr, void(*destructor)(void *))
 {
    ralloc_header *info = get_header(ptr);
+
+   assert(info->destructor != destroy_arena);
+   if (info->arena != NULL)
+      info->arena->num_destructors += !!destructor - !!info->destructor;
+
    info->destructor = destructor;
 }
 
@@ -755,7 +964,9 @@ ralloc_steal_linear_parent(void *new_ralloc_ctx, void *ptr)
    assert(node->magic == LMAGIC);
 
    while (node) {
-      ralloc_steal(new_ralloc_ctx, node);
+      /* The nodes share their ralloc parent, and thus their arena if any */
+      if (!ralloc_steal(new_ralloc_ctx, node))
+         return;
       node->ralloc_parent = new_ralloc_ctx;
       node = node->next;
    }
@@ -91,6 +91,21 @@ extern "C" {
  */
 void *ralloc_context(const void *ctx);
 
+/**
+ * Allocate a new ralloc context backed by an arena.
+ *
+ * Every descendant of the returned context is carved out of large chunks
+ * rather than malloc'ed, and the whole tree is released at once when the
+ * context is freed: freeing a descendant only unlinks it from the tree, and
+ * its memory is reclaimed with the context.  This suits large numbers of
+ * short-lived objects, such as the AST and IR of a shader being compiled.
+ *
+ * Descendants cannot be stolen out of the arena: ralloc_steal() refuses,
+ * so copy what has to outlive it.  The destructor of the context itself
+ * cannot be set.
+ */
+void *ralloc_arena_context(const void *ctx);
+
 /**
  * Allocate memory chained off of the given context.
  *
@@ -293,13 +308,20 @@ void ralloc_free(void *ptr);
  *
  * This changes \p ptr's context to \p new_ctx.  This is quite useful if
  * memory is allocated out of a temporary context.
+ *
+ * A block carved out of an arena (see ralloc_arena_context()) cannot be
+ * moved out of it: it is then left where it is, which asserts in debug
+ * builds.
+ *
+ * \return false if \p ptr could not be moved
  */
-void ralloc_steal(const void *new_ctx, void *ptr);
+bool ralloc_steal(const void *new_ctx, void *ptr);
 
 /**
  * Reparent all children from one context to another.
  *
  * This effectively calls ralloc_steal(new_ctx, child) for all children of \p old_ctx.
+ * The children which cannot leave the arena of \p old_ctx stay there.
  */
 void ralloc_adopt(const void *new_ctx, void *old_ctx);
 
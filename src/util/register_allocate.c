@@ -71,11 +71,15 @@
  */
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "ralloc.h"
 #include "main/imports.h"
 #include "main/macros.h"
 #include "util/bitset.h"
+#include "util/u_atomic.h"
+#include "util/u_process.h"
 #include "register_allocate.h"
 
 #define NO_REG ~0U
@@ -126,12 +130,24 @@ struct ra_node {
     * List of which nodes this node interferes with.  This should be
     * symmetric with the other node.
     */
-   BITSET_WORD *adjacency;
    unsigned int *adjacency_list;
    unsigned int adjacency_list_size;
    unsigned int adjacency_count;
    /** @} */
 
+   /** @{
+    *
+    * Lookup structure for adjacency_list, once it is too long to search
+    * linearly: an open-addressed hash set while that is smaller than a
+    * bitset of all the nodes, and the bitset after that.  This keeps the
+    * memory of sparse graphs proportional to the number of interferences
+    * instead of count².
+    */
+   unsigned int *adjacency_set;
+   unsigned int adjacency_set_size; /**< a power of two, or 0 */
+   BITSET_WORD *adjacency;
+   /** @} */
+
    unsigned int class;
 
    /* Client-assigned register, if assigned, or NO_REG. */
@@ -186,17 +202,27 @@ struct ra_graph {
       /** Bit-set indicating, for each register, if it pre-assigned */
       BITSET_WORD *reg_assigned;
 
-      /** Bit-set indicating, for each register, the value of the pq test */
+      /**
+       * Bit-set indicating, for each register not in the stack nor
+       * pre-assigned, if it passes the pq test.
+       */
       BITSET_WORD *pq_test;
 
-      /** For each BITSET_WORD, the minimum q value or ~0 if unknown */
-      unsigned int *min_q_total;
+      /** Bit-set indicating, for each BITSET_WORD of pq_test, if it's set */
+      BITSET_WORD *pq_words;
 
-      /*
-       * * For each BITSET_WORD, the node with the minimum q_total if
-       * min_q_total[i] != ~0.
+      /**
+       * Binary min-heap of the nodes not in the stack nor pre-assigned, by
+       * q_total and then by decreasing node index: the top is the node to
+       * push optimistically when none passes the pq test.  It's only built
+       * the first time that happens, as most graphs never need it.
        */
-      unsigned int *min_q_node;
+      uint64_t *heap;
+      unsigned int heap_count;
+      bool heap_built;
+
+      /** For each node in the heap, its position there */
+      unsigned int *heap_index;
 
       /**
        * Tracks the start of the set of optimistically-colored registers in the
@@ -417,11 +443,135 @@ ra_set_finalize(struct ra_regs *regs, unsigned int **q_values)
    }
 }
 
+/* Adjacency lists up to this length are searched linearly. */
+#define ADJACENCY_SET_MIN 32
+
+#define ADJACENCY_SET_EMPTY UINT_MAX
+
+static inline unsigned int
+ra_adjacency_set_slot(unsigned int n, unsigned int mask)
+{
+   return (n * 0x9e3779b1u) & mask;
+}
+
 static void
-ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
+ra_adjacency_set_insert(struct ra_node *node, unsigned int n)
+{
+   const unsigned int mask = node->adjacency_set_size - 1;
+   unsigned int i = ra_adjacency_set_slot(n, mask);
+
+   while (node->adjacency_set[i] != ADJACENCY_SET_EMPTY)
+      i = (i + 1) & mask;
+
+   node->adjacency_set[i] = n;
+}
+
+/**
+ * Removes n from the hash set, moving back the entries that follow it in
+ * the same cluster so that no deleted marker is needed.
+ */
+static void
+ra_adjacency_set_remove(struct ra_node *node, unsigned int n)
 {
-   BITSET_SET(g->nodes[n1].adjacency, n2);
+   const unsigned int mask = node->adjacency_set_size - 1;
+   unsigned int i = ra_adjacency_set_slot(n, mask);
+   unsigned int j;
+
+   while (node->adjacency_set[i] != n) {
+      assert(node->adjacency_set[i] != ADJACENCY_SET_EMPTY);
+      i = (i + 1) & mask;
+   }
+
+   for (j = (i + 1) & mask;
+        node->adjacency_set[j] != ADJACENCY_SET_EMPTY;
+        j = (j + 1) & mask) {
+      unsigned int k = ra_adjacency_set_slot(node->adjacency_set[j], mask);
+
+      /* Leave the entry alone if its home slot is in (i, j]. */
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+         continue;
+
+      node->adjacency_set[i] = node->adjacency_set[j];
+      i = j;
+   }
+
+   node->adjacency_set[i] = ADJACENCY_SET_EMPTY;
+}
 
+/**
+ * Rebuilds the hash set from the adjacency list, at most half full, or
+ * switches to a bitset if that is smaller.
+ */
+static void
+ra_adjacency_set_rebuild(struct ra_graph *g, struct ra_node *node)
+{
+   unsigned int size = 2 * ADJACENCY_SET_MIN;
+
+   while (size < 4 * node->adjacency_count)
+      size *= 2;
+
+   if (size * sizeof(unsigned int) >=
+       BITSET_WORDS(g->alloc) * sizeof(BITSET_WORD)) {
+      ralloc_free(node->adjacency_set);
+      node->adjacency_set = NULL;
+      node->adjacency_set_size = 0;
+
+      node->adjacency = rzalloc_array(g, BITSET_WORD, BITSET_WORDS(g->alloc));
+      for (unsigned int i = 0; i < node->adjacency_count; i++)
+         BITSET_SET(node->adjacency, node->adjacency_list[i]);
+      return;
+   }
+
+   if (size != node->adjacency_set_size) {
+      ralloc_free(node->adjacency_set);
+      node->adjacency_set = ralloc_array(g, unsigned int, size);
+      node->adjacency_set_size = size;
+   }
+   memset(node->adjacency_set, 0xff, size * sizeof(unsigned int));
+
+   for (unsigned int i = 0; i < node->adjacency_count; i++)
+      ra_adjacency_set_insert(node, node->adjacency_list[i]);
+}
+
+static bool
+ra_node_has_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
+{
+   /* Interference is symmetric, so look in the cheaper of the two. */
+   if (g->nodes[n1].adjacency)
+      return BITSET_TEST(g->nodes[n1].adjacency, n2);
+   if (g->nodes[n2].adjacency)
+      return BITSET_TEST(g->nodes[n2].adjacency, n1);
+
+   if (g->nodes[n1].adjacency_count > g->nodes[n2].adjacency_count) {
+      unsigned int tmp = n1;
+      n1 = n2;
+      n2 = tmp;
+   }
+
+   const struct ra_node *node = &g->nodes[n1];
+
+   if (node->adjacency_set) {
+      const unsigned int mask = node->adjacency_set_size - 1;
+      unsigned int i = ra_adjacency_set_slot(n2, mask);
+
+      while (node->adjacency_set[i] != ADJACENCY_SET_EMPTY) {
+         if (node->adjacency_set[i] == n2)
+            return true;
+         i = (i + 1) & mask;
+      }
+      return false;
+   }
+
+   for (unsigned int i = 0; i < node->adjacency_count; i++) {
+      if (node->adjacency_list[i] == n2)
+         return true;
+   }
+   return false;
+}
+
+static void
+ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
+{
    assert(n1 != n2);
 
    int n1_class = g->nodes[n1].class;
@@ -438,13 +588,22 @@ ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 
    g->nodes[n1].adjacency_list[g->nodes[n1].adjacency_count] = n2;
    g->nodes[n1].adjacency_count++;
+
+   if (g->nodes[n1].adjacency) {
+      BITSET_SET(g->nodes[n1].adjacency, n2);
+   } else if (g->nodes[n1].adjacency_set) {
+      if (g->nodes[n1].adjacency_count * 2 > g->nodes[n1].adjacency_set_size)
+         ra_adjacency_set_rebuild(g, &g->nodes[n1]);
+      else
+         ra_adjacency_set_insert(&g->nodes[n1], n2);
+   } else if (g->nodes[n1].adjacency_count > ADJACENCY_SET_MIN) {
+      ra_adjacency_set_rebuild(g, &g->nodes[n1]);
+   }
 }
 
 static void
 ra_node_remove_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
-   BITSET_CLEAR(g->nodes[n1].adjacency, n2);
-
    assert(n1 != n2);
 
    int n1_class = g->nodes[n1].class;
@@ -463,6 +622,11 @@ ra_node_remove_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
    }
    assert(i < g->nodes[n1].adjacency_count);
    g->nodes[n1].adjacency_count--;
+
+   if (g->nodes[n1].adjacency)
+      BITSET_CLEAR(g->nodes[n1].adjacency, n2);
+   else if (g->nodes[n1].adjacency_set)
+      ra_adjacency_set_remove(&g->nodes[n1], n2);
 }
 
 static void
@@ -481,17 +645,18 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
 
    unsigned g_bitset_count = BITSET_WORDS(g->alloc);
    unsigned bitset_count = BITSET_WORDS(alloc);
-   /* For nodes already in the graph, we just have to grow the adjacency set */
+   /* For dense nodes already in the graph, grow the adjacency bitset */
    for (unsigned i = 0; i < g->alloc; i++) {
-      assert(g->nodes[i].adjacency != NULL);
-      g->nodes[i].adjacency = rerzalloc(g, g->nodes[i].adjacency, BITSET_WORD,
-                                        g_bitset_count, bitset_count);
+      if (g->nodes[i].adjacency) {
+         g->nodes[i].adjacency = rerzalloc(g, g->nodes[i].adjacency,
+                                           BITSET_WORD, g_bitset_count,
+                                           bitset_count);
+      }
    }
 
    /* For new nodes, we have to fully initialize them */
    for (unsigned i = g->alloc; i < alloc; i++) {
       memset(&g->nodes[i], 0, sizeof(g->nodes[i]));
-      g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
       g->nodes[i].adjacency_list_size = 4;
       g->nodes[i].adjacency_list =
          ralloc_array(g, unsigned int, g->nodes[i].adjacency_list_size);
@@ -511,10 +676,10 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
    g->tmp.reg_assigned = reralloc(g, g->tmp.reg_assigned, BITSET_WORD,
                                   bitset_count);
    g->tmp.pq_test = reralloc(g, g->tmp.pq_test, BITSET_WORD, bitset_count);
-   g->tmp.min_q_total = reralloc(g, g->tmp.min_q_total, unsigned int,
-                                 bitset_count);
-   g->tmp.min_q_node = reralloc(g, g->tmp.min_q_node, unsigned int,
-                                bitset_count);
+   g->tmp.pq_words = reralloc(g, g->tmp.pq_words, BITSET_WORD,
+                              BITSET_WORDS(bitset_count));
+   g->tmp.heap = reralloc(g, g->tmp.heap, uint64_t, alloc);
+   g->tmp.heap_index = reralloc(g, g->tmp.heap_index, unsigned int, alloc);
 
    g->alloc = alloc;
 }
@@ -580,7 +745,7 @@ ra_add_node_interference(struct ra_graph *g,
                          unsigned int n1, unsigned int n2)
 {
    assert(n1 < g->count && n2 < g->count);
-   if (n1 != n2 && !BITSET_TEST(g->nodes[n1].adjacency, n2)) {
+   if (n1 != n2 && !ra_node_has_adjacency(g, n1, n2)) {
       ra_add_node_adjacency(g, n1, n2);
       ra_add_node_adjacency(g, n2, n1);
    }
@@ -592,31 +757,88 @@ ra_reset_node_interference(struct ra_graph *g, unsigned int n)
    for (unsigned int i = 0; i < g->nodes[n].adjacency_count; i++)
       ra_node_remove_adjacency(g, g->nodes[n].adjacency_list[i], n);
 
-   memset(g->nodes[n].adjacency, 0,
-          BITSET_WORDS(g->count) * sizeof(BITSET_WORD));
    g->nodes[n].adjacency_count = 0;
+   ralloc_free(g->nodes[n].adjacency);
+   g->nodes[n].adjacency = NULL;
+   ralloc_free(g->nodes[n].adjacency_set);
+   g->nodes[n].adjacency_set = NULL;
+   g->nodes[n].adjacency_set_size = 0;
+}
+
+/**
+ * Returns the heap key of node n: the lowest q_total is pushed
+ * optimistically first, and the highest node index among equals.
+ */
+static inline uint64_t
+ra_heap_key(struct ra_graph *g, unsigned int n)
+{
+   return (uint64_t)g->nodes[n].tmp.q_total << 32 | ~n;
+}
+
+static inline void
+ra_heap_set(struct ra_graph *g, unsigned int i, uint64_t key)
+{
+   g->tmp.heap[i] = key;
+   g->tmp.heap_index[~(uint32_t)key] = i;
+}
+
+static void
+ra_heap_sift_up(struct ra_graph *g, unsigned int i, uint64_t key)
+{
+   while (i > 0) {
+      unsigned int parent = (i - 1) / 2;
+
+      if (key >= g->tmp.heap[parent])
+         break;
+
+      ra_heap_set(g, i, g->tmp.heap[parent]);
+      i = parent;
+   }
+   ra_heap_set(g, i, key);
+}
+
+static void
+ra_heap_sift_down(struct ra_graph *g, unsigned int i, uint64_t key)
+{
+   for (;;) {
+      unsigned int child = 2 * i + 1;
+
+      if (child >= g->tmp.heap_count)
+         break;
+      if (child + 1 < g->tmp.heap_count &&
+          g->tmp.heap[child + 1] < g->tmp.heap[child])
+         child++;
+      if (key <= g->tmp.heap[child])
+         break;
+
+      ra_heap_set(g, i, g->tmp.heap[child]);
+      i = child;
+   }
+   ra_heap_set(g, i, key);
+}
+
+static void
+ra_heap_remove(struct ra_graph *g, unsigned int n)
+{
+   unsigned int i = g->tmp.heap_index[n];
+   uint64_t last = g->tmp.heap[--g->tmp.heap_count];
+
+   if (i == g->tmp.heap_count)
+      return;
+
+   if (i > 0 && last < g->tmp.heap[(i - 1) / 2])
+      ra_heap_sift_up(g, i, last);
+   else
+      ra_heap_sift_down(g, i, last);
 }
 
 static void
 update_pq_info(struct ra_graph *g, unsigned int n)
 {
-   int i = n / BITSET_WORDBITS;
    int n_class = g->nodes[n].class;
    if (g->nodes[n].tmp.q_total < g->regs->classes[n_class]->p) {
       BITSET_SET(g->tmp.pq_test, n);
-   } else if (g->tmp.min_q_total[i] != UINT_MAX) {
-      /* Only update min_q_total and min_q_node if min_q_total != UINT_MAX so
-       * that we don't update while we have stale data and accidentally mark
-       * it as non-stale.  Also, in order to remain consistent with the old
-       * naive implementation of the algorithm, we do a lexicographical sort
-       * to ensure that we always choose the node with the highest node index.
-       */
-      if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i] ||
-          (g->nodes[n].tmp.q_total == g->tmp.min_q_total[i] &&
-           n > g->tmp.min_q_node[i])) {
-         g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
-         g->tmp.min_q_node[i] = n;
-      }
+      BITSET_SET(g->tmp.pq_words, n / BITSET_WORDBITS);
    }
 }
 
@@ -637,6 +859,8 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
          assert(g->nodes[n2].tmp.q_total >= g->regs->classes[n2_class]->q[n_class]);
          g->nodes[n2].tmp.q_total -= g->regs->classes[n2_class]->q[n_class];
          update_pq_info(g, n2);
+         if (g->tmp.heap_built)
+            ra_heap_sift_up(g, g->tmp.heap_index[n2], ra_heap_key(g, n2));
       }
    }
 
@@ -644,8 +868,64 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
    g->tmp.stack_count++;
    BITSET_SET(g->tmp.in_stack, n);
 
-   /* Flag the min_q_total for n's block as dirty so it gets recalculated */
-   g->tmp.min_q_total[n / BITSET_WORDBITS] = UINT_MAX;
+   BITSET_CLEAR(g->tmp.pq_test, n);
+   if (!g->tmp.pq_test[n / BITSET_WORDBITS])
+      BITSET_CLEAR(g->tmp.pq_words, n / BITSET_WORDBITS);
+   if (g->tmp.heap_built)
+      ra_heap_remove(g, n);
+}
+
+static void
+ra_heap_build(struct ra_graph *g)
+{
+   unsigned int n;
+
+   g->tmp.heap_count = 0;
+   for (n = 0; n < g->count; n++) {
+      if (!BITSET_TEST(g->tmp.in_stack, n) &&
+          !BITSET_TEST(g->tmp.reg_assigned, n))
+         ra_heap_set(g, g->tmp.heap_count++, ra_heap_key(g, n));
+   }
+   for (n = g->tmp.heap_count / 2; n > 0; n--)
+      ra_heap_sift_down(g, n - 1, g->tmp.heap[n - 1]);
+
+   g->tmp.heap_built = true;
+}
+
+/**
+ * Returns the highest node below n that passes the pq test, or NO_REG.
+ */
+static unsigned int
+ra_prev_pq_node(struct ra_graph *g, unsigned int n)
+{
+   unsigned int i, w;
+   BITSET_WORD word;
+
+   if (n == 0)
+      return NO_REG;
+   n--;
+
+   i = n / BITSET_WORDBITS;
+   word = g->tmp.pq_test[i] &
+          (~(BITSET_WORD)0 >> (BITSET_WORDBITS - 1 - n % BITSET_WORDBITS));
+   if (word)
+      return i * BITSET_WORDBITS + util_last_bit(word) - 1;
+   if (i == 0)
+      return NO_REG;
+   i--;
+
+   /* Find the previous word with a node in it from the summary. */
+   w = i / BITSET_WORDBITS;
+   word = g->tmp.pq_words[w] &
+          (~(BITSET_WORD)0 >> (BITSET_WORDBITS - 1 - i % BITSET_WORDBITS));
+   while (!word) {
+      if (w == 0)
+         return NO_REG;
+      word = g->tmp.pq_words[--w];
+   }
+
+   i = w * BITSET_WORDBITS + util_last_bit(word) - 1;
+   return i * BITSET_WORDBITS + util_last_bit(g->tmp.pq_test[i]) - 1;
 }
 
 /**
@@ -657,103 +937,70 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * Each pass walks the graph from the highest node down, pushing the nodes
+ * that pass the pq test, including those that only pass it because of a
+ * node pushed earlier in the pass.  Rather than scanning every node, a pass
+ * jumps from one such node to the next with ra_prev_pq_node(), and the
+ * optimistic choice is the top of a heap kept up to date as the q totals
+ * drop, so the cost is proportional to the interferences of the pushed
+ * nodes instead of to the passes times the node count.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
+   bool progress = false;
    unsigned int stack_optimistic_start = UINT_MAX;
-
-   /* Figure out the high bit and bit mask for the first iteration of a loop
-    * over BITSET_WORDs.
-    */
-   const unsigned int top_word_high_bit = (g->count - 1) % BITSET_WORDBITS;
+   unsigned int n;
 
    /* Do a quick pre-pass to set things up */
    g->tmp.stack_count = 0;
-   for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-        i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-      g->tmp.in_stack[i] = 0;
-      g->tmp.reg_assigned[i] = 0;
-      g->tmp.pq_test[i] = 0;
-      g->tmp.min_q_total[i] = UINT_MAX;
-      g->tmp.min_q_node[i] = UINT_MAX;
-      for (int j = high_bit; j >= 0; j--) {
-         unsigned int n = i * BITSET_WORDBITS + j;
-         g->nodes[n].reg = g->nodes[n].forced_reg;
-         g->nodes[n].tmp.q_total = g->nodes[n].q_total;
-         if (g->nodes[n].reg != NO_REG)
-            g->tmp.reg_assigned[i] |= BITSET_BIT(j);
+   g->tmp.heap_built = false;
+   memset(g->tmp.in_stack, 0, BITSET_WORDS(g->count) * sizeof(BITSET_WORD));
+   memset(g->tmp.reg_assigned, 0,
+          BITSET_WORDS(g->count) * sizeof(BITSET_WORD));
+   memset(g->tmp.pq_test, 0, BITSET_WORDS(g->count) * sizeof(BITSET_WORD));
+   memset(g->tmp.pq_words, 0,
+          BITSET_WORDS(BITSET_WORDS(g->count)) * sizeof(BITSET_WORD));
+   for (n = 0; n < g->count; n++) {
+      g->nodes[n].reg = g->nodes[n].forced_reg;
+      g->nodes[n].tmp.q_total = g->nodes[n].q_total;
+      if (g->nodes[n].reg != NO_REG)
+         BITSET_SET(g->tmp.reg_assigned, n);
+      else
          update_pq_info(g, n);
-      }
    }
 
-   while (progress) {
-      unsigned int min_q_total = UINT_MAX;
-      unsigned int min_q_node = UINT_MAX;
-
-      progress = false;
-
-      for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-           i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-         BITSET_WORD mask = ~(BITSET_WORD)0 >> (31 - high_bit);
-
-         BITSET_WORD skip = g->tmp.in_stack[i] | g->tmp.reg_assigned[i];
-         if (skip == mask)
-            continue;
-
-         BITSET_WORD pq = g->tmp.pq_test[i] & ~skip;
-         if (pq) {
-            /* In this case, we have stuff we can immediately take off the
-             * stack.  This also means that we're guaranteed to make progress
-             * and we don't need to bother updating lowest_q_total because we
-             * know we're going to loop again before attempting to do anything
-             * optimistic.
-             */
-            for (int j = high_bit; j >= 0; j--) {
-               if (pq & BITSET_BIT(j)) {
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  add_node_to_stack(g, n);
-                  /* add_node_to_stack() may update pq_test for this word so
-                   * we need to update our local copy.
-                   */
-                  pq = g->tmp.pq_test[i] & ~skip;
-                  progress = true;
-               }
-            }
-         } else if (!progress) {
-            if (g->tmp.min_q_total[i] == UINT_MAX) {
-               /* The min_q_total and min_q_node are dirty because we added
-                * one of these nodes to the stack.  It needs to be
-                * recalculated.
-                */
-               for (int j = high_bit; j >= 0; j--) {
-                  if (skip & BITSET_BIT(j))
-                     continue;
-
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i]) {
-                     g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
-                     g->tmp.min_q_node[i] = n;
-                  }
-               }
-            }
-            if (g->tmp.min_q_total[i] < min_q_total) {
-               min_q_node = g->tmp.min_q_node[i];
-               min_q_total = g->tmp.min_q_total[i];
-            }
-         }
-      }
-
-      if (!progress && min_q_total != UINT_MAX) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->tmp.stack_count;
+   n = g->count;
+   for (;;) {
+      unsigned int next = ra_prev_pq_node(g, n);
 
-         add_node_to_stack(g, min_q_node);
+      if (next != NO_REG) {
+         add_node_to_stack(g, next);
+         n = next;
          progress = true;
+         continue;
+      }
+
+      /* Start another pass from the top, unless this one didn't push
+       * anything, in which case no node passes the pq test anymore.
+       */
+      if (progress) {
+         n = g->count;
+         progress = false;
+         continue;
       }
+
+      if (!g->tmp.heap_built)
+         ra_heap_build(g);
+      if (g->tmp.heap_count == 0)
+         break;
+
+      if (stack_optimistic_start == UINT_MAX)
+         stack_optimistic_start = g->tmp.stack_count;
+
+      add_node_to_stack(g, ~(uint32_t)g->tmp.heap[0]);
+      n = g->count;
    }
 
    g->tmp.stack_optimistic_start = stack_optimistic_start;
@@ -884,9 +1131,91 @@ ra_select(struct ra_graph *g)
    return true;
 }
 
+/**
+ * Writes the register set and the interference graph in a text form that
+ * src/util/tests/register_allocate/ra_bench.c can replay.
+ *
+ * The select callback isn't part of the dump, so the replay always uses
+ * the default register choice.
+ */
+void
+ra_dump_graph(struct ra_graph *g, FILE *fp)
+{
+   struct ra_regs *regs = g->regs;
+   unsigned int b, c, n, r, r2;
+
+   fprintf(fp, "ra_graph 1\n");
+   fprintf(fp, "regs %u %u\n", regs->count, regs->round_robin);
+
+   /* Conflicts are symmetric, so only list each pair once. */
+   for (r = 0; r < regs->count; r++) {
+      for (r2 = r + 1; r2 < regs->count; r2++) {
+         if (BITSET_TEST(regs->regs[r].conflicts, r2))
+            fprintf(fp, "conflict %u %u\n", r, r2);
+      }
+   }
+
+   fprintf(fp, "classes %u\n", regs->class_count);
+   for (c = 0; c < regs->class_count; c++) {
+      fprintf(fp, "class %u", c);
+      for (r = 0; r < regs->count; r++) {
+         if (reg_belongs_to_class(r, regs->classes[c]))
+            fprintf(fp, " %u", r);
+      }
+      fprintf(fp, "\n");
+   }
+   for (b = 0; b < regs->class_count; b++) {
+      fprintf(fp, "q %u", b);
+      for (c = 0; c < regs->class_count; c++)
+         fprintf(fp, " %u", regs->classes[b]->q[c]);
+      fprintf(fp, "\n");
+   }
+
+   fprintf(fp, "nodes %u\n", g->count);
+   for (n = 0; n < g->count; n++) {
+      fprintf(fp, "node %u %u %d %.9g\n", n, g->nodes[n].class,
+              (int)g->nodes[n].forced_reg, g->nodes[n].spill_cost);
+   }
+   for (n = 0; n < g->count; n++) {
+      for (unsigned int i = 0; i < g->nodes[n].adjacency_count; i++) {
+         if (n < g->nodes[n].adjacency_list[i])
+            fprintf(fp, "edge %u %u\n", n, g->nodes[n].adjacency_list[i]);
+      }
+   }
+}
+
+/**
+ * With RA_DUMP_DIR set, every graph is written to that directory before
+ * being allocated.
+ */
+static void
+ra_maybe_dump_graph(struct ra_graph *g)
+{
+   static uint32_t dump_count = 0;
+   const char *dir = getenv("RA_DUMP_DIR");
+   const char *name;
+   char path[4096];
+   FILE *fp;
+
+   if (!dir)
+      return;
+
+   name = util_get_process_name();
+   snprintf(path, sizeof(path), "%s/ra-%s-%u.graph", dir,
+            name ? name : "unknown", p_atomic_inc_return(&dump_count));
+
+   fp = fopen(path, "w");
+   if (!fp)
+      return;
+
+   ra_dump_graph(g, fp);
+   fclose(fp);
+}
+
 bool
 ra_allocate(struct ra_graph *g)
 {
+   ra_maybe_dump_graph(g);
    ra_simplify(g);
    return ra_select(g);
 }
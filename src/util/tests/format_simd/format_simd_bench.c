@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Measures the conversions of format_simd.h against the scalar loops they
+ * replace, on rows of pixels that stay in the cache.
+ *
+ * Usage: format_simd_bench [pixels per row] [rows]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/format_simd.h"
+#include "util/half_float.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/u_math.h"
+
+#define NUM_CASES 6
+
+static const uint8_t rgba_to_bgra[4] = { 2, 1, 0, 3 };
+static const uint8_t rgb_to_rgba[4] = { 0, 1, 2, 5 };
+static const uint8_t identity[4] = { 0, 1, 2, 3 };
+
+struct bench {
+   unsigned width;
+   uint8_t *ubyte;
+   uint8_t *ubyte_out;
+   float *floats;
+   float *floats_out;
+   uint16_t *halfs;
+};
+
+static const char *names[NUM_CASES] = {
+   "RGBA8 -> BGRA8",
+   "RGB8 -> RGBA8",
+   "RGBA32F -> RGBA8",
+   "RGBA8 -> RGBA32F",
+   "RGBA16F -> RGBA32F",
+   "RGBA32F -> RGBA16F",
+};
+
+static void
+convert_scalar(struct bench *b, unsigned c)
+{
+   const unsigned n = b->width;
+
+   switch (c) {
+   case 0:
+      for (unsigned i = 0; i < n; i++) {
+         b->ubyte_out[4 * i + 0] = b->ubyte[4 * i + 2];
+         b->ubyte_out[4 * i + 1] = b->ubyte[4 * i + 1];
+         b->ubyte_out[4 * i + 2] = b->ubyte[4 * i + 0];
+         b->ubyte_out[4 * i + 3] = b->ubyte[4 * i + 3];
+      }
+      break;
+   case 1:
+      for (unsigned i = 0; i < n; i++) {
+         b->ubyte_out[4 * i + 0] = b->ubyte[3 * i + 0];
+         b->ubyte_out[4 * i + 1] = b->ubyte[3 * i + 1];
+         b->ubyte_out[4 * i + 2] = b->ubyte[3 * i + 2];
+         b->ubyte_out[4 * i + 3] = 0xff;
+      }
+      break;
+   case 2:
+      for (unsigned i = 0; i < 4 * n; i++)
+         b->ubyte_out[i] = float_to_ubyte(b->floats[i]);
+      break;
+   case 3:
+      for (unsigned i = 0; i < 4 * n; i++)
+         b->floats_out[i] = ubyte_to_float(b->ubyte[i]);
+      break;
+   case 4:
+      for (unsigned i = 0; i < 4 * n; i++)
+         b->floats_out[i] = _mesa_half_to_float(b->halfs[i]);
+      break;
+   case 5:
+      for (unsigned i = 0; i < 4 * n; i++)
+         b->halfs[i] = _mesa_float_to_half(b->floats[i]);
+      break;
+   }
+}
+
+/* Returns false if the conversion has no SIMD version on this CPU.  The
+ * remaining pixels are left alone, as they are few and the same for both.
+ */
+static bool
+convert_simd(struct bench *b, unsigned c)
+{
+   const unsigned n = b->width;
+
+   switch (c) {
+   case 0:
+      return util_format_simd_swizzle_ubyte(b->ubyte_out, 4, b->ubyte, 4,
+                                            rgba_to_bgra, 0xff, n) != 0;
+   case 1:
+      return util_format_simd_swizzle_ubyte(b->ubyte_out, 4, b->ubyte, 3,
+                                            rgb_to_rgba, 0xff, n) != 0;
+   case 2:
+      return util_format_simd_float_to_unorm8(b->ubyte_out, 4, b->floats, 4,
+                                              identity, n) != 0;
+   case 3:
+      return util_format_simd_unorm8_to_float(b->floats_out, 4, b->ubyte, 4,
+                                              identity, n) != 0;
+   case 4:
+      return util_format_simd_half_to_float(b->floats_out, b->halfs,
+                                            4 * n) != 0;
+   default:
+      return util_format_simd_float_to_half(b->halfs, b->floats, 4 * n) != 0;
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   struct bench b;
+   unsigned rows;
+
+   b.width = argc > 1 ? atoi(argv[1]) : 1024;
+   rows = argc > 2 ? atoi(argv[2]) : 20000;
+   b.width = MAX2(b.width, 1);
+   rows = MAX2(rows, 1);
+
+   b.ubyte = malloc(4 * b.width);
+   b.ubyte_out = malloc(4 * b.width);
+   b.floats = malloc(4 * b.width * sizeof(float));
+   b.floats_out = malloc(4 * b.width * sizeof(float));
+   b.halfs = malloc(4 * b.width * sizeof(uint16_t));
+
+   for (unsigned i = 0; i < 4 * b.width; i++) {
+      b.ubyte[i] = i * 37;
+      b.floats[i] = (i % 1000) / 900.0f - 0.05f;
+      b.halfs[i] = _mesa_float_to_half(b.floats[i]);
+   }
+
+   printf("%-20s %14s %14s\n", "", "scalar Mpix/s", "SIMD Mpix/s");
+   for (unsigned c = 0; c < NUM_CASES; c++) {
+      int64_t start, scalar, simd;
+
+      start = os_time_get_nano();
+      for (unsigned r = 0; r < rows; r++)
+         convert_scalar(&b, c);
+      scalar = os_time_get_nano() - start;
+
+      /* pixels per microsecond */
+      printf("%-20s %14.1f", names[c],
+             (double) rows * b.width / (scalar / 1e3));
+
+      if (!convert_simd(&b, c)) {
+         printf(" %14s\n", "-");
+         continue;
+      }
+
+      start = os_time_get_nano();
+      for (unsigned r = 0; r < rows; r++)
+         convert_simd(&b, c);
+      simd = os_time_get_nano() - start;
+
+      printf(" %14.1f\n", (double) rows * b.width / (simd / 1e3));
+   }
+
+   free(b.ubyte);
+   free(b.ubyte_out);
+   free(b.floats);
+   free(b.floats_out);
+   free(b.halfs);
+   return 0;
+}
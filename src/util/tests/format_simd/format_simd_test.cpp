@@ -0,0 +1,306 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "util/format_simd.h"
+#include "util/half_float.h"
+#include "util/macros.h"
+#include "util/u_math.h"
+
+/* Enough pixels for several blocks of every kernel and a tail. */
+#define MAX_PIXELS 67
+
+/* Fills the bytes the kernels must not write. */
+#define GUARD 0xa5
+
+static const unsigned counts[] = { 0, 1, 3, 4, 5, 15, 16, 17, 33, MAX_PIXELS };
+
+static const float special_floats[] = {
+   0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 2.0f, INFINITY, -INFINITY, NAN, -NAN,
+   1e-40f, -1e-40f, FLT_MIN, FLT_MAX, -FLT_MAX, 0.5f / 255.0f,
+   1.5f / 255.0f, 254.5f / 255.0f, 0.99999994f, 1.0000001f,
+   65504.0f, 65519.0f, 65520.0f, 6.1035156e-05f, 6.0975552e-05f,
+   5.9604645e-08f, 2.9802322e-08f, 2.9802326e-08f, 8.940697e-08f,
+};
+
+static uint64_t seed = 1;
+
+static uint32_t
+rand32(void)
+{
+   seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+   return seed >> 32;
+}
+
+static uint32_t
+float_bits(float f)
+{
+   uint32_t u;
+
+   memcpy(&u, &f, 4);
+   return u;
+}
+
+/* Floats for the conversions to 8-bit unorm: special values, the rounding
+ * points of every unorm value, the range and random bit patterns.
+ */
+static float
+rand_float(void)
+{
+   const uint32_t r = rand32();
+   float f;
+
+   switch (r % 4) {
+   case 0:
+      return special_floats[(r >> 2) % ARRAY_SIZE(special_floats)];
+   case 1:
+      return ((r >> 2) % 256 + 0.5f) / 255.0f;
+   case 2:
+      return (float) (r >> 8) / (1 << 23) * 1.5f - 0.25f;
+   default: {
+      const uint32_t u = rand32();
+
+      memcpy(&f, &u, 4);
+      return f;
+   }
+   }
+}
+
+/* Calls f for every swizzle of dst_channels taking source channels, zero and
+ * one.
+ */
+template<typename F> static void
+foreach_swizzle(F f)
+{
+   for (unsigned dst_channels = 1; dst_channels <= 4; dst_channels++) {
+      for (unsigned src_channels = 1; src_channels <= 4; src_channels++) {
+         const unsigned n = src_channels + 2;
+         unsigned num_swizzles = 1;
+
+         for (unsigned i = 0; i < dst_channels; i++)
+            num_swizzles *= n;
+
+         for (unsigned s = 0; s < num_swizzles; s++) {
+            uint8_t swizzle[4] = { 4, 4, 4, 4 };
+
+            for (unsigned i = 0, x = s; i < dst_channels; i++, x /= n)
+               swizzle[i] = x % n < src_channels ? x % n :
+                                                   x % n - src_channels + 4;
+
+            for (unsigned c = 0; c < ARRAY_SIZE(counts); c++)
+               f(dst_channels, src_channels, swizzle, counts[c]);
+         }
+      }
+   }
+}
+
+TEST(format_simd, swizzle_ubyte)
+{
+   foreach_swizzle([](unsigned dst_channels, unsigned src_channels,
+                      const uint8_t swizzle[4], unsigned count) {
+      uint8_t src[MAX_PIXELS * 4], dst[MAX_PIXELS * 4 + 16];
+      unsigned done;
+
+      for (unsigned i = 0; i < sizeof(src); i++)
+         src[i] = rand32();
+      memset(dst, GUARD, sizeof(dst));
+
+      done = util_format_simd_swizzle_ubyte(dst, dst_channels,
+                                            src, src_channels,
+                                            swizzle, 0x7f, count);
+      ASSERT_LE(done, count);
+
+      for (unsigned i = 0; i < sizeof(dst); i++) {
+         const unsigned p = i / dst_channels, swz = swizzle[i % dst_channels];
+         uint8_t expected = GUARD;
+
+         if (p < done)
+            expected = swz < 4 ? src[p * src_channels + swz] :
+                       swz == 5 ? 0x7f : 0;
+         ASSERT_EQ(dst[i], expected) << "byte " << i << " of " << count
+                                     << " pixels, " << dst_channels << "x"
+                                     << src_channels << " channels";
+      }
+
+      /* In place */
+      if (dst_channels == src_channels) {
+         EXPECT_EQ(util_format_simd_swizzle_ubyte(src, dst_channels,
+                                                  src, src_channels,
+                                                  swizzle, 0x7f, count), done);
+         EXPECT_EQ(memcmp(src, dst, done * dst_channels), 0);
+      }
+   });
+}
+
+TEST(format_simd, float_to_unorm8)
+{
+   foreach_swizzle([](unsigned dst_channels, unsigned src_channels,
+                      const uint8_t swizzle[4], unsigned count) {
+      float src[MAX_PIXELS * 4];
+      uint8_t dst[MAX_PIXELS * 4 + 16];
+      unsigned done;
+
+      for (unsigned i = 0; i < ARRAY_SIZE(src); i++)
+         src[i] = rand_float();
+      memset(dst, GUARD, sizeof(dst));
+
+      done = util_format_simd_float_to_unorm8(dst, dst_channels,
+                                              src, src_channels,
+                                              swizzle, count);
+      ASSERT_LE(done, count);
+
+      for (unsigned i = 0; i < sizeof(dst); i++) {
+         const unsigned p = i / dst_channels, swz = swizzle[i % dst_channels];
+         uint8_t expected = GUARD;
+
+         if (p < done)
+            expected = swz < 4 ? float_to_ubyte(src[p * src_channels + swz]) :
+                       swz == 5 ? 0xff : 0;
+         ASSERT_EQ(dst[i], expected) << "byte " << i << " of " << count
+                                     << " pixels, " << dst_channels << "x"
+                                     << src_channels << " channels";
+      }
+   });
+}
+
+TEST(format_simd, float_to_unorm8_range)
+{
+   static const uint8_t identity[4] = { 0, 1, 2, 3 };
+   float src[4096];
+   uint8_t dst[4096];
+   uint64_t bits = 0;
+
+   /* A sample of all floats, and of those in [0, 1] more densely. */
+   while (bits <= 0xffffffff) {
+      unsigned n, done;
+
+      for (n = 0; n < ARRAY_SIZE(src) && bits <= 0xffffffff; n++) {
+         const uint32_t u = bits;
+
+         memcpy(&src[n], &u, 4);
+         bits += bits < 0x3f800000 ? 251 : 65537;
+      }
+
+      done = util_format_simd_float_to_unorm8(dst, 1, src, 1, identity, n);
+      for (unsigned i = 0; i < done; i++)
+         ASSERT_EQ(dst[i], float_to_ubyte(src[i])) << src[i];
+   }
+}
+
+TEST(format_simd, unorm8_to_float)
+{
+   foreach_swizzle([](unsigned dst_channels, unsigned src_channels,
+                      const uint8_t swizzle[4], unsigned count) {
+      uint8_t src[MAX_PIXELS * 4];
+      uint32_t dst[MAX_PIXELS * 4 + 4];
+      unsigned done;
+
+      for (unsigned i = 0; i < sizeof(src); i++)
+         src[i] = rand32();
+      memset(dst, GUARD, sizeof(dst));
+
+      done = util_format_simd_unorm8_to_float((float *) dst, dst_channels,
+                                              src, src_channels,
+                                              swizzle, count);
+      ASSERT_LE(done, count);
+
+      for (unsigned i = 0; i < ARRAY_SIZE(dst); i++) {
+         const unsigned p = i / dst_channels, swz = swizzle[i % dst_channels];
+         uint32_t expected = 0xa5a5a5a5;
+
+         if (p < done && swz < 4)
+            expected = float_bits(ubyte_to_float(src[p * src_channels + swz]));
+         else if (p < done)
+            expected = swz == 5 ? float_bits(1.0f) : 0;
+         ASSERT_EQ(dst[i], expected) << "float " << i << " of " << count
+                                     << " pixels, " << dst_channels << "x"
+                                     << src_channels << " channels";
+      }
+   });
+}
+
+TEST(format_simd, half_to_float)
+{
+   static uint16_t src[65536];
+   static uint32_t dst[65536];
+   unsigned done;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(src); i++)
+      src[i] = i;
+   memset(dst, GUARD, sizeof(dst));
+
+   /* All half floats, and a tail */
+   done = util_format_simd_half_to_float((float *) dst, src,
+                                         ARRAY_SIZE(src) - 3);
+   ASSERT_LE(done, ARRAY_SIZE(src) - 3);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(dst); i++) {
+      const uint32_t expected = i < done ? float_bits(_mesa_half_to_float(i)) :
+                                           0xa5a5a5a5;
+
+      ASSERT_EQ(dst[i], expected) << "half " << std::hex << i;
+   }
+}
+
+TEST(format_simd, float_to_half)
+{
+   float src[4096];
+   uint16_t dst[4096 + 8];
+   uint64_t bits = 0;
+   unsigned done;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(special_floats); i++) {
+      src[2 * i] = special_floats[i];
+      src[2 * i + 1] = -special_floats[i];
+   }
+   memset(dst, GUARD, sizeof(dst));
+
+   done = util_format_simd_float_to_half(dst, src,
+                                         2 * ARRAY_SIZE(special_floats));
+   ASSERT_LE(done, 2 * ARRAY_SIZE(special_floats));
+   for (unsigned i = 0; i < ARRAY_SIZE(dst); i++) {
+      const uint16_t expected = i < done ? _mesa_float_to_half(src[i]) :
+                                           0xa5a5;
+
+      ASSERT_EQ(dst[i], expected) << src[i];
+   }
+
+   /* A sample of all floats */
+   while (bits <= 0xffffffff) {
+      unsigned n;
+
+      for (n = 0; n < ARRAY_SIZE(src) && bits <= 0xffffffff; n++) {
+         const uint32_t u = bits;
+
+         memcpy(&src[n], &u, 4);
+         bits += 4099;
+      }
+
+      done = util_format_simd_float_to_half(dst, src, n);
+      for (unsigned i = 0; i < done; i++)
+         ASSERT_EQ(dst[i], _mesa_float_to_half(src[i])) << src[i];
+   }
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Measures the throughput of util_queue with empty jobs, added by as many
+ * threads as the queue has, from 1 to 64.
+ *
+ * Usage: u_queue_bench [number of jobs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+#include "util/u_thread.h"
+
+static struct util_queue queue;
+static struct util_queue_fence *fences;
+static unsigned num_jobs, num_producers;
+static unsigned num_executed;
+
+static void
+empty_job(void *data, int thread_index)
+{
+   p_atomic_inc(&num_executed);
+}
+
+static int
+producer_func(void *data)
+{
+   unsigned index = (uintptr_t) data;
+
+   for (unsigned i = index; i < num_jobs; i += num_producers)
+      util_queue_add_job(&queue, &num_executed, &fences[i], empty_job,
+                         NULL);
+
+   return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+   thrd_t producers[64];
+
+   num_jobs = argc > 1 ? atoi(argv[1]) : 1 << 20;
+   fences = calloc(num_jobs, sizeof(*fences));
+   if (!fences)
+      return 1;
+
+   for (unsigned num_threads = 1; num_threads <= 64; num_threads *= 2) {
+      int64_t start;
+
+      for (unsigned i = 0; i < num_jobs; i++)
+         util_queue_fence_init(&fences[i]);
+      num_executed = 0;
+      num_producers = num_threads;
+
+      util_queue_init(&queue, "bench", 64, num_threads,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+
+      start = os_time_get_nano();
+      for (unsigned i = 0; i < num_producers; i++) {
+         producers[i] = u_thread_create(producer_func,
+                                        (void *)(uintptr_t) i);
+      }
+      for (unsigned i = 0; i < num_producers; i++)
+         thrd_join(producers[i], NULL);
+      util_queue_finish(&queue);
+
+      double secs = (os_time_get_nano() - start) / 1e9;
+      printf("%2u threads: %8.2f Mjobs/s%s\n", num_threads,
+             num_jobs / secs / 1e6,
+             num_executed == num_jobs ? "" : " (jobs lost)");
+
+      util_queue_destroy(&queue);
+   }
+
+   free(fences);
+
+   return 0;
+}
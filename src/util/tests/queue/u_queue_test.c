@@ -0,0 +1,185 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define NUM_JOBS 10000
+
+struct test_job {
+   struct util_queue_fence fence;
+   unsigned id;
+};
+
+static unsigned order[NUM_JOBS];
+static unsigned num_executed;
+static struct util_queue_fence gate;
+static unsigned num_at_gate;
+
+static void
+record_job(void *data, int thread_index)
+{
+   struct test_job *job = data;
+
+   order[p_atomic_inc_return(&num_executed) - 1] = job->id;
+}
+
+/* Keeps the thread busy until the gate is signalled. */
+static void
+wait_gate(void *data, int thread_index)
+{
+   p_atomic_inc(&num_at_gate);
+   util_queue_fence_wait(&gate);
+}
+
+static void
+init_jobs(struct test_job *jobs, unsigned num_jobs)
+{
+   for (unsigned i = 0; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      jobs[i].id = i;
+   }
+   num_executed = 0;
+}
+
+static void
+test_fifo(void)
+{
+   struct util_queue queue;
+   struct test_job *jobs = calloc(NUM_JOBS, sizeof(*jobs));
+
+   /* Jobs of a queue with a single thread are executed in order. */
+   assert(util_queue_init(&queue, "test", 8, 1,
+                          UTIL_QUEUE_INIT_RESIZE_IF_FULL));
+   init_jobs(jobs, NUM_JOBS);
+
+   for (unsigned i = 0; i < NUM_JOBS; i++)
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, record_job, NULL);
+   util_queue_finish(&queue);
+
+   assert(num_executed == NUM_JOBS);
+   for (unsigned i = 0; i < NUM_JOBS; i++)
+      assert(order[i] == i);
+
+   util_queue_destroy(&queue);
+   free(jobs);
+}
+
+static void
+test_priorities(void)
+{
+   struct util_queue queue;
+   struct test_job jobs[7];
+   const enum util_queue_priority priorities[6] = {
+      UTIL_QUEUE_PRIORITY_LOW, UTIL_QUEUE_PRIORITY_NORMAL,
+      UTIL_QUEUE_PRIORITY_HIGH, UTIL_QUEUE_PRIORITY_LOW,
+      UTIL_QUEUE_PRIORITY_NORMAL, UTIL_QUEUE_PRIORITY_HIGH,
+   };
+   const unsigned expected[6] = { 3, 6, 2, 5, 1, 4 };
+
+   assert(util_queue_init(&queue, "test", 8, 1, 0));
+   init_jobs(jobs, 7);
+
+   /* Queue the jobs while the thread is busy. */
+   util_queue_fence_init(&gate);
+   util_queue_fence_reset(&gate);
+   util_queue_add_job(&queue, &jobs[0], &jobs[0].fence, wait_gate, NULL);
+
+   for (unsigned i = 0; i < 6; i++) {
+      util_queue_add_job_with_priority(&queue, &jobs[i + 1],
+                                       &jobs[i + 1].fence, record_job, NULL,
+                                       priorities[i]);
+   }
+
+   util_queue_fence_signal(&gate);
+   util_queue_finish(&queue);
+
+   assert(num_executed == 6);
+   for (unsigned i = 0; i < 6; i++)
+      assert(order[i] == expected[i]);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+test_finish_and_drop(void)
+{
+   struct util_queue queue;
+   struct test_job *jobs = calloc(NUM_JOBS, sizeof(*jobs));
+   struct test_job dropped;
+
+   assert(util_queue_init(&queue, "test", 64, 8, 0));
+   init_jobs(jobs, NUM_JOBS);
+
+   /* Block every thread, so that the job to drop is still queued. */
+   util_queue_fence_init(&gate);
+   util_queue_fence_reset(&gate);
+   num_at_gate = 0;
+   for (unsigned i = 0; i < 8; i++) {
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, wait_gate,
+                         NULL);
+   }
+   while (p_atomic_read(&num_at_gate) < 8)
+      thrd_yield();
+
+   util_queue_fence_init(&dropped.fence);
+   util_queue_add_job(&queue, &dropped, &dropped.fence, record_job, NULL);
+   util_queue_drop_job(&queue, &dropped.fence);
+   assert(util_queue_fence_is_signalled(&dropped.fence));
+
+   util_queue_fence_signal(&gate);
+
+   /* More jobs than max_jobs, from several threads, then fewer threads. */
+   for (unsigned i = 8; i < NUM_JOBS; i++) {
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, record_job,
+                         NULL);
+      if (i == NUM_JOBS / 2)
+         util_queue_adjust_num_threads(&queue, 3);
+   }
+   util_queue_finish(&queue);
+
+   assert(num_executed == NUM_JOBS - 8);
+   for (unsigned i = 0; i < NUM_JOBS; i++)
+      assert(util_queue_fence_is_signalled(&jobs[i].fence));
+
+   util_queue_destroy(&queue);
+   free(jobs);
+}
+
+int
+main(int argc, char **argv)
+{
+   (void) argc;
+   (void) argv;
+
+   test_fifo();
+   test_priorities();
+   test_finish_and_drop();
+
+   return 0;
+}
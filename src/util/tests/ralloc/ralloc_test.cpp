@@ -0,0 +1,422 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "util/ralloc.h"
+
+/**
+ * \file ralloc_test.cpp
+ *
+ * Test the contexts created by ralloc_arena_context().
+ */
+
+namespace {
+
+/* A block whose destructor counts how often it ran. */
+struct counted {
+   unsigned *calls;
+};
+
+void
+count_call(void *ptr)
+{
+   (*((struct counted *) ptr)->calls)++;
+}
+
+struct counted *
+counted_alloc(const void *ctx, unsigned *calls)
+{
+   struct counted *c = ralloc(ctx, struct counted);
+
+   c->calls = calls;
+   ralloc_set_destructor(c, count_call);
+   return c;
+}
+
+bool
+is_aligned(const void *ptr)
+{
+   return ((uintptr_t) ptr & 7) == 0;
+}
+
+} /* anonymous namespace */
+
+TEST(ralloc_arena, allocates_children)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(mem_ctx);
+
+   ASSERT_NE((void *) NULL, arena);
+   EXPECT_EQ(mem_ctx, ralloc_parent(arena));
+
+   /* Enough blocks for several chunks, and one larger than a chunk. */
+   void *prev = arena;
+   for (unsigned i = 0; i < 10000; i++) {
+      char *p = (char *) ralloc_size(i % 2 ? arena : prev, 1 + i % 100);
+
+      ASSERT_NE((void *) NULL, p);
+      EXPECT_TRUE(is_aligned(p));
+      EXPECT_EQ(i % 2 ? arena : prev, ralloc_parent(p));
+      memset(p, i, 1 + i % 100);
+      prev = p;
+   }
+
+   char *big = (char *) rzalloc_size(arena, 256 * 1024);
+   ASSERT_NE((void *) NULL, big);
+   EXPECT_EQ(0, big[256 * 1024 - 1]);
+
+   char *str = ralloc_asprintf(arena, "%s %u", "arena", 42u);
+   EXPECT_STREQ("arena 42", str);
+
+   ralloc_free(mem_ctx);
+}
+
+TEST(ralloc_arena, free_subtree)
+{
+   void *arena = ralloc_arena_context(NULL);
+   unsigned calls = 0;
+
+   void *a = ralloc_context(arena);
+   void *b = ralloc_context(arena);
+   void *a1 = ralloc_context(a);
+   void *a2 = ralloc_context(a);
+   counted_alloc(a1, &calls);
+   counted_alloc(a2, &calls);
+   counted_alloc(b, &calls);
+
+   /* Freeing a subtree runs its destructors and leaves the rest alone. */
+   ralloc_free(a);
+   EXPECT_EQ(2u, calls);
+   EXPECT_EQ(arena, ralloc_parent(b));
+
+   /* The siblings' links are still sound. */
+   void *c = ralloc_context(arena);
+   ralloc_steal(c, b);
+   EXPECT_EQ(c, ralloc_parent(b));
+
+   ralloc_free(arena);
+   EXPECT_EQ(3u, calls);
+}
+
+TEST(ralloc_arena, steal_within_arena)
+{
+   void *arena = ralloc_arena_context(NULL);
+   unsigned calls = 0;
+
+   void *a = ralloc_context(arena);
+   void *b = ralloc_context(arena);
+   struct counted *c = counted_alloc(a, &calls);
+
+   ralloc_steal(b, c);
+   EXPECT_EQ(b, ralloc_parent(c));
+
+   ralloc_free(a);
+   EXPECT_EQ(0u, calls);
+   ralloc_free(b);
+   EXPECT_EQ(1u, calls);
+
+   ralloc_free(arena);
+   EXPECT_EQ(1u, calls);
+}
+
+TEST(ralloc_arena, steal_out_of_arena)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   void *node = ralloc_context(arena);
+   char *str = ralloc_strdup(node, "kept");
+   bool stolen = true;
+
+   /* The block is left where it is rather than outlive its memory. */
+   EXPECT_DEBUG_DEATH(stolen = ralloc_steal(mem_ctx, str), "arena");
+#ifdef NDEBUG
+   EXPECT_FALSE(stolen);
+#endif
+   EXPECT_EQ(node, ralloc_parent(str));
+   EXPECT_STREQ("kept", str);
+
+   ralloc_free(arena);
+   ralloc_free(mem_ctx);
+}
+
+TEST(ralloc_arena, adopt_out_of_arena)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   void *node = ralloc_context(arena);
+   unsigned calls = 0;
+
+   /* Only the blocks stolen in can leave the arena. */
+   char *str = ralloc_strdup(node, "kept");
+   struct counted *out = counted_alloc(mem_ctx, &calls);
+   ralloc_steal(node, out);
+   ralloc_adopt(mem_ctx, node);
+   EXPECT_EQ(node, ralloc_parent(str));
+   EXPECT_EQ(mem_ctx, ralloc_parent(out));
+
+   ralloc_free(arena);
+   EXPECT_EQ(0u, calls);
+   ralloc_free(mem_ctx);
+   EXPECT_EQ(1u, calls);
+}
+
+TEST(ralloc_arena, steal_foreign_blocks)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   unsigned kept_calls = 0, child_calls = 0, out_calls = 0, freed_calls = 0;
+
+   /* Malloc'ed blocks, one with a malloc'ed child of its own. */
+   struct counted *kept = counted_alloc(mem_ctx, &kept_calls);
+   counted_alloc(kept, &child_calls);
+   struct counted *out = counted_alloc(mem_ctx, &out_calls);
+   struct counted *freed = counted_alloc(mem_ctx, &freed_calls);
+
+   void *node = ralloc_context(arena);
+   ralloc_steal(node, kept);
+   ralloc_steal(arena, out);
+   ralloc_steal(node, freed);
+   EXPECT_EQ(node, ralloc_parent(kept));
+   EXPECT_EQ(arena, ralloc_parent(out));
+
+   /* Blocks stolen in can leave again, or be freed on their own. */
+   ralloc_steal(mem_ctx, out);
+   EXPECT_EQ(mem_ctx, ralloc_parent(out));
+   ralloc_free(freed);
+   EXPECT_EQ(1u, freed_calls);
+
+   /* The arena still has to free the one left, even without any
+    * destructor of its own.
+    */
+   ralloc_free(arena);
+   EXPECT_EQ(1u, kept_calls);
+   EXPECT_EQ(1u, child_calls);
+   EXPECT_EQ(0u, out_calls);
+
+   ralloc_free(mem_ctx);
+   EXPECT_EQ(1u, out_calls);
+   EXPECT_EQ(1u, freed_calls);
+}
+
+TEST(ralloc_arena, foreign_count)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   unsigned calls = 0;
+
+   /* Each block stolen in is counted once, whichever way it goes, so the
+    * last one is still freed with the arena.
+    */
+   void *arena = ralloc_arena_context(NULL);
+   ralloc_steal(arena, counted_alloc(mem_ctx, &calls));
+   void *out = counted_alloc(mem_ctx, &calls);
+   ralloc_steal(arena, out);
+   ralloc_steal(mem_ctx, out);
+   ralloc_free(arena);
+   EXPECT_EQ(1u, calls);
+
+   arena = ralloc_arena_context(NULL);
+   ralloc_steal(arena, counted_alloc(mem_ctx, &calls));
+   void *freed = counted_alloc(mem_ctx, &calls);
+   ralloc_steal(arena, freed);
+   ralloc_free(freed);
+   EXPECT_EQ(2u, calls);
+   ralloc_free(arena);
+   EXPECT_EQ(3u, calls);
+
+   arena = ralloc_arena_context(NULL);
+   ralloc_steal(arena, counted_alloc(mem_ctx, &calls));
+   void *subtree = ralloc_context(arena);
+   ralloc_steal(subtree, counted_alloc(mem_ctx, &calls));
+   ralloc_free(subtree);
+   EXPECT_EQ(4u, calls);
+   ralloc_free(arena);
+   EXPECT_EQ(5u, calls);
+
+   ralloc_free(mem_ctx);
+   EXPECT_EQ(6u, calls);
+}
+
+TEST(ralloc_arena, adopt_between_contexts)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   unsigned calls = 0;
+
+   counted_alloc(mem_ctx, &calls);
+   counted_alloc(mem_ctx, &calls);
+
+   void *node = ralloc_context(arena);
+   ralloc_adopt(node, mem_ctx);
+   ralloc_free(mem_ctx);
+   EXPECT_EQ(0u, calls);
+
+   ralloc_free(arena);
+   EXPECT_EQ(2u, calls);
+}
+
+TEST(ralloc_arena, reralloc_growth)
+{
+   void *arena = ralloc_arena_context(NULL);
+
+   /* The last block of the chunk grows in place. */
+   unsigned *a = ralloc_array(arena, unsigned, 4);
+   for (unsigned i = 0; i < 4; i++)
+      a[i] = i;
+
+   unsigned *grown = reralloc(arena, a, unsigned, 64);
+   EXPECT_EQ(a, grown);
+   a = grown;
+   for (unsigned i = 4; i < 64; i++)
+      a[i] = i;
+
+   /* Shrinking keeps the block. */
+   EXPECT_EQ(a, reralloc(arena, a, unsigned, 8));
+
+   /* Once another block follows, growing moves it. */
+   void *child = ralloc_context(a);
+   unsigned *b = ralloc_array(arena, unsigned, 4);
+   grown = reralloc(arena, a, unsigned, 1024);
+   ASSERT_NE((void *) NULL, grown);
+   EXPECT_NE(a, grown);
+   EXPECT_TRUE(is_aligned(grown));
+   a = grown;
+   for (unsigned i = 0; i < 8; i++)
+      EXPECT_EQ(i, a[i]);
+
+   /* The tree follows the block. */
+   EXPECT_EQ(arena, ralloc_parent(a));
+   EXPECT_EQ(a, ralloc_parent(child));
+   EXPECT_EQ(arena, ralloc_parent(b));
+   ralloc_free(b);
+   EXPECT_EQ(a, ralloc_parent(child));
+
+   /* Beyond a chunk. */
+   a = rerzalloc(arena, a, unsigned, 1024, 128 * 1024);
+   ASSERT_NE((void *) NULL, a);
+   EXPECT_EQ(7u, a[7]);
+   EXPECT_EQ(0u, a[128 * 1024 - 1]);
+   EXPECT_EQ(a, ralloc_parent(child));
+
+   /* A string built piece by piece. */
+   char *str = ralloc_strdup(arena, "");
+   for (unsigned i = 0; i < 1000; i++)
+      ralloc_asprintf_append(&str, "%u,", i % 10);
+   EXPECT_EQ(2000u, strlen(str));
+   EXPECT_EQ(0, strncmp(str, "0,1,2,3,", 8));
+
+   ralloc_free(arena);
+}
+
+TEST(ralloc_arena, destructors)
+{
+   void *arena = ralloc_arena_context(NULL);
+   unsigned freed_calls = 0, cleared_calls = 0, kept_calls = 0;
+
+   struct counted *freed = counted_alloc(arena, &freed_calls);
+   struct counted *cleared = counted_alloc(arena, &cleared_calls);
+   counted_alloc(ralloc_context(arena), &kept_calls);
+   counted_alloc(arena, &kept_calls);
+
+   ralloc_free(freed);
+   EXPECT_EQ(1u, freed_calls);
+
+   /* Clearing or replacing a destructor keeps the count right. */
+   ralloc_set_destructor(cleared, count_call);
+   ralloc_set_destructor(cleared, NULL);
+
+   ralloc_free(arena);
+   EXPECT_EQ(1u, freed_calls);
+   EXPECT_EQ(0u, cleared_calls);
+   EXPECT_EQ(2u, kept_calls);
+}
+
+TEST(ralloc_arena, destructor_count)
+{
+   unsigned calls = 0;
+
+   /* Each block with a destructor is counted once, whichever way it goes,
+    * so the last one is still found when the arena is freed.
+    */
+   void *arena = ralloc_arena_context(NULL);
+   ralloc_free(counted_alloc(arena, &calls));
+   counted_alloc(arena, &calls);
+   ralloc_free(arena);
+   EXPECT_EQ(2u, calls);
+
+   arena = ralloc_arena_context(NULL);
+   void *subtree = ralloc_context(arena);
+   counted_alloc(subtree, &calls);
+   counted_alloc(arena, &calls);
+   ralloc_free(subtree);
+   EXPECT_EQ(3u, calls);
+   ralloc_free(arena);
+   EXPECT_EQ(4u, calls);
+}
+
+TEST(ralloc_arena, nested_arenas)
+{
+   void *outer = ralloc_arena_context(NULL);
+   void *node = ralloc_context(outer);
+   void *inner = ralloc_arena_context(node);
+   void *freed_inner = ralloc_arena_context(outer);
+   unsigned inner_calls = 0, freed_calls = 0;
+
+   EXPECT_EQ(node, ralloc_parent(inner));
+
+   for (unsigned i = 0; i < 1000; i++)
+      ralloc_size(i % 2 ? inner : freed_inner, 128);
+   counted_alloc(inner, &inner_calls);
+   counted_alloc(freed_inner, &freed_calls);
+
+   /* An inner arena can move around the outer one. */
+   ralloc_steal(outer, inner);
+   EXPECT_EQ(outer, ralloc_parent(inner));
+
+   ralloc_free(freed_inner);
+   EXPECT_EQ(1u, freed_calls);
+
+   /* Freeing the outer arena frees the inner one and its blocks. */
+   ralloc_free(outer);
+   EXPECT_EQ(1u, inner_calls);
+   EXPECT_EQ(1u, freed_calls);
+}
+
+TEST(ralloc_arena, linear_allocator)
+{
+   void *arena = ralloc_arena_context(NULL);
+   void *parent = linear_alloc_parent(arena, 16);
+
+   ASSERT_NE((void *) NULL, parent);
+   for (unsigned i = 0; i < 1000; i++) {
+      char *p = (char *) linear_alloc_child(parent, 100);
+      ASSERT_NE((void *) NULL, p);
+      memset(p, i, 100);
+   }
+   char *str = linear_asprintf(parent, "%d", 1234);
+   EXPECT_STREQ("1234", str);
+
+   ralloc_free(arena);
+}
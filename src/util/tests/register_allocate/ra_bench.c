@@ -0,0 +1,244 @@
+/*
+ * Copyright © 2019 FMSoft Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Replays interference graphs written by a driver run with RA_DUMP_DIR set,
+ * and prints the time spent building each graph and allocating it.  The
+ * allocation of the last iteration is checked against the interferences.
+ *
+ * Usage: ra_bench [-n iterations] file.graph...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/bitset.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/register_allocate.h"
+
+struct replay {
+   struct ra_regs *regs;
+   unsigned num_regs;
+
+   /* num_regs bitsets of conflicting registers, to check the allocation */
+   BITSET_WORD *conflicts;
+
+   unsigned num_nodes;
+   unsigned *node_class;
+   int *node_reg;
+   float *node_spill_cost;
+
+   unsigned *edges;
+   unsigned num_edges;
+};
+
+static bool
+read_replay(void *mem_ctx, FILE *fp, struct replay *r)
+{
+   unsigned version, round_robin, num_classes, a, b, c, i;
+   unsigned **q;
+   char word[16];
+
+   if (fscanf(fp, "ra_graph %u", &version) != 1 || version != 1)
+      return false;
+   if (fscanf(fp, " regs %u %u", &r->num_regs, &round_robin) != 2)
+      return false;
+
+   r->regs = ra_alloc_reg_set(mem_ctx, r->num_regs, false);
+   if (round_robin)
+      ra_set_allocate_round_robin(r->regs);
+
+   r->conflicts = rzalloc_array(mem_ctx, BITSET_WORD,
+                                r->num_regs * BITSET_WORDS(r->num_regs));
+   for (i = 0; i < r->num_regs; i++)
+      BITSET_SET(r->conflicts + i * BITSET_WORDS(r->num_regs), i);
+
+   while (fscanf(fp, " %15s", word) == 1 && !strcmp(word, "conflict")) {
+      if (fscanf(fp, "%u %u", &a, &b) != 2 ||
+          a >= r->num_regs || b >= r->num_regs)
+         return false;
+      ra_add_reg_conflict(r->regs, a, b);
+
+      BITSET_SET(r->conflicts + a * BITSET_WORDS(r->num_regs), b);
+      BITSET_SET(r->conflicts + b * BITSET_WORDS(r->num_regs), a);
+   }
+
+   if (strcmp(word, "classes") || fscanf(fp, "%u", &num_classes) != 1)
+      return false;
+
+   for (c = 0; c < num_classes; c++) {
+      if (ra_alloc_reg_class(r->regs) != c ||
+          fscanf(fp, " class %u", &a) != 1 || a != c)
+         return false;
+
+      /* the registers run up to the end of the line */
+      for (;;) {
+         int ch = fgetc(fp);
+         if (ch == '\n' || ch == EOF)
+            break;
+         if (ch == ' ')
+            continue;
+         ungetc(ch, fp);
+         if (fscanf(fp, "%u", &a) != 1)
+            return false;
+         ra_class_add_reg(r->regs, c, a);
+      }
+   }
+
+   q = ralloc_array(mem_ctx, unsigned *, num_classes);
+   for (b = 0; b < num_classes; b++) {
+      q[b] = ralloc_array(q, unsigned, num_classes);
+      if (fscanf(fp, " q %u", &a) != 1 || a != b)
+         return false;
+      for (c = 0; c < num_classes; c++) {
+         if (fscanf(fp, "%u", &q[b][c]) != 1)
+            return false;
+      }
+   }
+   ra_set_finalize(r->regs, q);
+
+   if (fscanf(fp, " nodes %u", &r->num_nodes) != 1)
+      return false;
+
+   r->node_class = ralloc_array(mem_ctx, unsigned, r->num_nodes);
+   r->node_reg = ralloc_array(mem_ctx, int, r->num_nodes);
+   r->node_spill_cost = ralloc_array(mem_ctx, float, r->num_nodes);
+   for (i = 0; i < r->num_nodes; i++) {
+      if (fscanf(fp, " node %u %u %d %f", &a, &r->node_class[i],
+                 &r->node_reg[i], &r->node_spill_cost[i]) != 4 || a != i)
+         return false;
+   }
+
+   r->edges = NULL;
+   r->num_edges = 0;
+   while (fscanf(fp, " edge %u %u", &a, &b) == 2) {
+      r->edges = reralloc(mem_ctx, r->edges, unsigned,
+                          2 * (r->num_edges + 1));
+      r->edges[2 * r->num_edges] = a;
+      r->edges[2 * r->num_edges + 1] = b;
+      r->num_edges++;
+   }
+
+   return true;
+}
+
+static struct ra_graph *
+build_graph(const struct replay *r)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(r->regs, r->num_nodes);
+   unsigned i;
+
+   for (i = 0; i < r->num_nodes; i++) {
+      ra_set_node_class(g, i, r->node_class[i]);
+      if (r->node_reg[i] >= 0)
+         ra_set_node_reg(g, i, r->node_reg[i]);
+      ra_set_node_spill_cost(g, i, r->node_spill_cost[i]);
+   }
+
+   for (i = 0; i < r->num_edges; i++)
+      ra_add_node_interference(g, r->edges[2 * i], r->edges[2 * i + 1]);
+
+   return g;
+}
+
+static unsigned
+check_allocation(const struct replay *r, struct ra_graph *g)
+{
+   unsigned i, errors = 0;
+
+   for (i = 0; i < r->num_edges; i++) {
+      unsigned a = ra_get_node_reg(g, r->edges[2 * i]);
+      unsigned b = ra_get_node_reg(g, r->edges[2 * i + 1]);
+
+      if (BITSET_TEST(r->conflicts + a * BITSET_WORDS(r->num_regs), b))
+         errors++;
+   }
+   return errors;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned iterations = 10;
+   int i = 1, failed = 0;
+
+   if (argc > 2 && !strcmp(argv[1], "-n")) {
+      iterations = MAX2(atoi(argv[2]), 1);
+      i = 3;
+   }
+
+   if (i >= argc) {
+      fprintf(stderr, "usage: %s [-n iterations] file.graph...\n", argv[0]);
+      return 1;
+   }
+
+   printf("%-40s %8s %9s %10s %10s %s\n",
+          "graph", "nodes", "edges", "build ms", "alloc ms", "result");
+
+   for (; i < argc; i++) {
+      void *mem_ctx = ralloc_context(NULL);
+      struct replay r;
+      int64_t build_time = 0, alloc_time = 0;
+      unsigned errors = 0;
+      bool success = false;
+      FILE *fp = fopen(argv[i], "r");
+
+      if (!fp || !read_replay(mem_ctx, fp, &r)) {
+         fprintf(stderr, "%s: cannot read graph\n", argv[i]);
+         if (fp)
+            fclose(fp);
+         ralloc_free(mem_ctx);
+         failed = 1;
+         continue;
+      }
+      fclose(fp);
+
+      for (unsigned it = 0; it < iterations; it++) {
+         int64_t start = os_time_get_nano();
+         struct ra_graph *g = build_graph(&r);
+         int64_t built = os_time_get_nano();
+
+         success = ra_allocate(g);
+         alloc_time += os_time_get_nano() - built;
+         build_time += built - start;
+
+         if (it == iterations - 1 && success)
+            errors = check_allocation(&r, g);
+
+         ralloc_free(g);
+      }
+
+      printf("%-40s %8u %9u %10.3f %10.3f %s\n", argv[i],
+             r.num_nodes, r.num_edges,
+             build_time / 1e6 / iterations, alloc_time / 1e6 / iterations,
+             errors ? "INVALID" : success ? "allocated" : "needs spilling");
+      if (errors)
+         failed = 1;
+
+      ralloc_free(mem_ctx);
+   }
+
+   return failed;
+}
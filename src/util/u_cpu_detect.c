@@ -488,7 +488,7 @@ util_cpu_detect_once(void)
 
       // check for avx512
       if (((regs2[2] >> 27) & 1) && // OSXSAVE
-          (xgetbv() & (0x7 << 5)) && // OPMASK: upper-256 enabled by OS
+          (xgetbv() & (0x7 << 5)) == (0x7 << 5) && // OPMASK, ZMM enabled by OS
           ((xgetbv() & 6) == 6)) { // XMM/YMM enabled by OS
          uint32_t regs3[4];
          cpuid_count(0x00000007, 0x00000000, regs3);
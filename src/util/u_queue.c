@@ -29,6 +29,7 @@
 #include "c11/threads.h"
 
 #include "util/os_time.h"
+#include "util/simple_mtx.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
 #include "u_process.h"
@@ -228,6 +229,135 @@ util_queue_fence_destroy(struct util_queue_fence *fence)
  * util_queue implementation
  */
 
+/* FIFO of jobs, growing as needed. */
+struct util_queue_ring {
+   struct util_queue_job *jobs;
+   unsigned size; /* 0 or a power of two */
+   unsigned read_idx;
+   unsigned num_jobs;
+};
+
+/* The barrier jobs of util_queue_finish go to this FIFO, after the
+ * priorities, and are never stolen.
+ */
+#define UTIL_QUEUE_RING_BARRIER UTIL_QUEUE_NUM_PRIORITIES
+
+/* The jobs queued for a thread. */
+struct util_queue_worker {
+   simple_mtx_t lock;
+   unsigned num_jobs; /* atomic, to skip empty workers when stealing */
+   struct util_queue_ring rings[UTIL_QUEUE_NUM_PRIORITIES + 1];
+};
+
+static void
+util_queue_ring_push(struct util_queue_ring *ring,
+                     const struct util_queue_job *job)
+{
+   if (ring->num_jobs == ring->size) {
+      unsigned new_size = MAX2(ring->size * 2, 8);
+      struct util_queue_job *jobs =
+         (struct util_queue_job*)malloc(new_size *
+                                        sizeof(struct util_queue_job));
+      assert(jobs);
+
+      /* Copy all queued jobs into the new ring. */
+      for (unsigned i = 0; i < ring->num_jobs; i++)
+         jobs[i] = ring->jobs[(ring->read_idx + i) & (ring->size - 1)];
+
+      free(ring->jobs);
+      ring->jobs = jobs;
+      ring->read_idx = 0;
+      ring->size = new_size;
+   }
+
+   ring->jobs[(ring->read_idx + ring->num_jobs) & (ring->size - 1)] = *job;
+   ring->num_jobs++;
+}
+
+static void
+util_queue_ring_pop(struct util_queue_ring *ring, struct util_queue_job *job)
+{
+   assert(ring->num_jobs);
+
+   *job = ring->jobs[ring->read_idx];
+   ring->read_idx = (ring->read_idx + 1) & (ring->size - 1);
+   ring->num_jobs--;
+}
+
+/* Take the next job of a worker, the barriers only if it is the worker of
+ * the calling thread. Returns the FIFO it comes from, or -1.
+ */
+static int
+util_queue_worker_pop(struct util_queue_worker *worker, bool own,
+                      struct util_queue_job *job)
+{
+   unsigned num_rings = UTIL_QUEUE_NUM_PRIORITIES + (own ? 1 : 0);
+   int ring_idx = -1;
+
+   if (!p_atomic_read(&worker->num_jobs))
+      return -1;
+
+   simple_mtx_lock(&worker->lock);
+   for (unsigned i = 0; i < num_rings; i++) {
+      if (worker->rings[i].num_jobs) {
+         util_queue_ring_pop(&worker->rings[i], job);
+         p_atomic_dec(&worker->num_jobs);
+         ring_idx = i;
+         break;
+      }
+   }
+   simple_mtx_unlock(&worker->lock);
+
+   return ring_idx;
+}
+
+/* Take the next job of the thread, or steal one from another thread. */
+static int
+util_queue_get_job(struct util_queue *queue, unsigned thread_index,
+                   struct util_queue_job *job)
+{
+   int ring_idx;
+
+   ring_idx = util_queue_worker_pop(&queue->workers[thread_index], true, job);
+   if (ring_idx >= 0)
+      return ring_idx;
+
+   for (unsigned i = 1; i < queue->max_threads; i++) {
+      unsigned victim = (thread_index + i) % queue->max_threads;
+
+      ring_idx = util_queue_worker_pop(&queue->workers[victim], false, job);
+      if (ring_idx >= 0)
+         return ring_idx;
+   }
+
+   return -1;
+}
+
+/* Signal the jobs left when all threads have been terminated. */
+static void
+util_queue_signal_remaining_jobs(struct util_queue *queue)
+{
+   for (unsigned i = 0; i < queue->max_threads; i++) {
+      struct util_queue_worker *worker = &queue->workers[i];
+
+      simple_mtx_lock(&worker->lock);
+      for (unsigned r = 0; r < ARRAY_SIZE(worker->rings); r++) {
+         struct util_queue_ring *ring = &worker->rings[r];
+         struct util_queue_job job;
+
+         while (ring->num_jobs) {
+            util_queue_ring_pop(ring, &job);
+            if (job.job)
+               util_queue_fence_signal(job.fence);
+         }
+      }
+      worker->num_jobs = 0;
+      simple_mtx_unlock(&worker->lock);
+   }
+
+   p_atomic_set(&queue->num_queued, 0);
+}
+
 struct thread_input {
    struct util_queue *queue;
    int thread_index;
@@ -238,6 +368,7 @@ util_queue_thread_func(void *input)
 {
    struct util_queue *queue = ((struct thread_input*)input)->queue;
    int thread_index = ((struct thread_input*)input)->thread_index;
+   struct util_queue_worker *worker = &queue->workers[thread_index];
 
    free(input);
 
@@ -263,27 +394,41 @@ util_queue_thread_func(void *input)
 
    while (1) {
       struct util_queue_job job;
-
-      mtx_lock(&queue->lock);
-      assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
-
-      /* wait if the queue is empty */
-      while (thread_index < queue->num_threads && queue->num_queued == 0)
-         cnd_wait(&queue->has_queued_cond, &queue->lock);
+      int ring_idx;
 
       /* only kill threads that are above "num_threads" */
-      if (thread_index >= queue->num_threads) {
-         mtx_unlock(&queue->lock);
+      if (thread_index >= p_atomic_read(&queue->num_threads))
          break;
+
+      ring_idx = util_queue_get_job(queue, thread_index, &job);
+      if (ring_idx < 0) {
+         /* wait if the queue is empty
+          *
+          * Adders increment num_queued before checking num_idle, and we
+          * increment num_idle before checking num_queued, so either they
+          * see us waiting and signal has_queued_cond under the lock, or we
+          * see their job.
+          */
+         mtx_lock(&queue->lock);
+         p_atomic_inc(&queue->num_idle);
+         while (thread_index < queue->num_threads &&
+                p_atomic_read(&queue->num_queued) == 0 &&
+                !p_atomic_read(&worker->rings[UTIL_QUEUE_RING_BARRIER].num_jobs))
+            cnd_wait(&queue->has_queued_cond, &queue->lock);
+         p_atomic_dec(&queue->num_idle);
+         mtx_unlock(&queue->lock);
+         continue;
       }
 
-      job = queue->jobs[queue->read_idx];
-      memset(&queue->jobs[queue->read_idx], 0, sizeof(struct util_queue_job));
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
+      if (ring_idx != UTIL_QUEUE_RING_BARRIER) {
+         p_atomic_dec(&queue->num_queued);
 
-      queue->num_queued--;
-      cnd_signal(&queue->has_space_cond);
-      mtx_unlock(&queue->lock);
+         if (p_atomic_read(&queue->num_full)) {
+            mtx_lock(&queue->lock);
+            cnd_broadcast(&queue->has_space_cond);
+            mtx_unlock(&queue->lock);
+         }
+      }
 
       if (job.job) {
          job.execute(job.job, thread_index);
@@ -295,17 +440,8 @@ util_queue_thread_func(void *input)
 
    /* signal remaining jobs if all threads are being terminated */
    mtx_lock(&queue->lock);
-   if (queue->num_threads == 0) {
-      for (unsigned i = queue->read_idx; i != queue->write_idx;
-           i = (i + 1) % queue->max_jobs) {
-         if (queue->jobs[i].job) {
-            util_queue_fence_signal(queue->jobs[i].fence);
-            queue->jobs[i].job = NULL;
-         }
-      }
-      queue->read_idx = queue->write_idx;
-      queue->num_queued = 0;
-   }
+   if (queue->num_threads == 0)
+      util_queue_signal_remaining_jobs(queue);
    mtx_unlock(&queue->lock);
    return 0;
 }
@@ -416,11 +552,14 @@ util_queue_init(struct util_queue *queue,
    queue->num_threads = num_threads;
    queue->max_jobs = max_jobs;
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
+   queue->workers = (struct util_queue_worker*)
+                    calloc(num_threads, sizeof(struct util_queue_worker));
+   if (!queue->workers)
       goto fail;
 
+   for (i = 0; i < num_threads; i++)
+      simple_mtx_init(&queue->workers[i].lock, mtx_plain);
+
    (void) mtx_init(&queue->lock, mtx_plain);
    (void) mtx_init(&queue->finish_lock, mtx_plain);
 
@@ -452,11 +591,13 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
+   if (queue->workers) {
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
       mtx_destroy(&queue->lock);
-      free(queue->jobs);
+      for (i = 0; i < num_threads; i++)
+         simple_mtx_destroy(&queue->workers[i].lock);
+      free(queue->workers);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -490,6 +631,33 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
    for (i = keep_num_threads; i < old_num_threads; i++)
       thrd_join(queue->threads[i], NULL);
 
+   /* Hand the jobs of the terminated threads over to the first thread.
+    * Jobs are no longer added to them, as num_threads is checked with
+    * their lock held.
+    */
+   if (keep_num_threads) {
+      struct util_queue_worker *dst = &queue->workers[0];
+
+      for (i = keep_num_threads; i < old_num_threads; i++) {
+         struct util_queue_worker *src = &queue->workers[i];
+
+         simple_mtx_lock(&src->lock);
+         simple_mtx_lock(&dst->lock);
+         for (unsigned r = 0; r < UTIL_QUEUE_NUM_PRIORITIES; r++) {
+            struct util_queue_job job;
+
+            while (src->rings[r].num_jobs) {
+               util_queue_ring_pop(&src->rings[r], &job);
+               util_queue_ring_push(&dst->rings[r], &job);
+               p_atomic_dec(&src->num_jobs);
+               p_atomic_inc(&dst->num_jobs);
+            }
+         }
+         simple_mtx_unlock(&dst->lock);
+         simple_mtx_unlock(&src->lock);
+      }
+   }
+
    if (!finish_locked)
       mtx_unlock(&queue->finish_lock);
 }
@@ -504,77 +672,113 @@ util_queue_destroy(struct util_queue *queue)
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->finish_lock);
    mtx_destroy(&queue->lock);
-   free(queue->jobs);
+   for (unsigned i = 0; i < queue->max_threads; i++) {
+      for (unsigned r = 0; r < ARRAY_SIZE(queue->workers[i].rings); r++)
+         free(queue->workers[i].rings[r].jobs);
+      simple_mtx_destroy(&queue->workers[i].lock);
+   }
+   free(queue->workers);
    free(queue->threads);
 }
 
-void
-util_queue_add_job(struct util_queue *queue,
-                   void *job,
-                   struct util_queue_fence *fence,
-                   util_queue_execute_func execute,
-                   util_queue_execute_func cleanup)
+/* Add a job to the FIFO ring_idx of a thread, to the next thread in turn
+ * if thread_index is -1.
+ */
+static void
+util_queue_add_job_to_ring(struct util_queue *queue,
+                           const struct util_queue_job *job,
+                           int thread_index, unsigned ring_idx)
 {
-   struct util_queue_job *ptr;
+   struct util_queue_worker *worker;
+   unsigned num_threads = p_atomic_read(&queue->num_threads);
 
-   mtx_lock(&queue->lock);
-   if (queue->num_threads == 0) {
-      mtx_unlock(&queue->lock);
+   if (num_threads == 0) {
       /* well no good option here, but any leaks will be
        * short-lived as things are shutting down..
        */
       return;
    }
 
-   util_queue_fence_reset(fence);
+   util_queue_fence_reset(job->fence);
 
-   assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+   if (thread_index < 0)
+      thread_index = p_atomic_inc_return(&queue->next_worker) % num_threads;
 
-   if (queue->num_queued == queue->max_jobs) {
-      if (queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) {
-         /* If the queue is full, make it larger to avoid waiting for a free
-          * slot.
-          */
-         unsigned new_max_jobs = queue->max_jobs + 8;
-         struct util_queue_job *jobs =
-            (struct util_queue_job*)calloc(new_max_jobs,
-                                           sizeof(struct util_queue_job));
-         assert(jobs);
-
-         /* Copy all queued jobs into the new list. */
-         unsigned num_jobs = 0;
-         unsigned i = queue->read_idx;
-
-         do {
-            jobs[num_jobs++] = queue->jobs[i];
-            i = (i + 1) % queue->max_jobs;
-         } while (i != queue->write_idx);
-
-         assert(num_jobs == queue->num_queued);
-
-         free(queue->jobs);
-         queue->jobs = jobs;
-         queue->read_idx = 0;
-         queue->write_idx = num_jobs;
-         queue->max_jobs = new_max_jobs;
-      } else {
-         /* Wait until there is a free slot. */
-         while (queue->num_queued == queue->max_jobs)
-            cnd_wait(&queue->has_space_cond, &queue->lock);
-      }
+   worker = &queue->workers[thread_index];
+   simple_mtx_lock(&worker->lock);
+
+   /* The thread may have been terminated meanwhile. */
+   if (thread_index >= p_atomic_read(&queue->num_threads) &&
+       thread_index != 0) {
+      simple_mtx_unlock(&worker->lock);
+      worker = &queue->workers[0];
+      simple_mtx_lock(&worker->lock);
    }
 
-   ptr = &queue->jobs[queue->write_idx];
-   assert(ptr->job == NULL);
-   ptr->job = job;
-   ptr->fence = fence;
-   ptr->execute = execute;
-   ptr->cleanup = cleanup;
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
+   util_queue_ring_push(&worker->rings[ring_idx], job);
+   p_atomic_inc(&worker->num_jobs);
+   simple_mtx_unlock(&worker->lock);
 
-   queue->num_queued++;
-   cnd_signal(&queue->has_queued_cond);
-   mtx_unlock(&queue->lock);
+   if (ring_idx == UTIL_QUEUE_RING_BARRIER) {
+      /* Wake up the owner of the barrier, whichever thread it is. */
+      mtx_lock(&queue->lock);
+      cnd_broadcast(&queue->has_queued_cond);
+      mtx_unlock(&queue->lock);
+      return;
+   }
+
+   p_atomic_inc(&queue->num_queued);
+
+   if (p_atomic_read(&queue->num_idle)) {
+      mtx_lock(&queue->lock);
+      cnd_signal(&queue->has_queued_cond);
+      mtx_unlock(&queue->lock);
+   }
+}
+
+void
+util_queue_add_job_with_priority(struct util_queue *queue,
+                                 void *job,
+                                 struct util_queue_fence *fence,
+                                 util_queue_execute_func execute,
+                                 util_queue_execute_func cleanup,
+                                 enum util_queue_priority priority)
+{
+   struct util_queue_job queue_job = {
+      .job = job,
+      .fence = fence,
+      .execute = execute,
+      .cleanup = cleanup,
+   };
+
+   assert(priority < UTIL_QUEUE_NUM_PRIORITIES);
+
+   /* Wait until there is a free slot, unless the queue may grow. The limit
+    * is not strict when several threads add jobs at the same time.
+    */
+   if (!(queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) &&
+       p_atomic_read(&queue->num_queued) >= queue->max_jobs) {
+      mtx_lock(&queue->lock);
+      p_atomic_inc(&queue->num_full);
+      while (queue->num_threads &&
+             p_atomic_read(&queue->num_queued) >= queue->max_jobs)
+         cnd_wait(&queue->has_space_cond, &queue->lock);
+      p_atomic_dec(&queue->num_full);
+      mtx_unlock(&queue->lock);
+   }
+
+   util_queue_add_job_to_ring(queue, &queue_job, -1, priority);
+}
+
+void
+util_queue_add_job(struct util_queue *queue,
+                   void *job,
+                   struct util_queue_fence *fence,
+                   util_queue_execute_func execute,
+                   util_queue_execute_func cleanup)
+{
+   util_queue_add_job_with_priority(queue, job, fence, execute, cleanup,
+                                    UTIL_QUEUE_PRIORITY_NORMAL);
 }
 
 /**
@@ -595,20 +799,30 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
-   mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].fence == fence) {
-         if (queue->jobs[i].cleanup)
-            queue->jobs[i].cleanup(queue->jobs[i].job, -1);
-
-         /* Just clear it. The threads will treat as a no-op job. */
-         memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
-         removed = true;
-         break;
+   for (unsigned i = 0; i < queue->max_threads && !removed; i++) {
+      struct util_queue_worker *worker = &queue->workers[i];
+
+      simple_mtx_lock(&worker->lock);
+      for (unsigned r = 0; r < UTIL_QUEUE_NUM_PRIORITIES && !removed; r++) {
+         struct util_queue_ring *ring = &worker->rings[r];
+
+         for (unsigned j = 0; j < ring->num_jobs; j++) {
+            struct util_queue_job *job =
+               &ring->jobs[(ring->read_idx + j) & (ring->size - 1)];
+
+            if (job->fence == fence) {
+               if (job->cleanup)
+                  job->cleanup(job->job, -1);
+
+               /* Just clear it. The threads will treat as a no-op job. */
+               memset(job, 0, sizeof(*job));
+               removed = true;
+               break;
+            }
+         }
       }
+      simple_mtx_unlock(&worker->lock);
    }
-   mtx_unlock(&queue->lock);
 
    if (removed)
       util_queue_fence_signal(fence);
@@ -647,9 +861,19 @@ util_queue_finish(struct util_queue *queue)
    fences = malloc(queue->num_threads * sizeof(*fences));
    util_barrier_init(&barrier, queue->num_threads);
 
+   /* Each thread gets its own barrier, which it only reaches once it has
+    * started all the jobs queued to it before, and which it can't steal
+    * from another thread.
+    */
    for (unsigned i = 0; i < queue->num_threads; ++i) {
+      struct util_queue_job job = {
+         .job = &barrier,
+         .fence = &fences[i],
+         .execute = util_queue_finish_execute,
+      };
+
       util_queue_fence_init(&fences[i]);
-      util_queue_add_job(queue, &barrier, &fences[i], util_queue_finish_execute, NULL);
+      util_queue_add_job_to_ring(queue, &job, i, UTIL_QUEUE_RING_BARRIER);
    }
 
    for (unsigned i = 0; i < queue->num_threads; ++i) {
@@ -28,6 +28,11 @@
  *
  * Jobs can be added from any thread. After that, the wait call can be used
  * to wait for completion of the job.
+ *
+ * Each thread of the queue has its own FIFOs of jobs, one per priority,
+ * filled in turn by util_queue_add_job, and steals jobs from the other
+ * threads when it has none left. Jobs of the same priority added to a
+ * queue with a single thread are thus executed in order.
  */
 
 #ifndef U_QUEUE_H
@@ -191,6 +196,16 @@ util_queue_fence_wait_timeout(struct util_queue_fence *fence,
 
 typedef void (*util_queue_execute_func)(void *job, int thread_index);
 
+/* Each thread starts the jobs of a higher priority before the jobs of a
+ * lower priority queued earlier.
+ */
+enum util_queue_priority {
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   UTIL_QUEUE_PRIORITY_LOW,
+   UTIL_QUEUE_NUM_PRIORITIES,
+};
+
 struct util_queue_job {
    void *job;
    struct util_queue_fence *fence;
@@ -198,21 +213,25 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+struct util_queue_worker;
+
 /* Put this into your context. */
 struct util_queue {
    char name[14]; /* 13 characters = the thread name without the index */
    mtx_t finish_lock; /* for util_queue_finish and protects threads/num_threads */
-   mtx_t lock;
+   mtx_t lock; /* only for sleeping on and signaling the conditions */
    cnd_t has_queued_cond;
    cnd_t has_space_cond;
    thrd_t *threads;
    unsigned flags;
-   int num_queued;
+   int num_queued; /* atomic, excluding the jobs of util_queue_finish */
+   unsigned num_idle; /* atomic, threads waiting for has_queued_cond */
+   unsigned num_full; /* atomic, threads waiting for has_space_cond */
    unsigned max_threads;
    unsigned num_threads; /* decreasing this number will terminate threads */
    int max_jobs;
-   int write_idx, read_idx; /* ring buffer pointers */
-   struct util_queue_job *jobs;
+   unsigned next_worker; /* atomic, thread to add the next job to */
+   struct util_queue_worker *workers; /* the job FIFOs of max_threads threads */
 
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
@@ -231,6 +250,12 @@ void util_queue_add_job(struct util_queue *queue,
                         struct util_queue_fence *fence,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup);
+void util_queue_add_job_with_priority(struct util_queue *queue,
+                                      void *job,
+                                      struct util_queue_fence *fence,
+                                      util_queue_execute_func execute,
+                                      util_queue_execute_func cleanup,
+                                      enum util_queue_priority priority);
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 